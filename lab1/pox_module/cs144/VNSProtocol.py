@@ -116,6 +116,48 @@ class VNSPacket(LTMessage):
         return 'PACKET: %uB on %s' % (len(self.ethernet_frame), self.intf_name)
 VNS_MESSAGES.append(VNSPacket)
 
+class VNSPacketBatch(LTMessage):
+    """Many frames in one message.  Each frame is tagged with the index of
+    its interface in VNSHardwareInfo.  An empty batch announces support."""
+    @staticmethod
+    def get_type():
+        return 4096
+
+    def __init__(self, frames):
+        LTMessage.__init__(self)
+        self.frames = frames # list of (intf_index, ethernet_frame)
+
+    def length(self):
+        return VNSPacketBatch.HEADER_SIZE + sum(VNSPacketBatch.FRAME_SIZE + len(f) for _, f in self.frames)
+
+    HEADER_FORMAT = '> HH'
+    HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+    FRAME_FORMAT = '> HBB'
+    FRAME_SIZE = struct.calcsize(FRAME_FORMAT)
+
+    def pack(self):
+        body = ''.join(struct.pack(VNSPacketBatch.FRAME_FORMAT, len(f), idx, 0) + str(f)
+                       for idx, f in self.frames)
+        return struct.pack(VNSPacketBatch.HEADER_FORMAT, len(self.frames), 0) + body
+
+    @staticmethod
+    def unpack(body):
+        count = struct.unpack(VNSPacketBatch.HEADER_FORMAT, body[:VNSPacketBatch.HEADER_SIZE])[0]
+        off = VNSPacketBatch.HEADER_SIZE
+        frames = []
+        for i in range(count):
+            flen, idx, _ = struct.unpack(VNSPacketBatch.FRAME_FORMAT, body[off:off + VNSPacketBatch.FRAME_SIZE])
+            off += VNSPacketBatch.FRAME_SIZE
+            if off + flen > len(body):
+                raise VNSProtocolException('truncated frame in packet batch')
+            frames.append((idx, body[off:off + flen]))
+            off += flen
+        return VNSPacketBatch(frames)
+
+    def __str__(self):
+        return 'PACKET_BATCH: %u frames' % len(self.frames)
+VNS_MESSAGES.append(VNSPacketBatch)
+
 class VNSProtocolException(Exception):
     def __init__(self, msg):
         self.msg = msg
@@ -124,11 +166,12 @@ class VNSProtocolException(Exception):
         return self.msg
 
 class VNSInterface:
-    def __init__(self, name, mac, ip, mask):
+    def __init__(self, name, mac, ip, mask, mtu=1500):
         self.name = str(name)
         self.mac = str(mac)
         self.ip = str(ip)
         self.mask = str(mask)
+        self.mtu = int(mtu)
 
         if len(mac) != 6:
             raise VNSProtocolException('MAC address must be 6B')
@@ -145,8 +188,9 @@ class VNSInterface:
     HWETHER = 32     # string
     HWETHIP = 64     # uint32
     HWMASK = 128     # uint32
+    HWMTU = 256      # uint32
 
-    FORMAT = '> I32s II28s I32s I4s28s II28s I4s28s'
+    FORMAT = '> I32s II28s I32s I4s28s II28s I4s28s II28s'
     SIZE = struct.calcsize(FORMAT)
 
     def pack(self):
@@ -156,11 +200,12 @@ class VNSInterface:
                            VNSInterface.HWETHER, self.mac,
                            VNSInterface.HWETHIP, self.ip, '',
                            VNSInterface.HWSUBNET, 0, '',
-                           VNSInterface.HWMASK, self.mask, '')
+                           VNSInterface.HWMASK, self.mask, '',
+                           VNSInterface.HWMTU, self.mtu, '')
 
     def __str__(self):
-        fmt = '%s: mac=%s ip=%s mask=%s'
-        return fmt % (self.name, self.mac, inet_ntoa(self.ip), inet_ntoa(self.mask))
+        fmt = '%s: mac=%s ip=%s mask=%s mtu=%u'
+        return fmt % (self.name, self.mac, inet_ntoa(self.ip), inet_ntoa(self.mask), self.mtu)
 
 class VNSBanner(LTMessage):
     @staticmethod
@@ -381,6 +426,63 @@ class VNSAuthStatus(LTMessage):
         return 'AUTH_STATUS: ' + ' auth_ok=%s msg=%s' % (str(self.auth_ok), self.msg)
 VNS_MESSAGES.append(VNSAuthStatus)
 
+SHM_PATHSIZE = 108
+
+class VNSShmOpen(LTMessage):
+    @staticmethod
+    def get_type():
+        return 1024
+
+    def __init__(self, nslots, slot_size, path):
+        LTMessage.__init__(self)
+        self.nslots = int(nslots)
+        self.slot_size = int(slot_size)
+        self.path = str(path)
+
+    def length(self):
+        return VNSShmOpen.SIZE
+
+    FORMAT = '> II %us' % SHM_PATHSIZE
+    SIZE = struct.calcsize(FORMAT)
+
+    def pack(self):
+        return struct.pack(VNSShmOpen.FORMAT, self.nslots, self.slot_size, self.path)
+
+    @staticmethod
+    def unpack(body):
+        t = struct.unpack(VNSShmOpen.FORMAT, body)
+        return VNSShmOpen(t[0], t[1], strip_null_chars(t[2]))
+
+    def __str__(self):
+        return 'SHM_OPEN: %s (%u slots x %uB)' % (self.path, self.nslots, self.slot_size)
+VNS_MESSAGES.append(VNSShmOpen)
+
+class VNSShmStatus(LTMessage):
+    @staticmethod
+    def get_type():
+        return 2048
+
+    def __init__(self, shm_ok, msg):
+        LTMessage.__init__(self)
+        self.shm_ok = bool(shm_ok)
+        self.msg = msg
+
+    def length(self):
+        return 1 + len(self.msg)
+
+    def pack(self):
+        return struct.pack('>B', self.shm_ok) + self.msg
+
+    @staticmethod
+    def unpack(body):
+        shm_ok = struct.unpack('>B', body[:1])[0]
+        msg = body[1:]
+        return VNSShmStatus(shm_ok, msg)
+
+    def __str__(self):
+        return 'SHM_STATUS: ' + ' shm_ok=%s msg=%s' % (str(self.shm_ok), self.msg)
+VNS_MESSAGES.append(VNSShmStatus)
+
 VNS_PROTOCOL = LTProtocol(VNS_MESSAGES, 'I', 'I')
 
 def create_vns_server(port, recv_callback, new_conn_callback, lost_conn_callback, verbose=True):
@@ -0,0 +1,153 @@
+"""Server side of the sr shared-memory transport (see router/sr_shm.h).
+
+The router creates the segment and offers it with VNS_SHM_OPEN. Ring 0
+carries frames to the router (we produce), ring 1 carries frames from the
+router (we consume). Each consumer parks on a FIFO doorbell next to the
+segment when its ring is empty.
+
+Both ends run on the same x86 box; the ordering of the slot write before the
+head update relies on its store ordering.
+"""
+
+import mmap
+import os
+import select
+import struct
+import threading
+
+SHM_MAGIC = 0x53525348
+SHM_VERSION = 1
+
+HDR_FORMAT = '<IIIIII'
+RING_HEAD = 0
+RING_TAIL = 64
+RING_WAITING = 128
+RING_CTL_SIZE = 192
+SLOT_FORMAT = '<II16s'
+SLOT_HDR_SIZE = struct.calcsize(SLOT_FORMAT)
+POLL_SECONDS = 0.01
+
+def _strip(s):
+  return s.split('\x00', 1)[0]
+
+class ShmRing(object):
+  ''' One SPSC ring inside the mapped segment '''
+  def __init__(self, mm, off, nslots, slot_size):
+    self.mm = mm
+    self.off = off
+    self.nslots = nslots
+    self.slot_size = slot_size
+
+  def _load(self, field):
+    return struct.unpack_from('<I', self.mm, self.off + field)[0]
+
+  def _store(self, field, value):
+    struct.pack_into('<I', self.mm, self.off + field, value & 0xffffffff)
+
+  def _slot(self, idx):
+    return self.off + RING_CTL_SIZE + (idx & (self.nslots - 1)) * self.slot_size
+
+  def put(self, intf, frame):
+    ''' Producer: returns False when the ring is full or the frame too big '''
+    head = self._load(RING_HEAD)
+    if (head - self._load(RING_TAIL)) & 0xffffffff >= self.nslots:
+      return False
+    if len(frame) > self.slot_size - SLOT_HDR_SIZE:
+      return False
+    slot = self._slot(head)
+    struct.pack_into(SLOT_FORMAT, self.mm, slot, len(frame), 0, intf)
+    self.mm[slot + SLOT_HDR_SIZE:slot + SLOT_HDR_SIZE + len(frame)] = frame
+    self._store(RING_HEAD, head + 1)
+    return True
+
+  def get(self):
+    ''' Consumer: returns (intf, frame) or None when empty '''
+    tail = self._load(RING_TAIL)
+    if self._load(RING_HEAD) == tail:
+      return None
+    slot = self._slot(tail)
+    length, _, intf = struct.unpack_from(SLOT_FORMAT, self.mm, slot)
+    length = min(length, self.slot_size - SLOT_HDR_SIZE)
+    frame = self.mm[slot + SLOT_HDR_SIZE:slot + SLOT_HDR_SIZE + length]
+    self._store(RING_TAIL, tail + 1)
+    return (_strip(intf), frame)
+
+  def empty(self):
+    return self._load(RING_HEAD) == self._load(RING_TAIL)
+
+  def waiting(self):
+    return self._load(RING_WAITING)
+
+  def set_waiting(self, value):
+    self._store(RING_WAITING, value)
+
+class SRShmChannel(object):
+  ''' Maps a segment offered by one sr client and pumps frames both ways.
+
+  on_frames is called on the pump thread with a list of (intf, frame) read
+  from the router; it has to hand them over to the thread that raises POX
+  events.
+  '''
+  def __init__(self, path, nslots, slot_size, on_frames):
+    self.path = path
+    self.on_frames = on_frames
+    fd = os.open(path, os.O_RDWR)
+    try:
+      size = os.fstat(fd).st_size
+      self.mm = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+    finally:
+      os.close(fd)
+    magic, version, n, sz, off0, off1 = struct.unpack_from(HDR_FORMAT, self.mm, 0)
+    if magic != SHM_MAGIC or version != SHM_VERSION or n != nslots or sz != slot_size:
+      self.mm.close()
+      raise ValueError('segment %s does not match the offer' % path)
+    self.to_router = ShmRing(self.mm, off0, n, sz)
+    self.from_router = ShmRing(self.mm, off1, n, sz)
+    self.bell_rx = os.open(path + '.rx', os.O_RDWR | os.O_NONBLOCK)
+    self.bell_tx = os.open(path + '.tx', os.O_RDWR | os.O_NONBLOCK)
+    self.running = True
+    self.thread = threading.Thread(target=self._pump)
+    self.thread.daemon = True
+    self.thread.start()
+
+  def send(self, intf, frame):
+    ''' Queue a frame for the router; False means use the socket instead '''
+    if not self.to_router.put(intf, frame):
+      return False
+    if self.to_router.waiting():
+      self.to_router.set_waiting(0)
+      try:
+        os.write(self.bell_rx, 'x')
+      except OSError:
+        pass
+    return True
+
+  def _pump(self):
+    while self.running:
+      frames = []
+      msg = self.from_router.get()
+      while msg is not None:
+        frames.append(msg)
+        if len(frames) == self.from_router.nslots:
+          break
+        msg = self.from_router.get()
+      if frames:
+        self.on_frames(frames)
+        continue
+      self.from_router.set_waiting(1)
+      if not self.from_router.empty():
+        self.from_router.set_waiting(0)
+        continue
+      r, _, _ = select.select([self.bell_tx], [], [], POLL_SECONDS)
+      if r:
+        try:
+          os.read(self.bell_tx, 64)
+        except OSError:
+          pass
+
+  def close(self):
+    self.running = False
+    self.thread.join(1.0)
+    os.close(self.bell_rx)
+    os.close(self.bell_tx)
+    self.mm.close()
@@ -23,9 +23,15 @@ from twisted.internet import reactor
 from VNSProtocol import VNS_DEFAULT_PORT, create_vns_server
 from VNSProtocol import VNSOpen, VNSClose, VNSPacket, VNSOpenTemplate, VNSBanner
 from VNSProtocol import VNSRtable, VNSAuthRequest, VNSAuthReply, VNSAuthStatus, VNSInterface, VNSHardwareInfo
+from VNSProtocol import VNSShmOpen, VNSShmStatus, VNSPacketBatch
+from shmring import SRShmChannel
 
 log = core.getLogger()
 
+BATCH_MAX_FRAMES = 64
+BATCH_MAX_BYTES = 8192   # sr rejects messages over 10000 bytes unless run with -M
+RATE_REPORT_SECONDS = 10
+
 def pack_mac(macaddr):
   octets = macaddr.split(':')
   ret = ''
@@ -49,6 +55,13 @@ class SRServerListener(EventMixin):
     self.listen_port = port
     self.intfname_to_port = {}
     self.port_to_intfname = {}
+    self.shm_channels = {}
+    self.intfname_to_index = {}
+    self.batch_clients = set()   # clients that announced VNSPACKET_BATCH
+    self.pending = {}            # client -> [(intf_index, frame)]
+    self.pending_lock = threading.Lock()
+    self.counts = {'single': [0, 0], 'batch': [0, 0]} # frames, messages
+    Timer(RATE_REPORT_SECONDS, self._report_rate, recurring=True)
     self.server = create_vns_server(port,
                                     self._handle_recv_msg,
                                     self._handle_new_client,
@@ -69,16 +82,69 @@ class SRServerListener(EventMixin):
         log.debug("Couldn't find interface for portnumber %s" % event.port)
         return
     print "srpacketin, packet=%s" % ethernet(event.pkt)
-    self.broadcast(VNSPacket(intfname, event.pkt))
+    for client in self.srclients:
+      # shared memory when negotiated, the socket otherwise or if the ring is full
+      channel = self.shm_channels.get(client)
+      if channel is not None and channel.send(intfname, event.pkt):
+        continue
+      if client in self.batch_clients and len(event.pkt) + VNSPacketBatch.FRAME_SIZE <= BATCH_MAX_BYTES:
+        self._queue_batch(client, intfname, event.pkt)
+      else:
+        self._count('single', 1)
+        client.send(VNSPacket(intfname, event.pkt))
+
+  def _queue_batch(self, client, intfname, pkt):
+    # frames arriving before the reactor gets to run go out in one message
+    pkt = str(pkt)
+    overflow = None
+    with self.pending_lock:
+      frames = self.pending.setdefault(client, [])
+      nbytes = sum(VNSPacketBatch.FRAME_SIZE + len(f) for _, f in frames)
+      if frames and nbytes + VNSPacketBatch.FRAME_SIZE + len(pkt) > BATCH_MAX_BYTES:
+        # no room left: the pending frames go now, this one starts a new batch
+        overflow = frames
+        self.pending[client] = frames = []
+      frames.append((self.intfname_to_index[intfname], pkt))
+      first = len(frames) == 1
+      full = len(frames) >= BATCH_MAX_FRAMES
+    if overflow:
+      reactor.callFromThread(self._send_batch, client, overflow)
+    if first or full:
+      reactor.callFromThread(self._flush_batch, client)
+
+  def _flush_batch(self, client):
+    with self.pending_lock:
+      frames = self.pending.pop(client, [])
+    self._send_batch(client, frames)
+
+  def _send_batch(self, client, frames):
+    if frames:
+      self._count('batch', len(frames))
+      client.send(VNSPacketBatch(frames))
+
+  def _count(self, mode, frames):
+    self.counts[mode][0] += frames
+    self.counts[mode][1] += 1
+
+  def _report_rate(self):
+    for mode in ('single', 'batch'):
+      frames, msgs = self.counts[mode]
+      if frames:
+        log.info('%s: %.0f pps to sr (%u frames in %u messages)' %
+                 (mode, float(frames) / RATE_REPORT_SECONDS, frames, msgs))
+      self.counts[mode] = [0, 0]
 
   def _handle_RouterInfo(self, event):
     log.debug("SRServerListener catch RouterInfo even, info=%s, rtable=%s", event.info, event.rtable)
     interfaces = []
+    self.intfname_to_index = {}
     for intf in event.info.keys():
       ip, mac, rate, port = event.info[intf]
       ip = pack_ip(ip)
       mac = pack_mac(mac)
       mask = pack_ip('255.255.255.255')
+      # batched frames refer to interfaces by their VNSHardwareInfo position
+      self.intfname_to_index[intf] = len(interfaces)
       interfaces.append(VNSInterface(intf, mac, ip, mask))
       # Mapping between of-port and intf-name
       self.intfname_to_port[intf] = port
@@ -106,6 +172,10 @@ class SRServerListener(EventMixin):
     elif vns_msg.get_type() == VNSOpenTemplate.get_type():
       # TODO: see if this is needed...
       self._handle_open_template_msg(conn, vns_msg)
+    elif vns_msg.get_type() == VNSPacketBatch.get_type():
+      self._handle_packet_batch_msg(conn, vns_msg)
+    elif vns_msg.get_type() == VNSShmOpen.get_type():
+      self._handle_shm_open_msg(conn, vns_msg)
     else:
       log.debug('unexpected VNS message received: %s' % vns_msg)
 
@@ -124,9 +194,39 @@ class SRServerListener(EventMixin):
 
   def _handle_client_disconnected(self, conn):
     log.info("disconnected")
+    self._close_shm(conn)
+    self.batch_clients.discard(conn)
     conn.transport.loseConnection()
     return
 
+  def _handle_shm_open_msg(self, conn, vns_msg):
+    # router offers a shared memory segment for packet traffic
+    try:
+      channel = SRShmChannel(vns_msg.path, vns_msg.nslots, vns_msg.slot_size,
+                             self._shm_packets_out)
+    except (OSError, IOError, ValueError) as e:
+      log.info('declined shared memory %s: %s' % (vns_msg.path, e))
+      conn.send(VNSShmStatus(False, str(e)))
+      return
+    self._close_shm(conn)
+    self.shm_channels[conn] = channel
+    log.info('shared memory transport at %s' % vns_msg.path)
+    conn.send(VNSShmStatus(True, vns_msg.path))
+
+  def _shm_packets_out(self, frames):
+    # runs on the channel's pump thread: raise the events from the reactor,
+    # as for frames that come over the socket
+    reactor.callFromThread(self._packets_out, frames)
+
+  def _packets_out(self, frames):
+    for out_intf, pkt in frames:
+      self._packet_out(out_intf, pkt)
+
+  def _close_shm(self, conn):
+    channel = self.shm_channels.pop(conn, None)
+    if channel is not None:
+      channel.close()
+
   def _handle_open_msg(self, conn, vns_msg):
     # client wants to connect to some topology.
     log.debug("open-msg: %s, %s" % (vns_msg.topo_id, vns_msg.vhost))
@@ -137,14 +237,26 @@ class SRServerListener(EventMixin):
     return
 
   def _handle_close_msg(self, conn):
+    self._close_shm(conn)
     conn.send("Goodbyte!") # spelling mistake intended...
     conn.transport.loseConnection()
     return
 
   def _handle_packet_msg(self, conn, vns_msg):
-    out_intf = vns_msg.intf_name
-    pkt = vns_msg.ethernet_frame
+    self._packet_out(vns_msg.intf_name, vns_msg.ethernet_frame)
+
+  def _handle_packet_batch_msg(self, conn, vns_msg):
+    # an empty batch is the client announcing that it accepts batches
+    self.batch_clients.add(conn)
+    for idx, pkt in vns_msg.frames:
+      try:
+        out_intf = self.interfaces[idx].name
+      except (IndexError, AttributeError):
+        log.debug('packet-out through unknown interface index %d' % idx)
+        continue
+      self._packet_out(out_intf, pkt)
 
+  def _packet_out(self, out_intf, pkt):
     try:
       out_port = self.intfname_to_port[out_intf]
     except KeyError:
@@ -0,0 +1,624 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_acl.c
+ *
+ * Description:
+ *
+ * Rule parser, tuple space compiler and lookup for -A, see sr_acl.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_acl.h"
+
+#define SR_ACL_LINELEN    512
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_addr(..)
+ * Scope:  Local
+ *
+ * Parse "any" or A.B.C.D[/LEN] into an address and mask, both in
+ * network byte order, the address with its host bits cleared.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_addr(const char* s, uint32_t* addr, uint32_t* mask)
+{
+    char buf[32];
+    char* slash;
+    char* end;
+    struct in_addr in;
+    unsigned long len = 32;
+
+    if(strcmp(s, "any") == 0)
+    {
+        *addr = 0;
+        *mask = 0;
+        return 0;
+    }
+    if(strlen(s) >= sizeof(buf))
+    { return -1; }
+    strcpy(buf, s);
+    if((slash = strchr(buf, '/')) != 0)
+    {
+        *slash++ = '\0';
+        errno = 0;
+        len = strtoul(slash, &end, 10);
+        if(errno || *slash == '\0' || *end != '\0' || len > 32)
+        { return -1; }
+    }
+    if(inet_aton(buf, &in) == 0)
+    { return -1; }
+
+    *mask = len ? htonl(0xffffffffUL << (32 - len)) : 0;
+    *addr = in.s_addr & *mask;
+    return 0;
+} /* -- sr_acl_addr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_port(..)
+ * Scope:  Local
+ *
+ * Parse "any", N or N-M.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_port(const char* s, uint16_t* lo, uint16_t* hi)
+{
+    unsigned long a, b;
+    char* end;
+
+    if(strcmp(s, "any") == 0)
+    {
+        *lo = 0;
+        *hi = 0xffff;
+        return 0;
+    }
+    errno = 0;
+    a = b = strtoul(s, &end, 10);
+    if(end != s && *end == '-')
+    {
+        s = end + 1;
+        b = strtoul(s, &end, 10);
+    }
+    if(errno || end == s || *end != '\0' || a > b || b > 0xffff)
+    { return -1; }
+
+    *lo = (uint16_t)a;
+    *hi = (uint16_t)b;
+    return 0;
+} /* -- sr_acl_port -- */
+
+static int sr_acl_proto(const char* s)
+{
+    unsigned long n;
+    char* end;
+
+    if(strcmp(s, "any") == 0)
+    { return -1; }
+    if(strcmp(s, "icmp") == 0)
+    { return ip_protocol_icmp; }
+    if(strcmp(s, "tcp") == 0)
+    { return ip_protocol_tcp; }
+    if(strcmp(s, "udp") == 0)
+    { return ip_protocol_udp; }
+
+    errno = 0;
+    n = strtoul(s, &end, 10);
+    if(errno || end == s || *end != '\0' || n > 255)
+    { return -2; }
+    return (int)n;
+} /* -- sr_acl_proto -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_parse(..)
+ * Scope:  Local
+ *
+ * Fill in 'r' from the fields of one line.  Returns -1 after printing
+ * what is wrong.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_parse(const char* path, unsigned int line, char** tok,
+                        int ntok, struct sr_acl_rule* r)
+{
+    const char* src;
+    const char* dst;
+
+    memset(r, 0, sizeof(*r));
+    r->line = line;
+    r->sport_hi = r->dport_hi = 0xffff;
+
+    if(ntok != 4 && ntok != 6)
+    {
+        fprintf(stderr, "Error: %s:%u: expected action proto src [sport] "
+                "dst [dport]\n", path, line);
+        return -1;
+    }
+    src = tok[2];
+    dst = tok[ntok == 6 ? 4 : 3];
+    if(strcmp(tok[0], "permit") == 0)
+    { r->action = SR_ACL_PERMIT; }
+    else if(strcmp(tok[0], "deny") == 0)
+    { r->action = SR_ACL_DENY; }
+    else
+    {
+        fprintf(stderr, "Error: %s:%u: unknown action %s\n", path, line,
+                tok[0]);
+        return -1;
+    }
+    if((r->proto = sr_acl_proto(tok[1])) == -2)
+    {
+        fprintf(stderr, "Error: %s:%u: unknown protocol %s\n", path, line,
+                tok[1]);
+        return -1;
+    }
+    if(sr_acl_addr(src, &r->src, &r->src_mask) != 0)
+    {
+        fprintf(stderr, "Error: %s:%u: bad address %s\n", path, line, src);
+        return -1;
+    }
+    if(sr_acl_addr(dst, &r->dst, &r->dst_mask) != 0)
+    {
+        fprintf(stderr, "Error: %s:%u: bad address %s\n", path, line, dst);
+        return -1;
+    }
+    if(ntok == 6)
+    {
+        if(sr_acl_port(tok[3], &r->sport_lo, &r->sport_hi) != 0 ||
+           sr_acl_port(tok[5], &r->dport_lo, &r->dport_hi) != 0)
+        {
+            fprintf(stderr, "Error: %s:%u: bad port %s or %s\n", path, line,
+                    tok[3], tok[5]);
+            return -1;
+        }
+        if(r->proto != ip_protocol_tcp && r->proto != ip_protocol_udp &&
+           (r->sport_lo != 0 || r->sport_hi != 0xffff ||
+            r->dport_lo != 0 || r->dport_hi != 0xffff))
+        {
+            fprintf(stderr, "Error: %s:%u: only tcp and udp rules can give"
+                    " a port\n", path, line);
+            return -1;
+        }
+    }
+    return 0;
+} /* -- sr_acl_parse -- */
+
+static __inline__ uint32_t sr_acl_hash(const struct sr_acl_key* k)
+{
+    uint64_t h;
+
+    h = ((uint64_t)k->src << 32 | k->dst) * 0x9e3779b97f4a7c15ULL;
+    h ^= (uint64_t)k->proto * 0xc2b2ae3d27d4eb4fULL;
+    h ^= h >> 31;
+    return (uint32_t)(h ^ (h >> 32));
+} /* -- sr_acl_hash -- */
+
+static __inline__ int sr_acl_key_eq(const struct sr_acl_key* a,
+                                    const struct sr_acl_key* b)
+{
+    return a->src == b->src && a->dst == b->dst && a->proto == b->proto;
+} /* -- sr_acl_key_eq -- */
+
+/* the slot of 'key' in 't', or the empty slot where it would go */
+static __inline__ struct sr_acl_entry* sr_acl_slot(
+    const struct sr_acl_tuple* t, const struct sr_acl_key* key)
+{
+    uint32_t i = sr_acl_hash(key) & (t->size - 1);
+
+    while(t->slots[i].rule && !sr_acl_key_eq(&t->slots[i].key, key))
+    { i = (i + 1) & (t->size - 1); }
+    return &t->slots[i];
+} /* -- sr_acl_slot -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_insert(..)
+ * Scope:  Local
+ *
+ * Add rule 'n' under 'key', after the rules already there, doubling
+ * the table past half full.  Returns 1 for a new entry, 0 if the key
+ * had one, -1 if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_insert(struct sr_acl* acl, struct sr_acl_tuple* t,
+                         const struct sr_acl_key* key, uint32_t n)
+{
+    struct sr_acl_tuple bigger;
+    struct sr_acl_entry* e;
+    unsigned int i;
+
+    if((t->used + 1) * 2 > t->size)
+    {
+        bigger = *t;
+        bigger.size = t->size ? t->size * 2 : 8;
+        bigger.slots = (struct sr_acl_entry*)
+            calloc(bigger.size, sizeof(struct sr_acl_entry));
+        if(bigger.slots == 0)
+        {
+            perror("calloc");
+            return -1;
+        }
+        for(i = 0; i < t->size; i++)
+        {
+            if(t->slots[i].rule)
+            { *sr_acl_slot(&bigger, &t->slots[i].key) = t->slots[i]; }
+        }
+        free(t->slots);
+        *t = bigger;
+    }
+
+    e = sr_acl_slot(t, key);
+    if(e->rule)
+    {
+        acl->rules[e->last - 1].next = n + 1;
+        e->last = n + 1;
+        return 0;
+    }
+    e->key = *key;
+    e->rule = e->last = n + 1;
+    t->used++;
+    return 1;
+} /* -- sr_acl_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_tuple(..)
+ * Scope:  Local
+ *
+ * The group whose masks are 'mask', added at the end if there is none.
+ * Rules are compiled in order, so the groups stay sorted by their first
+ * rule.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_acl_tuple* sr_acl_tuple(struct sr_acl* acl,
+                                         const struct sr_acl_key* mask,
+                                         uint32_t rule, unsigned int* cap)
+{
+    struct sr_acl_tuple* t;
+    unsigned int i;
+
+    for(i = 0; i < acl->ntuples; i++)
+    {
+        if(sr_acl_key_eq(&acl->tuples[i].mask, mask))
+        { return &acl->tuples[i]; }
+    }
+    if(acl->ntuples == *cap)
+    {
+        *cap = *cap ? *cap * 2 : 16;
+        t = (struct sr_acl_tuple*)
+            realloc(acl->tuples, *cap * sizeof(struct sr_acl_tuple));
+        if(t == 0)
+        {
+            perror("realloc");
+            return 0;
+        }
+        acl->tuples = t;
+    }
+    t = &acl->tuples[acl->ntuples++];
+    memset(t, 0, sizeof(*t));
+    t->mask = *mask;
+    t->first = rule;
+    return t;
+} /* -- sr_acl_tuple -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_compile(..)
+ * Scope:  Local
+ *
+ * Build the tuple space, one rule at a time in file order.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_compile(struct sr_acl* acl)
+{
+    unsigned int cap = 0;
+    struct sr_acl_rule* r;
+    struct sr_acl_key mask, key;
+    struct sr_acl_tuple* t;
+    uint32_t n;
+    int rc;
+
+    for(n = 0; n < acl->nrules; n++)
+    {
+        r = &acl->rules[n];
+        mask.src = r->src_mask;
+        mask.dst = r->dst_mask;
+        mask.proto = r->proto < 0 ? 0 : 0xffffffff;
+        key.src = r->src;
+        key.dst = r->dst;
+        key.proto = r->proto < 0 ? 0 : (uint32_t)r->proto;
+
+        if((t = sr_acl_tuple(acl, &mask, n, &cap)) == 0 ||
+           (rc = sr_acl_insert(acl, t, &key, n)) < 0)
+        { return -1; }
+        acl->nentries += rc;
+    }
+    return 0;
+} /* -- sr_acl_compile -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_acl_load(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_acl* sr_acl_load(const char* path)
+{
+    struct sr_acl* acl;
+    struct sr_acl_rule* rules;
+    unsigned int cap = 0, line = 0;
+    char buf[SR_ACL_LINELEN];
+    char* tok[8];
+    char* p;
+    int ntok;
+    FILE* fp;
+
+    if(strlen(path) >= SR_ACL_PATHLEN)
+    {
+        fprintf(stderr, "Error: -A path %s too long\n", path);
+        return 0;
+    }
+    if((fp = fopen(path, "r")) == 0)
+    {
+        perror(path);
+        return 0;
+    }
+    if((acl = (struct sr_acl*)calloc(1, sizeof(struct sr_acl))) == 0)
+    {
+        perror("calloc");
+        fclose(fp);
+        return 0;
+    }
+    strcpy(acl->path, path);
+
+    while(fgets(buf, sizeof(buf), fp) != 0)
+    {
+        line++;
+        if((p = strchr(buf, '#')) != 0)
+        { *p = '\0'; }
+
+        ntok = 0;
+        for(p = strtok(buf, " \t\r\n"); p && ntok < 8;
+            p = strtok(0, " \t\r\n"))
+        { tok[ntok++] = p; }
+        if(ntok == 0)
+        { continue; }
+
+        if(acl->nrules == cap)
+        {
+            if(cap == SR_ACL_MAX_RULES)
+            {
+                fprintf(stderr, "Error: %s: more than %d rules\n", path,
+                        SR_ACL_MAX_RULES);
+                goto fail;
+            }
+            cap = cap ? cap * 2 : 64;
+            if(cap > SR_ACL_MAX_RULES)
+            { cap = SR_ACL_MAX_RULES; }
+            rules = (struct sr_acl_rule*)
+                realloc(acl->rules, cap * sizeof(struct sr_acl_rule));
+            if(rules == 0)
+            {
+                perror("realloc");
+                goto fail;
+            }
+            acl->rules = rules;
+        }
+        if(sr_acl_parse(path, line, tok, ntok, &acl->rules[acl->nrules]) != 0)
+        { goto fail; }
+        acl->nrules++;
+    }
+    fclose(fp);
+    fp = 0;
+
+    if(sr_acl_compile(acl) != 0)
+    { goto fail; }
+    return acl;
+
+fail:
+    if(fp)
+    { fclose(fp); }
+    sr_acl_destroy(acl);
+    return 0;
+} /* -- sr_acl_load -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_acl_destroy(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_acl_destroy(struct sr_acl* acl)
+{
+    unsigned int i;
+
+    if(!acl)
+    { return; }
+    for(i = 0; i < acl->ntuples; i++)
+    { free(acl->tuples[i].slots); }
+    free(acl->tuples);
+    free(acl->rules);
+    free(acl);
+} /* -- sr_acl_destroy -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_acl_lookup(..)
+ * Scope: Global
+ *
+ * One probe per group until a match rules out the groups that are left.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_acl_rule* sr_acl_lookup(struct sr_acl* acl, const uint8_t* ip,
+                                  unsigned int len)
+{
+    const sr_ip_hdr_t* iph = (const sr_ip_hdr_t*)ip;
+    const struct sr_acl_tuple* t;
+    const struct sr_acl_tuple* end = acl->tuples + acl->ntuples;
+    const struct sr_acl_entry* e;
+    struct sr_acl_rule* r;
+    struct sr_acl_key k;
+    uint32_t best = 0xffffffff;
+    uint16_t sport = 0, dport = 0;
+    unsigned int hl, i;
+
+    if(len < sizeof(sr_ip_hdr_t))
+    { return 0; }
+
+    hl = iph->ip_hl * 4;
+    if((iph->ip_p == ip_protocol_tcp || iph->ip_p == ip_protocol_udp) &&
+       (ntohs(iph->ip_off) & IP_OFFMASK) == 0 && len >= hl + 4)
+    {
+        sport = ntohs(*(const uint16_t*)(ip + hl));
+        dport = ntohs(*(const uint16_t*)(ip + hl + 2));
+    }
+
+    acl->lookups++;
+    for(t = acl->tuples; t < end && t->first < best; t++)
+    {
+        acl->probes++;
+        k.src = iph->ip_src & t->mask.src;
+        k.dst = iph->ip_dst & t->mask.dst;
+        k.proto = iph->ip_p & t->mask.proto;
+        e = sr_acl_slot(t, &k);
+
+        /* in file order, so the first whose ports match is the one */
+        for(i = e->rule; i && i - 1 < best; i = r->next)
+        {
+            r = &acl->rules[i - 1];
+            if(sport >= r->sport_lo && sport <= r->sport_hi &&
+               dport >= r->dport_lo && dport <= r->dport_hi)
+            {
+                best = i - 1;
+                break;
+            }
+        }
+    }
+
+    if(best == 0xffffffff)
+    {
+        acl->unmatched++;
+        return 0;
+    }
+    r = &acl->rules[best];
+    r->hits++;
+    r->bytes += len;
+    return r;
+} /* -- sr_acl_lookup -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_acl_match(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_acl_rule* sr_acl_match(struct sr_acl* acl, const uint8_t* buf,
+                                 unsigned int len)
+{
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    { return 0; }
+    return sr_acl_lookup(acl, buf + sizeof(sr_ethernet_hdr_t),
+                         len - sizeof(sr_ethernet_hdr_t));
+} /* -- sr_acl_match -- */
+
+void sr_acl_hit(struct sr_acl_rule* r, unsigned int len)
+{
+    r->hits++;
+    r->bytes += len - sizeof(sr_ethernet_hdr_t);
+} /* -- sr_acl_hit -- */
+
+static void sr_acl_print_addr(char* buf, uint32_t addr, uint32_t mask)
+{
+    struct in_addr in;
+    unsigned int len = 0;
+    uint32_t m = ntohl(mask);
+
+    if(!mask)
+    {
+        strcpy(buf, "any");
+        return;
+    }
+    while(m & 0x80000000UL)
+    {
+        len++;
+        m <<= 1;
+    }
+    in.s_addr = addr;
+    if(len == 32)
+    { sprintf(buf, "%s", inet_ntoa(in)); }
+    else
+    { sprintf(buf, "%s/%u", inet_ntoa(in), len); }
+} /* -- sr_acl_print_addr -- */
+
+static void sr_acl_print_port(char* buf, uint16_t lo, uint16_t hi)
+{
+    if(lo == 0 && hi == 0xffff)
+    { strcpy(buf, "any"); }
+    else if(lo == hi)
+    { sprintf(buf, "%u", (unsigned int)lo); }
+    else
+    { sprintf(buf, "%u-%u", (unsigned int)lo, (unsigned int)hi); }
+} /* -- sr_acl_print_port -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_acl_dump(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_acl_dump(struct sr_acl* acl, FILE* fp)
+{
+    char src[24], dst[24], sport[16], dport[16], proto[8];
+    struct sr_acl_rule* r;
+    unsigned int i, idle = 0;
+
+    if(!acl)
+    { return; }
+
+    fprintf(fp, "acl %s: %u rules in %u tuples (%u entries)\n", acl->path,
+            acl->nrules, acl->ntuples, acl->nentries);
+    fprintf(fp, "%-6s %-6s %-5s %-18s %-11s %-18s %-11s %12s %14s\n",
+            "line", "action", "proto", "source", "sport", "destination",
+            "dport", "packets", "bytes");
+    for(i = 0; i < acl->nrules; i++)
+    {
+        r = &acl->rules[i];
+        if(!r->hits)
+        {
+            idle++;
+            continue;
+        }
+        sr_acl_print_addr(src, r->src, r->src_mask);
+        sr_acl_print_addr(dst, r->dst, r->dst_mask);
+        sr_acl_print_port(sport, r->sport_lo, r->sport_hi);
+        sr_acl_print_port(dport, r->dport_lo, r->dport_hi);
+        if(r->proto < 0)
+        { strcpy(proto, "any"); }
+        else if(r->proto == ip_protocol_icmp)
+        { strcpy(proto, "icmp"); }
+        else if(r->proto == ip_protocol_tcp)
+        { strcpy(proto, "tcp"); }
+        else if(r->proto == ip_protocol_udp)
+        { strcpy(proto, "udp"); }
+        else
+        { sprintf(proto, "%d", r->proto); }
+        fprintf(fp, "%-6u %-6s %-5s %-18s %-11s %-18s %-11s %12llu %14llu\n",
+                r->line, r->action == SR_ACL_DENY ? "deny" : "permit", proto,
+                src, sport, dst, dport, (unsigned long long)r->hits,
+                (unsigned long long)r->bytes);
+    }
+    fprintf(fp, "%llu lookups, %.2f tuples probed per lookup, %llu matched"
+            " no rule, %u rules never matched\n",
+            (unsigned long long)acl->lookups,
+            acl->lookups ? (double)acl->probes / acl->lookups : 0.0,
+            (unsigned long long)acl->unmatched, idle);
+} /* -- sr_acl_dump -- */
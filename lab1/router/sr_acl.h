@@ -0,0 +1,138 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_acl.h
+ *
+ * Description:
+ *
+ * Access control list (-A file).  Every IPv4 datagram with a good header
+ * checksum, forwarded or addressed to the router, is checked against the
+ * rules before anything else is done with it; a denied one is dropped as
+ * "acl_deny".  One rule per line, first match wins, and a datagram no rule
+ * matches is permitted:
+ *
+ *   # action  proto  source        sport  destination    dport
+ *   deny      tcp    10.0.1.0/24   any    192.168.2.2    80
+ *   deny      udp    any           any    172.64.3.0/24  5000-5999
+ *   permit    icmp   10.0.1.100    any
+ *   deny      any    10.0.1.0/24   any
+ *
+ * proto is any, icmp, tcp, udp or a protocol number; an address is
+ * A.B.C.D[/LEN] or any; a port is N, N-M or any, and only tcp and udp
+ * rules may give one.  The port columns can be left out together.
+ * Fragments after the first are checked with both ports 0.
+ *
+ * Scanning thousands of rules per datagram would cost more than forwarding
+ * it, so the list is compiled into a tuple space (Srinivasan, Suri and
+ * Varghese, 1999).  Rules are grouped by the shape of their match: the
+ * prefix length of each address and whether the protocol is given.  Each
+ * group is a hash table of the masked fields, so a lookup is one probe per
+ * group, whatever the number of rules.  Groups are searched in the order
+ * of the first rule they hold, and the search stops at a group that cannot
+ * hold a rule earlier than the one already found.  Port ranges are not
+ * prefixes and are left out of the shape: rules with the same addresses
+ * and protocol share an entry, in file order, and their ports are
+ * compared one by one.  Real lists have few of those per entry; splitting
+ * ranges into prefixes instead made hundreds of groups out of random ones.
+ *
+ * Each rule counts the datagrams and bytes it matched.  Lookups and counts
+ * belong to the thread that reads from VNS, and so do the management
+ * socket's "show acl" and "acl reload"; a reload that fails keeps the old
+ * rules, one that succeeds starts the counts again.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ACL_H
+#define SR_ACL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_ACL_PATHLEN   256
+#define SR_ACL_MAX_RULES 1000000
+
+#define SR_ACL_PERMIT    0
+#define SR_ACL_DENY      1
+
+struct sr_acl_rule
+{
+    int action;                    /* SR_ACL_PERMIT, SR_ACL_DENY */
+    int proto;                     /* -1 for any */
+    uint32_t src;                  /* network byte order */
+    uint32_t src_mask;
+    uint32_t dst;
+    uint32_t dst_mask;
+    uint16_t sport_lo;             /* host byte order */
+    uint16_t sport_hi;
+    uint16_t dport_lo;
+    uint16_t dport_hi;
+    unsigned int line;             /* in the file */
+    uint32_t next;                 /* next rule of its entry, index + 1 */
+
+    uint64_t hits;
+    uint64_t bytes;
+};
+
+/* the fields a rule can match, masked for one group */
+struct sr_acl_key
+{
+    uint32_t src;
+    uint32_t dst;
+    uint32_t proto;
+};
+
+struct sr_acl_entry
+{
+    struct sr_acl_key key;
+    uint32_t rule;                 /* first rule, index + 1, 0 if empty */
+    uint32_t last;
+};
+
+/* one group of the tuple space */
+struct sr_acl_tuple
+{
+    struct sr_acl_key mask;
+    uint32_t first;                /* earliest rule in the group */
+    unsigned int size;             /* slots, a power of two */
+    unsigned int used;
+    struct sr_acl_entry* slots;
+};
+
+struct sr_acl
+{
+    char path[SR_ACL_PATHLEN];
+    struct sr_acl_rule* rules;
+    unsigned int nrules;
+    struct sr_acl_tuple* tuples;   /* by first rule */
+    unsigned int ntuples;
+    unsigned int nentries;         /* in all groups */
+
+    uint64_t lookups;
+    uint64_t probes;               /* groups looked at */
+    uint64_t unmatched;            /* permitted by default */
+};
+
+/* read and compile the rules in 'path', 0 after printing what is wrong */
+struct sr_acl* sr_acl_load(const char* path);
+void sr_acl_destroy(struct sr_acl* acl);
+
+/* the rule 'ip' (an IPv4 header and what follows, 'len' bytes) matches,
+ * or 0; counts the match */
+struct sr_acl_rule* sr_acl_lookup(struct sr_acl* acl, const uint8_t* ip,
+                                  unsigned int len);
+
+/* sr_acl_lookup() for the datagram in the ethernet frame 'buf' */
+struct sr_acl_rule* sr_acl_match(struct sr_acl* acl, const uint8_t* buf,
+                                 unsigned int len);
+/* count a frame against the rule an earlier one of its flow matched */
+void sr_acl_hit(struct sr_acl_rule* r, unsigned int len);
+
+/* the rules that matched something, and the size of the tuple space */
+void sr_acl_dump(struct sr_acl* acl, FILE* fp);
+
+#endif /* -- SR_ACL_H -- */
@@ -0,0 +1,247 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_acl_bench.c
+ *
+ * Description:
+ *
+ * Per-packet cost of sr_acl_lookup() against a first-match scan of the same
+ * rules, for random access lists of a few sizes.  Rules are drawn the way
+ * real lists look: addresses from a few hundred networks, mostly /24 and
+ * /32, a source of any now and then, mostly tcp and udp, destination ports
+ * either a service, a range or any.  Half the packets are drawn to fall
+ * inside some rule; the rest are random, match nothing and make the scan
+ * go through the whole list, as traffic the list permits by default does.
+ * Every lookup is checked against the scan.
+ *
+ *   usage: sr_acl_bench [rules ...]      (default 1000 10000)
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_acl.h"
+
+#define BENCH_NPKTS 4096
+#define BENCH_PKTLEN 64
+#define BENCH_NETS 256
+
+static uint8_t pkts[BENCH_NPKTS][BENCH_PKTLEN];
+static uint32_t nets[BENCH_NETS];
+
+static const uint16_t services[] = { 22, 25, 53, 80, 123, 443, 3306, 8080 };
+
+static uint32_t bench_rand(void)
+{
+    return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+static unsigned int bench_prefix(int src)
+{
+    static const unsigned int lens[] = { 16, 24, 24, 24, 32, 32, 32, 32 };
+
+    if(src && bench_rand() % 8 == 0)
+    { return 0; }
+    return lens[bench_rand() % (sizeof(lens) / sizeof(lens[0]))];
+}
+
+static void bench_addr(char* buf, unsigned int len)
+{
+    struct in_addr in;
+
+    if(len == 0)
+    {
+        strcpy(buf, "any");
+        return;
+    }
+    in.s_addr = htonl(nets[bench_rand() % BENCH_NETS] | (bench_rand() & 0xff));
+    sprintf(buf, "%s/%u", inet_ntoa(in), len);
+}
+
+static void bench_port(char* buf)
+{
+    unsigned int r = bench_rand() % 10, lo;
+
+    if(r < 4)
+    { sprintf(buf, "%u", services[bench_rand() % 8]); }
+    else if(r < 6)
+    { strcpy(buf, "any"); }
+    else if(r < 8)
+    { strcpy(buf, "1024-65535"); }
+    else
+    {
+        lo = bench_rand() % 60000;
+        sprintf(buf, "%u-%u", lo, lo + bench_rand() % 1000);
+    }
+}
+
+/* write 'n' random rules to a temporary file and load them */
+static struct sr_acl* bench_rules(unsigned int n)
+{
+    char path[] = "/tmp/sr_acl_benchXXXXXX";
+    char src[32], dst[32], dport[16];
+    struct sr_acl* acl;
+    unsigned int i, r;
+    FILE* fp;
+    int fd;
+
+    if((fd = mkstemp(path)) < 0 || (fp = fdopen(fd, "w")) == 0)
+    {
+        perror(path);
+        return 0;
+    }
+    for(i = 0; i < n; i++)
+    {
+        bench_addr(src, bench_prefix(1));
+        bench_addr(dst, bench_prefix(0));
+        r = bench_rand() % 10;
+        if(r < 8)
+        {
+            bench_port(dport);
+            fprintf(fp, "%s %s %s any %s %s\n",
+                    bench_rand() % 2 ? "deny" : "permit",
+                    r < 5 ? "tcp" : "udp", src, dst, dport);
+        }
+        else
+        {
+            fprintf(fp, "%s %s %s %s\n", bench_rand() % 2 ? "deny" : "permit",
+                    r == 8 ? "icmp" : "any", src, dst);
+        }
+    }
+    fclose(fp);
+    acl = sr_acl_load(path);
+    unlink(path);
+    return acl;
+}
+
+/* a datagram inside a random rule, or anywhere */
+static void bench_pkt(uint8_t* p, const struct sr_acl* acl)
+{
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)p;
+    const struct sr_acl_rule* r;
+    uint16_t sport, dport;
+
+    memset(p, 0, BENCH_PKTLEN);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(BENCH_PKTLEN);
+    ip->ip_ttl = 64;
+    ip->ip_src = htonl(nets[bench_rand() % BENCH_NETS] | (bench_rand() & 0xff));
+    ip->ip_dst = htonl(nets[bench_rand() % BENCH_NETS] | (bench_rand() & 0xff));
+    ip->ip_p = bench_rand() % 2 ? ip_protocol_tcp : ip_protocol_udp;
+    sport = 1024 + bench_rand() % 64512;
+    dport = services[bench_rand() % 8];
+
+    if(bench_rand() % 2)
+    {
+        r = &acl->rules[bench_rand() % acl->nrules];
+        ip->ip_src = r->src | (bench_rand() & ~r->src_mask);
+        ip->ip_dst = r->dst | (bench_rand() & ~r->dst_mask);
+        if(r->proto >= 0)
+        { ip->ip_p = r->proto; }
+        sport = r->sport_lo + bench_rand() % (r->sport_hi - r->sport_lo + 1);
+        dport = r->dport_lo + bench_rand() % (r->dport_hi - r->dport_lo + 1);
+    }
+    p[20] = sport >> 8; p[21] = sport & 0xff;
+    p[22] = dport >> 8; p[23] = dport & 0xff;
+}
+
+/* first match by scanning, the reference for sr_acl_lookup() */
+static const struct sr_acl_rule* bench_scan(const struct sr_acl* acl,
+                                            const uint8_t* p)
+{
+    const sr_ip_hdr_t* ip = (const sr_ip_hdr_t*)p;
+    const struct sr_acl_rule* r;
+    uint16_t sport = 0, dport = 0;
+    unsigned int i;
+
+    if(ip->ip_p == ip_protocol_tcp || ip->ip_p == ip_protocol_udp)
+    {
+        sport = p[20] << 8 | p[21];
+        dport = p[22] << 8 | p[23];
+    }
+    for(i = 0; i < acl->nrules; i++)
+    {
+        r = &acl->rules[i];
+        if((ip->ip_src & r->src_mask) == r->src &&
+           (ip->ip_dst & r->dst_mask) == r->dst &&
+           (r->proto < 0 || r->proto == ip->ip_p) &&
+           sport >= r->sport_lo && sport <= r->sport_hi &&
+           dport >= r->dport_lo && dport <= r->dport_hi)
+        { return r; }
+    }
+    return 0;
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench(unsigned int n)
+{
+    struct sr_acl* acl;
+    const struct sr_acl_rule* r;
+    unsigned long i, iters, matched = 0, wrong = 0;
+    double t0, t1, tss, scan;
+
+    if((acl = bench_rules(n)) == 0)
+    { return 1; }
+    for(i = 0; i < BENCH_NPKTS; i++)
+    { bench_pkt(pkts[i], acl); }
+
+    for(i = 0; i < BENCH_NPKTS; i++)
+    {
+        r = bench_scan(acl, pkts[i]);
+        matched += r != 0;
+        if(sr_acl_lookup(acl, pkts[i], BENCH_PKTLEN) != r)
+        { wrong++; }
+    }
+    t1 = bench_now();
+    for(i = 0; i < BENCH_NPKTS; i++)
+    { bench_scan(acl, pkts[i]); }
+    scan = (bench_now() - t1) * 1e9 / BENCH_NPKTS;
+
+    acl->lookups = acl->probes = 0;
+    iters = 20000000 / (n / 100 + 10);
+    t0 = bench_now();
+    for(i = 0; i < iters; i++)
+    { sr_acl_lookup(acl, pkts[i % BENCH_NPKTS], BENCH_PKTLEN); }
+    tss = (bench_now() - t0) * 1e9 / iters;
+
+    printf("%8u %8u %8u %8.2f %11.1f %11.1f %7.1fx %7.0f%% %s\n", acl->nrules,
+           acl->ntuples, acl->nentries, (double)acl->probes / acl->lookups,
+           tss, scan, scan / tss, 100.0 * matched / BENCH_NPKTS,
+           wrong ? "MISMATCH" : "ok");
+    sr_acl_destroy(acl);
+    return wrong != 0;
+}
+
+int main(int argc, char** argv)
+{
+    static const char* defaults[] = { "1000", "10000", 0 };
+    const char** sizes = defaults;
+    int i, rc = 0;
+
+    if(argc > 1)
+    { sizes = (const char**)(argv + 1); }
+
+    srand(1);
+    for(i = 0; i < BENCH_NETS; i++)
+    { nets[i] = (10 + bench_rand() % 200) << 24 | (bench_rand() & 0xffff00); }
+
+    printf("%8s %8s %8s %8s %11s %11s %8s %8s\n", "rules", "tuples",
+           "entries", "probes", "ns/lookup", "ns/scan", "speedup", "matched");
+    for(i = 0; sizes[i]; i++)
+    { rc |= bench(strtoul(sizes[i], 0, 10)); }
+    return rc;
+}
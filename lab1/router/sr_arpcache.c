@@ -10,6 +10,11 @@
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_trace.h"
+#include "sr_stats.h"
+#include "sr_metrics.h"
+#include "sr_sdt.h"
+#include "sr_flow.h"
 
 #define MAX_REQUEST_TRIES 5
 
@@ -47,6 +52,7 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req)
                 sr_ethernet_hdr_t *ethernet_hdr = (sr_ethernet_hdr_t *)(curr_packet->buf);
                 sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t*)(curr_packet + sizeof(sr_ethernet_hdr_t));
                 struct sr_if *curr_if = sr->if_list;
+                sr_stats_drop(sr_drop_arp_giveup);
                 for(; curr_if != NULL; curr_if = curr_if->next)
                 {
                     if(memcmp(ethernet_hdr->ether_dhost, curr_if->addr, ETHER_ADDR_LEN) == 0)
@@ -86,6 +92,8 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq *req)
             arp_hdr->ar_sip = sending_interface->ip;
             arp_hdr->ar_tip = req->ip;
 
+            SR_TRACE2(sr_ev_arp_req, req->ip, req->times_sent);
+            SR_PROBE2(arp_request, req->ip, req->times_sent);
             sr_send_packet(sr, arp_request_packet, arp_pkt_len, sending_interface->name);
             free(arp_request_packet);
             return;
@@ -154,8 +162,19 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         cache->requests = req;
     }
     
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
+    /* Add the packet to the list of packets for this request, unless the
+       next hop is already holding as many as it should: frames queue here
+       for up to five seconds, so a busy unresolved next hop would grow
+       without bound */
+    int held = 0;
+    struct sr_packet *pkt;
+    for (pkt = req->packets; pkt != NULL; pkt = pkt->next) {
+        held++;
+    }
+    if (packet && packet_len && iface && held >= SR_ARPREQ_MAX_PACKETS) {
+        sr_stats_drop(sr_drop_arp_queue_full);
+    }
+    else if (packet && packet_len && iface) {
         struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
         
         new_pkt->buf = (uint8_t *)malloc(packet_len);
@@ -272,6 +291,13 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     fprintf(stderr, "\n");
 }
 
+/* Invalidates every entry; pending requests are left alone. */
+void sr_arpcache_flush(struct sr_arpcache *cache) {
+    pthread_mutex_lock(&(cache->lock));
+    memset(cache->entries, 0, sizeof(cache->entries));
+    pthread_mutex_unlock(&(cache->lock));
+}
+
 /* Initialize table + table lock. Returns 0 on success. */
 int sr_arpcache_init(struct sr_arpcache *cache) {  
     /* Seed RNG to kick out a random entry if all entries full. */
@@ -316,6 +342,10 @@ void *sr_arpcache_timeout(void *sr_ptr) {
         }
         
         sr_arpcache_sweepreqs(sr);
+        sr_flush_packets(sr);
+        sr_flow_age(sr->flows);
+        sr_stats_poll(sr);
+        sr_metrics_snapshot(sr);
 
         pthread_mutex_unlock(&(cache->lock));
     }
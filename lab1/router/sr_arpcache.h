@@ -73,6 +73,7 @@
 
 #define SR_ARPCACHE_SZ    100  
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPREQ_MAX_PACKETS 64   /* frames held per pending request */
 
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
@@ -138,6 +139,9 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
+/* Invalidates all entries, e.g. after a topology change (srctl arp flush). */
+void sr_arpcache_flush(struct sr_arpcache *cache);
+
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
    a destructor, and a cleanup thread times out cache entries every 15
@@ -147,6 +151,7 @@ int   sr_arpcache_init(struct sr_arpcache *cache);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
 
+void sr_arpcache_sweepreqs(struct sr_instance *sr);
 void handle_arpreq(struct sr_instance *, struct sr_arpreq *);
 
 #endif
@@ -0,0 +1,518 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * Forwarding benchmark without VNS, POX or Mininet.  Links the real
+ * sr_router.c, sr_arpcache.c, sr_rt.c and sr_if.c against a stub transport
+ * (sr_send_packet() below counts frames and drops them), sets up the
+ * lab topology's three interfaces and a routing table, and feeds frames to
+ * sr_handlepacket() in a tight loop.
+ *
+ *   usage: sr_bench [-n packets] [-r rtable] [-t traffic] [-s payload]
+ *                   [-p capture.pcap] [-V vector size]
+ *
+ *   traffic   fwd      forwarded ICMP echo, next hop in the ARP cache
+ *             echo     echo request to the router
+ *             ttl      TTL 1, answered with time exceeded
+ *             noroute  no matching route, net unreachable
+ *             arp      ARP request for a router address
+ *             arpmiss  fwd with the next hop not resolved, queued for ARP
+ *             mix      80% fwd and 5% of each of the others but arpmiss
+ *
+ * With -p the frames of a pcap file (as written by sr -l) are replayed
+ * instead, each on the interface whose MAC address it is sent to.  With -V
+ * the frames go through the vector path (sr_vector.h) in vectors of that
+ * size instead of one sr_handlepacket() call each.
+ *
+ * After an arpmiss run the ARP reply for the next hop is fed in, and the
+ * frames it releases must all have gone out with their TTL decremented;
+ * sr_bench exits 1 if one did not.
+ *
+ * Reports Mpps, ns per packet, frames sent per packet and malloc/calloc/
+ * realloc calls per packet (counted by wrapping them at link time).  The
+ * time includes copying each frame into the receive buffer, as the VNS
+ * path does.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_utils.h"
+#include "sr_dumper.h"
+#include "sr_stats.h"
+#include "sr_vector.h"
+
+#define BENCH_MAX_FRAME 9018
+#define BENCH_MAX_TEMPLATES 65536
+#define BENCH_SWEEP_EVERY 65536   /* packets between ARP request sweeps */
+
+int sr_log_level = 0;
+
+/* -----------------------------------------------------------------------
+ * Stub transport and allocation counters
+ * --------------------------------------------------------------------- */
+
+static unsigned long bench_tx_frames;
+static unsigned long bench_tx_bytes;
+static unsigned long bench_allocs;
+static uint8_t bench_expect_ttl;       /* 0 for not checking */
+static unsigned long bench_released;
+static unsigned long bench_bad_ttl;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    bench_allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    bench_allocs++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+    bench_allocs++;
+    return __real_realloc(p, size);
+}
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{
+    bench_tx_frames++;
+    bench_tx_bytes += len;
+    if(bench_expect_ttl && len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+       ethertype(buf) == ethertype_ip)
+    {
+        bench_released++;
+        if(((sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t)))->ip_ttl !=
+           bench_expect_ttl)
+        { bench_bad_ttl++; }
+    }
+    return 0;
+}
+
+void sr_flush_packets(struct sr_instance* sr)
+{
+}
+
+/* -----------------------------------------------------------------------
+ * Topology, the lab's three interfaces (see ../IP_CONFIG)
+ * --------------------------------------------------------------------- */
+
+static const char* bench_ifs[][2] = {
+    { "eth1", "192.168.2.1" },
+    { "eth2", "172.64.3.1" },
+    { "eth3", "10.0.1.1" },
+};
+#define BENCH_NIFS 3
+
+static const char* bench_rtable[][4] = {
+    { "10.0.1.0",    "10.0.1.100",  "255.255.255.0",   "eth3" },
+    { "192.168.2.2", "192.168.2.2", "255.255.255.255", "eth1" },
+    { "172.64.3.0",  "172.64.3.10", "255.255.255.0",   "eth2" },
+};
+#define BENCH_NROUTES 3
+
+static const char* bench_neighbours[] = {
+    "10.0.1.100", "192.168.2.2", "172.64.3.10"
+};
+#define BENCH_NNEIGHBOURS 3
+
+static void bench_mac(unsigned char* mac, int host)
+{
+    mac[0] = 0x02; mac[1] = 0x00; mac[2] = 0x5e;
+    mac[3] = 0x00; mac[4] = (host >> 8) & 0xff; mac[5] = host & 0xff;
+}
+
+static void bench_topology(struct sr_instance* sr, const char* rtable,
+                           const char* unresolved)
+{
+    unsigned char mac[ETHER_ADDR_LEN];
+    struct in_addr dest, gw, mask;
+    int i;
+
+    for(i = 0; i < BENCH_NIFS; i++)
+    {
+        bench_mac(mac, i + 1);
+        sr_add_interface(sr, bench_ifs[i][0]);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, inet_addr(bench_ifs[i][1]));
+        sr_set_ether_mtu(sr, SR_MTU_DEFAULT);
+    }
+
+    if(rtable)
+    {
+        if(sr_load_rt(sr, rtable) != 0)
+        {
+            fprintf(stderr, "Error loading routing table %s\n", rtable);
+            exit(1);
+        }
+    }
+    else
+    {
+        for(i = 0; i < BENCH_NROUTES; i++)
+        {
+            inet_aton(bench_rtable[i][0], &dest);
+            inet_aton(bench_rtable[i][1], &gw);
+            inet_aton(bench_rtable[i][2], &mask);
+            sr_add_rt_entry(sr, dest, gw, mask, (char*)bench_rtable[i][3]);
+        }
+    }
+
+    /* every next hop already resolved, but 'unresolved' */
+    for(i = 0; i < BENCH_NNEIGHBOURS; i++)
+    {
+        if(unresolved && strcmp(bench_neighbours[i], unresolved) == 0)
+        { continue; }
+        bench_mac(mac, 0x100 + i);
+        sr_arpcache_insert(&(sr->cache), mac, inet_addr(bench_neighbours[i]));
+    }
+}
+
+/* -----------------------------------------------------------------------
+ * Traffic
+ * --------------------------------------------------------------------- */
+
+struct bench_frame
+{
+    uint8_t* buf;
+    unsigned int len;
+    struct sr_if* iface;
+};
+
+static struct bench_frame bench_frames[BENCH_MAX_TEMPLATES];
+static unsigned int bench_nframes;
+
+static void bench_add(uint8_t* buf, unsigned int len, struct sr_if* iface)
+{
+    struct bench_frame* f = &bench_frames[bench_nframes++];
+
+    f->buf = (uint8_t*)__real_malloc(len);
+    memcpy(f->buf, buf, len);
+    f->len = len;
+    f->iface = iface;
+}
+
+/* an ICMP echo request from 'src' to 'dst' arriving on 'iface' */
+static void bench_echo(struct sr_if* iface, const char* src, const char* dst,
+                       uint8_t ttl, unsigned int payload)
+{
+    uint8_t buf[BENCH_MAX_FRAME];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)buf;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+    sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*)(ip + 1);
+    unsigned int icmp_len = sizeof(sr_icmp_hdr_t) + 4 + payload;
+    unsigned int len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) +
+                       icmp_len;
+    unsigned int i;
+
+    memset(buf, 0, len);
+    memcpy(eth->ether_dhost, iface->addr, ETHER_ADDR_LEN);
+    bench_mac(eth->ether_shost, 0x200);
+    eth->ether_type = htons(ethertype_ip);
+
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(sizeof(sr_ip_hdr_t) + icmp_len);
+    ip->ip_id = htons(bench_nframes);
+    ip->ip_ttl = ttl;
+    ip->ip_p = ip_protocol_icmp;
+    ip->ip_src = inet_addr(src);
+    ip->ip_dst = inet_addr(dst);
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+
+    icmp->icmp_type = 8;
+    for(i = 0; i < payload; i++)
+    { ((uint8_t*)(icmp + 1))[4 + i] = (uint8_t)i; }
+    icmp->icmp_sum = cksum(icmp, icmp_len);
+
+    bench_add(buf, len, iface);
+}
+
+static void bench_arp_request(struct sr_if* iface, const char* src)
+{
+    uint8_t buf[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)buf;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(eth + 1);
+
+    memset(buf, 0, sizeof(buf));
+    memset(eth->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    bench_mac(eth->ether_shost, 0x200);
+    eth->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(arp_op_request);
+    memcpy(arp->ar_sha, eth->ether_shost, ETHER_ADDR_LEN);
+    arp->ar_sip = inet_addr(src);
+    arp->ar_tip = iface->ip;
+
+    bench_add(buf, sizeof(buf), iface);
+}
+
+static void bench_traffic(struct sr_instance* sr, const char* type,
+                          unsigned int payload)
+{
+    struct sr_if* eth1 = sr_get_interface(sr, "eth1");
+    struct sr_if* eth2 = sr_get_interface(sr, "eth2");
+    struct sr_if* eth3 = sr_get_interface(sr, "eth3");
+    int mix = (strcmp(type, "mix") == 0);
+    int i;
+
+    for(i = 0; i < (mix ? 16 : 1); i++)
+    {
+        if(mix || strcmp(type, "fwd") == 0)
+        {
+            /* every direction between client, server1 and server2 */
+            bench_echo(eth3, "10.0.1.100", "192.168.2.2", 64, payload);
+            bench_echo(eth1, "192.168.2.2", "10.0.1.100", 64, payload);
+            bench_echo(eth3, "10.0.1.100", "172.64.3.10", 64, payload);
+            bench_echo(eth2, "172.64.3.10", "10.0.1.100", 64, payload);
+        }
+    }
+    if(mix || strcmp(type, "echo") == 0)
+    { bench_echo(eth3, "10.0.1.100", "10.0.1.1", 64, payload); }
+    if(mix || strcmp(type, "ttl") == 0)
+    { bench_echo(eth3, "10.0.1.100", "192.168.2.2", 1, payload); }
+    if(mix || strcmp(type, "noroute") == 0)
+    { bench_echo(eth3, "10.0.1.100", "8.8.8.8", 64, payload); }
+    if(mix || strcmp(type, "arp") == 0)
+    { bench_arp_request(eth3, "10.0.1.100"); }
+    if(strcmp(type, "arpmiss") == 0)
+    { bench_echo(eth3, "10.0.1.100", "172.64.3.10", 64, payload); }
+
+    if(bench_nframes == 0)
+    {
+        fprintf(stderr, "Unknown traffic type %s\n", type);
+        exit(1);
+    }
+}
+
+/* the frames of a pcap file, by destination MAC, else on the first interface */
+static void bench_pcap(struct sr_instance* sr, const char* path)
+{
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    uint8_t buf[BENCH_MAX_FRAME];
+    struct sr_if* iface;
+    int swap;
+    FILE* fp;
+
+    if((fp = fopen(path, "rb")) == 0 || fread(&fh, sizeof(fh), 1, fp) != 1)
+    {
+        perror(path);
+        exit(1);
+    }
+    if(fh.magic == TCPDUMP_MAGIC)
+    { swap = 0; }
+    else if(__builtin_bswap32(fh.magic) == TCPDUMP_MAGIC)
+    { swap = 1; }
+    else
+    {
+        fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n",
+                path);
+        exit(1);
+    }
+
+    while(bench_nframes < BENCH_MAX_TEMPLATES &&
+          fread(&ph, sizeof(ph), 1, fp) == 1)
+    {
+        if(swap)
+        { ph.caplen = __builtin_bswap32(ph.caplen); }
+        if(ph.caplen > sizeof(buf) || fread(buf, ph.caplen, 1, fp) != 1)
+        { break; }
+        if(ph.caplen < sizeof(sr_ethernet_hdr_t))
+        { continue; }
+        for(iface = sr->if_list; iface; iface = iface->next)
+        {
+            if(memcmp(buf, iface->addr, ETHER_ADDR_LEN) == 0)
+            { break; }
+        }
+        bench_add(buf, ph.caplen, iface ? iface : sr->if_list);
+    }
+    fclose(fp);
+
+    if(bench_nframes == 0)
+    {
+        fprintf(stderr, "%s: no frames\n", path);
+        exit(1);
+    }
+}
+
+/* one frame into the router, scalar or through the vector */
+static void bench_rx(struct sr_instance* sr, struct bench_frame* f)
+{
+    static uint8_t rxbuf[SR_VEC_MAX][BENCH_MAX_FRAME];
+    uint8_t* buf;
+
+    if(!sr->vec)
+    {
+        memcpy(rxbuf[0], f->buf, f->len);
+        sr_handlepacket(sr, rxbuf[0], f->len, f->iface->name);
+        return;
+    }
+    buf = rxbuf[sr->vec->n];
+    memcpy(buf, f->buf, f->len);
+    sr_vec_add(sr, buf, f->len, f->iface);
+    if(sr->vec->n == sr->vec->size)
+    { sr_vec_run(sr); }
+}
+
+/* arpmiss: queue another vector's worth, answer the ARP request for
+ * server2 and check the TTL of what the reply releases; 0 if all is well */
+static int bench_arp_release(struct sr_instance* sr)
+{
+    uint8_t buf[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)buf;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(eth + 1);
+    struct sr_if* eth2 = sr_get_interface(sr, "eth2");
+    unsigned int i;
+
+    for(i = 0; i < (sr->vec ? sr->vec->size : 1); i++)
+    { bench_rx(sr, &bench_frames[0]); }
+    sr_vec_run(sr);
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(eth->ether_dhost, eth2->addr, ETHER_ADDR_LEN);
+    bench_mac(eth->ether_shost, 0x102);
+    eth->ether_type = htons(ethertype_arp);
+    arp->ar_hrd = htons(arp_hrd_ethernet);
+    arp->ar_pro = htons(ethertype_ip);
+    arp->ar_hln = ETHER_ADDR_LEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(arp_op_reply);
+    memcpy(arp->ar_sha, eth->ether_shost, ETHER_ADDR_LEN);
+    arp->ar_sip = inet_addr("172.64.3.10");
+    memcpy(arp->ar_tha, eth2->addr, ETHER_ADDR_LEN);
+    arp->ar_tip = eth2->ip;
+
+    bench_expect_ttl = 63;
+    sr_handlepacket(sr, buf, sizeof(buf), eth2->name);
+    bench_expect_ttl = 0;
+
+    printf("arp reply released %lu frames, %lu not sent with TTL 63\n",
+           bench_released, bench_bad_ttl);
+    return (bench_released == 0 || bench_bad_ttl != 0);
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(char* argv0)
+{
+    fprintf(stderr, "usage: %s [-n packets] [-r rtable] "
+            "[-t fwd|echo|ttl|noroute|arp|arpmiss|mix] [-s payload] "
+            "[-p capture.pcap] [-V vector size]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    static struct sr_instance sr;
+    unsigned long npkts = 2000000, i, allocs;
+    const char* rtable = 0;
+    const char* type = "fwd";
+    const char* pcap = 0;
+    unsigned int payload = 56;
+    unsigned int vec_size = 0;
+    struct sr_stats_totals t;
+    uint64_t dropped = 0;
+    uint64_t dropped0 = 0;
+    double t0, t1;
+    int c;
+
+    while((c = getopt(argc, argv, "hn:r:t:s:p:V:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'n': npkts = strtoul(optarg, 0, 10); break;
+            case 'r': rtable = optarg; break;
+            case 't': type = optarg; break;
+            case 's': payload = atoi(optarg); break;
+            case 'p': pcap = optarg; break;
+            case 'V': vec_size = atoi(optarg); break;
+            default:  usage(argv[0]);
+        }
+    }
+    if(npkts == 0 || payload > SR_MTU_DEFAULT - 28)
+    { usage(argv[0]); }
+
+    memset(&sr, 0, sizeof(sr));
+    sr.max_msg_len = SR_MSG_LEN_DEFAULT;
+    sr.max_frame_len = BENCH_MAX_FRAME;
+    sr.if_mtu = SR_MTU_DEFAULT;
+    sr_arpcache_init(&(sr.cache));   /* no sweeper thread, see below */
+    if(vec_size && (sr.vec = sr_vec_create(vec_size)) == 0)
+    { exit(1); }
+    bench_topology(&sr, rtable,
+                   (!pcap && strcmp(type, "arpmiss") == 0) ? "172.64.3.10" : 0);
+
+    if(pcap)
+    { bench_pcap(&sr, pcap); }
+    else
+    { bench_traffic(&sr, type, payload); }
+
+    /* warm up caches and branch predictors */
+    for(i = 0; i < bench_nframes * 4 + vec_size; i++)
+    { bench_rx(&sr, &bench_frames[i % bench_nframes]); }
+    sr_vec_run(&sr);
+
+    sr_stats_sum(&t);
+    for(c = 0; c < sr_drop_count; c++)
+    { dropped0 += t.drops[c]; }
+
+    bench_tx_frames = bench_tx_bytes = bench_allocs = 0;
+    t0 = bench_now();
+    for(i = 0; i < npkts; i++)
+    {
+        bench_rx(&sr, &bench_frames[i % bench_nframes]);
+        if((i & (BENCH_SWEEP_EVERY - 1)) == BENCH_SWEEP_EVERY - 1)
+        {
+            /* the ARP thread's job: give up on unanswered requests */
+            pthread_mutex_lock(&(sr.cache.lock));
+            sr_arpcache_sweepreqs(&sr);
+            pthread_mutex_unlock(&(sr.cache.lock));
+        }
+    }
+    sr_vec_run(&sr);
+    t1 = bench_now();
+    allocs = bench_allocs;
+
+    sr_stats_sum(&t);
+    for(c = 0; c < sr_drop_count; c++)
+    { dropped += t.drops[c]; }
+
+    printf("%-10s %6s %10s %9s %10s %12s %12s %10s\n", "traffic", "vector",
+           "packets", "Mpps", "ns/packet", "allocs/pkt", "tx/pkt", "dropped");
+    printf("%-10s %6u %10lu %9.3f %10.1f %12.3f %12.3f %10llu\n",
+           pcap ? "pcap" : type, vec_size, npkts,
+           npkts / (t1 - t0) / 1e6, (t1 - t0) * 1e9 / npkts,
+           (double)allocs / npkts, (double)bench_tx_frames / npkts,
+           (unsigned long long)(dropped - dropped0));
+    if(!pcap && strcmp(type, "arpmiss") == 0)
+    { return bench_arp_release(&sr); }
+    return 0;
+}
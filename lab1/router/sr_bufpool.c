@@ -0,0 +1,109 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bufpool.c
+ *
+ * Description:
+ *
+ * Fixed-size buffer pool, see sr_bufpool.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sr_bufpool.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_bufpool_init(..)
+ * Scope:  Global
+ *
+ * Set up a pool of 'bufsize' byte buffers and fill it with 'prealloc'
+ * of them.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_bufpool_init(struct sr_bufpool* pool, size_t bufsize,
+                    unsigned int prealloc)
+{
+    unsigned int i;
+    void* buf;
+
+    /* -- REQUIRES -- */
+    assert(pool);
+    assert(bufsize >= sizeof(void*));
+
+    pool->bufsize = bufsize;
+    pool->free_list = 0;
+    pool->nfree = 0;
+    pool->max_free = SR_BUFPOOL_MAX_FREE;
+    pool->allocs = 0;
+    if(pthread_mutex_init(&(pool->lock), 0) != 0)
+    { return -1; }
+
+    for(i = 0; i < prealloc && i < pool->max_free; i++)
+    {
+        if((buf = malloc(bufsize)) == 0)
+        { return -1; }
+        pool->allocs++;
+        sr_bufpool_put(pool, buf);
+    }
+    return 0;
+} /* -- sr_bufpool_init -- */
+
+void sr_bufpool_destroy(struct sr_bufpool* pool)
+{
+    void* buf;
+
+    pthread_mutex_lock(&(pool->lock));
+    while((buf = pool->free_list) != 0)
+    {
+        pool->free_list = *(void**)buf;
+        free(buf);
+    }
+    pool->nfree = 0;
+    pthread_mutex_unlock(&(pool->lock));
+    pthread_mutex_destroy(&(pool->lock));
+} /* -- sr_bufpool_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_bufpool_get(..)
+ * Scope:  Global
+ *
+ * Returns a buffer of pool->bufsize bytes, or 0 if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_bufpool_get(struct sr_bufpool* pool)
+{
+    void* buf;
+
+    pthread_mutex_lock(&(pool->lock));
+    if((buf = pool->free_list) != 0)
+    {
+        pool->free_list = *(void**)buf;
+        pool->nfree--;
+        pthread_mutex_unlock(&(pool->lock));
+        return buf;
+    }
+    pool->allocs++;
+    pthread_mutex_unlock(&(pool->lock));
+
+    return malloc(pool->bufsize);
+} /* -- sr_bufpool_get -- */
+
+void sr_bufpool_put(struct sr_bufpool* pool, void* buf)
+{
+    if(!buf)
+    { return; }
+
+    pthread_mutex_lock(&(pool->lock));
+    if(pool->nfree < pool->max_free)
+    {
+        *(void**)buf = pool->free_list;
+        pool->free_list = buf;
+        pool->nfree++;
+        buf = 0;
+    }
+    pthread_mutex_unlock(&(pool->lock));
+
+    free(buf); /* pool is full */
+} /* -- sr_bufpool_put -- */
@@ -0,0 +1,37 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bufpool.h
+ *
+ * Description:
+ *
+ * A pool of fixed-size buffers for VNS messages, so that receiving and
+ * sending a frame does not cost a malloc()/free() pair.  Buffers are sized
+ * for the largest message the router accepts (see sr_instance.max_msg_len).
+ * The pool is shared by the packet thread and the ARP thread.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_BUFPOOL_H
+#define SR_BUFPOOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define SR_BUFPOOL_MAX_FREE 256 /* buffers kept around for reuse */
+
+struct sr_bufpool
+{
+    size_t bufsize;
+    void* free_list;          /* first word of a free buffer links the next */
+    unsigned int nfree;
+    unsigned int max_free;
+    unsigned long allocs;     /* buffers obtained from malloc() */
+    pthread_mutex_t lock;
+};
+
+int   sr_bufpool_init(struct sr_bufpool* pool, size_t bufsize,
+                      unsigned int prealloc);
+void  sr_bufpool_destroy(struct sr_bufpool* pool);
+void* sr_bufpool_get(struct sr_bufpool* pool);
+void  sr_bufpool_put(struct sr_bufpool* pool, void* buf);
+
+#endif /* -- SR_BUFPOOL_H -- */
@@ -0,0 +1,394 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_codel.c
+ *
+ * Description:
+ *
+ * FIFO, CoDel and FQ-CoDel queues for the -Q classes, see sr_codel.h.
+ * The CoDel state machine is the pseudocode of RFC 8289, the flow
+ * scheduler that of RFC 8290.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include "sr_codel.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+
+/* ---- one FIFO ---- */
+
+static void sr_codel_push(struct sr_qos_queue* q, struct sr_qos_flow* f,
+                          struct sr_qos_pkt* p)
+{
+    p->next = 0;
+    if(f->tail)
+    { f->tail->next = p; }
+    else
+    { f->head = p; }
+    f->tail = p;
+    f->depth++;
+    f->bytes += p->len;
+    q->depth++;
+    q->bytes += p->len;
+} /* -- sr_codel_push -- */
+
+static struct sr_qos_pkt* sr_codel_pop(struct sr_qos_queue* q,
+                                       struct sr_qos_flow* f)
+{
+    struct sr_qos_pkt* p = f->head;
+
+    if(!p)
+    { return 0; }
+    if((f->head = p->next) == 0)
+    { f->tail = 0; }
+    f->depth--;
+    f->bytes -= p->len;
+    q->depth--;
+    q->bytes -= p->len;
+    return p;
+} /* -- sr_codel_pop -- */
+
+static void sr_codel_free(struct sr_qos_flow* f)
+{
+    struct sr_qos_pkt *p, *next;
+
+    for(p = f->head; p; p = next)
+    {
+        next = p->next;
+        free(p);
+    }
+    memset(f, 0, sizeof(*f));
+} /* -- sr_codel_free -- */
+
+/* ---- CoDel ---- */
+
+static uint64_t sr_codel_control_law(const struct sr_qos* qos, uint64_t t,
+                                     unsigned int count)
+{
+    return t + (uint64_t)(qos->interval / sqrt((double)count));
+} /* -- sr_codel_control_law -- */
+
+/* a frame 'p' just taken off 'f' has been queued too long; a queue of at
+ * most one frame is never too long */
+static int sr_codel_ok_to_drop(const struct sr_qos* qos, struct sr_qos_flow* f,
+                               const struct sr_qos_pkt* p, uint64_t now)
+{
+    struct sr_codel* cd = &(f->codel);
+
+    if(now - p->enqueued < qos->target || f->bytes <= qos->sr->max_frame_len)
+    {
+        cd->first_above = 0;
+        return 0;
+    }
+    if(cd->first_above == 0)
+    {
+        cd->first_above = now + qos->interval;
+        return 0;
+    }
+    return now >= cd->first_above;
+} /* -- sr_codel_ok_to_drop -- */
+
+/* congestion signal for 'p': 1 if it was marked CE and is to be sent,
+ * 0 if it was dropped */
+static int sr_codel_signal(const struct sr_qos* qos, struct sr_qos_queue* q,
+                           struct sr_qos_pkt* p)
+{
+    uint8_t* frame = (uint8_t*)(p + 1);
+
+    if(qos->ecn && p->len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+       ethertype(frame) == ethertype_ip &&
+       ip_set_ce((sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t))))
+    {
+        q->ecn_marks++;
+        return 1;
+    }
+    q->aqm_drops++;
+    free(p);
+    sr_stats_drop(sr_drop_codel);
+    return 0;
+} /* -- sr_codel_signal -- */
+
+static struct sr_qos_pkt* sr_codel_flow_dequeue(const struct sr_qos* qos,
+                                                struct sr_qos_queue* q,
+                                                struct sr_qos_flow* f,
+                                                uint64_t now)
+{
+    struct sr_codel* cd = &(f->codel);
+    struct sr_qos_pkt* p;
+    unsigned int delta;
+    int ok;
+
+    if((p = sr_codel_pop(q, f)) == 0)
+    {
+        cd->first_above = 0;
+        cd->dropping = 0;
+        return 0;
+    }
+    ok = sr_codel_ok_to_drop(qos, f, p, now);
+
+    if(cd->dropping)
+    {
+        if(!ok)
+        { cd->dropping = 0; }
+        while(cd->dropping && now >= cd->drop_next)
+        {
+            cd->count++;
+            if(sr_codel_signal(qos, q, p))
+            {
+                cd->drop_next = sr_codel_control_law(qos, cd->drop_next,
+                                                     cd->count);
+                return p;
+            }
+            if((p = sr_codel_pop(q, f)) == 0)
+            {
+                cd->first_above = 0;
+                cd->dropping = 0;
+                return 0;
+            }
+            if(!sr_codel_ok_to_drop(qos, f, p, now))
+            { cd->dropping = 0; }
+            else
+            {
+                cd->drop_next = sr_codel_control_law(qos, cd->drop_next,
+                                                     cd->count);
+            }
+        }
+    }
+    else if(ok)
+    {
+        /* start dropping, faster if the last episode ended recently */
+        if(!sr_codel_signal(qos, q, p) && (p = sr_codel_pop(q, f)) != 0)
+        { sr_codel_ok_to_drop(qos, f, p, now); }
+        cd->dropping = 1;
+        delta = cd->count - cd->lastcount;
+        cd->count = (delta > 1 && now < cd->drop_next + 16 * qos->interval) ?
+                    delta : 1;
+        cd->drop_next = sr_codel_control_law(qos, now, cd->count);
+        cd->lastcount = cd->count;
+    }
+    return p;
+} /* -- sr_codel_flow_dequeue -- */
+
+/* ---- flows ---- */
+
+static unsigned int sr_codel_hash(const struct sr_qos* qos,
+                                  const uint8_t* frame, unsigned int len,
+                                  unsigned int nflows)
+{
+    const sr_ip_hdr_t* ip;
+    uint32_t h = qos->perturb, ports;
+    unsigned int hl;
+
+    if(len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+       ethertype((uint8_t*)frame) == ethertype_ip)
+    {
+        ip = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+        hl = ip->ip_hl * 4;
+        h = (h ^ ip->ip_src) * 0x9e3779b1U;
+        h = (h ^ ip->ip_dst) * 0x9e3779b1U;
+        h = (h ^ ip->ip_p) * 0x9e3779b1U;
+        if((ip->ip_p == ip_protocol_tcp || ip->ip_p == ip_protocol_udp) &&
+           (ntohs(ip->ip_off) & IP_OFFMASK) == 0 &&
+           len >= sizeof(sr_ethernet_hdr_t) + hl + 4)
+        {
+            memcpy(&ports, frame + sizeof(sr_ethernet_hdr_t) + hl, 4);
+            h = (h ^ ports) * 0x9e3779b1U;
+        }
+    }
+    h ^= h >> 16;
+    return (unsigned int)(((uint64_t)h * nflows) >> 32);
+} /* -- sr_codel_hash -- */
+
+static void sr_codel_link(struct sr_qos_queue* q, int list, int i)
+{
+    struct sr_qos_flist* l = list == SR_QOS_FLOW_NEW ? &(q->new_flows)
+                                                     : &(q->old_flows);
+
+    q->flows[i].list = list;
+    q->flows[i].next = -1;
+    if(l->tail >= 0)
+    { q->flows[l->tail].next = i; }
+    else
+    { l->head = i; }
+    l->tail = i;
+} /* -- sr_codel_link -- */
+
+static int sr_codel_unlink(struct sr_qos_flist* l, struct sr_qos_flow* flows)
+{
+    int i = l->head;
+
+    if((l->head = flows[i].next) < 0)
+    { l->tail = -1; }
+    flows[i].list = SR_QOS_FLOW_IDLE;
+    return i;
+} /* -- sr_codel_unlink -- */
+
+/* the list the scheduler serves next, 0 if both are empty */
+static struct sr_qos_flist* sr_codel_current(struct sr_qos_queue* q)
+{
+    if(q->new_flows.head >= 0)
+    { return &(q->new_flows); }
+    if(q->old_flows.head >= 0)
+    { return &(q->old_flows); }
+    return 0;
+} /* -- sr_codel_current -- */
+
+/* an empty flow leaves the schedule; a new one goes through the old list
+ * first, so a flow cannot stay new by emptying itself */
+static void sr_codel_retire(struct sr_qos_queue* q, struct sr_qos_flist* l)
+{
+    int i = sr_codel_unlink(l, q->flows);
+
+    if(l == &(q->new_flows) && q->old_flows.head >= 0)
+    { sr_codel_link(q, SR_QOS_FLOW_OLD, i); }
+} /* -- sr_codel_retire -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_codel_init(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_codel_init(struct sr_qos_queue* q, const struct sr_qos_class* c)
+{
+    unsigned int i;
+
+    q->aqm = c->aqm;
+    q->new_flows.head = q->new_flows.tail = -1;
+    q->old_flows.head = q->old_flows.tail = -1;
+    if(c->aqm != SR_QOS_FQ_CODEL)
+    { return 0; }
+    if((q->flows = (struct sr_qos_flow*)calloc(c->flows,
+                       sizeof(struct sr_qos_flow))) == 0)
+    {
+        perror("calloc");
+        q->aqm = SR_QOS_CODEL;
+        return -1;
+    }
+    q->nflows = c->flows;
+    for(i = 0; i < q->nflows; i++)
+    { q->flows[i].next = -1; }
+    return 0;
+} /* -- sr_codel_init -- */
+
+void sr_codel_flush(struct sr_qos_queue* q)
+{
+    unsigned int i;
+
+    sr_codel_free(&(q->fifo));
+    for(i = 0; i < q->nflows; i++)
+    { sr_codel_free(&(q->flows[i])); }
+    free(q->flows);
+    q->flows = 0;
+    q->nflows = 0;
+    q->depth = 0;
+    q->bytes = 0;
+} /* -- sr_codel_flush -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_codel_enqueue(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_codel_enqueue(struct sr_qos* qos, struct sr_qos_queue* q,
+                      struct sr_qos_pkt* p)
+{
+    struct sr_qos_flow* f;
+    unsigned int i;
+
+    if(!q->flows)
+    {
+        sr_codel_push(q, &(q->fifo), p);
+        return;
+    }
+    i = sr_codel_hash(qos, (uint8_t*)(p + 1), p->len, q->nflows);
+    f = &(q->flows[i]);
+    sr_codel_push(q, f, p);
+    if(f->list == SR_QOS_FLOW_IDLE)
+    {
+        f->deficit = SR_QOS_QUANTUM;
+        sr_codel_link(q, SR_QOS_FLOW_NEW, (int)i);
+    }
+} /* -- sr_codel_enqueue -- */
+
+void sr_codel_overflow(struct sr_qos_queue* q)
+{
+    struct sr_qos_flow* fat = 0;
+    unsigned int i;
+
+    for(i = 0; i < q->nflows; i++)
+    {
+        if(!fat || q->flows[i].bytes > fat->bytes)
+        { fat = &(q->flows[i]); }
+    }
+    if(fat && fat->head)
+    {
+        free(sr_codel_pop(q, fat));
+        q->drops++;
+        sr_stats_drop(sr_drop_qos_full);
+    }
+} /* -- sr_codel_overflow -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_codel_peek(..)
+ * Scope: Global
+ *
+ * For fq, also moves the schedule on to the flow that is served next, so
+ * the sr_codel_dequeue() that follows starts with the same flow.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_qos_pkt* sr_codel_peek(struct sr_qos_queue* q)
+{
+    struct sr_qos_flist* l;
+    struct sr_qos_flow* f;
+
+    if(!q->flows)
+    { return q->fifo.head; }
+    while((l = sr_codel_current(q)) != 0)
+    {
+        f = &(q->flows[l->head]);
+        if(f->deficit <= 0)
+        {
+            /* used its share of this round */
+            f->deficit += SR_QOS_QUANTUM;
+            sr_codel_link(q, SR_QOS_FLOW_OLD, sr_codel_unlink(l, q->flows));
+        }
+        else if(!f->head)
+        { sr_codel_retire(q, l); }
+        else
+        { return f->head; }
+    }
+    return 0;
+} /* -- sr_codel_peek -- */
+
+struct sr_qos_pkt* sr_codel_dequeue(struct sr_qos* qos,
+                                    struct sr_qos_queue* q, uint64_t now)
+{
+    struct sr_qos_flow* f;
+    struct sr_qos_pkt* p;
+
+    if(q->aqm == SR_QOS_FIFO)
+    { return sr_codel_pop(q, &(q->fifo)); }
+    if(!q->flows)
+    { return sr_codel_flow_dequeue(qos, q, &(q->fifo), now); }
+
+    while(sr_codel_peek(q))
+    {
+        f = &(q->flows[sr_codel_current(q)->head]);
+        if((p = sr_codel_flow_dequeue(qos, q, f, now)) != 0)
+        {
+            f->deficit -= (int)p->len;
+            return p;
+        }
+        /* CoDel dropped all of it */
+        sr_codel_retire(q, sr_codel_current(q));
+    }
+    return 0;
+} /* -- sr_codel_dequeue -- */
@@ -0,0 +1,40 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_codel.h
+ *
+ * Description:
+ *
+ * The queue of one -Q class: a FIFO, a FIFO under CoDel, or FQ-CoDel's
+ * hashed flows (see sr_qos.h for the options).  All of it runs under the
+ * interface lock of the queue.
+ *
+ * CoDel looks at the sojourn time of the frame at the head, the time it
+ * spent queued, when it is taken off.  Once that has stayed above the
+ * target for an interval the queue is a standing queue rather than a
+ * burst, and CoDel drops a frame, then another after interval/sqrt(2),
+ * interval/sqrt(3), ... until the sojourn time is below target again.
+ * An ECN-capable IPv4 frame is marked CE and sent instead of dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CODEL_H
+#define SR_CODEL_H
+
+#include "sr_qos.h"
+
+/* set up 'q' for class 'c', -1 if its flows cannot be allocated */
+int  sr_codel_init(struct sr_qos_queue* q, const struct sr_qos_class* c);
+/* free every frame queued and the flows */
+void sr_codel_flush(struct sr_qos_queue* q);
+
+void sr_codel_enqueue(struct sr_qos* qos, struct sr_qos_queue* q,
+                      struct sr_qos_pkt* p);
+/* make room in a full fq queue: drop the head of its longest flow */
+void sr_codel_overflow(struct sr_qos_queue* q);
+
+/* the frame sr_codel_dequeue() would start with, 0 if 'q' is empty */
+struct sr_qos_pkt* sr_codel_peek(struct sr_qos_queue* q);
+/* take the next frame off 'q', after what CoDel drops at 'now' */
+struct sr_qos_pkt* sr_codel_dequeue(struct sr_qos* qos,
+                                    struct sr_qos_queue* q, uint64_t now);
+
+#endif /* -- SR_CODEL_H -- */
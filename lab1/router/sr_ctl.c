@@ -0,0 +1,463 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Description:
+ *
+ * Management socket and its commands, see sr_ctl.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_stats.h"
+#include "sr_acl.h"
+#include "sr_flow.h"
+#include "sr_ctl.h"
+
+static int sr_ctl_nonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return (flags < 0) ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+} /* -- sr_ctl_nonblock -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_open(..)
+ * Scope:  Global
+ *
+ * Listen on the Unix socket 'path', replacing a stale one.  Returns 0 on
+ * failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ctl* sr_ctl_open(struct sr_instance* sr, const char* path)
+{
+    struct sr_ctl* ctl;
+    struct sockaddr_un addr;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(path);
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: control socket path %s too long\n", path);
+        return 0;
+    }
+
+    ctl = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl));
+    assert(ctl);
+    ctl->sr = sr;
+    strncpy(ctl->path, path, sizeof(ctl->path) - 1);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(path);
+    if((ctl->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+       bind(ctl->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(ctl->fd, SR_CTL_MAX_CLIENTS) < 0 ||
+       sr_ctl_nonblock(ctl->fd) < 0)
+    {
+        perror("socket(..):sr_ctl.c::sr_ctl_open");
+        if(ctl->fd >= 0)
+        { close(ctl->fd); }
+        free(ctl);
+        return 0;
+    }
+    return ctl;
+} /* -- sr_ctl_open -- */
+
+static void sr_ctl_drop_client(struct sr_ctl* ctl, int i)
+{
+    close(ctl->clients[i].fd);
+    free(ctl->clients[i].out);
+    ctl->clients[i] = ctl->clients[--ctl->nclients];
+} /* -- sr_ctl_drop_client -- */
+
+void sr_ctl_close(struct sr_ctl* ctl)
+{
+    if(!ctl)
+    { return; }
+    while(ctl->nclients > 0)
+    { sr_ctl_drop_client(ctl, ctl->nclients - 1); }
+    close(ctl->fd);
+    unlink(ctl->path);
+    free(ctl);
+} /* -- sr_ctl_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_pollfds(..)
+ * Scope:  Global
+ *
+ * Fill in 'fds' (room for SR_CTL_MAX_FDS) for poll(2): the listening
+ * socket first, then the clients.  Returns the number used.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_pollfds(struct sr_ctl* ctl, struct pollfd* fds)
+{
+    int i;
+
+    fds[0].fd = ctl->fd;
+    fds[0].events = (ctl->nclients < SR_CTL_MAX_CLIENTS) ? POLLIN : 0;
+    fds[0].revents = 0;
+    for(i = 0; i < ctl->nclients; i++)
+    {
+        fds[i + 1].fd = ctl->clients[i].fd;
+        fds[i + 1].events = POLLIN;
+        if(ctl->clients[i].outoff < ctl->clients[i].outlen)
+        { fds[i + 1].events |= POLLOUT; }
+        fds[i + 1].revents = 0;
+    }
+    return ctl->nclients + 1;
+} /* -- sr_ctl_pollfds -- */
+
+/* -----------------------------------------------------------------------
+ * Commands.  Each writes its reply text to 'fp' and returns 0, or -1 with
+ * an error message in 'fp'.
+ * --------------------------------------------------------------------- */
+
+static int sr_ctl_show_routes(struct sr_instance* sr, FILE* fp)
+{
+    struct sr_rt* rt;
+
+    fprintf(fp, "%-16s %-16s %-16s %s\n",
+            "destination", "gateway", "mask", "interface");
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        fprintf(fp, "%-16s ", inet_ntoa(rt->dest));
+        fprintf(fp, "%-16s ", inet_ntoa(rt->gw));
+        fprintf(fp, "%-16s ", inet_ntoa(rt->mask));
+        fprintf(fp, "%s\n", rt->interface);
+    }
+    return 0;
+} /* -- sr_ctl_show_routes -- */
+
+static int sr_ctl_show_arp(struct sr_instance* sr, FILE* fp)
+{
+    struct sr_arpcache* cache = &(sr->cache);
+    struct sr_arpreq* req;
+    struct in_addr ip;
+    time_t now = time(NULL);
+    unsigned char* mac;
+    int i;
+
+    fprintf(fp, "%-16s %-18s %s\n", "address", "hwaddress", "age");
+    pthread_mutex_lock(&(cache->lock));
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    {
+        if(!cache->entries[i].valid)
+        { continue; }
+        ip.s_addr = cache->entries[i].ip;
+        mac = cache->entries[i].mac;
+        fprintf(fp, "%-16s %02x:%02x:%02x:%02x:%02x:%02x  %lds\n",
+                inet_ntoa(ip), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+                (long)(now - cache->entries[i].added));
+    }
+    for(req = cache->requests; req; req = req->next)
+    {
+        ip.s_addr = req->ip;
+        fprintf(fp, "%-16s %-18s sent %u times\n", inet_ntoa(ip),
+                "(incomplete)", req->times_sent);
+    }
+    pthread_mutex_unlock(&(cache->lock));
+    return 0;
+} /* -- sr_ctl_show_arp -- */
+
+static int sr_ctl_show_interfaces(struct sr_instance* sr, FILE* fp)
+{
+    struct sr_if* iface;
+    struct in_addr ip;
+    unsigned char* mac;
+
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        ip.s_addr = iface->ip;
+        mac = iface->addr;
+        fprintf(fp, "%-8s %02x:%02x:%02x:%02x:%02x:%02x %-16s mtu %u\n",
+                iface->name, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+                inet_ntoa(ip), iface->mtu);
+    }
+    return 0;
+} /* -- sr_ctl_show_interfaces -- */
+
+static int sr_ctl_route(struct sr_instance* sr, char** argv, int argc,
+                        FILE* fp)
+{
+    struct in_addr dest, gw, mask;
+
+    if(argc == 6 && strcmp(argv[1], "add") == 0)
+    {
+        if(!inet_aton(argv[2], &dest) || !inet_aton(argv[3], &gw) ||
+           !inet_aton(argv[4], &mask))
+        {
+            fprintf(fp, "bad address\n");
+            return -1;
+        }
+        if(!sr_get_interface(sr, argv[5]))
+        {
+            fprintf(fp, "no interface %s\n", argv[5]);
+            return -1;
+        }
+        sr_add_rt_entry(sr, dest, gw, mask, argv[5]);
+        return 0;
+    }
+    if(argc == 4 && strcmp(argv[1], "del") == 0)
+    {
+        if(!inet_aton(argv[2], &dest) || !inet_aton(argv[3], &mask))
+        {
+            fprintf(fp, "bad address\n");
+            return -1;
+        }
+        if(sr_del_rt_entry(sr, dest, mask) != 0)
+        {
+            fprintf(fp, "no such route\n");
+            return -1;
+        }
+        return 0;
+    }
+    fprintf(fp, "usage: route add <dest> <gateway> <mask> <interface> | "
+                "route del <dest> <mask>\n");
+    return -1;
+} /* -- sr_ctl_route -- */
+
+/* read the -A file again; the old rules stay if it has an error */
+static int sr_ctl_acl_reload(struct sr_instance* sr, FILE* fp)
+{
+    struct sr_acl* acl;
+
+    if(!sr->acl)
+    {
+        fprintf(fp, "no access list, start sr with -A\n");
+        return -1;
+    }
+    if((acl = sr_acl_load(sr->acl->path)) == 0)
+    {
+        fprintf(fp, "%s has errors, see the router's output; "
+                "keeping the old rules\n", sr->acl->path);
+        return -1;
+    }
+    sr_acl_destroy(sr->acl);
+    sr->acl = acl;
+    sr_flow_invalidate(sr->flows);
+    fprintf(fp, "%u rules in %u tuples\n", acl->nrules, acl->ntuples);
+    return 0;
+} /* -- sr_ctl_acl_reload -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_command(..)
+ * Scope:  Local
+ *
+ * Run one request line.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_command(struct sr_instance* sr, char* line, FILE* fp)
+{
+    char* argv[8];
+    char* save = 0;
+    int argc = 0;
+
+    while(argc < 8 &&
+          (argv[argc] = strtok_r(argc ? 0 : line, " \t\r", &save)) != 0)
+    { argc++; }
+
+    if(argc == 2 && strcmp(argv[0], "show") == 0)
+    {
+        if(strcmp(argv[1], "routes") == 0)
+        { return sr_ctl_show_routes(sr, fp); }
+        if(strcmp(argv[1], "arp") == 0)
+        { return sr_ctl_show_arp(sr, fp); }
+        if(strcmp(argv[1], "interfaces") == 0)
+        { return sr_ctl_show_interfaces(sr, fp); }
+        if(strcmp(argv[1], "counters") == 0)
+        {
+            sr_stats_dump(sr, fp);
+            return 0;
+        }
+        if(strcmp(argv[1], "flows") == 0)
+        {
+            if(!sr->flows)
+            { fprintf(fp, "no flow table, start sr with -F\n"); }
+            sr_flow_dump(sr->flows, fp);
+            return 0;
+        }
+        if(strcmp(argv[1], "acl") == 0)
+        {
+            if(!sr->acl)
+            { fprintf(fp, "no access list, start sr with -A\n"); }
+            sr_acl_dump(sr->acl, fp);
+            return 0;
+        }
+    }
+    else if(argc >= 1 && strcmp(argv[0], "route") == 0)
+    { return sr_ctl_route(sr, argv, argc, fp); }
+    else if(argc == 2 && strcmp(argv[0], "arp") == 0 &&
+            strcmp(argv[1], "flush") == 0)
+    {
+        sr_arpcache_flush(&(sr->cache));
+        return 0;
+    }
+    else if(argc == 2 && strcmp(argv[0], "acl") == 0 &&
+            strcmp(argv[1], "reload") == 0)
+    { return sr_ctl_acl_reload(sr, fp); }
+    else if(argc == 3 && strcmp(argv[0], "log") == 0 &&
+            strcmp(argv[1], "level") == 0)
+    {
+        sr_log_level = atoi(argv[2]);
+        return 0;
+    }
+
+    fprintf(fp, "unknown command, try: show routes|arp|interfaces|counters|"
+                "flows|acl, route add|del, arp flush, acl reload, log level <n>\n");
+    return -1;
+} /* -- sr_ctl_command -- */
+
+/* write what we can of the client's pending reply; -1 if it is gone */
+static int sr_ctl_flush(struct sr_ctl_client* c)
+{
+    ssize_t n;
+
+    while(c->outoff < c->outlen)
+    {
+        n = send(c->fd, c->out + c->outoff, c->outlen - c->outoff,
+                 MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(n < 0)
+        { return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1; }
+        c->outoff += n;
+    }
+    free(c->out);
+    c->out = 0;
+    c->outlen = c->outoff = 0;
+    return 0;
+} /* -- sr_ctl_flush -- */
+
+/* queue the header and body of one reply */
+static int sr_ctl_reply(struct sr_ctl_client* c, int status,
+                        const char* body, size_t len)
+{
+    char hdr[32];
+    int hlen = snprintf(hdr, sizeof(hdr), "%d %lu\n", status ? 1 : 0,
+                        (unsigned long)len);
+    char* out;
+
+    if(c->outlen - c->outoff + hlen + len > SR_CTL_OUT_MAX)
+    { return -1; }
+    out = (char*)realloc(c->out, c->outlen + hlen + len);
+    if(!out)
+    { return -1; }
+    memcpy(out + c->outlen, hdr, hlen);
+    memcpy(out + c->outlen + hlen, body, len);
+    c->out = out;
+    c->outlen += hlen + len;
+    return 0;
+} /* -- sr_ctl_reply -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_read(..)
+ * Scope:  Local
+ *
+ * Read what the client sent and answer every complete line.  Returns -1
+ * when the client should be dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_read(struct sr_ctl* ctl, struct sr_ctl_client* c)
+{
+    char* nl;
+    char* body = 0;
+    size_t blen = 0;
+    unsigned int used;
+    ssize_t n;
+    FILE* fp;
+    int status;
+
+    n = recv(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen, MSG_DONTWAIT);
+    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                  errno != EINTR))
+    { return -1; }
+    if(n < 0)
+    { return 0; }
+    c->inlen += n;
+
+    while((nl = memchr(c->in, '\n', c->inlen)) != 0)
+    {
+        *nl = 0;
+        used = nl + 1 - c->in;
+        if((fp = open_memstream(&body, &blen)) == 0)
+        { return -1; }
+        status = sr_ctl_command(ctl->sr, c->in, fp);
+        fclose(fp);
+        n = sr_ctl_reply(c, status, body, blen);
+        free(body);
+        body = 0;
+        if(n != 0)
+        { return -1; }
+        memmove(c->in, c->in + used, c->inlen - used);
+        c->inlen -= used;
+    }
+    if(c->inlen == sizeof(c->in))
+    { return -1; } /* line too long */
+    return sr_ctl_flush(c);
+} /* -- sr_ctl_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_service(..)
+ * Scope:  Global
+ *
+ * Act on the poll(2) results for the descriptors from sr_ctl_pollfds().
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ctl_service(struct sr_ctl* ctl, struct pollfd* fds)
+{
+    struct sr_ctl_client* c;
+    int i, fd;
+
+    /* backwards, so dropping a client only moves one already seen */
+    for(i = ctl->nclients - 1; i >= 0; i--)
+    {
+        c = &(ctl->clients[i]);
+        if(fds[i + 1].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            if(!(fds[i + 1].revents & POLLIN))
+            {
+                sr_ctl_drop_client(ctl, i);
+                continue;
+            }
+        }
+        if(((fds[i + 1].revents & POLLIN) && sr_ctl_read(ctl, c) != 0) ||
+           ((fds[i + 1].revents & POLLOUT) && sr_ctl_flush(c) != 0))
+        { sr_ctl_drop_client(ctl, i); }
+    }
+
+    if((fds[0].revents & POLLIN) && ctl->nclients < SR_CTL_MAX_CLIENTS)
+    {
+        if((fd = accept(ctl->fd, 0, 0)) < 0)
+        { return; }
+        if(sr_ctl_nonblock(fd) < 0)
+        {
+            close(fd);
+            return;
+        }
+        c = &(ctl->clients[ctl->nclients++]);
+        memset(c, 0, sizeof(*c));
+        c->fd = fd;
+    }
+} /* -- sr_ctl_service -- */
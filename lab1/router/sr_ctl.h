@@ -0,0 +1,68 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ *
+ * Description:
+ *
+ * Management socket (sr -c path).  A Unix stream socket served from the
+ * router's main loop between packets, so commands see a consistent routing
+ * table without locks and never hold up forwarding for longer than it
+ * takes to format one reply.  All sockets are non-blocking; a client that
+ * does not read its replies is dropped once SR_CTL_OUT_MAX bytes are
+ * waiting.
+ *
+ * Protocol: a request is one line of text,
+ *
+ *   show routes | show arp | show interfaces | show counters
+ *   show flows | show acl
+ *   route add <dest> <gateway> <mask> <interface>
+ *   route del <dest> <mask>
+ *   arp flush
+ *   acl reload                  (read the -A file again, see sr_acl.h)
+ *   log level <0|1>
+ *
+ * and the reply is a header line "<status> <length>\n", status 0 for
+ * success and 1 for an error, followed by exactly <length> bytes of text.
+ * srctl is a command line client.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#include <poll.h>
+#include <stddef.h>
+
+#include "sr_shm.h"     /* SR_SHM_PATHLEN */
+
+#define SR_CTL_MAX_CLIENTS 8
+#define SR_CTL_MAX_FDS     (SR_CTL_MAX_CLIENTS + 1)
+#define SR_CTL_LINE_MAX    256
+#define SR_CTL_OUT_MAX     (1 << 20)
+
+struct sr_instance;
+
+struct sr_ctl_client
+{
+    int fd;
+    char in[SR_CTL_LINE_MAX];
+    unsigned int inlen;
+    char* out;                 /* reply bytes not yet written */
+    size_t outlen;
+    size_t outoff;
+};
+
+struct sr_ctl
+{
+    int fd;                    /* listening socket */
+    char path[SR_SHM_PATHLEN];
+    struct sr_instance* sr;
+    struct sr_ctl_client clients[SR_CTL_MAX_CLIENTS];
+    int nclients;
+};
+
+struct sr_ctl* sr_ctl_open(struct sr_instance* sr, const char* path);
+void sr_ctl_close(struct sr_ctl* ctl);
+int  sr_ctl_pollfds(struct sr_ctl* ctl, struct pollfd* fds);
+void sr_ctl_service(struct sr_ctl* ctl, struct pollfd* fds);
+
+#endif /* -- SR_CTL_H -- */
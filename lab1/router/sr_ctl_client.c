@@ -0,0 +1,117 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl_client.c
+ *
+ * Description:
+ *
+ * srctl, command line client for the sr -c management socket (see
+ * sr_ctl.h for the commands).  Prints the reply and exits with its status.
+ *
+ *   usage: srctl [-c socket] command ...
+ *   e.g.   srctl -c /tmp/sr.ctl route add 10.0.3.0 10.0.1.2 255.255.255.0 eth1
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sr_ctl.h"
+
+#define SRCTL_DEFAULT_PATH "/tmp/sr.ctl"
+
+static int srctl_read(int fd, char* buf, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0)
+    {
+        if((n = read(fd, buf, len)) <= 0)
+        { return -1; }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+} /* -- srctl_read -- */
+
+int main(int argc, char** argv)
+{
+    const char* path = SRCTL_DEFAULT_PATH;
+    struct sockaddr_un addr;
+    char line[SR_CTL_LINE_MAX];
+    char hdr[32];
+    char* body;
+    unsigned long len;
+    size_t used = 0;
+    int fd, i, status;
+
+    i = 1;
+    if(argc > 2 && strcmp(argv[1], "-c") == 0)
+    {
+        path = argv[2];
+        i = 3;
+    }
+    if(i >= argc)
+    {
+        fprintf(stderr, "usage: %s [-c socket] command ...\n", argv[0]);
+        return 2;
+    }
+
+    for(line[0] = 0; i < argc; i++)
+    {
+        if(used + strlen(argv[i]) + 2 > sizeof(line))
+        {
+            fprintf(stderr, "%s: command too long\n", argv[0]);
+            return 2;
+        }
+        used += sprintf(line + used, "%s%s", used ? " " : "", argv[i]);
+    }
+    line[used++] = '\n';
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+       connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        perror(path);
+        return 2;
+    }
+    if(write(fd, line, used) != (ssize_t)used)
+    {
+        perror("write");
+        return 2;
+    }
+
+    /* "<status> <length>\n" */
+    for(i = 0; i < (int)sizeof(hdr) - 1; i++)
+    {
+        if(srctl_read(fd, hdr + i, 1) != 0)
+        {
+            fprintf(stderr, "%s: connection closed\n", argv[0]);
+            return 2;
+        }
+        if(hdr[i] == '\n')
+        { break; }
+    }
+    hdr[i] = 0;
+    if(sscanf(hdr, "%d %lu", &status, &len) != 2 || len > SR_CTL_OUT_MAX)
+    {
+        fprintf(stderr, "%s: bad reply header \"%s\"\n", argv[0], hdr);
+        return 2;
+    }
+
+    body = (char*)malloc(len + 1);
+    if(!body || srctl_read(fd, body, len) != 0)
+    {
+        fprintf(stderr, "%s: short reply\n", argv[0]);
+        return 2;
+    }
+    fwrite(body, 1, len, status ? stderr : stdout);
+    free(body);
+    close(fd);
+    return status;
+}
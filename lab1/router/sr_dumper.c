@@ -2,6 +2,11 @@
 #include <sys/types.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "sr_dumper.h"
 
 static void
@@ -69,3 +74,298 @@ sr_dump_close(FILE *fp)
   fclose(fp);
 }
 
+
+/*
+ * pcapng and rotating capture files (struct sr_dumpfile).
+ */
+
+#define PCAPNG_ALIGN(x) (((x) + 3) & ~3u)
+
+static size_t
+pcapng_opt(uint8_t *p, uint16_t code, const void *val, uint16_t len)
+{
+        memcpy(p, &code, 2);
+        memcpy(p + 2, &len, 2);
+        if (len)
+                memcpy(p + 4, val, len);
+        memset(p + 4 + len, 0, PCAPNG_ALIGN(len) - len);
+        return 4 + PCAPNG_ALIGN(len);
+}
+
+/* fill in both length fields of a block whose body ends at blk + len */
+static size_t
+pcapng_close_block(uint8_t *blk, size_t len)
+{
+        uint32_t total = len + 4;
+
+        memcpy(blk + 4, &total, 4);
+        memcpy(blk + len, &total, 4);
+        return total;
+}
+
+static size_t
+pcapng_shb(uint8_t *p)
+{
+        uint32_t type = PCAPNG_SHB_TYPE, bom = PCAPNG_BYTE_ORDER;
+        uint16_t major = 1, minor = 0;
+        int64_t section_len = -1;
+        size_t len = 8;
+
+        memcpy(p, &type, 4);
+        memcpy(p + len, &bom, 4);          len += 4;
+        memcpy(p + len, &major, 2);        len += 2;
+        memcpy(p + len, &minor, 2);        len += 2;
+        memcpy(p + len, &section_len, 8);  len += 8;
+        len += pcapng_opt(p + len, PCAPNG_OPT_SHB_APPL, "sr", 2);
+        len += pcapng_opt(p + len, PCAPNG_OPT_END, 0, 0);
+        return pcapng_close_block(p, len);
+}
+
+static size_t
+pcapng_idb(uint8_t *p, const char *name, uint32_t snaplen)
+{
+        uint32_t type = PCAPNG_IDB_TYPE;
+        uint16_t linktype = LINKTYPE_ETHERNET, reserved = 0;
+        uint8_t tsresol = 9; /* nanoseconds */
+        size_t len = 8;
+
+        memcpy(p, &type, 4);
+        memcpy(p + len, &linktype, 2);     len += 2;
+        memcpy(p + len, &reserved, 2);     len += 2;
+        memcpy(p + len, &snaplen, 4);      len += 4;
+        len += pcapng_opt(p + len, PCAPNG_OPT_IF_NAME, name, strlen(name));
+        len += pcapng_opt(p + len, PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+        len += pcapng_opt(p + len, PCAPNG_OPT_END, 0, 0);
+        return pcapng_close_block(p, len);
+}
+
+static size_t
+pcapng_epb(uint8_t *p, uint32_t ifid, uint32_t dir, uint64_t ts_ns,
+           const unsigned char *sp, uint32_t caplen, uint32_t len)
+{
+        uint32_t type = PCAPNG_EPB_TYPE;
+        uint32_t ts_hi = ts_ns >> 32, ts_lo = ts_ns & 0xffffffff;
+        size_t n = 8;
+
+        memcpy(p, &type, 4);
+        memcpy(p + n, &ifid, 4);           n += 4;
+        memcpy(p + n, &ts_hi, 4);          n += 4;
+        memcpy(p + n, &ts_lo, 4);          n += 4;
+        memcpy(p + n, &caplen, 4);         n += 4;
+        memcpy(p + n, &len, 4);            n += 4;
+        memcpy(p + n, sp, caplen);
+        memset(p + n + caplen, 0, PCAPNG_ALIGN(caplen) - caplen);
+        n += PCAPNG_ALIGN(caplen);
+        if (dir)
+                n += pcapng_opt(p + n, PCAPNG_OPT_EPB_FLAGS, &dir, 4);
+        n += pcapng_opt(p + n, PCAPNG_OPT_END, 0, 0);
+        return pcapng_close_block(p, n);
+}
+
+static size_t
+pcap_record(uint8_t *p, uint64_t ts_ns, const unsigned char *sp,
+            uint32_t caplen, uint32_t len)
+{
+        struct pcap_sf_pkthdr sf_hdr;
+
+        sf_hdr.ts.tv_sec  = ts_ns / 1000000000ull;
+        sf_hdr.ts.tv_usec = (ts_ns % 1000000000ull) / 1000;
+        sf_hdr.caplen     = caplen;
+        sf_hdr.len        = len;
+        memcpy(p, &sf_hdr, sizeof(sf_hdr));
+        memcpy(p + sizeof(sf_hdr), sp, caplen);
+        return sizeof(sf_hdr) + caplen;
+}
+
+static int
+sr_dumpfile_rotating(const struct sr_dumpfile *df)
+{
+        return df->max_bytes || df->max_secs;
+}
+
+static void
+sr_dumpfile_write(struct sr_dumpfile *df)
+{
+        size_t off = 0;
+        ssize_t n;
+
+        while (off < df->fill) {
+                if ((n = write(df->fd, df->buf + off, df->fill - off)) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        perror("write(..):sr_dumper.c::sr_dumpfile_write");
+                        break;
+                }
+                off += n;
+        }
+        df->fill = 0;
+}
+
+static void
+sr_dumpfile_end(struct sr_dumpfile *df)
+{
+        if (df->fd < 0)
+                return;
+        sr_dumpfile_write(df);
+        if (df->fd != STDOUT_FILENO) {
+                /* give back what was preallocated and not used */
+                if (df->max_bytes && ftruncate(df->fd, df->file_bytes) != 0)
+                        perror("ftruncate(..):sr_dumper.c::sr_dumpfile_end");
+                close(df->fd);
+        }
+        df->fd = -1;
+}
+
+/*
+ * Open ring slot df->cur and queue the file headers.
+ */
+static int
+sr_dumpfile_begin(struct sr_dumpfile *df, uint64_t ts_ns)
+{
+        char name[SR_DUMP_NAMELEN + 16];
+        struct pcap_file_header hdr;
+        unsigned int i;
+
+        if (df->base[0] == '-' && df->base[1] == '\0')
+                df->fd = STDOUT_FILENO;
+        else {
+                if (sr_dumpfile_rotating(df))
+                        snprintf(name, sizeof(name), "%s.%u", df->base, df->cur);
+                else
+                        snprintf(name, sizeof(name), "%s", df->base);
+                df->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (df->fd < 0) {
+                        fprintf(stderr, "sr_dumpfile: can't open %s\n", name);
+                        return -1;
+                }
+#ifdef _LINUX_
+                /* reserve the whole segment now; not every filesystem can */
+                if (df->max_bytes)
+                        (void)fallocate(df->fd, 0, 0, df->max_bytes);
+#endif /* _LINUX_ */
+        }
+
+        df->opened_ns = ts_ns;
+        if (df->format == SR_DUMP_PCAPNG) {
+                df->fill += pcapng_shb(df->buf + df->fill);
+                if (df->nifs == 0)
+                        df->fill += pcapng_idb(df->buf + df->fill, "sr",
+                                               df->snaplen);
+                for (i = 0; i < df->nifs; i++)
+                        df->fill += pcapng_idb(df->buf + df->fill,
+                                               df->ifnames[i], df->snaplen);
+        } else {
+                hdr.magic = TCPDUMP_MAGIC;
+                hdr.version_major = PCAP_VERSION_MAJOR;
+                hdr.version_minor = PCAP_VERSION_MINOR;
+                hdr.thiszone = 0;
+                hdr.snaplen = df->snaplen;
+                hdr.sigfigs = 0;
+                hdr.linktype = LINKTYPE_ETHERNET;
+                memcpy(df->buf + df->fill, &hdr, sizeof(hdr));
+                df->fill += sizeof(hdr);
+        }
+        df->file_bytes = df->fill;
+        return 0;
+}
+
+/*
+ * Set up a capture.  Nothing is created on disk until the first packet,
+ * by which time the interfaces are known.
+ */
+struct sr_dumpfile *
+sr_dumpfile_open(const char *base, int format, int snaplen,
+                 uint64_t max_bytes, unsigned int max_secs,
+                 unsigned int nfiles)
+{
+        struct sr_dumpfile *df;
+
+        if (strlen(base) >= SR_DUMP_NAMELEN) {
+                fprintf(stderr, "sr_dumpfile_open: name too long\n");
+                return (NULL);
+        }
+        df = (struct sr_dumpfile *)calloc(1, sizeof(*df));
+        if (df == NULL || (df->buf = malloc(SR_DUMP_BUF_SIZE)) == NULL) {
+                fprintf(stderr, "sr_dumpfile_open: out of memory\n");
+                free(df);
+                return (NULL);
+        }
+        strcpy(df->base, base);
+        df->format = format;
+        df->snaplen = snaplen;
+        df->max_bytes = max_bytes;
+        df->max_secs = max_secs;
+        df->nfiles = nfiles ? nfiles : 1;
+        df->fd = -1;
+        return df;
+}
+
+/*
+ * Name interface 'index' in the Interface Description Blocks.  Must be done
+ * before the first packet is logged.
+ */
+void
+sr_dumpfile_add_interface(struct sr_dumpfile *df, unsigned int index,
+                          const char *name)
+{
+        if (index >= SR_DUMP_MAX_IFS)
+                return;
+        strncpy(df->ifnames[index], name, sizeof(df->ifnames[index]) - 1);
+        if (index >= df->nifs)
+                df->nifs = index + 1;
+}
+
+/*
+ * Append one packet, moving to the next file of the ring first if this one
+ * is full or old enough.  Records from different threads can come a
+ * little out of order, so one older than the file does not age it.
+ */
+int
+sr_dumpfile_packet(struct sr_dumpfile *df, uint32_t ifindex, uint32_t dir,
+                   uint64_t ts_ns, const unsigned char *sp,
+                   uint32_t caplen, uint32_t len)
+{
+        size_t need = caplen + SR_DUMP_OVERHEAD;
+
+        if (df->fd >= 0 && sr_dumpfile_rotating(df) &&
+            df->fd != STDOUT_FILENO &&
+            ((df->max_bytes && df->file_bytes + need > df->max_bytes) ||
+             (df->max_secs && ts_ns > df->opened_ns &&
+              ts_ns - df->opened_ns >= df->max_secs * 1000000000ull))) {
+                sr_dumpfile_end(df);
+                df->cur = (df->cur + 1) % df->nfiles;
+        }
+        if (df->fd < 0 && sr_dumpfile_begin(df, ts_ns) != 0)
+                return -1;
+
+        if (df->fill + need > SR_DUMP_BUF_SIZE)
+                sr_dumpfile_write(df);
+
+        if (df->format == SR_DUMP_PCAPNG) {
+                if (ifindex >= df->nifs)
+                        ifindex = 0;
+                need = pcapng_epb(df->buf + df->fill, ifindex, dir, ts_ns,
+                                  sp, caplen, len);
+        } else
+                need = pcap_record(df->buf + df->fill, ts_ns, sp, caplen, len);
+        df->fill += need;
+        df->file_bytes += need;
+        return 0;
+}
+
+void
+sr_dumpfile_flush(struct sr_dumpfile *df)
+{
+        if (df->fd >= 0)
+                sr_dumpfile_write(df);
+}
+
+void
+sr_dumpfile_close(struct sr_dumpfile *df)
+{
+        if (df == NULL)
+                return;
+        sr_dumpfile_end(df);
+        free(df->buf);
+        free(df);
+}
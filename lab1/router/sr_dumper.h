@@ -3,6 +3,8 @@
  * format as well as a set of operations for logging.
  */
 
+#ifndef SR_DUMPER_H
+#define SR_DUMPER_H
 
 #ifdef _LINUX_
 #include <stdint.h>
@@ -12,6 +14,7 @@
 #include <inttypes.h>
 #endif /* _DARWIN_ */
 
+#include <stdio.h>
 #include <sys/time.h>
 
 #define PCAP_VERSION_MAJOR 2
@@ -77,3 +80,69 @@ void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
  * Close the file
  */
 void sr_dump_close(FILE *fp);
+
+/*
+ * pcapng (https://www.ietf.org/archive/id/draft-tuexen-opsawg-pcapng-05.html)
+ */
+
+#define PCAPNG_SHB_TYPE   0x0A0D0D0A /* section header block */
+#define PCAPNG_IDB_TYPE   0x00000001 /* interface description block */
+#define PCAPNG_EPB_TYPE   0x00000006 /* enhanced packet block */
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+
+#define PCAPNG_OPT_END        0
+#define PCAPNG_OPT_SHB_APPL   4
+#define PCAPNG_OPT_IF_NAME    2
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_EPB_FLAGS  2
+
+/* epb_flags direction bits */
+#define SR_DUMP_DIR_IN  1
+#define SR_DUMP_DIR_OUT 2
+
+/*
+ * A capture written to one file, or rotated through a ring of files
+ * <base>.0 .. <base>.<nfiles-1> by size and/or age.  Records are gathered
+ * in a large buffer and written with write(2); size-limited files are
+ * preallocated so that extending them does not stall the writer.
+ *
+ * Only the logger thread may touch an sr_dumpfile once packets flow.
+ */
+
+#define SR_DUMP_PCAP   0
+#define SR_DUMP_PCAPNG 1
+
+#define SR_DUMP_MAX_IFS   32
+#define SR_DUMP_BUF_SIZE  (1024 * 1024)
+#define SR_DUMP_OVERHEAD  64  /* largest per-record framing, either format */
+#define SR_DUMP_NAMELEN   256
+
+struct sr_dumpfile {
+  char base[SR_DUMP_NAMELEN];
+  int format;                  /* SR_DUMP_* */
+  int snaplen;
+  uint64_t max_bytes;          /* rotate when a file would exceed this, 0 never */
+  unsigned int max_secs;       /* rotate when a file is this old, 0 never */
+  unsigned int nfiles;         /* files in the ring, 1 disables rotation */
+  unsigned int cur;            /* ring slot being written */
+  int fd;                      /* -1 until the first packet */
+  uint64_t file_bytes;         /* written to fd plus pending in buf */
+  uint64_t opened_ns;          /* timestamp of the first packet in the file */
+  uint8_t* buf;
+  size_t fill;
+  char ifnames[SR_DUMP_MAX_IFS][32];
+  unsigned int nifs;
+};
+
+struct sr_dumpfile* sr_dumpfile_open(const char *base, int format, int snaplen,
+                                     uint64_t max_bytes, unsigned int max_secs,
+                                     unsigned int nfiles);
+void sr_dumpfile_add_interface(struct sr_dumpfile *df, unsigned int index,
+                               const char *name);
+int  sr_dumpfile_packet(struct sr_dumpfile *df, uint32_t ifindex, uint32_t dir,
+                        uint64_t ts_ns, const unsigned char *sp,
+                        uint32_t caplen, uint32_t len);
+void sr_dumpfile_flush(struct sr_dumpfile *df);
+void sr_dumpfile_close(struct sr_dumpfile *df);
+
+#endif /* -- SR_DUMPER_H -- */
@@ -0,0 +1,491 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_export.c
+ *
+ * Description:
+ *
+ * IPFIX messages, report ring and export thread of -X, see sr_export.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_export.h"
+
+#define SR_IPFIX_VERSION      10
+#define SR_IPFIX_HDR_LEN      16
+#define SR_IPFIX_SET_LEN      4
+#define SR_IPFIX_TEMPLATE_SET 2
+#define SR_IPFIX_OPTIONS_SET  3
+#define SR_IPFIX_FLOW_ID      256      /* template of the flow records */
+#define SR_IPFIX_SAMPLING_ID  257      /* options template, with -X sample */
+
+/* information elements of a flow record, in order */
+static const uint16_t sr_ipfix_flow[][2] =
+{
+    {   8, 4 },    /* sourceIPv4Address */
+    {  12, 4 },    /* destinationIPv4Address */
+    {   7, 2 },    /* sourceTransportPort */
+    {  11, 2 },    /* destinationTransportPort */
+    {   4, 1 },    /* protocolIdentifier */
+    {   6, 1 },    /* tcpControlBits */
+    { 136, 1 },    /* flowEndReason */
+    {   1, 8 },    /* octetDeltaCount */
+    {   2, 8 },    /* packetDeltaCount */
+    { 152, 8 },    /* flowStartMilliseconds */
+    { 153, 8 }     /* flowEndMilliseconds */
+};
+#define SR_IPFIX_FLOW_FIELDS (sizeof(sr_ipfix_flow) / sizeof(sr_ipfix_flow[0]))
+#define SR_IPFIX_FLOW_LEN    47
+
+/* scope observationDomainId, then selectorAlgorithm,
+ * samplingPacketInterval and samplingPacketSpace */
+static const uint16_t sr_ipfix_sampling[][2] =
+{
+    { 149, 4 }, { 304, 2 }, { 305, 4 }, { 306, 4 }
+};
+#define SR_IPFIX_SAMPLING_FIELDS \
+    (sizeof(sr_ipfix_sampling) / sizeof(sr_ipfix_sampling[0]))
+#define SR_IPFIX_COUNT_BASED  1        /* systematic count-based sampling */
+
+static uint64_t sr_export_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} /* -- sr_export_now -- */
+
+static __inline__ uint8_t* sr_put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v >> 8; p[1] = v;
+    return p + 2;
+}
+
+static __inline__ uint8_t* sr_put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    return p + 4;
+}
+
+static __inline__ uint8_t* sr_put64(uint8_t* p, uint64_t v)
+{
+    return sr_put32(sr_put32(p, (uint32_t)(v >> 32)), (uint32_t)v);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_export_templates(..)
+ * Scope:  Local
+ *
+ * The template set and, when sampling, the options template set and the
+ * sampling record, at 'p'.  Returns the end.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint8_t* sr_export_templates(struct sr_export* ex, uint8_t* p)
+{
+    uint8_t* set = p;
+    unsigned int i;
+
+    p = sr_put16(p + SR_IPFIX_SET_LEN, SR_IPFIX_FLOW_ID);
+    p = sr_put16(p, SR_IPFIX_FLOW_FIELDS);
+    for(i = 0; i < SR_IPFIX_FLOW_FIELDS; i++)
+    { p = sr_put16(sr_put16(p, sr_ipfix_flow[i][0]), sr_ipfix_flow[i][1]); }
+    sr_put16(sr_put16(set, SR_IPFIX_TEMPLATE_SET), p - set);
+
+    if(ex->sample <= 1)
+    { return p; }
+
+    set = p;
+    p = sr_put16(p + SR_IPFIX_SET_LEN, SR_IPFIX_SAMPLING_ID);
+    p = sr_put16(p, SR_IPFIX_SAMPLING_FIELDS);
+    p = sr_put16(p, 1);
+    for(i = 0; i < SR_IPFIX_SAMPLING_FIELDS; i++)
+    {
+        p = sr_put16(sr_put16(p, sr_ipfix_sampling[i][0]),
+                     sr_ipfix_sampling[i][1]);
+    }
+    sr_put16(sr_put16(set, SR_IPFIX_OPTIONS_SET), p - set);
+
+    set = p;
+    p = sr_put32(p + SR_IPFIX_SET_LEN, ex->domain);
+    p = sr_put16(p, SR_IPFIX_COUNT_BASED);
+    p = sr_put32(p, 1);
+    p = sr_put32(p, ex->sample - 1);
+    sr_put16(sr_put16(set, SR_IPFIX_SAMPLING_ID), p - set);
+    ex->seq++;
+    return p;
+} /* -- sr_export_templates -- */
+
+static uint8_t* sr_export_record(struct sr_export* ex, uint8_t* p,
+                                 const struct sr_export_rec* r)
+{
+    memcpy(p, &(r->src), 4);
+    memcpy(p + 4, &(r->dst), 4);
+    p = sr_put16(p + 8, r->sport);
+    p = sr_put16(p, r->dport);
+    *p++ = r->proto;
+    *p++ = r->tcp_flags;
+    *p++ = r->reason;
+    p = sr_put64(p, r->bytes);
+    p = sr_put64(p, r->pkts);
+    p = sr_put64(p, r->start + ex->wall);
+    return sr_put64(p, r->end + ex->wall);
+} /* -- sr_export_record -- */
+
+/* refill the bucket for the time since the last call; the burst is a
+ * second's worth, or a whole message if that is more */
+static void sr_export_refill(struct sr_export* ex, uint64_t now)
+{
+    uint64_t full = (uint64_t)ex->kbit * 1000;
+
+    if(full < SR_EXPORT_MTU * 8)
+    { full = SR_EXPORT_MTU * 8; }
+    if(now > ex->refilled)
+    {
+        ex->tokens += (now - ex->refilled) * ex->kbit;
+        if(ex->tokens > full)
+        { ex->tokens = full; }
+        ex->refilled = now;
+    }
+} /* -- sr_export_refill -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_export_send(..)
+ * Scope:  Local
+ *
+ * One message: the templates if they are due, then as many reports as
+ * fit.  Returns 0 without taking any if the bucket cannot pay for it
+ * yet.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_export_send(struct sr_export* ex, uint64_t now, int templates)
+{
+    uint8_t *p = ex->msg + SR_IPFIX_HDR_LEN, *set;
+    uint32_t head, tail, n = 0;
+    uint32_t seq = ex->seq;
+    ssize_t rc;
+
+    if(templates)
+    { p = sr_export_templates(ex, p); }
+
+    head = __atomic_load_n(&ex->head, __ATOMIC_ACQUIRE);
+    tail = ex->tail;
+    set = p;
+    p += SR_IPFIX_SET_LEN;
+    while(tail + n != head &&
+          p + SR_IPFIX_FLOW_LEN <= ex->msg + SR_EXPORT_MTU)
+    {
+        p = sr_export_record(ex, p,
+                             &(ex->ring[(tail + n) & (SR_EXPORT_RING - 1)]));
+        n++;
+    }
+    if(n)
+    { sr_put16(sr_put16(set, SR_IPFIX_FLOW_ID), p - set); }
+    else
+    { p = set; }
+
+    sr_export_refill(ex, now);
+    if(ex->tokens < (uint64_t)(p - ex->msg) * 8)
+    {
+        ex->seq = seq;                 /* the sampling record's */
+        return 0;
+    }
+    ex->tokens -= (uint64_t)(p - ex->msg) * 8;
+
+    sr_put16(ex->msg, SR_IPFIX_VERSION);
+    sr_put16(ex->msg + 2, p - ex->msg);
+    sr_put32(ex->msg + 4, (uint32_t)((now + ex->wall) / 1000));
+    sr_put32(ex->msg + 8, seq);
+    sr_put32(ex->msg + 12, ex->domain);
+
+    rc = write(ex->fd, ex->msg, p - ex->msg);
+    if(rc != p - ex->msg)
+    { ex->errors++; }
+    else
+    {
+        ex->messages++;
+        ex->bytes += rc;
+        ex->sent += n;
+    }
+    ex->seq += n;
+    if(templates)
+    { ex->templates_at = now; }
+    __atomic_store_n(&ex->tail, tail + n, __ATOMIC_RELEASE);
+    return 1;
+} /* -- sr_export_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_export_thread(..)
+ * Scope:  Local
+ *
+ * Send a message once there is a full one, a report has waited
+ * SR_EXPORT_FLUSH_MS or the templates are due; sleep otherwise.  After
+ * sr_export_close(), send what is left until the ring is empty or
+ * SR_EXPORT_DRAIN_MS is up.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_export_thread(void* arg)
+{
+    struct sr_export* ex = (struct sr_export*)arg;
+    uint64_t now, oldest = 0, deadline = 0;
+    uint32_t n, per_msg;
+    int templates;
+
+    per_msg = (SR_EXPORT_MTU - SR_IPFIX_HDR_LEN - SR_IPFIX_SET_LEN) /
+              SR_IPFIX_FLOW_LEN;
+    for(;;)
+    {
+        now = sr_export_now();
+        n = __atomic_load_n(&ex->head, __ATOMIC_ACQUIRE) - ex->tail;
+        if(!ex->running)
+        {
+            if(!deadline)
+            { deadline = now + SR_EXPORT_DRAIN_MS; }
+            if(n == 0 || now >= deadline)
+            { break; }
+        }
+        if(n && !oldest)
+        { oldest = now; }
+
+        templates = !ex->templates_at ||
+                    now - ex->templates_at >= SR_EXPORT_TEMPLATE_S * 1000;
+        if((templates || n >= per_msg || !ex->running ||
+            (n && now - oldest >= SR_EXPORT_FLUSH_MS)) &&
+           sr_export_send(ex, now, templates))
+        {
+            oldest = ex->tail != __atomic_load_n(&ex->head, __ATOMIC_ACQUIRE) ?
+                     now : 0;
+            continue;
+        }
+        usleep(SR_EXPORT_POLL_MS * 1000);
+    }
+    return 0;
+} /* -- sr_export_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_export_parse(..)
+ * Scope:  Local
+ *
+ * The options after the collector in -X, key=value each.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_export_item(struct sr_export* ex, char* item)
+{
+    static const char* keys[] = { "sample", "kbit", "active", "domain" };
+    static const unsigned long max[] = { SR_EXPORT_SAMPLE_MAX, 10000000,
+                                         86400, 0xffffffffUL };
+    unsigned long v;
+    char *eq, *end;
+    unsigned int i;
+
+    if((eq = strchr(item, '=')) == 0)
+    {
+        fprintf(stderr, "Error: -X option \"%s\" is not key=value\n", item);
+        return -1;
+    }
+    *eq = '\0';
+    for(i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        if(strcmp(item, keys[i]) != 0)
+        { continue; }
+        v = strtoul(eq + 1, &end, 10);
+        if(*end != '\0' || eq[1] == '\0' || v > max[i] || (i < 3 && v == 0))
+        {
+            fprintf(stderr, "Error: -X %s=\"%s\" is not a number in [%d, %lu]\n",
+                    item, eq + 1, i < 3, max[i]);
+            return -1;
+        }
+        if(i == 0)
+        { ex->sample = v; }
+        else if(i == 1)
+        { ex->kbit = v; }
+        else if(i == 2)
+        { ex->active = v; }
+        else
+        { ex->domain = v; }
+        return 0;
+    }
+    fprintf(stderr, "Error: unknown -X option \"%s\", expected sample, kbit,"
+            " active or domain\n", item);
+    return -1;
+} /* -- sr_export_item -- */
+
+static int sr_export_parse(struct sr_export* ex, const char* spec)
+{
+    char *copy, *item, *save = 0;
+    int rc = 0;
+
+    if((copy = strdup(spec)) == 0)
+    {
+        perror("strdup");
+        return -1;
+    }
+    item = strtok_r(copy, ",", &save);
+    if(!item || strlen(item) >= sizeof(ex->collector))
+    {
+        fprintf(stderr, "Error: -X needs a collector, a port or a file\n");
+        rc = -1;
+    }
+    else
+    { strcpy(ex->collector, item); }
+    for(item = strtok_r(0, ",", &save); item && rc == 0;
+        item = strtok_r(0, ",", &save))
+    { rc = sr_export_item(ex, item); }
+    free(copy);
+    return rc;
+} /* -- sr_export_parse -- */
+
+/* a connected UDP socket to 127.0.0.1 if the collector is a port number,
+ * else the file */
+static int sr_export_connect(struct sr_export* ex)
+{
+    struct sockaddr_in sin;
+    unsigned long port;
+    char* end;
+
+    port = strtoul(ex->collector, &end, 10);
+    if(*end != '\0')
+    {
+        if((ex->fd = open(ex->collector, O_WRONLY | O_CREAT | O_TRUNC,
+                          0644)) < 0)
+        {
+            perror(ex->collector);
+            return -1;
+        }
+        return 0;
+    }
+    if(port == 0 || port > 65535)
+    {
+        fprintf(stderr, "Error: -X port %s not in [1, 65535]\n", ex->collector);
+        return -1;
+    }
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons((uint16_t)port);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if((ex->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+       connect(ex->fd, (struct sockaddr*)&sin, sizeof(sin)) < 0)
+    {
+        perror("socket(..):sr_export.c::sr_export_connect");
+        if(ex->fd >= 0)
+        { close(ex->fd); }
+        return -1;
+    }
+    ex->udp = 1;
+    return 0;
+} /* -- sr_export_connect -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_export_open(..)
+ * Scope: Global
+ *
+ * Parse -X, open the collector and start the export thread.  Returns 0
+ * on failure.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_export* sr_export_open(const char* spec)
+{
+    struct sr_export* ex;
+    struct timespec rt;
+
+    if((ex = (struct sr_export*)calloc(1, sizeof(struct sr_export))) == 0)
+    {
+        perror("calloc");
+        return 0;
+    }
+    ex->fd = -1;
+    ex->sample = 1;
+    ex->kbit = SR_EXPORT_KBIT;
+    ex->active = SR_EXPORT_ACTIVE;
+    ex->domain = 1;
+    if(sr_export_parse(ex, spec) != 0 || sr_export_connect(ex) != 0)
+    {
+        free(ex);
+        return 0;
+    }
+    if((ex->ring = (struct sr_export_rec*)
+        calloc(SR_EXPORT_RING, sizeof(struct sr_export_rec))) == 0)
+    {
+        perror("calloc");
+        close(ex->fd);
+        free(ex);
+        return 0;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &rt);
+    ex->refilled = sr_export_now();
+    ex->wall = ((int64_t)rt.tv_sec * 1000 + rt.tv_nsec / 1000000) -
+               (int64_t)ex->refilled;
+    ex->tokens = (uint64_t)SR_EXPORT_MTU * 8;
+
+    ex->running = 1;
+    if(pthread_create(&(ex->thread), 0, sr_export_thread, ex) != 0)
+    {
+        perror("pthread_create(..):sr_export.c::sr_export_open");
+        close(ex->fd);
+        free(ex->ring);
+        free(ex);
+        return 0;
+    }
+    return ex;
+} /* -- sr_export_open -- */
+
+int sr_export_flow(struct sr_export* ex, const struct sr_export_rec* rec)
+{
+    uint32_t head = ex->head;
+
+    if(head - __atomic_load_n(&ex->tail, __ATOMIC_ACQUIRE) >= SR_EXPORT_RING)
+    {
+        ex->drops++;
+        return -1;
+    }
+    ex->ring[head & (SR_EXPORT_RING - 1)] = *rec;
+    __atomic_store_n(&ex->head, head + 1, __ATOMIC_RELEASE);
+    ex->queued++;
+    return 0;
+} /* -- sr_export_flow -- */
+
+void sr_export_dump(struct sr_export* ex, FILE* fp)
+{
+    if(!ex)
+    { return; }
+    fprintf(fp, "export to %s%s, 1 in %u sampled: %lu flow records in %lu"
+            " messages, %llu bytes, %lu dropped, %lu send errors\n",
+            ex->udp ? "udp 127.0.0.1:" : "", ex->collector, ex->sample,
+            ex->sent, ex->messages, ex->bytes, ex->drops, ex->errors);
+} /* -- sr_export_dump -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_export_close(..)
+ * Scope: Global
+ *
+ * Only once nothing reports any more.  What the drain leaves in the ring
+ * counts as dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_export_close(struct sr_export* ex)
+{
+    if(!ex)
+    { return; }
+    ex->running = 0;
+    pthread_join(ex->thread, 0);
+    ex->drops += ex->head - ex->tail;
+    sr_export_dump(ex, stdout);
+    close(ex->fd);
+    free(ex->ring);
+    free(ex);
+} /* -- sr_export_close -- */
@@ -0,0 +1,132 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_export.h
+ *
+ * Description:
+ *
+ * IPFIX (RFC 7011) export of the -F flow table (-X).  A flow is reported
+ * when it ends, idle-timed-out, on a FIN or RST, evicted for a new one or
+ * at exit, and every 'active' seconds while it lasts; a report carries
+ * the packets and bytes since the one before (delta counters) and the
+ * flow end reason.  With -X but no -F, sr keeps a table of
+ * SR_EXPORT_FLOWS flows.
+ *
+ *   -X collector[,sample=N][,kbit=N][,active=S][,domain=N]
+ *
+ *   collector  a port number, for UDP to 127.0.0.1, or a file to write
+ *              the IPFIX messages to one after the other (RFC 5655)
+ *   sample     count 1 in N datagrams (systematic count-based sampling),
+ *              default 1, every datagram
+ *   kbit       cap on the export, kbit/s, default SR_EXPORT_KBIT
+ *   active     active timeout, s, default SR_EXPORT_ACTIVE
+ *   domain     observation domain id, default 1
+ *
+ * Sampling is done by the flow table: the datagrams in between are not
+ * looked up at all, so they also go without a cached decision.  The
+ * counters exported are of the sampled datagrams; an options record with
+ * the sampling interval goes with the templates for the collector to
+ * scale them by.
+ *
+ * The flow table hands each report to sr_export_flow() under its lock,
+ * so there is one producer at a time.  The reports go through a ring of
+ * SR_EXPORT_RING records to an export thread, which packs them into
+ * messages of at most SR_EXPORT_MTU bytes, sends one when it is full or
+ * its oldest report has waited SR_EXPORT_FLUSH_MS, and resends the
+ * templates every SR_EXPORT_TEMPLATE_S.  A message waits for the kbit/s
+ * token bucket; while it does the ring fills up, and a report that finds
+ * it full is dropped and counted, so the forwarding path never waits on
+ * the collector.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EXPORT_H
+#define SR_EXPORT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SR_EXPORT_FLOWS       4096    /* table size without -F */
+#define SR_EXPORT_RING        8192    /* reports, a power of two */
+#define SR_EXPORT_MTU         1400    /* bytes per message */
+#define SR_EXPORT_KBIT        1000
+#define SR_EXPORT_ACTIVE      60      /* s */
+#define SR_EXPORT_SAMPLE_MAX  65536
+#define SR_EXPORT_FLUSH_MS    1000
+#define SR_EXPORT_TEMPLATE_S  60
+#define SR_EXPORT_POLL_MS     50      /* export thread sleep */
+#define SR_EXPORT_DRAIN_MS    2000    /* at most, at exit */
+
+/* flowEndReason */
+#define SR_EXPORT_END_IDLE    1
+#define SR_EXPORT_END_ACTIVE  2
+#define SR_EXPORT_END_FIN     3       /* FIN or RST */
+#define SR_EXPORT_END_EXIT    4
+#define SR_EXPORT_END_EVICTED 5       /* lack of resources */
+
+struct sr_export_rec
+{
+    uint32_t src;                  /* network byte order */
+    uint32_t dst;
+    uint16_t sport;                /* host byte order */
+    uint16_t dport;
+    uint8_t proto;
+    uint8_t tcp_flags;
+    uint8_t reason;                /* flowEndReason */
+    uint64_t pkts;                 /* since the last report */
+    uint64_t bytes;
+    uint64_t start;                /* ms, CLOCK_MONOTONIC */
+    uint64_t end;
+};
+
+/* head is only written under the flow table's lock, tail only by the
+ * export thread */
+struct sr_export
+{
+    char collector[128];
+    int fd;                        /* connected UDP socket or file */
+    int udp;
+    unsigned int sample;
+    unsigned int active;
+    unsigned int kbit;
+    uint32_t domain;
+    int64_t wall;                  /* ms, CLOCK_REALTIME - CLOCK_MONOTONIC */
+
+    struct sr_export_rec* ring;
+    volatile uint32_t head;
+    uint8_t pad0[64 - sizeof(uint32_t)];
+    volatile uint32_t tail;
+    uint8_t pad1[64 - sizeof(uint32_t)];
+
+    /* export thread only */
+    uint32_t seq;                  /* data records sent */
+    uint64_t tokens;               /* bits; kbit/s is bits per ms */
+    uint64_t refilled;             /* ms */
+    uint64_t templates_at;         /* ms, 0 for never */
+    uint8_t msg[SR_EXPORT_MTU];
+
+    unsigned long queued;          /* under the flow table's lock */
+    unsigned long drops;
+    unsigned long sent;            /* export thread */
+    unsigned long messages;
+    unsigned long long bytes;
+    unsigned long errors;
+
+    volatile int running;
+    pthread_t thread;
+};
+
+struct sr_export* sr_export_open(const char* spec);
+/* report a flow; never blocks, -1 if the ring is full */
+int  sr_export_flow(struct sr_export* ex, const struct sr_export_rec* rec);
+void sr_export_dump(struct sr_export* ex, FILE* fp);
+/* send what is queued, within SR_EXPORT_DRAIN_MS, and stop */
+void sr_export_close(struct sr_export* ex);
+
+#endif /* -- SR_EXPORT_H -- */
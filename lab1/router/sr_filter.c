@@ -0,0 +1,478 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.c
+ *
+ * Description:
+ *
+ * Compiler and interpreter for packet log filters, see sr_filter.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_filter.h"
+
+#define SR_FILTER_TOKLEN 32
+
+/* parser state */
+struct sr_fparse
+{
+    const char* p;                 /* next character of the expression */
+    char tok[SR_FILTER_TOKLEN];    /* current token, "" at the end */
+    struct sr_filter* f;
+    int depth;                     /* stack depth the program reaches */
+    int max_depth;
+    int error;
+};
+
+static void sr_fparse_expr(struct sr_fparse* ps);
+
+/*---------------------------------------------------------------------
+ * Method: sr_fparse_next(..)
+ * Scope:  Local
+ *
+ * Advance to the next token.  Parentheses and "!" are tokens of their
+ * own, "&&" and "||" likewise; anything else runs to the next blank or
+ * parenthesis.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fparse_next(struct sr_fparse* ps)
+{
+    int n = 0;
+
+    while(isspace((unsigned char)*ps->p))
+    { ps->p++; }
+
+    if(*ps->p == '(' || *ps->p == ')' || *ps->p == '!')
+    {
+        ps->tok[n++] = *ps->p++;
+    }
+    else if((ps->p[0] == '&' && ps->p[1] == '&') ||
+            (ps->p[0] == '|' && ps->p[1] == '|'))
+    {
+        ps->tok[n++] = *ps->p++;
+        ps->tok[n++] = *ps->p++;
+    }
+    else
+    {
+        while(*ps->p && !isspace((unsigned char)*ps->p) &&
+              *ps->p != '(' && *ps->p != ')' && *ps->p != '!' &&
+              n < SR_FILTER_TOKLEN - 1)
+        { ps->tok[n++] = *ps->p++; }
+    }
+    ps->tok[n] = '\0';
+} /* -- sr_fparse_next -- */
+
+static void sr_fparse_error(struct sr_fparse* ps, const char* what)
+{
+    if(!ps->error)
+    {
+        fprintf(stderr, "filter: %s near '%s'\n", what,
+                ps->tok[0] ? ps->tok : "end of expression");
+    }
+    ps->error = 1;
+}
+
+static int sr_fparse_is(struct sr_fparse* ps, const char* word)
+{
+    return strcmp(ps->tok, word) == 0;
+}
+
+/* append one instruction, keeping track of the stack depth it needs */
+static void sr_fparse_emit(struct sr_fparse* ps, uint32_t op, uint32_t k,
+                           uint32_t mask)
+{
+    struct sr_filter_insn* insn;
+
+    if(ps->f->len == SR_FILTER_MAX_INSNS)
+    {
+        sr_fparse_error(ps, "expression too long");
+        return;
+    }
+    insn = &(ps->f->prog[ps->f->len++]);
+    insn->op = op;
+    insn->k = k;
+    insn->mask = mask;
+
+    if(op == sr_fop_and || op == sr_fop_or)
+    { ps->depth--; }
+    else if(op != sr_fop_not)
+    {
+        if(++ps->depth > ps->max_depth)
+        { ps->max_depth = ps->depth; }
+    }
+} /* -- sr_fparse_emit -- */
+
+static int sr_fparse_number(struct sr_fparse* ps, uint32_t max, uint32_t* out)
+{
+    char* end = 0;
+    unsigned long v;
+
+    sr_fparse_next(ps);
+    v = strtoul(ps->tok, &end, 0);
+    if(ps->tok[0] == '\0' || *end != '\0' || v > max)
+    {
+        sr_fparse_error(ps, "expected a number");
+        return -1;
+    }
+    *out = (uint32_t)v;
+    return 0;
+} /* -- sr_fparse_number -- */
+
+/* A.B.C.D, or A.B.C.D/LEN when 'prefix' is set */
+static int sr_fparse_addr(struct sr_fparse* ps, int prefix, uint32_t* addr,
+                          uint32_t* mask)
+{
+    char buf[SR_FILTER_TOKLEN];
+    char* slash;
+    char* end = 0;
+    struct in_addr in;
+    unsigned long bits = 32;
+
+    sr_fparse_next(ps);
+    strncpy(buf, ps->tok, sizeof(buf));
+    if((slash = strchr(buf, '/')) != 0)
+    {
+        *slash++ = '\0';
+        bits = strtoul(slash, &end, 10);
+        if(!prefix || *slash == '\0' || *end != '\0' || bits > 32)
+        {
+            sr_fparse_error(ps, "bad prefix length");
+            return -1;
+        }
+    }
+    if(inet_pton(AF_INET, buf, &in) != 1)
+    {
+        sr_fparse_error(ps, "expected an IPv4 address");
+        return -1;
+    }
+    *mask = bits ? htonl(0xffffffffu << (32 - bits)) : 0;
+    *addr = in.s_addr & *mask;
+    return 0;
+} /* -- sr_fparse_addr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fparse_prim(..)
+ * Scope:  Local
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fparse_prim(struct sr_fparse* ps)
+{
+    uint32_t k = 0, mask = 0;
+    int dir = 0; /* 0 either, 1 src, 2 dst */
+
+    if(sr_fparse_is(ps, "arp"))
+    { sr_fparse_emit(ps, sr_fop_ethertype, ethertype_arp, 0); }
+    else if(sr_fparse_is(ps, "ip"))
+    { sr_fparse_emit(ps, sr_fop_ethertype, ethertype_ip, 0); }
+    else if(sr_fparse_is(ps, "tcp") || sr_fparse_is(ps, "udp"))
+    {
+        /* "tcp port N" is "tcp and port N" */
+        const char* save = ps->p;
+        k = sr_fparse_is(ps, "tcp") ? 6 : 17;
+        sr_fparse_emit(ps, sr_fop_ip_proto, k, 0);
+        sr_fparse_next(ps);
+        if(sr_fparse_is(ps, "port") || sr_fparse_is(ps, "src") ||
+           sr_fparse_is(ps, "dst"))
+        {
+            sr_fparse_prim(ps);
+            sr_fparse_emit(ps, sr_fop_and, 0, 0);
+            return; /* sr_fparse_prim() already moved past it */
+        }
+        ps->p = save;
+    }
+    else if(sr_fparse_is(ps, "icmp"))
+    {
+        /* "icmp type N" or plain "icmp" */
+        const char* save = ps->p;
+        sr_fparse_next(ps);
+        if(sr_fparse_is(ps, "type"))
+        {
+            if(sr_fparse_number(ps, 255, &k) == 0)
+            { sr_fparse_emit(ps, sr_fop_icmp_type, k, 0); }
+        }
+        else
+        {
+            ps->p = save;
+            sr_fparse_emit(ps, sr_fop_ip_proto, ip_protocol_icmp, 0);
+        }
+    }
+    else if(sr_fparse_is(ps, "ether"))
+    {
+        sr_fparse_next(ps);
+        if(!sr_fparse_is(ps, "proto"))
+        { sr_fparse_error(ps, "expected 'proto'"); return; }
+        if(sr_fparse_number(ps, 0xffff, &k) == 0)
+        { sr_fparse_emit(ps, sr_fop_ethertype, k, 0); }
+    }
+    else if(sr_fparse_is(ps, "proto"))
+    {
+        if(sr_fparse_number(ps, 255, &k) == 0)
+        { sr_fparse_emit(ps, sr_fop_ip_proto, k, 0); }
+    }
+    else
+    {
+        if(sr_fparse_is(ps, "src") || sr_fparse_is(ps, "dst"))
+        {
+            dir = sr_fparse_is(ps, "src") ? 1 : 2;
+            sr_fparse_next(ps);
+        }
+
+        if(sr_fparse_is(ps, "host") || sr_fparse_is(ps, "net"))
+        {
+            if(sr_fparse_addr(ps, sr_fparse_is(ps, "net"), &k, &mask) == 0)
+            {
+                sr_fparse_emit(ps, dir == 1 ? sr_fop_ip_src :
+                               dir == 2 ? sr_fop_ip_dst : sr_fop_ip_any,
+                               k, mask);
+            }
+        }
+        else if(sr_fparse_is(ps, "port"))
+        {
+            if(sr_fparse_number(ps, 0xffff, &k) == 0)
+            {
+                sr_fparse_emit(ps, dir == 1 ? sr_fop_port_src :
+                               dir == 2 ? sr_fop_port_dst : sr_fop_port_any,
+                               k, 0);
+            }
+        }
+        else
+        {
+            sr_fparse_error(ps, dir ? "expected 'host', 'net' or 'port'" :
+                            "unknown primitive");
+            return;
+        }
+    }
+    sr_fparse_next(ps);
+} /* -- sr_fparse_prim -- */
+
+static void sr_fparse_factor(struct sr_fparse* ps)
+{
+    if(sr_fparse_is(ps, "not") || sr_fparse_is(ps, "!"))
+    {
+        sr_fparse_next(ps);
+        sr_fparse_factor(ps);
+        sr_fparse_emit(ps, sr_fop_not, 0, 0);
+    }
+    else if(sr_fparse_is(ps, "("))
+    {
+        sr_fparse_next(ps);
+        sr_fparse_expr(ps);
+        if(!sr_fparse_is(ps, ")"))
+        { sr_fparse_error(ps, "expected ')'"); return; }
+        sr_fparse_next(ps);
+    }
+    else if(ps->tok[0] == '\0')
+    { sr_fparse_error(ps, "expected a primitive"); }
+    else
+    { sr_fparse_prim(ps); }
+} /* -- sr_fparse_factor -- */
+
+static void sr_fparse_term(struct sr_fparse* ps)
+{
+    sr_fparse_factor(ps);
+    while(!ps->error && (sr_fparse_is(ps, "and") || sr_fparse_is(ps, "&&")))
+    {
+        sr_fparse_next(ps);
+        sr_fparse_factor(ps);
+        sr_fparse_emit(ps, sr_fop_and, 0, 0);
+    }
+} /* -- sr_fparse_term -- */
+
+static void sr_fparse_expr(struct sr_fparse* ps)
+{
+    sr_fparse_term(ps);
+    while(!ps->error && (sr_fparse_is(ps, "or") || sr_fparse_is(ps, "||")))
+    {
+        sr_fparse_next(ps);
+        sr_fparse_term(ps);
+        sr_fparse_emit(ps, sr_fop_or, 0, 0);
+    }
+} /* -- sr_fparse_expr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_compile(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_filter* sr_filter_compile(const char* expr)
+{
+    struct sr_fparse ps;
+
+    /* -- REQUIRES -- */
+    assert(expr);
+
+    memset(&ps, 0, sizeof(ps));
+    ps.p = expr;
+    ps.f = (struct sr_filter*)calloc(1, sizeof(struct sr_filter));
+    assert(ps.f);
+
+    sr_fparse_next(&ps);
+    sr_fparse_expr(&ps);
+    if(!ps.error && ps.tok[0] != '\0')
+    { sr_fparse_error(&ps, "trailing input"); }
+    if(!ps.error && ps.max_depth > SR_FILTER_MAX_STACK)
+    { sr_fparse_error(&ps, "expression nested too deeply"); }
+
+    if(ps.error)
+    {
+        free(ps.f);
+        return 0;
+    }
+    return ps.f;
+} /* -- sr_filter_compile -- */
+
+void sr_filter_destroy(struct sr_filter* f)
+{
+    free(f);
+} /* -- sr_filter_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_match(..)
+ * Scope:  Global
+ *
+ * Headers are looked at once, up front; a field the frame does not have
+ * (ports of an ARP, the ICMP type of a non-first fragment, ...) simply
+ * never matches.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_filter_match(const struct sr_filter* f, const uint8_t* buf,
+                    unsigned int len)
+{
+    const struct sr_filter_insn* insn = f->prog;
+    const struct sr_filter_insn* end = f->prog + f->len;
+    const sr_ip_hdr_t* ip = 0;
+    const uint8_t* l4 = 0;
+    uint32_t ethertype = 0;
+    uint32_t sport = 0, dport = 0;
+    int has_ports = 0, has_icmp = 0;
+    uint8_t stack[SR_FILTER_MAX_STACK];
+    int sp = 0;
+    unsigned int hl;
+
+    if(len < sizeof(sr_ethernet_hdr_t))
+    { return 0; }
+    ethertype = (buf[12] << 8) | buf[13];
+
+    if(ethertype == ethertype_ip && len >= sizeof(sr_ethernet_hdr_t) +
+                                           sizeof(sr_ip_hdr_t))
+    {
+        ip = (const sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+        hl = ip->ip_hl * 4;
+        if((ntohs(ip->ip_off) & IP_OFFMASK) == 0 &&
+           len >= sizeof(sr_ethernet_hdr_t) + hl + 4)
+        {
+            l4 = buf + sizeof(sr_ethernet_hdr_t) + hl;
+            if(ip->ip_p == 6 || ip->ip_p == 17)
+            {
+                sport = (l4[0] << 8) | l4[1];
+                dport = (l4[2] << 8) | l4[3];
+                has_ports = 1;
+            }
+            else if(ip->ip_p == ip_protocol_icmp)
+            { has_icmp = 1; }
+        }
+    }
+
+    for(; insn < end; insn++)
+    {
+        switch(insn->op)
+        {
+            case sr_fop_ethertype:
+                stack[sp++] = (ethertype == insn->k);
+                break;
+            case sr_fop_ip_src:
+                stack[sp++] = ip && (ip->ip_src & insn->mask) == insn->k;
+                break;
+            case sr_fop_ip_dst:
+                stack[sp++] = ip && (ip->ip_dst & insn->mask) == insn->k;
+                break;
+            case sr_fop_ip_any:
+                stack[sp++] = ip && ((ip->ip_src & insn->mask) == insn->k ||
+                                     (ip->ip_dst & insn->mask) == insn->k);
+                break;
+            case sr_fop_ip_proto:
+                stack[sp++] = ip && ip->ip_p == insn->k;
+                break;
+            case sr_fop_port_src:
+                stack[sp++] = has_ports && sport == insn->k;
+                break;
+            case sr_fop_port_dst:
+                stack[sp++] = has_ports && dport == insn->k;
+                break;
+            case sr_fop_port_any:
+                stack[sp++] = has_ports && (sport == insn->k ||
+                                            dport == insn->k);
+                break;
+            case sr_fop_icmp_type:
+                stack[sp++] = has_icmp && l4[0] == insn->k;
+                break;
+            case sr_fop_and:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] & stack[sp];
+                break;
+            case sr_fop_or:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] | stack[sp];
+                break;
+            case sr_fop_not:
+                stack[sp - 1] = !stack[sp - 1];
+                break;
+        }
+    }
+
+    return sp ? stack[sp - 1] : 1;
+} /* -- sr_filter_match -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_filter_print(..)
+ * Scope:  Global
+ *
+ * Dump the compiled program, one instruction per line.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_filter_print(const struct sr_filter* f)
+{
+    static const char* names[] = {
+        "ethertype", "ip_src", "ip_dst", "ip_any", "ip_proto",
+        "port_src", "port_dst", "port_any", "icmp_type", "and", "or", "not"
+    };
+    struct in_addr a, m;
+    unsigned int i;
+
+    for(i = 0; i < f->len; i++)
+    {
+        const struct sr_filter_insn* insn = &(f->prog[i]);
+        switch(insn->op)
+        {
+            case sr_fop_ip_src:
+            case sr_fop_ip_dst:
+            case sr_fop_ip_any:
+                a.s_addr = insn->k;
+                m.s_addr = insn->mask;
+                printf("  %2u %-9s %s", i, names[insn->op], inet_ntoa(a));
+                printf("/%s\n", inet_ntoa(m));
+                break;
+            case sr_fop_and:
+            case sr_fop_or:
+            case sr_fop_not:
+                printf("  %2u %s\n", i, names[insn->op]);
+                break;
+            default:
+                printf("  %2u %-9s %u\n", i, names[insn->op], insn->k);
+        }
+    }
+} /* -- sr_filter_print -- */
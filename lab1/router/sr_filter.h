@@ -0,0 +1,82 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_filter.h
+ *
+ * Description:
+ *
+ * Capture filter for the -l packet log.  An expression in a small subset
+ * of the tcpdump/BPF language is compiled once, at startup, into postfix
+ * bytecode for a stack machine.  sr_filter_match() decodes the frame's
+ * headers once and runs the program, so frames that are not wanted are
+ * rejected before they are timestamped or copied.
+ *
+ * Grammar:
+ *
+ *   expr    := term { ("or" | "||") term }
+ *   term    := factor { ("and" | "&&") factor }
+ *   factor  := ("not" | "!") factor | "(" expr ")" | prim
+ *   prim    := "arp" | "ip" | "tcp" | "udp" | "icmp"
+ *            | "ether" "proto" NUM
+ *            | "proto" NUM                       IP protocol number
+ *            | ["src" | "dst"] "host" A.B.C.D
+ *            | ["src" | "dst"] "net" A.B.C.D/LEN
+ *            | ["tcp" | "udp"] ["src" | "dst"] "port" NUM
+ *            | "icmp" "type" NUM
+ *
+ * Without "src" or "dst" a host, net or port matches either end.
+ * Example:  -f "icmp type 3 or (dst net 10.0.1.0/24 and tcp port 80)"
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FILTER_H
+#define SR_FILTER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_FILTER_MAX_INSNS 64
+#define SR_FILTER_MAX_STACK 16
+
+enum sr_filter_op {
+  sr_fop_ethertype,   /* k = ethertype */
+  sr_fop_ip_src,      /* (src & mask) == k, network byte order */
+  sr_fop_ip_dst,
+  sr_fop_ip_any,
+  sr_fop_ip_proto,    /* k = protocol */
+  sr_fop_port_src,    /* k = port, tcp or udp */
+  sr_fop_port_dst,
+  sr_fop_port_any,
+  sr_fop_icmp_type,   /* k = type */
+  sr_fop_and,
+  sr_fop_or,
+  sr_fop_not
+};
+
+struct sr_filter_insn
+{
+  uint32_t op;
+  uint32_t k;
+  uint32_t mask;
+};
+
+struct sr_filter
+{
+  struct sr_filter_insn prog[SR_FILTER_MAX_INSNS];
+  unsigned int len;
+};
+
+/* returns 0 and prints a message on a syntax error */
+struct sr_filter* sr_filter_compile(const char* expr);
+void sr_filter_destroy(struct sr_filter* f);
+
+/* nonzero if the ethernet frame matches */
+int  sr_filter_match(const struct sr_filter* f, const uint8_t* buf,
+                     unsigned int len);
+
+void sr_filter_print(const struct sr_filter* f);
+
+#endif /* -- SR_FILTER_H -- */
@@ -0,0 +1,623 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_flow.c
+ *
+ * Description:
+ *
+ * Robin Hood hash, LRU list and timer wheel of the -F flow table, see
+ * sr_flow.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_flow.h"
+#include "sr_export.h"
+
+#define SR_FLOW_TH_FIN 0x01
+#define SR_FLOW_TH_RST 0x04
+
+static uint64_t sr_flow_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+} /* -- sr_flow_now -- */
+
+/* to -X, what the flow did since its last report, if anything */
+static void sr_flow_report(struct sr_flow_table* ft, struct sr_flow* f,
+                           uint8_t reason)
+{
+    struct sr_export_rec r;
+
+    if(!ft->export || f->pkts == f->reported_pkts)
+    { return; }
+    r.src = f->key.src;
+    r.dst = f->key.dst;
+    r.sport = f->key.sport;
+    r.dport = f->key.dport;
+    r.proto = f->key.proto;
+    r.tcp_flags = f->tcp_flags;
+    r.reason = reason;
+    r.pkts = f->pkts - f->reported_pkts;
+    r.bytes = f->bytes - f->reported_bytes;
+    r.start = f->reported_at ? f->reported_at : f->first;
+    r.end = f->last;
+    sr_export_flow(ft->export, &r);
+    f->reported_pkts = f->pkts;
+    f->reported_bytes = f->bytes;
+    f->reported_at = f->last;
+} /* -- sr_flow_report -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flow_create(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_flow_table* sr_flow_create(unsigned int max)
+{
+    struct sr_flow_table* ft;
+    unsigned int i, size = 1;
+
+    if(max < SR_FLOW_MIN || max > SR_FLOW_MAX)
+    {
+        fprintf(stderr, "Error: -F takes %d to %d flows\n", SR_FLOW_MIN,
+                SR_FLOW_MAX);
+        return 0;
+    }
+    /* at most 7/8 full */
+    while(size < max + max / 7 + 1)
+    { size <<= 1; }
+
+    if((ft = (struct sr_flow_table*)
+        calloc(1, sizeof(struct sr_flow_table))) == 0 ||
+       (ft->flows = (struct sr_flow*)calloc(max, sizeof(struct sr_flow))) == 0 ||
+       (ft->slots = (struct sr_flow_slot*)
+        calloc(size, sizeof(struct sr_flow_slot))) == 0)
+    {
+        perror("calloc");
+        if(ft)
+        { free(ft->flows); }
+        free(ft);
+        return 0;
+    }
+    pthread_mutex_init(&(ft->lock), 0);
+    ft->gen = 1;
+    ft->sample = 1;
+    ft->max = max;
+    ft->mask = size - 1;
+    for(i = 0; i < max; i++)
+    { ft->flows[i].lru_next = i + 1 < max ? i + 1 : SR_FLOW_NONE; }
+    ft->free = 0;
+    ft->lru_head = ft->lru_tail = SR_FLOW_NONE;
+    for(i = 0; i < SR_FLOW_WHEEL; i++)
+    { ft->wheel[i] = SR_FLOW_NONE; }
+    ft->wheel_now = (uint32_t)(sr_flow_now() / 1000);
+    return ft;
+} /* -- sr_flow_create -- */
+
+void sr_flow_destroy(struct sr_flow_table* ft)
+{
+    uint32_t idx;
+
+    if(!ft)
+    { return; }
+    for(idx = ft->lru_head; idx != SR_FLOW_NONE; idx = ft->flows[idx].lru_next)
+    { sr_flow_report(ft, &(ft->flows[idx]), SR_EXPORT_END_EXIT); }
+    pthread_mutex_destroy(&(ft->lock));
+    free(ft->slots);
+    free(ft->flows);
+    free(ft);
+} /* -- sr_flow_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_flow_parse(..)
+ * Scope:  Local
+ *
+ * The flow key and TCP flags of the datagram in an ethernet frame, -1
+ * if there is no IPv4 header.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_flow_parse(const uint8_t* buf, unsigned int len,
+                         struct sr_flow_key* k, uint8_t* tcp_flags)
+{
+    const sr_ip_hdr_t* ip = (const sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+    const uint8_t* l4;
+    unsigned int hl;
+
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    { return -1; }
+    len -= sizeof(sr_ethernet_hdr_t);
+    hl = ip->ip_hl * 4;
+    l4 = (const uint8_t*)ip + hl;
+
+    memset(k, 0, sizeof(*k));
+    k->src = ip->ip_src;
+    k->dst = ip->ip_dst;
+    k->proto = ip->ip_p;
+    *tcp_flags = 0;
+    if((ip->ip_p == ip_protocol_tcp || ip->ip_p == ip_protocol_udp) &&
+       (ntohs(ip->ip_off) & IP_OFFMASK) == 0 && len >= hl + 4)
+    {
+        k->sport = l4[0] << 8 | l4[1];
+        k->dport = l4[2] << 8 | l4[3];
+        if(ip->ip_p == ip_protocol_tcp && len >= hl + 14)
+        { *tcp_flags = l4[13]; }
+    }
+    return 0;
+} /* -- sr_flow_parse -- */
+
+static __inline__ uint32_t sr_flow_hash(const struct sr_flow_key* k)
+{
+    uint64_t h;
+
+    h = ((uint64_t)k->src << 32 | k->dst) * 0x9e3779b97f4a7c15ULL;
+    h ^= ((uint64_t)k->sport << 24 | (uint64_t)k->dport << 8 | k->proto) *
+         0xc2b2ae3d27d4eb4fULL;
+    h ^= h >> 29;
+    return (uint32_t)(h ^ (h >> 32));
+} /* -- sr_flow_hash -- */
+
+static __inline__ int sr_flow_key_eq(const struct sr_flow_key* a,
+                                     const struct sr_flow_key* b)
+{
+    return a->src == b->src && a->dst == b->dst && a->sport == b->sport &&
+           a->dport == b->dport && a->proto == b->proto;
+} /* -- sr_flow_key_eq -- */
+
+/* how far slot 'i' is from the home of 'hash' */
+#define SR_FLOW_DIST(ft, i, hash) (((i) - (hash)) & (ft)->mask)
+
+/*---------------------------------------------------------------------
+ * Method: sr_flow_find(..)
+ * Scope:  Local
+ *
+ * The record of 'k', or SR_FLOW_NONE.  Slots are in order of distance
+ * from home within a run, so a slot nearer its home than we are to ours
+ * means the key is not there.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_flow_find(struct sr_flow_table* ft,
+                             const struct sr_flow_key* k, uint32_t hash)
+{
+    uint32_t i = hash & ft->mask, d = 0;
+    const struct sr_flow_slot* s;
+
+    for(;;)
+    {
+        s = &(ft->slots[i]);
+        if(!s->flow || SR_FLOW_DIST(ft, i, s->hash) < d)
+        { return SR_FLOW_NONE; }
+        if(s->hash == hash && sr_flow_key_eq(&(ft->flows[s->flow - 1].key), k))
+        { return s->flow - 1; }
+        i = (i + 1) & ft->mask;
+        d++;
+    }
+} /* -- sr_flow_find -- */
+
+/* insert, taking the slot of anything nearer its home than we are */
+static void sr_flow_slot_add(struct sr_flow_table* ft, uint32_t hash,
+                             uint32_t idx)
+{
+    struct sr_flow_slot e, t;
+    uint32_t i = hash & ft->mask, d = 0, sd;
+
+    e.hash = hash;
+    e.flow = idx + 1;
+    while(ft->slots[i].flow)
+    {
+        sd = SR_FLOW_DIST(ft, i, ft->slots[i].hash);
+        if(sd < d)
+        {
+            t = ft->slots[i];
+            ft->slots[i] = e;
+            e = t;
+            d = sd;
+        }
+        i = (i + 1) & ft->mask;
+        d++;
+    }
+    ft->slots[i] = e;
+} /* -- sr_flow_slot_add -- */
+
+/* remove, shifting the rest of the run back a slot */
+static void sr_flow_slot_del(struct sr_flow_table* ft, uint32_t hash,
+                             uint32_t idx)
+{
+    uint32_t i = hash & ft->mask, j;
+
+    while(ft->slots[i].flow != idx + 1)
+    { i = (i + 1) & ft->mask; }
+    for(j = (i + 1) & ft->mask;
+        ft->slots[j].flow && SR_FLOW_DIST(ft, j, ft->slots[j].hash) != 0;
+        j = (j + 1) & ft->mask)
+    {
+        ft->slots[i] = ft->slots[j];
+        i = j;
+    }
+    ft->slots[i].flow = 0;
+} /* -- sr_flow_slot_del -- */
+
+static void sr_flow_lru_unlink(struct sr_flow_table* ft, uint32_t idx)
+{
+    struct sr_flow* f = &(ft->flows[idx]);
+
+    if(f->lru_prev != SR_FLOW_NONE)
+    { ft->flows[f->lru_prev].lru_next = f->lru_next; }
+    else
+    { ft->lru_head = f->lru_next; }
+    if(f->lru_next != SR_FLOW_NONE)
+    { ft->flows[f->lru_next].lru_prev = f->lru_prev; }
+    else
+    { ft->lru_tail = f->lru_prev; }
+} /* -- sr_flow_lru_unlink -- */
+
+static void sr_flow_lru_push(struct sr_flow_table* ft, uint32_t idx)
+{
+    struct sr_flow* f = &(ft->flows[idx]);
+
+    f->lru_prev = SR_FLOW_NONE;
+    f->lru_next = ft->lru_head;
+    if(ft->lru_head != SR_FLOW_NONE)
+    { ft->flows[ft->lru_head].lru_prev = idx; }
+    else
+    { ft->lru_tail = idx; }
+    ft->lru_head = idx;
+} /* -- sr_flow_lru_push -- */
+
+static void sr_flow_wheel_unlink(struct sr_flow_table* ft, uint32_t idx)
+{
+    struct sr_flow* f = &(ft->flows[idx]);
+
+    if(f->wheel_prev != SR_FLOW_NONE)
+    { ft->flows[f->wheel_prev].wheel_next = f->wheel_next; }
+    else
+    { ft->wheel[f->wheel_at & (SR_FLOW_WHEEL - 1)] = f->wheel_next; }
+    if(f->wheel_next != SR_FLOW_NONE)
+    { ft->flows[f->wheel_next].wheel_prev = f->wheel_prev; }
+} /* -- sr_flow_wheel_unlink -- */
+
+/* into the slot of its timeout or report, or the furthest one the wheel
+ * has */
+static void sr_flow_wheel_link(struct sr_flow_table* ft, uint32_t idx)
+{
+    struct sr_flow* f = &(ft->flows[idx]);
+    uint32_t at = f->expires, b;
+
+    if(ft->export && (int32_t)(f->report - at) < 0)
+    { at = f->report; }
+
+    if((int32_t)(at - ft->wheel_now) < 1)
+    { at = ft->wheel_now + 1; }
+    if(at - ft->wheel_now > SR_FLOW_WHEEL - 1)
+    { at = ft->wheel_now + SR_FLOW_WHEEL - 1; }
+
+    b = at & (SR_FLOW_WHEEL - 1);
+    f->wheel_at = at;
+    f->wheel_prev = SR_FLOW_NONE;
+    f->wheel_next = ft->wheel[b];
+    if(ft->wheel[b] != SR_FLOW_NONE)
+    { ft->flows[ft->wheel[b]].wheel_prev = idx; }
+    ft->wheel[b] = idx;
+} /* -- sr_flow_wheel_link -- */
+
+static uint32_t sr_flow_timeout(const struct sr_flow* f)
+{
+    if(f->key.proto == ip_protocol_tcp)
+    {
+        return (f->tcp_flags & (SR_FLOW_TH_FIN | SR_FLOW_TH_RST)) ?
+               SR_FLOW_FIN_TIMEOUT : SR_FLOW_TCP_TIMEOUT;
+    }
+    if(f->key.proto == ip_protocol_udp)
+    { return SR_FLOW_UDP_TIMEOUT; }
+    return SR_FLOW_ICMP_TIMEOUT;
+} /* -- sr_flow_timeout -- */
+
+/* take the flow out of the hash, the LRU list and the wheel */
+static void sr_flow_remove(struct sr_flow_table* ft, uint32_t idx, int wheel)
+{
+    struct sr_flow* f = &(ft->flows[idx]);
+
+    sr_flow_slot_del(ft, f->hash, idx);
+    sr_flow_lru_unlink(ft, idx);
+    if(wheel)
+    { sr_flow_wheel_unlink(ft, idx); }
+    f->pkts = 0;
+    f->lru_next = ft->free;
+    ft->free = idx;
+    ft->active--;
+} /* -- sr_flow_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_flow_new(..)
+ * Scope:  Local
+ *
+ * A record for a new flow: a free one, or the least recently used.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_flow_new(struct sr_flow_table* ft,
+                            const struct sr_flow_key* k, uint32_t hash,
+                            uint64_t now)
+{
+    struct sr_flow* f;
+    uint32_t idx;
+
+    if(ft->free == SR_FLOW_NONE)
+    {
+        sr_flow_report(ft, &(ft->flows[ft->lru_tail]), SR_EXPORT_END_EVICTED);
+        sr_flow_remove(ft, ft->lru_tail, 1);
+        ft->evicted++;
+    }
+    idx = ft->free;
+    f = &(ft->flows[idx]);
+    ft->free = f->lru_next;
+
+    memset(f, 0, sizeof(*f));
+    f->key = *k;
+    f->hash = hash;
+    f->first = now;
+    sr_flow_slot_add(ft, hash, idx);
+    sr_flow_lru_push(ft, idx);
+    f->expires = (uint32_t)(now / 1000) + sr_flow_timeout(f);
+    if(ft->export)
+    { f->report = (uint32_t)(now / 1000) + ft->export->active; }
+    sr_flow_wheel_link(ft, idx);
+    ft->active++;
+    ft->created++;
+    return idx;
+} /* -- sr_flow_new -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flow_packet(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_flow_packet(struct sr_flow_table* ft, const uint8_t* buf,
+                   unsigned int len, uint32_t* handle,
+                   struct sr_flow_fwd* fwd)
+{
+    struct sr_flow_key k;
+    struct sr_flow* f;
+    uint8_t tcp_flags;
+    uint32_t hash, idx, expires;
+    uint64_t now;
+    int valid;
+
+    *handle = 0;
+    if(ft->sample > 1 && ++ft->skip < ft->sample)
+    { return 0; }
+    ft->skip = 0;
+    if(sr_flow_parse(buf, len, &k, &tcp_flags) != 0)
+    { return 0; }
+    hash = sr_flow_hash(&k);
+    now = sr_flow_now();
+
+    pthread_mutex_lock(&(ft->lock));
+    ft->lookups++;
+    if((idx = sr_flow_find(ft, &k, hash)) == SR_FLOW_NONE)
+    { idx = sr_flow_new(ft, &k, hash, now); }
+    else if(ft->lru_head != idx)
+    {
+        sr_flow_lru_unlink(ft, idx);
+        sr_flow_lru_push(ft, idx);
+    }
+
+    f = &(ft->flows[idx]);
+    f->pkts++;
+    f->bytes += len - sizeof(sr_ethernet_hdr_t);
+    f->last = now;
+    f->tcp_flags |= tcp_flags;
+    expires = (uint32_t)(now / 1000) + sr_flow_timeout(f);
+    f->expires = expires;
+    if((int32_t)(expires - f->wheel_at) < 0)
+    {
+        /* FIN or RST: sooner than the slot it waits in */
+        sr_flow_wheel_unlink(ft, idx);
+        sr_flow_wheel_link(ft, idx);
+    }
+
+    valid = f->fwd.gen == ft->gen;
+    if(valid)
+    {
+        *fwd = f->fwd;
+        ft->hits++;
+    }
+    *handle = idx + 1;
+    pthread_mutex_unlock(&(ft->lock));
+    return valid;
+} /* -- sr_flow_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flow_cache(..)
+ * Scope: Global
+ *
+ * The flow can only have gone if the ARP thread timed it out since
+ * sr_flow_packet(); its record is not reused before the next packet.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_flow_cache(struct sr_flow_table* ft, uint32_t handle,
+                   const struct sr_flow_fwd* fwd)
+{
+    struct sr_flow* f;
+
+    if(!handle)
+    { return; }
+    pthread_mutex_lock(&(ft->lock));
+    f = &(ft->flows[handle - 1]);
+    if(f->pkts)
+    {
+        f->fwd = *fwd;
+        f->fwd.gen = ft->gen;
+    }
+    pthread_mutex_unlock(&(ft->lock));
+} /* -- sr_flow_cache -- */
+
+void sr_flow_export(struct sr_flow_table* ft, struct sr_export* ex)
+{
+    uint32_t now = (uint32_t)(sr_flow_now() / 1000), idx;
+
+    pthread_mutex_lock(&(ft->lock));
+    ft->export = ex;
+    ft->sample = ex ? ex->sample : 1;
+    ft->skip = 0;
+    for(idx = ft->lru_head; idx != SR_FLOW_NONE; idx = ft->flows[idx].lru_next)
+    { ft->flows[idx].report = ex ? now + ex->active : 0; }
+    pthread_mutex_unlock(&(ft->lock));
+} /* -- sr_flow_export -- */
+
+void sr_flow_invalidate(struct sr_flow_table* ft)
+{
+    if(!ft)
+    { return; }
+    pthread_mutex_lock(&(ft->lock));
+    if(++ft->gen == 0)
+    { ft->gen = 1; }
+    pthread_mutex_unlock(&(ft->lock));
+} /* -- sr_flow_invalidate -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flow_age(..)
+ * Scope: Global
+ *
+ * Turn the wheel to now, a slot per second.  Each slot's flows either
+ * time out or, if they were used since they were put there, move on to
+ * the slot of their new timeout.  With -X, a flow whose active timeout
+ * is up is reported on the way.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_flow_age(struct sr_flow_table* ft)
+{
+    uint32_t now = (uint32_t)(sr_flow_now() / 1000);
+    uint32_t t, idx, next;
+    struct sr_flow* f;
+
+    if(!ft)
+    { return; }
+    pthread_mutex_lock(&(ft->lock));
+    if(now - ft->wheel_now > SR_FLOW_WHEEL)
+    { ft->wheel_now = now - SR_FLOW_WHEEL; }
+
+    while((int32_t)(now - ft->wheel_now) > 0)
+    {
+        t = ++ft->wheel_now;
+        idx = ft->wheel[t & (SR_FLOW_WHEEL - 1)];
+        ft->wheel[t & (SR_FLOW_WHEEL - 1)] = SR_FLOW_NONE;
+        for(; idx != SR_FLOW_NONE; idx = next)
+        {
+            f = &(ft->flows[idx]);
+            next = f->wheel_next;
+            if((int32_t)(f->expires - t) <= 0)
+            {
+                sr_flow_report(ft, f, (f->tcp_flags & (SR_FLOW_TH_FIN |
+                               SR_FLOW_TH_RST)) ? SR_EXPORT_END_FIN :
+                               SR_EXPORT_END_IDLE);
+                sr_flow_remove(ft, idx, 0);
+                ft->expired++;
+                continue;
+            }
+            if(ft->export && (int32_t)(f->report - t) <= 0)
+            {
+                sr_flow_report(ft, f, SR_EXPORT_END_ACTIVE);
+                f->report = t + ft->export->active;
+            }
+            sr_flow_wheel_link(ft, idx);
+        }
+    }
+    pthread_mutex_unlock(&(ft->lock));
+} /* -- sr_flow_age -- */
+
+static void sr_flow_print_end(char* buf, uint32_t addr, uint16_t port,
+                              uint8_t proto)
+{
+    struct in_addr in;
+
+    in.s_addr = addr;
+    if(proto == ip_protocol_tcp || proto == ip_protocol_udp)
+    { sprintf(buf, "%s:%u", inet_ntoa(in), (unsigned int)port); }
+    else
+    { sprintf(buf, "%s", inet_ntoa(in)); }
+} /* -- sr_flow_print_end -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flow_dump(..)
+ * Scope: Global
+ *
+ * Copies the top flows out under the lock and prints them after.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_flow_dump(struct sr_flow_table* ft, FILE* fp)
+{
+    struct sr_flow top[SR_FLOW_TOP];
+    unsigned long long created, expired, evicted;
+    unsigned int active;
+    double cached;
+    char src[32], dst[32], proto[8];
+    unsigned int ntop = 0, i, j;
+    uint32_t idx;
+    uint64_t now;
+
+    if(!ft)
+    { return; }
+
+    pthread_mutex_lock(&(ft->lock));
+    now = sr_flow_now();
+    active = ft->active;
+    created = ft->created;
+    expired = ft->expired;
+    evicted = ft->evicted;
+    cached = ft->lookups ? 100.0 * ft->hits / ft->lookups : 0.0;
+    for(idx = ft->lru_head; idx != SR_FLOW_NONE; idx = ft->flows[idx].lru_next)
+    {
+        if(ntop == SR_FLOW_TOP && ft->flows[idx].bytes <= top[ntop - 1].bytes)
+        { continue; }
+        for(i = ntop < SR_FLOW_TOP ? ntop++ : ntop - 1;
+            i > 0 && top[i - 1].bytes < ft->flows[idx].bytes; i--)
+        { top[i] = top[i - 1]; }
+        top[i] = ft->flows[idx];
+    }
+    pthread_mutex_unlock(&(ft->lock));
+
+    fprintf(fp, "flows %u of %u, created %llu, expired %llu, evicted %llu,"
+            " %.1f%% of datagrams decided from the cache\n", active, ft->max,
+            created, expired, evicted, cached);
+    sr_export_dump(ft->export, fp);
+    if(!ntop)
+    { return; }
+    fprintf(fp, "%-5s %-21s %-21s %10s %14s %8s %8s\n", "proto", "source",
+            "destination", "packets", "bytes", "age s", "idle s");
+    for(j = 0; j < ntop; j++)
+    {
+        sr_flow_print_end(src, top[j].key.src, top[j].key.sport,
+                          top[j].key.proto);
+        sr_flow_print_end(dst, top[j].key.dst, top[j].key.dport,
+                          top[j].key.proto);
+        if(top[j].key.proto == ip_protocol_icmp)
+        { strcpy(proto, "icmp"); }
+        else if(top[j].key.proto == ip_protocol_tcp)
+        { strcpy(proto, "tcp"); }
+        else if(top[j].key.proto == ip_protocol_udp)
+        { strcpy(proto, "udp"); }
+        else
+        { sprintf(proto, "%u", (unsigned int)top[j].key.proto); }
+        fprintf(fp, "%-5s %-21s %-21s %10llu %14llu %8.1f %8.1f\n", proto,
+                src, dst, (unsigned long long)top[j].pkts,
+                (unsigned long long)top[j].bytes,
+                (now - top[j].first) / 1000.0, (now - top[j].last) / 1000.0);
+    }
+} /* -- sr_flow_dump -- */
@@ -0,0 +1,182 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_flow.h
+ *
+ * Description:
+ *
+ * Flow table (-F entries).  Every IPv4 datagram with a good header
+ * checksum is counted against its flow, the 5-tuple of protocol,
+ * addresses and, for tcp and udp, ports (0 for anything else and for
+ * fragments after the first, as in sr_acl.h).  A flow remembers what the
+ * router decided for its first datagram, the -A rule it matched, whether
+ * it is addressed to the router and otherwise its route, so the ones
+ * after it skip the access list and the routing table.  Changing either
+ * (sr_add_rt_entry(), sr_del_rt_entry(), "acl reload") bumps the table's
+ * generation, and a decision from an older one is worked out again.
+ *
+ * The table never grows: the flow records are allocated up front, and a
+ * new flow when all are in use takes the least recently used one
+ * ("evicted").  Lookups are Robin Hood hashing over an array of 8 byte
+ * slots, hash and record index, at most 7/8 full: a probe compares
+ * hashes within a cache line or two and reads a record only when they
+ * match, and a miss stops as soon as it meets a slot closer to its home
+ * than the key would be.
+ *
+ * A flow is idle-timed-out after
+ *
+ *   tcp        SR_FLOW_TCP_TIMEOUT, SR_FLOW_FIN_TIMEOUT once FIN or RST
+ *              was seen
+ *   udp        SR_FLOW_UDP_TIMEOUT
+ *   otherwise  SR_FLOW_ICMP_TIMEOUT
+ *
+ * ("expired"), on a wheel of one second slots turned by the ARP thread.
+ * A flow is put in the slot of its timeout when created and left there
+ * while it sees traffic; when the slot comes round, a flow that was used
+ * since moves to the slot of its new timeout.  A FIN or RST moves it to
+ * an earlier slot at once.
+ *
+ * With -X (sr_export.h) each flow is reported when it ends and every
+ * active timeout while it lasts, which the wheel also keeps: a flow
+ * waits in the slot of whichever is sooner.  Sampling 1 in N datagrams
+ * is done here too; the others are not looked up at all.
+ *
+ * The packet thread, the ARP thread's aging and the dump share the table
+ * under its lock.  The dump is part of sr_stats_dump(), the SIGUSR1, exit
+ * and "show counters" output, and of "show flows" on the management
+ * socket: the table's counts and the flows that moved the most bytes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FLOW_H
+#define SR_FLOW_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SR_FLOW_MIN          64
+#define SR_FLOW_MAX          (1 << 22)
+
+#define SR_FLOW_TCP_TIMEOUT  120     /* s */
+#define SR_FLOW_FIN_TIMEOUT  10
+#define SR_FLOW_UDP_TIMEOUT  30
+#define SR_FLOW_ICMP_TIMEOUT 10
+
+#define SR_FLOW_WHEEL        256     /* one second slots, a power of two */
+#define SR_FLOW_TOP          10      /* flows in the dump */
+#define SR_FLOW_NONE         0xffffffff
+
+struct sr_instance;
+struct sr_if;
+struct sr_rt;
+struct sr_acl_rule;
+struct sr_export;
+
+struct sr_flow_key
+{
+    uint32_t src;                  /* network byte order */
+    uint32_t dst;
+    uint16_t sport;                /* host byte order */
+    uint16_t dport;
+    uint8_t proto;
+};
+
+/* what was decided for the flow's first datagram */
+struct sr_flow_fwd
+{
+    uint32_t gen;                  /* of the table, 0 for nothing yet */
+    struct sr_acl_rule* acl;       /* rule matched, 0 for none */
+    struct sr_if* local;           /* addressed to the router, else 0 */
+    struct sr_rt* rt;              /* route if not local, 0 for none */
+};
+
+struct sr_flow
+{
+    struct sr_flow_key key;
+    uint32_t hash;
+    uint8_t tcp_flags;             /* of all its segments */
+
+    uint64_t pkts;
+    uint64_t bytes;                /* IP datagrams */
+    uint64_t first;                /* ms, CLOCK_MONOTONIC */
+    uint64_t last;
+
+    uint32_t expires;              /* s */
+    uint32_t wheel_at;             /* s, of the slot it is in */
+    uint32_t lru_prev;             /* towards the most recently used */
+    uint32_t lru_next;             /* also links the free records */
+    uint32_t wheel_prev;
+    uint32_t wheel_next;
+
+    uint32_t report;               /* s, next active timeout with -X */
+    uint64_t reported_pkts;        /* as of the last report */
+    uint64_t reported_bytes;
+    uint64_t reported_at;          /* ms, 0 for none yet */
+
+    struct sr_flow_fwd fwd;
+};
+
+struct sr_flow_slot
+{
+    uint32_t hash;
+    uint32_t flow;                 /* index + 1, 0 for an empty slot */
+};
+
+struct sr_flow_table
+{
+    pthread_mutex_t lock;
+    uint32_t gen;                  /* of the routes and access list */
+
+    struct sr_flow* flows;         /* 'max' records */
+    unsigned int max;
+    unsigned int active;
+    uint32_t free;                 /* first unused record */
+    uint32_t lru_head;             /* most recently used */
+    uint32_t lru_tail;
+
+    struct sr_flow_slot* slots;
+    uint32_t mask;                 /* slots - 1 */
+
+    uint32_t wheel[SR_FLOW_WHEEL]; /* first flow in each slot */
+    uint32_t wheel_now;            /* s, last second aged */
+
+    struct sr_export* export;      /* -X, 0 for none */
+    unsigned int sample;           /* count 1 in this many datagrams */
+    unsigned int skip;             /* since the last one, packet thread */
+
+    uint64_t lookups;
+    uint64_t hits;                 /* found with a decision still valid */
+    uint64_t created;
+    uint64_t expired;
+    uint64_t evicted;
+};
+
+struct sr_flow_table* sr_flow_create(unsigned int max);
+/* reports every flow left with -X; the caller closes the export after */
+void sr_flow_destroy(struct sr_flow_table* ft);
+
+/* count the datagram in the ethernet frame 'buf' against its flow, made
+ * if it is new; *handle names the flow for sr_flow_cache().  Returns 1
+ * with the flow's decision in *fwd if it is still valid. */
+int  sr_flow_packet(struct sr_flow_table* ft, const uint8_t* buf,
+                    unsigned int len, uint32_t* handle,
+                    struct sr_flow_fwd* fwd);
+/* remember the decision made for the datagram sr_flow_packet() counted */
+void sr_flow_cache(struct sr_flow_table* ft, uint32_t handle,
+                   const struct sr_flow_fwd* fwd);
+/* report flows to 'ex' from now on, sampling as it says */
+void sr_flow_export(struct sr_flow_table* ft, struct sr_export* ex);
+/* forget every cached decision, after a change to routes or -A */
+void sr_flow_invalidate(struct sr_flow_table* ft);
+
+/* time out idle flows; once a second from the ARP thread */
+void sr_flow_age(struct sr_flow_table* ft);
+void sr_flow_dump(struct sr_flow_table* ft, FILE* fp);
+
+#endif /* -- SR_FLOW_H -- */
@@ -54,6 +54,34 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
     return 0;
 } /* -- sr_get_interface -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Given the position of an interface in the hardware info return the
+ * interface record or 0 if it doesn't exist.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, uint32_t index)
+{
+    struct sr_if* if_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if_walker = sr->if_list;
+
+    while(if_walker)
+    {
+       if(if_walker->index == index)
+        { return if_walker; }
+        if_walker = if_walker->next;
+    }
+
+    return 0;
+} /* -- sr_get_interface_by_index -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_destroy_interface(..)
  * Scope: Global
@@ -96,6 +124,9 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
         sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
         assert(sr->if_list);
         sr->if_list->next = 0;
+        sr->if_list->index = 0;
+        sr->if_list->mtu = 0;
+        sr->if_list->speed = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
         return;
     }
@@ -107,8 +138,11 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
 
     if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
     assert(if_walker->next);
+    if_walker->next->index = if_walker->index + 1;
     if_walker = if_walker->next;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
+    if_walker->mtu = 0;
+    if_walker->speed = 0;
     if_walker->next = 0;
 } /* -- sr_add_interface -- */ 
 
@@ -160,6 +194,53 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
 } /* -- sr_set_ether_ip -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_ether_mtu(..)
+ * Scope: Global
+ *
+ * set the MTU of the LAST interface in the interface list
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_set_ether_mtu(struct sr_instance* sr, uint32_t mtu)
+{
+    struct sr_if* if_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr->if_list);
+    
+    if_walker = sr->if_list;
+    while(if_walker->next)
+    {if_walker = if_walker->next; }
+
+    if_walker->mtu = mtu;
+
+} /* -- sr_set_ether_mtu -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_ether_speed(..)
+ * Scope: Global
+ *
+ * set the link speed, in Mbit/s, of the LAST interface in the interface
+ * list
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_set_ether_speed(struct sr_instance* sr, uint32_t mbit)
+{
+    struct sr_if* if_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr->if_list);
+    
+    if_walker = sr->if_list;
+    while(if_walker->next)
+    {if_walker = if_walker->next; }
+
+    if_walker->speed = mbit;
+
+} /* -- sr_set_ether_speed -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_print_if_list(..)
  * Scope: Global
@@ -199,16 +280,21 @@ void sr_print_if_list(struct sr_instance* sr)
 
 void sr_print_if(struct sr_if* iface)
 {
+#ifdef _DEBUG_
     struct in_addr ip_addr;
+#endif /* _DEBUG_ */
 
     /* -- REQUIRES --*/
     assert(iface);
     assert(iface->name);
 
+#ifdef _DEBUG_
     ip_addr.s_addr = iface->ip;
+#endif /* _DEBUG_ */
 
     Debug("%s\tHWaddr",iface->name);
     DebugMAC(iface->addr);
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
+    Debug("\tmtu %u\n",iface->mtu);
 } /* -- sr_print_if -- */
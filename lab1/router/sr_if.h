@@ -40,15 +40,20 @@ struct sr_if
   char name[sr_IFACE_NAMELEN];
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
-  uint32_t speed;
+  uint32_t speed; /* Mbit/s from VNSHWINFO, 0 if not given */
+  uint32_t mtu;   /* largest IP datagram sent out of this interface */
+  uint32_t index; /* position in VNSHWINFO, used by batched frames */
   struct sr_if* next;
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, uint32_t index);
 void sr_destroy_interface(struct sr_instance* sr);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
+void sr_set_ether_mtu(struct sr_instance*, uint32_t mtu);
+void sr_set_ether_speed(struct sr_instance*, uint32_t mbit);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
 
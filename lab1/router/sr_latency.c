@@ -0,0 +1,240 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_latency.c
+ *
+ * Description:
+ *
+ * Per-thread latency histograms and their percentiles, see sr_latency.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_latency.h"
+
+__thread struct sr_lat_block* sr_lat_self = 0;
+unsigned int sr_lat_sample = SR_LAT_SAMPLE_DEFAULT;
+
+static struct sr_lat_block* sr_lat_blocks = 0;
+static pthread_mutex_t sr_lat_lock = PTHREAD_MUTEX_INITIALIZER;
+static double sr_lat_ns_per_tick = 1.0;
+
+#define SR_LAT_NAME(id, name) name,
+static const char* sr_lat_stage_names[] = { SR_LAT_STAGES(SR_LAT_NAME) 0 };
+static const char* sr_lat_path_names[] = { SR_LAT_PATHS(SR_LAT_NAME) 0 };
+#undef SR_LAT_NAME
+
+static uint64_t sr_lat_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- sr_lat_now_ns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_latency_init(..)
+ * Scope:  Global
+ *
+ * Time one packet in 'sample' (0 for none) and measure the tick rate so
+ * the dump can print ns.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_latency_init(unsigned int sample)
+{
+    uint64_t t0, n0, t1, n1;
+
+    sr_lat_sample = sample;
+
+    n0 = sr_lat_now_ns();
+    t0 = sr_trace_ticks();
+    usleep(20000);
+    t1 = sr_trace_ticks();
+    n1 = sr_lat_now_ns();
+    if(t1 > t0)
+    { sr_lat_ns_per_tick = (double)(n1 - n0) / (double)(t1 - t0); }
+} /* -- sr_latency_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_lat_thread_block(..)
+ * Scope:  Global
+ *
+ * Slow path of sr_lat_begin(): give the calling thread its histograms.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_lat_block* sr_lat_thread_block(void)
+{
+    struct sr_lat_block* b = 0;
+
+    if(posix_memalign((void**)&b, 64, sizeof(struct sr_lat_block)) != 0)
+    { b = 0; }
+    assert(b);
+    memset(b, 0, sizeof(struct sr_lat_block));
+    b->countdown = 1;
+
+    pthread_mutex_lock(&sr_lat_lock);
+    b->next = sr_lat_blocks;
+    sr_lat_blocks = b;
+    pthread_mutex_unlock(&sr_lat_lock);
+
+    sr_lat_self = b;
+    return b;
+} /* -- sr_lat_thread_block -- */
+
+/* the middle of bucket 'i', in ticks */
+static double sr_lat_bucket_value(unsigned int i)
+{
+    unsigned int e;
+    uint64_t width;
+
+    if(i < SR_LAT_SUB)
+    { return i; }
+    e = i / SR_LAT_SUB + SR_LAT_SUB_BITS - 1;
+    width = 1ull << (e - SR_LAT_SUB_BITS);
+    return (double)((SR_LAT_SUB + i % SR_LAT_SUB) * width) + width / 2.0;
+} /* -- sr_lat_bucket_value -- */
+
+/* value below which fraction 'q' of the samples in 'h' fall, in ticks */
+static double sr_lat_percentile(const struct sr_lat_hist* h, double q)
+{
+    uint64_t want = (uint64_t)(q * h->count + 0.5), seen = 0;
+    unsigned int i;
+
+    if(want == 0)
+    { want = 1; }
+    for(i = 0; i < SR_LAT_BUCKETS; i++)
+    {
+        seen += h->bucket[i];
+        if(seen >= want)
+        { return sr_lat_bucket_value(i); }
+    }
+    return (double)h->max;
+} /* -- sr_lat_percentile -- */
+
+static void sr_lat_add(struct sr_lat_hist* to,
+                       const volatile struct sr_lat_hist* from)
+{
+    unsigned int i;
+
+    to->count += from->count;
+    to->sum += from->sum;
+    if(from->max > to->max)
+    { to->max = from->max; }
+    for(i = 0; i < SR_LAT_BUCKETS; i++)
+    { to->bucket[i] += from->bucket[i]; }
+} /* -- sr_lat_add -- */
+
+static void sr_lat_print(FILE* fp, const char* name,
+                         const struct sr_lat_hist* h)
+{
+    double ns = sr_lat_ns_per_tick;
+
+    if(h->count == 0)
+    { return; }
+    fprintf(fp, "  %-12s %10llu %8.0f %8.0f %8.0f %8.0f %8.0f %10.0f\n",
+            name, (unsigned long long)h->count,
+            ns * h->sum / h->count,
+            ns * sr_lat_percentile(h, 0.50),
+            ns * sr_lat_percentile(h, 0.90),
+            ns * sr_lat_percentile(h, 0.99),
+            ns * sr_lat_percentile(h, 0.999),
+            ns * h->max);
+} /* -- sr_lat_print -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_latency_sum(..)
+ * Scope:  Global
+ *
+ * Add up the histograms of all threads into 'stage' (sr_lat_nstages of
+ * them) and 'total' (sr_lat_npaths).
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_latency_sum(struct sr_lat_hist* stage, struct sr_lat_hist* total)
+{
+    const volatile struct sr_lat_block* b;
+    int i;
+
+    memset(stage, 0, sr_lat_nstages * sizeof(struct sr_lat_hist));
+    memset(total, 0, sr_lat_npaths * sizeof(struct sr_lat_hist));
+
+    pthread_mutex_lock(&sr_lat_lock);
+    for(b = sr_lat_blocks; b; b = b->next)
+    {
+        for(i = 0; i < sr_lat_nstages; i++)
+        { sr_lat_add(&stage[i], &(b->stage[i])); }
+        for(i = 0; i < sr_lat_npaths; i++)
+        { sr_lat_add(&total[i], &(b->total[i])); }
+    }
+    pthread_mutex_unlock(&sr_lat_lock);
+} /* -- sr_latency_sum -- */
+
+/* bucket 'i' and the sum of a histogram in ns, for other renderings */
+double sr_latency_bucket_ns(unsigned int i)
+{
+    return sr_lat_ns_per_tick * sr_lat_bucket_value(i);
+} /* -- sr_latency_bucket_ns -- */
+
+/* for histograms kept in other units, e.g. the -Q queueing times in ns */
+double sr_latency_percentile(const struct sr_lat_hist* h, double q)
+{
+    return sr_lat_percentile(h, q);
+} /* -- sr_latency_percentile -- */
+
+double sr_latency_bucket(unsigned int i)
+{
+    return sr_lat_bucket_value(i);
+} /* -- sr_latency_bucket -- */
+
+double sr_latency_ticks_ns(uint64_t ticks)
+{
+    return sr_lat_ns_per_tick * ticks;
+} /* -- sr_latency_ticks_ns -- */
+
+const char* sr_latency_stage_name(int stage)
+{
+    return sr_lat_stage_names[stage];
+} /* -- sr_latency_stage_name -- */
+
+const char* sr_latency_path_name(int path)
+{
+    return sr_lat_path_names[path];
+} /* -- sr_latency_path_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_latency_dump(..)
+ * Scope:  Global
+ *
+ * Print count, mean and percentiles in ns for every stage and path that
+ * saw a timed packet.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_latency_dump(FILE* fp)
+{
+    static struct sr_lat_hist stage[sr_lat_nstages], total[sr_lat_npaths];
+    static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+    int i;
+
+    if(!sr_lat_blocks)
+    { return; }
+
+    /* static for their size, the lock keeps two dumps apart */
+    pthread_mutex_lock(&dump_lock);
+    sr_latency_sum(stage, total);
+
+    fprintf(fp, "latency in ns, 1 in %u packets timed\n", sr_lat_sample);
+    fprintf(fp, "  %-12s %10s %8s %8s %8s %8s %8s %10s\n", "stage/path",
+            "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for(i = 0; i < sr_lat_nstages; i++)
+    { sr_lat_print(fp, sr_lat_stage_names[i], &stage[i]); }
+    for(i = 0; i < sr_lat_npaths; i++)
+    { sr_lat_print(fp, sr_lat_path_names[i], &total[i]); }
+    pthread_mutex_unlock(&dump_lock);
+} /* -- sr_latency_dump -- */
@@ -0,0 +1,176 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_latency.h
+ *
+ * Description:
+ *
+ * Time spent per packet in each stage of sr_handlepacket(), and per path
+ * through the router, as log-linear histograms of TSC ticks (16 buckets
+ * per power of two, so a percentile is good to about 6%).
+ *
+ * The packet path marks the end of each stage with SR_LAT_STAGE(); a
+ * stage is the time since the previous mark, which starts with
+ * SR_LAT_BEGIN().  SR_LAT_PATH() says how the packet is being handled and
+ * SR_LAT_END() charges the whole packet to that path.  A packet that takes
+ * no path is an error (it was dropped or answered with an ICMP error).
+ *
+ * Reading the TSC is not free, so only one packet in -L n is timed
+ * (default SR_LAT_SAMPLE_DEFAULT), which keeps the average cost per packet
+ * within a few ns.  Built without LATENCY=1 the marks compile to nothing.
+ *
+ * Like sr_stats.h every thread writes only its own histograms.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LATENCY_H
+#define SR_LATENCY_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_trace.h"   /* sr_trace_ticks() */
+
+#define SR_LAT_SAMPLE_DEFAULT 16
+#define SR_LAT_SUB_BITS 4
+#define SR_LAT_SUB      (1 << SR_LAT_SUB_BITS)
+#define SR_LAT_MAX_EXP  36     /* 2^36 ticks, longer samples share a bucket */
+#define SR_LAT_BUCKETS  ((SR_LAT_MAX_EXP - SR_LAT_SUB_BITS + 2) * SR_LAT_SUB)
+
+#define SR_LAT_STAGES(X) \
+    X(sr_lat_parse,  "parse")       \
+    X(sr_lat_local,  "local_check") \
+    X(sr_lat_lpm,    "lpm")         \
+    X(sr_lat_arp,    "arp_lookup")  \
+    X(sr_lat_icmp,   "icmp_gen")    \
+    X(sr_lat_send,   "send")
+
+#define SR_LAT_PATHS(X) \
+    X(sr_path_error,      "error")      \
+    X(sr_path_forward,    "forwarded")  \
+    X(sr_path_local_icmp, "local_icmp") \
+    X(sr_path_arp,        "arp")
+
+#define SR_LAT_ENUM(id, name) id,
+enum sr_lat_stage { SR_LAT_STAGES(SR_LAT_ENUM) sr_lat_nstages };
+enum sr_lat_path  { SR_LAT_PATHS(SR_LAT_ENUM) sr_lat_npaths };
+#undef SR_LAT_ENUM
+
+struct sr_lat_hist
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t bucket[SR_LAT_BUCKETS];
+};
+
+struct sr_lat_block
+{
+    /* the packet being timed */
+    int active;
+    int path;
+    unsigned int countdown;    /* packets until the next timed one */
+    uint64_t start;
+    uint64_t last;
+
+    struct sr_lat_hist stage[sr_lat_nstages];
+    struct sr_lat_hist total[sr_lat_npaths];
+    struct sr_lat_block* next;
+} __attribute__ ((aligned (64)));
+
+extern __thread struct sr_lat_block* sr_lat_self;
+extern unsigned int sr_lat_sample;
+
+void sr_latency_init(unsigned int sample);
+struct sr_lat_block* sr_lat_thread_block(void);
+void sr_latency_sum(struct sr_lat_hist* stage, struct sr_lat_hist* total);
+double sr_latency_bucket_ns(unsigned int i);
+double sr_latency_ticks_ns(uint64_t ticks);
+double sr_latency_percentile(const struct sr_lat_hist* h, double q);
+double sr_latency_bucket(unsigned int i);       /* in the histogram's units */
+const char* sr_latency_stage_name(int stage);
+const char* sr_latency_path_name(int path);
+void sr_latency_dump(FILE* fp);
+
+static __inline__ unsigned int sr_lat_bucket(uint64_t v)
+{
+    unsigned int e;
+
+    if(v < SR_LAT_SUB)
+    { return (unsigned int)v; }
+    e = 63 - __builtin_clzll(v);
+    if(e > SR_LAT_MAX_EXP)
+    { return SR_LAT_BUCKETS - 1; }
+    return (e - SR_LAT_SUB_BITS + 1) * SR_LAT_SUB +
+           (unsigned int)((v >> (e - SR_LAT_SUB_BITS)) & (SR_LAT_SUB - 1));
+}
+
+static __inline__ void sr_lat_record(struct sr_lat_hist* h, uint64_t v)
+{
+    h->count++;
+    h->sum += v;
+    if(v > h->max)
+    { h->max = v; }
+    h->bucket[sr_lat_bucket(v)]++;
+}
+
+static __inline__ void sr_lat_begin(void)
+{
+    struct sr_lat_block* b = sr_lat_self;
+
+    if(!b)
+    { b = sr_lat_thread_block(); }
+    if(sr_lat_sample == 0 || --b->countdown > 0)
+    {
+        b->active = 0;
+        return;
+    }
+    b->countdown = sr_lat_sample;
+    b->active = 1;
+    b->path = sr_path_error;
+    b->start = b->last = sr_trace_ticks();
+}
+
+static __inline__ void sr_lat_stage(int stage)
+{
+    struct sr_lat_block* b = sr_lat_self;
+    uint64_t now;
+
+    if(b && b->active)
+    {
+        now = sr_trace_ticks();
+        sr_lat_record(&(b->stage[stage]), now - b->last);
+        b->last = now;
+    }
+}
+
+static __inline__ void sr_lat_end(void)
+{
+    struct sr_lat_block* b = sr_lat_self;
+
+    if(b && b->active)
+    {
+        sr_lat_record(&(b->total[b->path]), sr_trace_ticks() - b->start);
+        b->active = 0;
+    }
+}
+
+#ifdef SR_LATENCY
+#define SR_LAT_BEGIN()    sr_lat_begin()
+#define SR_LAT_STAGE(s)   sr_lat_stage(s)
+#define SR_LAT_PATH(p) \
+    do { if(sr_lat_self) sr_lat_self->path = (p); } while(0)
+#define SR_LAT_END()      sr_lat_end()
+#else
+#define SR_LAT_BEGIN()    do{}while(0)
+#define SR_LAT_STAGE(s)   do{}while(0)
+#define SR_LAT_PATH(p)    do{}while(0)
+#define SR_LAT_END()      do{}while(0)
+#endif /* SR_LATENCY */
+
+#endif /* -- SR_LATENCY_H -- */
@@ -0,0 +1,824 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_loadgen.c
+ *
+ * Description:
+ *
+ * Stand-in VNS server and traffic generator for load testing the real sr
+ * binary on one machine, without POX or Mininet.  It accepts one router,
+ * runs the VNS handshake (auth, VNSOPEN or VNS_OPEN_TEMPLATE plus
+ * VNS_RTABLE, VNSHWINFO), and then plays the hosts of the lab topology
+ * (../IP_CONFIG): it answers the router's ARP requests for them, sends ICMP
+ * echo flows at the requested rates and counts what comes back.
+ *
+ *   usage: sr_loadgen [-p port] [-d seconds] [-w warmup] [-i interval]
+ *                     [-s link Mbit/s]
+ *                     [-f src,dst,pps[,payload[,ttl[,dscp[,ecn]]]]] ...
+ *
+ *   e.g.   sr_loadgen -f client,server1,20000 -f server2,client,5000,1400
+ *          ./sr -p 8888 -r ../rtable            (in another shell)
+ *
+ * src is one of the hosts (client, server1, server2, or its address); dst
+ * is a host or any address, a router interface included.  Each flow sends
+ * ICMP echo requests with the flow number as the ICMP id.  A flow's packet
+ * is delivered when it reaches any host: forwarded to its destination, or
+ * answered by the router with an echo reply or an ICMP error quoting it.
+ * Latency is from the write to the VNS socket to the read of the frame
+ * that delivers it.  Frames sent during the warmup (default 1 s, which
+ * also covers ARP resolution) are not counted.  ICMP errors whose payload
+ * does not quote the offending header cannot be matched to a flow; they
+ * are totalled separately.  -s advertises a link speed (VNS HWSPEED) on
+ * every interface, for the router's -Q shaper.  A flow with an ecn of 1
+ * or 2 sends ECT(1) or ECT(0); its frames delivered marked CE, and any
+ * delivered with a bad IP checksum, are counted.
+ *
+ * Frames go to the router as single VNSPACKET messages; VNSPACKET_BATCH
+ * from the router is understood and the shared-memory offer is declined.
+ * If the router falls behind, frames that do not fit the socket buffer
+ * are counted as "unsent" rather than queued without bound.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "vnscommand.h"
+
+#define LG_DEFAULT_PORT   8888
+#define LG_MAX_FLOWS      16
+#define LG_MAX_MSG        65536
+#define LG_OUT_MAX        (4 << 20)
+#define LG_IN_MAX         (1 << 20)
+#define LG_SEQ_RING       65536      /* send times kept per flow */
+#define LG_BURST          64         /* most frames one flow sends per tick */
+#define LG_HIST_SUB_BITS  3
+#define LG_HIST_BUCKETS   (64 << LG_HIST_SUB_BITS)
+#define LG_ICMP_ID_BASE   0x5300     /* ICMP id of flow 0 */
+
+/* -----------------------------------------------------------------------
+ * Topology: router interface and the host behind it
+ * --------------------------------------------------------------------- */
+
+struct lg_port
+{
+    const char* ifname;
+    const char* if_ip;
+    const char* host;
+    const char* host_ip;
+    uint32_t ifaddr;            /* network byte order */
+    uint32_t hostaddr;
+    uint8_t ifmac[ETHER_ADDR_LEN];
+    uint8_t hostmac[ETHER_ADDR_LEN];
+    unsigned long arp_replies;
+};
+
+static struct lg_port lg_ports[] = {
+    { "eth1", "192.168.2.1", "server1", "192.168.2.2" },
+    { "eth2", "172.64.3.1",  "server2", "172.64.3.10" },
+    { "eth3", "10.0.1.1",    "client",  "10.0.1.100" },
+};
+#define LG_NPORTS 3
+
+/* -----------------------------------------------------------------------
+ * Flows and their results
+ * --------------------------------------------------------------------- */
+
+struct lg_hist
+{
+    uint64_t count;
+    uint64_t max;
+    uint64_t bucket[LG_HIST_BUCKETS];
+};
+
+struct lg_flow
+{
+    struct lg_port* src;
+    uint32_t dst;
+    double pps;
+    unsigned int payload;
+    uint8_t ttl;
+    uint8_t tos;
+
+    uint16_t seq;
+    double credit;              /* frames owed by the pacing */
+    uint64_t sent_ns[LG_SEQ_RING];
+
+    unsigned long sent, unsent, delivered, replies, errors;
+    unsigned long ce, badsum;   /* of those delivered */
+    unsigned long long bytes;   /* delivered, IP length */
+    struct lg_hist lat;
+};
+
+static struct lg_flow lg_flows[LG_MAX_FLOWS];
+static int lg_nflows;
+
+static int lg_fd = -1;
+static uint8_t lg_out[LG_OUT_MAX];
+static size_t lg_outlen;
+static uint64_t lg_window;      /* counting starts here, ns */
+static unsigned long lg_unquoted[2];  /* errors we could not match: 3, 11 */
+static uint32_t lg_speed;             /* -s, network order, 0 for none */
+
+static uint64_t lg_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void lg_hist_add(struct lg_hist* h, uint64_t v)
+{
+    unsigned int e, i;
+
+    if(v < (1u << LG_HIST_SUB_BITS))
+    { i = (unsigned int)v; }
+    else
+    {
+        e = 63 - __builtin_clzll(v);
+        i = ((e - LG_HIST_SUB_BITS + 1) << LG_HIST_SUB_BITS) +
+            (unsigned int)((v >> (e - LG_HIST_SUB_BITS)) &
+                           ((1u << LG_HIST_SUB_BITS) - 1));
+    }
+    h->bucket[i]++;
+    h->count++;
+    if(v > h->max)
+    { h->max = v; }
+}
+
+/* lower edge of the bucket holding fraction q of the samples, in ns */
+static double lg_hist_pct(const struct lg_hist* h, double q)
+{
+    uint64_t want = (uint64_t)(q * h->count + 0.5), seen = 0;
+    unsigned int i, e;
+
+    if(want == 0)
+    { want = 1; }
+    for(i = 0; i < LG_HIST_BUCKETS; i++)
+    {
+        seen += h->bucket[i];
+        if(seen >= want)
+        {
+            if(i < (1u << LG_HIST_SUB_BITS))
+            { return i; }
+            e = (i >> LG_HIST_SUB_BITS) + LG_HIST_SUB_BITS - 1;
+            return (double)(((1u << LG_HIST_SUB_BITS) +
+                             (i & ((1u << LG_HIST_SUB_BITS) - 1)))
+                            << (e - LG_HIST_SUB_BITS));
+        }
+    }
+    return (double)h->max;
+}
+
+/* -----------------------------------------------------------------------
+ * VNS messages
+ * --------------------------------------------------------------------- */
+
+/* queue a message; -1 if it does not fit behind what is waiting */
+static int lg_queue(const void* msg, size_t len)
+{
+    if(lg_outlen + len > sizeof(lg_out))
+    { return -1; }
+    memcpy(lg_out + lg_outlen, msg, len);
+    lg_outlen += len;
+    return 0;
+}
+
+static int lg_flush(int block)
+{
+    ssize_t n;
+    size_t off = 0;
+
+    while(off < lg_outlen)
+    {
+        n = send(lg_fd, lg_out + off, lg_outlen - off,
+                 (block ? 0 : MSG_DONTWAIT) | MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            { break; }
+            perror("send");
+            return -1;
+        }
+        off += n;
+    }
+    memmove(lg_out, lg_out + off, lg_outlen - off);
+    lg_outlen -= off;
+    return 0;
+}
+
+static int lg_send_frame(struct lg_port* port, const uint8_t* frame,
+                         unsigned int len)
+{
+    uint8_t msg[sizeof(c_packet_header) + LG_MAX_MSG];
+    c_packet_header* hdr = (c_packet_header*)msg;
+
+    hdr->mLen = htonl(sizeof(c_packet_header) + len);
+    hdr->mType = htonl(VNSPACKET);
+    memset(hdr->mInterfaceName, 0, sizeof(hdr->mInterfaceName));
+    strncpy(hdr->mInterfaceName, port->ifname,
+            sizeof(hdr->mInterfaceName) - 1);
+    memcpy(msg + sizeof(c_packet_header), frame, len);
+    return lg_queue(msg, sizeof(c_packet_header) + len);
+}
+
+/* read exactly one message, blocking; used during the handshake */
+static int lg_read_msg(uint8_t* buf, uint32_t* type)
+{
+    uint32_t len;
+    size_t got = 0;
+    ssize_t n;
+
+    while(got < 4)
+    {
+        if((n = recv(lg_fd, buf + got, 4 - got, 0)) <= 0)
+        { return -1; }
+        got += n;
+    }
+    len = ntohl(*(uint32_t*)buf);
+    if(len < sizeof(c_base) || len > LG_MAX_MSG)
+    { return -1; }
+    while(got < len)
+    {
+        if((n = recv(lg_fd, buf + got, len - got, 0)) <= 0)
+        { return -1; }
+        got += n;
+    }
+    *type = ntohl(((c_base*)buf)->mType);
+    return (int)len;
+}
+
+static void lg_hw_entry(c_hwinfo* hw, int* n, uint32_t key, const void* v,
+                        size_t len)
+{
+    hw->mHWInfo[*n].mKey = htonl(key);
+    memset(hw->mHWInfo[*n].value, 0, sizeof(hw->mHWInfo[*n].value));
+    memcpy(hw->mHWInfo[*n].value, v, len);
+    (*n)++;
+}
+
+static int lg_handshake(void)
+{
+    static uint8_t buf[LG_MAX_MSG];
+    static c_hwinfo hw;
+    c_auth_request areq;
+    uint8_t salt[20];
+    struct {
+        c_auth_status st;
+        char msg[16];
+    } __attribute__ ((packed)) ast;
+    uint32_t type, mask = htonl(0xffffff00);
+    char rt[512];
+    c_rtable* rtm;
+    size_t rtlen;
+    int i, n = 0, len;
+
+    /* auth: any reply is accepted */
+    memset(salt, 0x5a, sizeof(salt));
+    areq.mLen = htonl(sizeof(areq) + sizeof(salt));
+    areq.mType = htonl(VNS_AUTH_REQUEST);
+    lg_queue(&areq, sizeof(areq));
+    lg_queue(salt, sizeof(salt));
+    if(lg_flush(1) != 0 || lg_read_msg(buf, &type) < 0 ||
+       type != VNS_AUTH_REPLY)
+    {
+        fprintf(stderr, "Error: no VNS_AUTH_REPLY from the router\n");
+        return -1;
+    }
+    memset(&ast, 0, sizeof(ast));
+    ast.st.mLen = htonl(sizeof(ast));
+    ast.st.mType = htonl(VNS_AUTH_STATUS);
+    ast.st.auth_ok = 1;
+    strcpy(ast.msg, "sr_loadgen");
+    lg_queue(&ast, sizeof(ast));
+    lg_flush(1);
+
+    if((len = lg_read_msg(buf, &type)) < 0 ||
+       (type != VNSOPEN && type != VNS_OPEN_TEMPLATE))
+    {
+        fprintf(stderr, "Error: expected VNSOPEN from the router\n");
+        return -1;
+    }
+    if(type == VNS_OPEN_TEMPLATE)
+    {
+        /* the router asked for a template, hand it the lab table */
+        rtlen = 0;
+        for(i = 0; i < LG_NPORTS; i++)
+        {
+            rtlen += snprintf(rt + rtlen, sizeof(rt) - rtlen,
+                              "%s %s 255.255.255.255 %s\n",
+                              lg_ports[i].host_ip, lg_ports[i].host_ip,
+                              lg_ports[i].ifname);
+        }
+        rtm = (c_rtable*)buf;
+        rtm->mLen = htonl(sizeof(c_rtable) + rtlen);
+        rtm->mType = htonl(VNS_RTABLE);
+        memset(rtm->mVirtualHostID, 0, IDSIZE);
+        strncpy(rtm->mVirtualHostID,
+                ((c_open_template*)buf)->mVirtualHostID, IDSIZE - 1);
+        memcpy(rtm->rtable, rt, rtlen);
+        lg_queue(buf, sizeof(c_rtable) + rtlen);
+    }
+
+    for(i = 0; i < LG_NPORTS; i++)
+    {
+        lg_hw_entry(&hw, &n, HWINTERFACE, lg_ports[i].ifname,
+                    strlen(lg_ports[i].ifname));
+        lg_hw_entry(&hw, &n, HWETHER, lg_ports[i].ifmac, ETHER_ADDR_LEN);
+        lg_hw_entry(&hw, &n, HWETHIP, &lg_ports[i].ifaddr, 4);
+        lg_hw_entry(&hw, &n, HWMASK, &mask, 4);
+        if(lg_speed)
+        { lg_hw_entry(&hw, &n, HWSPEED, &lg_speed, 4); }
+    }
+    hw.mLen = htonl(2 * sizeof(uint32_t) + n * sizeof(c_hw_entry));
+    hw.mType = htonl(VNSHWINFO);
+    lg_queue(&hw, 2 * sizeof(uint32_t) + n * sizeof(c_hw_entry));
+    return lg_flush(1);
+}
+
+/* -----------------------------------------------------------------------
+ * Hosts
+ * --------------------------------------------------------------------- */
+
+static struct lg_port* lg_port_by_name(const char* ifname)
+{
+    int i;
+
+    for(i = 0; i < LG_NPORTS; i++)
+    {
+        if(strncmp(lg_ports[i].ifname, ifname, 16) == 0)
+        { return &lg_ports[i]; }
+    }
+    return 0;
+}
+
+static void lg_arp(struct lg_port* port, const uint8_t* frame,
+                   unsigned int len)
+{
+    uint8_t reply[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    const sr_arp_hdr_t* req = (const sr_arp_hdr_t*)
+        (frame + sizeof(sr_ethernet_hdr_t));
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)reply;
+    sr_arp_hdr_t* arp = (sr_arp_hdr_t*)(eth + 1);
+
+    if(len < sizeof(reply) || ntohs(req->ar_op) != arp_op_request ||
+       req->ar_tip != port->hostaddr)
+    { return; }
+
+    memcpy(eth->ether_dhost, req->ar_sha, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, port->hostmac, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_arp);
+    *arp = *req;
+    arp->ar_op = htons(arp_op_reply);
+    memcpy(arp->ar_sha, port->hostmac, ETHER_ADDR_LEN);
+    arp->ar_sip = port->hostaddr;
+    memcpy(arp->ar_tha, req->ar_sha, ETHER_ADDR_LEN);
+    arp->ar_tip = req->ar_sip;
+    if(lg_send_frame(port, reply, sizeof(reply)) == 0)
+    { port->arp_replies++; }
+}
+
+/* the flow and send time of one of our echo requests, by its ICMP header */
+static struct lg_flow* lg_match(const uint8_t* icmp, uint64_t* sent)
+{
+    unsigned int id = (icmp[4] << 8) | icmp[5];
+    unsigned int seq = (icmp[6] << 8) | icmp[7];
+    struct lg_flow* f;
+
+    if(id < LG_ICMP_ID_BASE || id >= LG_ICMP_ID_BASE + (unsigned)lg_nflows)
+    { return 0; }
+    f = &lg_flows[id - LG_ICMP_ID_BASE];
+    *sent = f->sent_ns[seq % LG_SEQ_RING];
+    f->sent_ns[seq % LG_SEQ_RING] = 0;   /* count each packet once */
+    return f;
+}
+
+static void lg_ip(struct lg_port* port, const uint8_t* frame,
+                  unsigned int len, uint64_t now)
+{
+    const sr_ip_hdr_t* ip = (const sr_ip_hdr_t*)
+        (frame + sizeof(sr_ethernet_hdr_t));
+    const uint8_t* icmp = (const uint8_t*)ip + ip->ip_hl * 4;
+    const sr_ip_hdr_t* quoted;
+    struct lg_flow* f = 0;
+    uint64_t sent = 0;
+    int error = 0;
+
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 8 ||
+       ip->ip_p != ip_protocol_icmp || ip->ip_dst != port->hostaddr)
+    { return; }
+
+    if(icmp[0] == 8 || icmp[0] == 0)             /* forwarded or answered */
+    { f = lg_match(icmp, &sent); }
+    else if((icmp[0] == 3 || icmp[0] == 11) &&
+            len >= (unsigned int)(icmp - frame) + 8 + sizeof(sr_ip_hdr_t) + 8)
+    {
+        quoted = (const sr_ip_hdr_t*)(icmp + 8);
+        if(quoted->ip_v == 4 && quoted->ip_p == ip_protocol_icmp)
+        { f = lg_match((const uint8_t*)quoted + quoted->ip_hl * 4, &sent); }
+        else if(now >= lg_window)
+        { lg_unquoted[icmp[0] == 11]++; }
+        error = 1;
+    }
+    if(!f || sent < lg_window)
+    { return; }   /* not ours, a duplicate, or sent during the warmup */
+
+    f->delivered++;
+    f->bytes += ntohs(ip->ip_len);
+    if((ip->ip_tos & IP_ECN_MASK) == IP_ECN_CE)
+    { f->ce++; }
+    if(cksum(ip, ip->ip_hl * 4) != 0xffff)
+    { f->badsum++; }
+    if(error)
+    { f->errors++; }
+    else if(icmp[0] == 0)
+    { f->replies++; }
+    lg_hist_add(&f->lat, now - sent);
+}
+
+static void lg_frame(struct lg_port* port, const uint8_t* frame,
+                     unsigned int len, uint64_t now)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)frame;
+
+    if(!port || len < sizeof(sr_ethernet_hdr_t))
+    { return; }
+    if(ntohs(eth->ether_type) == ethertype_arp)
+    { lg_arp(port, frame, len); }
+    else if(ntohs(eth->ether_type) == ethertype_ip)
+    { lg_ip(port, frame, len, now); }
+}
+
+/* everything the router has sent, message by message */
+static int lg_receive(void)
+{
+    static uint8_t in[LG_IN_MAX];
+    static size_t inlen;
+    uint32_t len, type;
+    size_t off = 0, boff;
+    unsigned int count, flen;
+    c_batch_frame* bf;
+    uint64_t now;
+    ssize_t n;
+
+    n = recv(lg_fd, in + inlen, sizeof(in) - inlen, MSG_DONTWAIT);
+    if(n == 0)
+    {
+        fprintf(stderr, "Router closed the connection\n");
+        return -1;
+    }
+    if(n < 0)
+    { return (errno == EAGAIN || errno == EINTR) ? 0 : -1; }
+    inlen += n;
+    now = lg_now();
+
+    while(inlen - off >= sizeof(c_base))
+    {
+        len = ntohl(((c_base*)(in + off))->mLen);
+        type = ntohl(((c_base*)(in + off))->mType);
+        if(len < sizeof(c_base) || len > LG_MAX_MSG)
+        {
+            fprintf(stderr, "Error: bad message length %u\n", len);
+            return -1;
+        }
+        if(inlen - off < len)
+        { break; }
+
+        if(type == VNSPACKET && len > sizeof(c_packet_header))
+        {
+            lg_frame(lg_port_by_name(((c_packet_header*)(in + off))
+                                     ->mInterfaceName),
+                     in + off + sizeof(c_packet_header),
+                     len - sizeof(c_packet_header), now);
+        }
+        else if(type == VNSPACKET_BATCH)
+        {
+            count = ntohs(((c_packet_batch*)(in + off))->count);
+            boff = off + sizeof(c_packet_batch);
+            while(count-- > 0 && boff + sizeof(c_batch_frame) <= off + len)
+            {
+                bf = (c_batch_frame*)(in + boff);
+                flen = ntohs(bf->len);
+                boff += sizeof(c_batch_frame);
+                if(boff + flen > off + len)
+                { break; }
+                if(bf->ifindex < LG_NPORTS)
+                { lg_frame(&lg_ports[bf->ifindex], in + boff, flen, now); }
+                boff += flen;
+            }
+        }
+        else if(type == VNS_SHM_OPEN)
+        {
+            struct {
+                c_shm_status st;
+                char msg[24];
+            } __attribute__ ((packed)) no;
+            memset(&no, 0, sizeof(no));
+            no.st.mLen = htonl(sizeof(no));
+            no.st.mType = htonl(VNS_SHM_STATUS);
+            strcpy(no.msg, "not offered by loadgen");
+            lg_queue(&no, sizeof(no));
+        }
+        off += len;
+    }
+    memmove(in, in + off, inlen - off);
+    inlen -= off;
+    return 0;
+}
+
+/* -----------------------------------------------------------------------
+ * Sending
+ * --------------------------------------------------------------------- */
+
+static void lg_send_echo(struct lg_flow* f, uint64_t now)
+{
+    uint8_t frame[sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 8 +
+                  LG_MAX_MSG / 2];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    uint8_t* icmp = (uint8_t*)(ip + 1);
+    unsigned int icmp_len = 8 + f->payload;
+    unsigned int len = sizeof(*eth) + sizeof(*ip) + icmp_len;
+    unsigned int id = LG_ICMP_ID_BASE + (unsigned int)(f - lg_flows);
+    uint16_t seq = f->seq++;
+
+    memcpy(eth->ether_dhost, f->src->ifmac, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, f->src->hostmac, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_ip);
+
+    memset(ip, 0, sizeof(*ip));
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_tos = f->tos;
+    ip->ip_len = htons(sizeof(*ip) + icmp_len);
+    ip->ip_id = htons(seq);
+    ip->ip_ttl = f->ttl;
+    ip->ip_p = ip_protocol_icmp;
+    ip->ip_src = f->src->hostaddr;
+    ip->ip_dst = f->dst;
+    ip->ip_sum = cksum(ip, sizeof(*ip));
+
+    memset(icmp, 0, icmp_len);
+    icmp[0] = 8;
+    icmp[4] = id >> 8;
+    icmp[5] = id & 0xff;
+    icmp[6] = seq >> 8;
+    icmp[7] = seq & 0xff;
+    ((sr_icmp_hdr_t*)icmp)->icmp_sum = cksum(icmp, icmp_len);
+
+    if(lg_send_frame(f->src, frame, len) != 0)
+    {
+        if(now >= lg_window)
+        { f->unsent++; }
+        return;
+    }
+    f->sent_ns[seq % LG_SEQ_RING] = now;
+    if(now >= lg_window)
+    { f->sent++; }
+}
+
+static void lg_pace(uint64_t now, uint64_t* last)
+{
+    double dt = (now - *last) / 1e9;
+    int i, n;
+
+    *last = now;
+    for(i = 0; i < lg_nflows; i++)
+    {
+        lg_flows[i].credit += lg_flows[i].pps * dt;
+        if(lg_flows[i].credit > LG_BURST)
+        { lg_flows[i].credit = LG_BURST; }
+        for(n = (int)lg_flows[i].credit; n > 0; n--)
+        { lg_send_echo(&lg_flows[i], now); }
+        lg_flows[i].credit -= (int)lg_flows[i].credit;
+    }
+}
+
+/* -----------------------------------------------------------------------
+ * Setup and report
+ * --------------------------------------------------------------------- */
+
+static struct lg_port* lg_host(const char* name)
+{
+    int i;
+
+    for(i = 0; i < LG_NPORTS; i++)
+    {
+        if(strcmp(name, lg_ports[i].host) == 0 ||
+           strcmp(name, lg_ports[i].host_ip) == 0)
+        { return &lg_ports[i]; }
+    }
+    return 0;
+}
+
+static int lg_add_flow(char* spec)
+{
+    char* field[7] = { 0, 0, 0, 0, 0, 0, 0 };
+    struct lg_port* dst;
+    struct lg_flow* f;
+    char* save = 0;
+    int n = 0;
+
+    if(lg_nflows == LG_MAX_FLOWS)
+    { return -1; }
+    while(n < 7 && (field[n] = strtok_r(n ? 0 : spec, ",", &save)) != 0)
+    { n++; }
+    if(n < 3)
+    { return -1; }
+
+    f = &lg_flows[lg_nflows];
+    if((f->src = lg_host(field[0])) == 0)
+    {
+        fprintf(stderr, "Unknown source host %s\n", field[0]);
+        return -1;
+    }
+    if((dst = lg_host(field[1])) != 0)
+    { f->dst = dst->hostaddr; }
+    else if(inet_pton(AF_INET, field[1], &f->dst) != 1)
+    {
+        fprintf(stderr, "Bad destination %s\n", field[1]);
+        return -1;
+    }
+    f->pps = atof(field[2]);
+    f->payload = field[3] ? atoi(field[3]) : 56;
+    f->ttl = field[4] ? atoi(field[4]) : 64;
+    f->tos = field[5] ? atoi(field[5]) << 2 : 0;
+    if(f->pps <= 0 || f->payload > 1472 - 8 || (field[5] && atoi(field[5]) > 63) ||
+       (field[6] && (atoi(field[6]) < 0 || atoi(field[6]) > 2)))
+    { return -1; }
+    if(field[6])
+    { f->tos |= atoi(field[6]); }
+    lg_nflows++;
+    return 0;
+}
+
+static void lg_report(double secs, int final)
+{
+    struct lg_flow* f;
+    int i;
+
+    printf("%s%-4s %-22s %9s %9s %9s %7s %9s %8s %8s %8s %8s\n",
+           final ? "\n" : "", "flow", "src -> dst", "sent", "delivered",
+           "unsent", "loss%", "Mbit/s", "errors", "p50 us", "p99 us",
+           "max us");
+    for(i = 0; i < lg_nflows; i++)
+    {
+        char route[40];
+        f = &lg_flows[i];
+        snprintf(route, sizeof(route), "%s -> %s", f->src->host,
+                 inet_ntoa(*(struct in_addr*)&f->dst));
+        printf("%-4d %-22s %9lu %9lu %9lu %7.2f %9.2f %8lu %8.1f %8.1f %8.1f\n",
+               i, route, f->sent, f->delivered, f->unsent,
+               f->sent ? 100.0 * (f->sent - f->delivered) / f->sent : 0.0,
+               secs > 0 ? f->bytes * 8 / secs / 1e6 : 0.0, f->errors,
+               lg_hist_pct(&f->lat, 0.50) / 1e3,
+               lg_hist_pct(&f->lat, 0.99) / 1e3, f->lat.max / 1e3);
+    }
+    if(final)
+    {
+        printf("ARP replies:");
+        for(i = 0; i < LG_NPORTS; i++)
+        { printf(" %s %lu", lg_ports[i].host, lg_ports[i].arp_replies); }
+        printf("\n");
+        for(i = 0; i < lg_nflows; i++)
+        {
+            if(lg_flows[i].tos & IP_ECN_MASK || lg_flows[i].badsum)
+            {
+                printf("flow %d: %lu delivered marked CE, %lu with a bad IP"
+                       " checksum\n", i, lg_flows[i].ce, lg_flows[i].badsum);
+            }
+        }
+        if(lg_unquoted[0] || lg_unquoted[1])
+        {
+            printf("ICMP errors not quoting their packet: %lu unreachable, "
+                   "%lu time exceeded\n", lg_unquoted[0], lg_unquoted[1]);
+        }
+    }
+    fflush(stdout);
+}
+
+static void usage(char* argv0)
+{
+    fprintf(stderr, "usage: %s [-p port] [-d seconds] [-w warmup] "
+            "[-i interval] [-s link Mbit/s]\n"
+            "       [-f src,dst,pps[,payload[,ttl[,dscp[,ecn]]]]] ...\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned short port = LG_DEFAULT_PORT;
+    double duration = 10, warmup = 1, interval = 0;
+    uint64_t start, now, last, end, next_report;
+    struct sockaddr_in addr;
+    struct pollfd pfd;
+    int lfd, c, i, on = 1;
+
+    for(i = 0; i < LG_NPORTS; i++)
+    {
+        inet_pton(AF_INET, lg_ports[i].if_ip, &lg_ports[i].ifaddr);
+        inet_pton(AF_INET, lg_ports[i].host_ip, &lg_ports[i].hostaddr);
+        memcpy(lg_ports[i].ifmac, "\x02\x00\x00\x00\x01", 5);
+        lg_ports[i].ifmac[5] = i + 1;
+        memcpy(lg_ports[i].hostmac, "\x02\x00\x00\x00\x02", 5);
+        lg_ports[i].hostmac[5] = i + 1;
+    }
+
+    while((c = getopt(argc, argv, "hp:d:w:i:s:f:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'p': port = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'w': warmup = atof(optarg); break;
+            case 'i': interval = atof(optarg); break;
+            case 's': lg_speed = htonl(atoi(optarg)); break;
+            case 'f':
+                if(lg_add_flow(optarg) != 0)
+                { usage(argv[0]); }
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if(lg_nflows == 0)
+    {
+        char def[] = "client,server1,10000";
+        lg_add_flow(def);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+       setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+       bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(lfd, 1) < 0)
+    {
+        perror("listen");
+        return 1;
+    }
+    printf("Waiting for sr on port %u\n", port);
+    if((lg_fd = accept(lfd, 0, 0)) < 0)
+    {
+        perror("accept");
+        return 1;
+    }
+    close(lfd);
+    setsockopt(lg_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if(lg_handshake() != 0)
+    { return 1; }
+    printf("Router connected, %d flow(s), %.0fs warmup, %.0fs run\n",
+           lg_nflows, warmup, duration);
+
+    start = last = lg_now();
+    lg_window = start + (uint64_t)(warmup * 1e9);
+    end = lg_window + (uint64_t)(duration * 1e9);
+    next_report = interval > 0 ? lg_window + (uint64_t)(interval * 1e9) : 0;
+
+    pfd.fd = lg_fd;
+    while((now = lg_now()) < end)
+    {
+        lg_pace(now, &last);
+        if(lg_flush(0) != 0)
+        { return 1; }
+
+        /* wake for the router or the next frame, whichever is first */
+        pfd.events = POLLIN | (lg_outlen ? POLLOUT : 0);
+        pfd.revents = 0;
+        poll(&pfd, 1, 0);
+        if(!(pfd.revents & (POLLIN | POLLOUT)))
+        { usleep(50); }
+        if((pfd.revents & POLLIN) && lg_receive() != 0)
+        { break; }
+
+        if(next_report && now >= next_report)
+        {
+            lg_report((now - lg_window) / 1e9, 0);
+            next_report += (uint64_t)(interval * 1e9);
+        }
+    }
+
+    /* late replies still count, for a moment */
+    for(last = lg_now(); lg_now() - last < 200000000ull; )
+    {
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, 20) > 0 && lg_receive() != 0)
+        { break; }
+    }
+    lg_report(duration, 1);
+    close(lg_fd);
+    return 0;
+}
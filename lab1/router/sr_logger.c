@@ -0,0 +1,241 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_logger.c
+ *
+ * Description:
+ *
+ * Ring-buffered capture writer, see sr_logger.h.  The file formats and
+ * rotation live in sr_dumper.c.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "sr_dumper.h"
+#include "sr_logger.h"
+
+#define SR_LOG_ALIGN(x) (((x) + 7) & ~7u)
+
+static void* sr_logger_thread(void* arg);
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_open(..)
+ * Scope:  Global
+ *
+ * Start the writer thread for capture 'df', which the logger now owns.
+ * Returns 0 on failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_logger* sr_logger_open(struct sr_dumpfile* df, uint32_t ring_size)
+{
+    struct sr_logger* log;
+
+    /* -- REQUIRES -- */
+    assert(df);
+    assert((ring_size & (ring_size - 1)) == 0);
+
+    log = (struct sr_logger*)calloc(1, sizeof(struct sr_logger));
+    assert(log);
+    log->ring_size = ring_size;
+    log->snaplen = df->snaplen;
+    log->df = df;
+    if((log->ring = (uint8_t*)calloc(1, ring_size)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_logger_open)\n");
+        free(log);
+        return 0;
+    }
+
+    log->running = 1;
+    if(pthread_create(&(log->thread), 0, sr_logger_thread, log) != 0)
+    {
+        perror("pthread_create(..):sr_logger.c::sr_logger_open");
+        free(log->ring);
+        free(log);
+        return 0;
+    }
+
+    return log;
+} /* -- sr_logger_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_log(..)
+ * Scope:  Global
+ *
+ * Queue one frame for the pcap file.  Safe to call from any thread and
+ * never blocks; returns -1 if the frame was dropped because the ring is
+ * full.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_logger_log(struct sr_logger* log, const uint8_t* buf, unsigned int len,
+                  uint32_t ifindex, uint32_t dir)
+{
+    struct sr_logrec* rec;
+    struct timespec now;
+    uint32_t head, tail, off, need, size;
+    unsigned int caplen = min(log->snaplen, len);
+
+    size = SR_LOG_ALIGN(sizeof(struct sr_logrec) + caplen);
+
+    /* -- reserve: a record never wraps, pad out the end of the ring -- */
+    for(;;)
+    {
+        head = __atomic_load_n(&log->head, __ATOMIC_RELAXED);
+        tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+        off  = head & (log->ring_size - 1);
+        need = size;
+        if(off + size > log->ring_size)
+        { need += log->ring_size - off; }
+
+        if((uint32_t)(head - tail) + need > log->ring_size)
+        {
+            __sync_fetch_and_add(&log->drops, 1);
+            return -1;
+        }
+        if(__sync_bool_compare_and_swap(&log->head, head, head + need))
+        { break; }
+    }
+
+    if(need != size)
+    {
+        rec = (struct sr_logrec*)(log->ring + off);
+        rec->size = log->ring_size - off;
+        __atomic_store_n(&rec->state, SR_LOGREC_PAD, __ATOMIC_RELEASE);
+        off = 0;
+    }
+
+    /* -- fill and publish -- */
+    clock_gettime(CLOCK_REALTIME, &now);
+    rec = (struct sr_logrec*)(log->ring + off);
+    rec->size    = size;
+    rec->ifindex = ifindex;
+    rec->dir     = dir;
+    rec->ts_ns   = now.tv_sec * 1000000000ull + now.tv_nsec;
+    rec->caplen  = caplen;
+    rec->len     = len;
+    memcpy(rec + 1, buf, caplen);
+    __atomic_store_n(&rec->state, SR_LOGREC_READY, __ATOMIC_RELEASE);
+
+    return 0;
+} /* -- sr_logger_log -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_drain(..)
+ * Scope:  Local
+ *
+ * Hand every published record to the capture file.  Returns the number
+ * of records consumed.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_logger_drain(struct sr_logger* log)
+{
+    struct sr_logrec* rec;
+    uint32_t tail = log->tail;
+    uint32_t state, size;
+    int n = 0;
+
+    while(tail != __atomic_load_n(&log->head, __ATOMIC_ACQUIRE))
+    {
+        rec = (struct sr_logrec*)(log->ring + (tail & (log->ring_size - 1)));
+        if((state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE)) ==
+           SR_LOGREC_FREE)
+        { break; } /* reserved but not filled in yet */
+
+        size = rec->size;
+        if(state == SR_LOGREC_READY &&
+           sr_dumpfile_packet(log->df, rec->ifindex, rec->dir, rec->ts_ns,
+                              (uint8_t*)(rec + 1), rec->caplen, rec->len) == 0)
+        { log->written++; }
+
+        /* a later record may start anywhere in here, so no stale state
+         * word may survive */
+        memset(rec, 0, size);
+        tail += size;
+        __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+        n++;
+    }
+    return n;
+} /* -- sr_logger_drain -- */
+
+static void* sr_logger_thread(void* arg)
+{
+    struct sr_logger* log = (struct sr_logger*)arg;
+    struct timeval last, now;
+    int idle = 0;
+
+    gettimeofday(&last, 0);
+    for(;;)
+    {
+        if(sr_logger_drain(log) > 0)
+        {
+            idle = 0;
+            continue;
+        }
+
+        gettimeofday(&now, 0);
+        if((now.tv_sec - last.tv_sec) * 1000 +
+           (now.tv_usec - last.tv_usec) / 1000 >= SR_LOG_FLUSH_MS)
+        {
+            sr_dumpfile_flush(log->df);
+            last = now;
+        }
+
+        /* on close, give producers in the middle of a record a moment */
+        if(!log->running && (log->tail == log->head || ++idle > 100))
+        { break; }
+        usleep(SR_LOG_IDLE_US);
+    }
+
+    sr_dumpfile_flush(log->df);
+    return 0;
+} /* -- sr_logger_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_add_interface(..)
+ * Scope:  Global
+ *
+ * Describe an interface in the capture.  Only valid before the first
+ * packet is logged; the writer thread reads the list when it opens a file.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_logger_add_interface(struct sr_logger* log, uint32_t index,
+                             const char* name)
+{
+    sr_dumpfile_add_interface(log->df, index, name);
+} /* -- sr_logger_add_interface -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_logger_close(..)
+ * Scope:  Global
+ *
+ * Write out whatever is still in the ring and close the file.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_logger_close(struct sr_logger* log)
+{
+    if(!log)
+    { return; }
+
+    log->running = 0;
+    pthread_join(log->thread, 0);
+
+    if(log->drops)
+    {
+        fprintf(stderr, "packet log: %lu frames written, %lu dropped\n",
+                log->written, log->drops);
+    }
+
+    sr_dumpfile_close(log->df);
+    free(log->ring);
+    free(log);
+} /* -- sr_logger_close -- */
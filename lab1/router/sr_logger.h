@@ -0,0 +1,83 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_logger.h
+ *
+ * Description:
+ *
+ * Asynchronous packet capture for -l.  The forwarding path only copies the
+ * frame into a lock-free ring; a background thread drains the ring into the
+ * capture file(s) (struct sr_dumpfile, pcap or pcapng) with large buffered
+ * writes.  When the ring is full the frame is counted as dropped rather
+ * than blocking the caller.
+ *
+ * The ring holds variable-length records, each 8-byte aligned:
+ *
+ *   struct sr_logrec   size, state, interface, direction, time, lengths
+ *   caplen bytes of frame
+ *
+ * Producers (the packet thread and the ARP thread both send) reserve space
+ * by advancing head with a compare-and-swap, fill the record and then mark
+ * it ready.  The single consumer walks from tail and stops at the first
+ * record that is not ready yet.  A record that would run past the end of
+ * the ring is preceded by a pad record up to the end.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOGGER_H
+#define SR_LOGGER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sr_dumper.h"
+
+#define SR_LOG_RING_BYTES (4 * 1024 * 1024) /* power of two */
+#define SR_LOG_IDLE_US    2000               /* writer sleep when ring empty */
+#define SR_LOG_FLUSH_MS   200                /* file flushed at least this often */
+
+#define SR_LOGREC_FREE  0
+#define SR_LOGREC_READY 1
+#define SR_LOGREC_PAD   2
+
+struct sr_logrec
+{
+    uint32_t size;           /* whole record, header included, 8-aligned */
+    volatile uint32_t state; /* SR_LOGREC_* */
+    uint32_t ifindex;        /* sr_if.index */
+    uint32_t dir;            /* SR_DUMP_DIR_* */
+    uint64_t ts_ns;          /* wall clock, nanoseconds */
+    uint32_t caplen;
+    uint32_t len;
+};
+
+struct sr_logger
+{
+    uint8_t* ring;
+    uint32_t ring_size;
+    unsigned int snaplen;
+    volatile uint32_t head;     /* next byte to reserve (producers) */
+    uint8_t pad0[64 - sizeof(uint32_t)];
+    volatile uint32_t tail;     /* next record to write out (writer) */
+    uint8_t pad1[64 - sizeof(uint32_t)];
+    unsigned long drops;        /* frames lost to a full ring */
+    unsigned long written;
+    struct sr_dumpfile* df;     /* owned by the writer thread */
+    volatile int running;
+    pthread_t thread;
+};
+
+struct sr_logger* sr_logger_open(struct sr_dumpfile* df, uint32_t ring_size);
+int  sr_logger_log(struct sr_logger* log, const uint8_t* buf, unsigned int len,
+                   uint32_t ifindex, uint32_t dir);
+void sr_logger_add_interface(struct sr_logger* log, uint32_t index,
+                             const char* name);
+void sr_logger_close(struct sr_logger* log);
+
+#endif /* -- SR_LOGGER_H -- */
@@ -34,6 +34,19 @@
 #include "sr_router.h"
 #include "sr_rt.h"
 #include "sr_if.h"
+#include "sr_trace.h"
+#include "sr_stats.h"
+#include "sr_latency.h"
+#include "sr_perf.h"
+#include "sr_ctl.h"
+#include "sr_metrics.h"
+#include "sr_vector.h"
+#include "sr_punt.h"
+#include "sr_police.h"
+#include "sr_qos.h"
+#include "sr_acl.h"
+#include "sr_flow.h"
+#include "sr_export.h"
 
 extern char* optarg;
 
@@ -46,6 +59,9 @@ extern char* optarg;
 #define DEFAULT_SERVER "localhost"
 #define DEFAULT_RTABLE "rtable"
 #define DEFAULT_TOPO 0
+#define DEFAULT_LOG_FILES 10
+
+int sr_log_level = 1;
 
 struct sr_instance sr;
 static void usage(char* );
@@ -64,6 +80,11 @@ void sig_int_handler(){
     raise(SIGINT);
 }
 
+/* counters are printed by the ARP cache thread, see sr_stats_poll() */
+void sig_usr1_handler(){
+    sr_stats_dump_pending = 1;
+}
+
 int main(int argc, char **argv)
 {
     int c;
@@ -75,11 +96,34 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    char *filter = 0;
+    int log_format = SR_DUMP_PCAP;
+    unsigned int log_mbytes = 0, log_secs = 0, log_files = 0;
+    char *shm_path = 0;
+    int batching = 0;
+    unsigned int max_msg_len = SR_MSG_LEN_DEFAULT;
+    unsigned int mtu = SR_MTU_DEFAULT;
+    char *tracefile = 0;
+    int lat_sample = -1;
+    char *perf_regions = 0;
+    char *ctl_path = 0;
+    unsigned int metrics_port = 0;
+    unsigned int vec_size = 0;
+    unsigned int punt_depth = 0;
+    struct sr_police *police = 0;
+    struct sr_qos *qos = 0;
+    char *acl_path = 0;
+    unsigned int flows = 0;
+    char *export_spec = 0;
 
     printf("Using %s\n", VERSION_INFO);
     signal(SIGINT, sig_int_handler);
+    signal(SIGUSR1, sig_usr1_handler);
+    /* -Q sends from its own thread, which can outlive the VNS connection;
+     * a write to the closed socket should fail, not kill the router */
+    signal(SIGPIPE, SIG_IGN);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:f:nC:G:W:T:m:bM:j:x:L:P:c:e:V:S:R:Q:A:F:X:")) != EOF)
     {
         switch (c)
         {
@@ -105,17 +149,101 @@ int main(int argc, char **argv)
             case 'l':
                 logfile = optarg;
                 break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'n':
+                log_format = SR_DUMP_PCAPNG;
+                break;
+            case 'C':
+                log_mbytes = atoi((char *) optarg);
+                break;
+            case 'G':
+                log_secs = atoi((char *) optarg);
+                break;
+            case 'W':
+                log_files = atoi((char *) optarg);
+                break;
             case 'r':
                 rtable = optarg;
                 break;
             case 'T':
                 template = optarg;
                 break;
+            case 'm':
+                shm_path = optarg;
+                break;
+            case 'b':
+                batching = 1;
+                break;
+            case 'M':
+                max_msg_len = atoi((char *) optarg);
+                break;
+            case 'j':
+                mtu = atoi((char *) optarg);
+                break;
+            case 'x':
+                tracefile = optarg;
+                break;
+            case 'L':
+                lat_sample = atoi((char *) optarg);
+                break;
+            case 'P':
+                perf_regions = optarg;
+                break;
+            case 'c':
+                ctl_path = optarg;
+                break;
+            case 'e':
+                metrics_port = atoi((char *) optarg);
+                break;
+            case 'V':
+                vec_size = atoi((char *) optarg);
+                break;
+            case 'S':
+                punt_depth = atoi((char *) optarg);
+                break;
+            case 'R':
+                if(!police && (police = sr_police_create()) == 0)
+                { exit(1); }
+                if(sr_police_parse(police, optarg) != 0)
+                { exit(1); }
+                break;
+            case 'Q':
+                if(!qos && (qos = sr_qos_create()) == 0)
+                { exit(1); }
+                if(sr_qos_parse(qos, optarg) != 0)
+                { exit(1); }
+                break;
+            case 'A':
+                acl_path = optarg;
+                break;
+            case 'F':
+                flows = atoi((char *) optarg);
+                break;
+            case 'X':
+                export_spec = optarg;
+                break;
         } /* switch */
     } /* -- while -- */
 
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.police = police;
+    if(acl_path && (sr.acl = sr_acl_load(acl_path)) == 0)
+    { exit(1); }
+    if(flows && (sr.flows = sr_flow_create(flows)) == 0)
+    { exit(1); }
+    if(export_spec)
+    {
+        struct sr_export* ex;
+
+        if(!sr.flows && (sr.flows = sr_flow_create(SR_EXPORT_FLOWS)) == 0)
+        { exit(1); }
+        if((ex = sr_export_open(export_spec)) == 0)
+        { exit(1); }
+        sr_flow_export(sr.flows, ex);
+    }
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
@@ -133,11 +261,50 @@ int main(int argc, char **argv)
     else
     { strncpy(sr.user, user, 32); }
 
+    if(shm_path)
+    { strncpy(sr.shm_path, shm_path, SR_SHM_PATHLEN - 1); }
+    sr.batching = batching;
+
+    if(sr_set_max_msg_len(&sr, max_msg_len) != 0)
+    { exit(1); }
+    if(mtu < SR_MTU_MIN ||
+       mtu > sr.max_frame_len - sizeof(struct sr_ethernet_hdr))
+    {
+        fprintf(stderr,"Error: mtu %u not in [%d, %u], raise -M for jumbo frames\n",
+                mtu, SR_MTU_MIN,
+                (unsigned int)(sr.max_frame_len - sizeof(struct sr_ethernet_hdr)));
+        exit(1);
+    }
+    sr.if_mtu = mtu;
+
+    if(vec_size && (sr.vec = sr_vec_create(vec_size)) == 0)
+    { exit(1); }
+
     /* -- set up file pointer for logging of raw packets -- */
+    if(filter != 0)
+    {
+        if(logfile == 0)
+        { fprintf(stderr,"Warning: -f has no effect without -l\n"); }
+        else if((sr.logfilter = sr_filter_compile(filter)) == 0)
+        { exit(1); }
+        else
+        {
+            Debug("Logging only \"%s\":\n", filter);
+            sr_filter_print(sr.logfilter);
+        }
+    }
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        struct sr_dumpfile* df;
+
+        /* a ring of files only makes sense with a size or age limit */
+        if((log_mbytes || log_secs) && log_files == 0)
+        { log_files = DEFAULT_LOG_FILES; }
+        df = sr_dumpfile_open(logfile, log_format, sr.snaplen,
+                              (uint64_t)log_mbytes * 1000000, log_secs,
+                              log_files);
+        sr.logger = df ? sr_logger_open(df,SR_LOG_RING_BYTES) : 0;
+        if(!sr.logger)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -145,6 +312,33 @@ int main(int argc, char **argv)
         }
     }
 
+    if(tracefile != 0)
+    {
+#ifdef SR_TRACE
+        if(sr_trace_start(tracefile) != 0)
+        { exit(1); }
+#else
+        fprintf(stderr,"Warning: built with TRACE=0, -x has no effect\n");
+#endif
+    }
+
+#ifdef SR_LATENCY
+    sr_latency_init(lat_sample >= 0 ? lat_sample : SR_LAT_SAMPLE_DEFAULT);
+#else
+    if(lat_sample >= 0)
+    { fprintf(stderr,"Warning: built without LATENCY=1, -L has no effect\n"); }
+#endif
+
+    if(perf_regions != 0)
+    {
+#ifdef SR_PERF
+        if(sr_perf_set_regions(perf_regions) != 0)
+        { exit(1); }
+#else
+        fprintf(stderr,"Warning: built without PERF=1, -P has no effect\n");
+#endif
+    }
+
     Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
     if(template)
         Debug("Requesting topology template %s\n", template);
@@ -169,6 +363,19 @@ int main(int argc, char **argv)
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
 
+    if(punt_depth && (sr.punt = sr_punt_open(&sr, punt_depth)) == 0)
+    { exit(1); }
+    if(qos)
+    {
+        if(sr_qos_start(qos, &sr) != 0)
+        { exit(1); }
+        sr.qos = qos;
+    }
+    if(ctl_path && (sr.ctl = sr_ctl_open(&sr, ctl_path)) == 0)
+    { exit(1); }
+    if(metrics_port && sr_metrics_open(&sr, metrics_port) == 0)
+    { exit(1); }
+
     /* -- whizbang main loop ;-) */
     while( sr_read_from_server(&sr) == 1);
 
@@ -188,9 +395,36 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-f log filter] [-n (pcapng)] \n");
+    printf("           [-C MB per log file] [-G seconds per log file] \n");
+    printf("           [-W log files, default %d] \n", DEFAULT_LOG_FILES);
+    printf("           [-m shared memory path] [-b] \n");
+    printf("           [-M max message bytes] [-j interface mtu] \n");
+    printf("           [-x binary trace file] \n");
+    printf("           [-L time 1 in n packets, 0 for none, default %d] \n",
+            SR_LAT_SAMPLE_DEFAULT);
+    printf("           [-P perf counter regions: packet,fib,arp,vector or all] \n");
+    printf("           [-c management socket path] \n");
+    printf("           [-e metrics port on localhost] \n");
+    printf("           [-V vector size, %d to %d, default scalar] \n",
+            SR_VEC_MIN, SR_VEC_MAX);
+    printf("           [-S slow path queue depth, %d to %d, default inline] \n",
+            SR_PUNT_DEPTH_MIN, SR_PUNT_DEPTH_MAX);
+    printf("           [-R rate limits: class=pps[/burst],... for echo,unreach, \n");
+    printf("               timex,local and src/prefix length] \n");
+    printf("           [-Q \"class prio|weight N [dscp A-B] [limit N] [codel|fq N] \n");
+    printf("               [ecn N] [match filter]\", shape [Mbit/s], \n");
+    printf("               codel [target us] [interval us] [noecn], fq N, ecn N \n");
+    printf("               or default; repeat] \n");
+    printf("           [-A access list file] \n");
+    printf("           [-F flow table entries, %d to %d, default none] \n",
+            SR_FLOW_MIN, SR_FLOW_MAX);
+    printf("           [-X IPFIX collector port or file[,sample=N][,kbit=N] \n");
+    printf("               [,active=s][,domain=N]] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
+    printf("            max message=%d mtu=%d \n",
+            SR_MSG_LEN_DEFAULT, SR_MTU_DEFAULT );
 } /* -- usage -- */
 
 /*-----------------------------------------------------------------------------
@@ -227,14 +461,50 @@ void sr_set_user(struct sr_instance* sr)
 
 static void sr_destroy_instance(struct sr_instance* sr)
 {
+    struct sr_metrics* metrics;
+    struct sr_qos* qos;
+    struct sr_flow_table* flows;
+    struct sr_export* export;
+
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
-    {
-        sr_dump_close(sr->logfile);
-    }
+    sr_trace_stop();
+    sr_ctl_close(sr->ctl);
+    sr->ctl = 0;
+    pthread_mutex_lock(&(sr->cache.lock));
+    metrics = sr->metrics;
+    sr->metrics = 0;     /* no more snapshots from the ARP thread */
+    pthread_mutex_unlock(&(sr->cache.lock));
+    sr_metrics_close(metrics);
+    sr_logger_close(sr->logger);
+    sr->logger = 0;
+    sr_vns_print_stats(sr);
+    sr_vec_dump(sr->vec, stdout);
+    sr_stats_dump(sr, stdout);
+    sr_acl_dump(sr->acl, stdout);
+    sr_punt_close(sr->punt);
+    sr->punt = 0;
+    sr_qos_dump(sr->qos, stdout);
+    qos = sr->qos;
+    sr->qos = 0;         /* send directly from here on */
+    sr_qos_destroy(qos);
+    sr_vec_destroy(sr->vec);
+    sr->vec = 0;
+    sr_shm_destroy(sr->shm);
+    sr->shm = 0;
+    pthread_mutex_lock(&(sr->cache.lock));
+    flows = sr->flows;
+    sr->flows = 0;       /* no more aging from the ARP thread */
+    pthread_mutex_unlock(&(sr->cache.lock));
+    export = flows ? flows->export : 0;
+    sr_flow_destroy(flows);
+    sr_export_close(export);
     sr_arpcache_destroy(&(sr->cache));
+    sr_police_destroy(sr->police);
+    sr->police = 0;
+    sr_acl_destroy(sr->acl);
+    sr->acl = 0;
     sr_destroy_interface(sr);
     sr_destory_rt(sr);
 
@@ -261,7 +531,29 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->topo_id = 0;
     sr->if_list = 0;
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->logger = 0;
+    sr->logfilter = 0;
+    sr->shm_path[0] = 0;
+    sr->shm = 0;
+    sr->batching = 0;
+    sr->txbatch.buf = 0;
+    sr->txbatch.len = 0;
+    sr->txbatch.count = 0;
+    pthread_mutex_init(&(sr->txbatch.lock), 0);
+    memset(&(sr->vns_stats), 0, sizeof(sr->vns_stats));
+    sr->max_msg_len = 0;
+    sr->max_frame_len = 0;
+    sr->snaplen = 0;
+    sr->if_mtu = SR_MTU_DEFAULT;
+    sr->ctl = 0;
+    sr->metrics = 0;
+    sr->vec = 0;
+    sr->punt = 0;
+    sr->police = 0;
+    sr->qos = 0;
+    sr->acl = 0;
+    sr->flows = 0;
+    sr->rt_count = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
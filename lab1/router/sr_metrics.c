@@ -0,0 +1,547 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_metrics.c
+ *
+ * Description:
+ *
+ * Snapshots and the HTTP listener for the metrics endpoint, see
+ * sr_metrics.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_metrics.h"
+
+#define SR_METRICS_REQ_MAX 2048
+
+/*---------------------------------------------------------------------
+ * Method: sr_metrics_snapshot(..)
+ * Scope:  Global
+ *
+ * Take a new snapshot for the listener.  Called once a second from the
+ * ARP cache thread with the cache lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+#ifdef SR_LATENCY
+static void sr_metrics_hist(struct sr_metrics_hist* to,
+                            const struct sr_lat_hist* from)
+{
+    static const double bounds[] = SR_METRICS_LAT_BOUNDS;
+    uint64_t seen = 0;
+    unsigned int i;
+    int j = 0;
+
+    memset(to, 0, sizeof(*to));
+    for(i = 0; i < SR_LAT_BUCKETS; i++)
+    {
+        if(from->bucket[i] == 0)
+        { continue; }
+        while(j < SR_METRICS_LAT_NBOUNDS &&
+              sr_latency_bucket_ns(i) > bounds[j] * 1e9)
+        { to->le[j++] = seen; }
+        seen += from->bucket[i];
+    }
+    while(j < SR_METRICS_LAT_NBOUNDS)
+    { to->le[j++] = seen; }
+    to->count = from->count;
+    to->sum = sr_latency_ticks_ns(from->sum) / 1e9;
+} /* -- sr_metrics_hist -- */
+#endif /* SR_LATENCY */
+
+static void sr_metrics_sojourn(struct sr_metrics_qos* to,
+                               const struct sr_lat_hist* from)
+{
+    static const double bounds[] = SR_METRICS_QOS_BOUNDS;
+    uint64_t seen = 0;
+    unsigned int i;
+    int j = 0;
+
+    for(i = 0; i < SR_LAT_BUCKETS; i++)
+    {
+        if(from->bucket[i] == 0)
+        { continue; }
+        while(j < SR_METRICS_QOS_NBOUNDS &&
+              sr_latency_bucket(i) > bounds[j] * 1e9)
+        { to->le[j++] = seen; }
+        seen += from->bucket[i];
+    }
+    while(j < SR_METRICS_QOS_NBOUNDS)
+    { to->le[j++] = seen; }
+    to->count = from->count;
+    to->sum = from->sum / 1e9;
+} /* -- sr_metrics_sojourn -- */
+
+static void sr_metrics_qos(struct sr_metrics_snap* s, struct sr_qos* qos)
+{
+    struct sr_metrics_qos* to;
+    struct sr_qos_queue* q;
+    unsigned int i, c;
+
+    s->qos_classes = qos->nclasses;
+    for(c = 0; c < qos->nclasses; c++)
+    { strcpy(s->qos_class[c], qos->cls[c].name); }
+    for(i = 0; i < SR_QOS_MAX_IFS; i++)
+    {
+        if(qos->ifs[i].name[0] == '\0')
+        { continue; }
+        pthread_mutex_lock(&(qos->ifs[i].lock));
+        for(c = 0; c < qos->nclasses; c++)
+        {
+            q = &(qos->ifs[i].queue[c]);
+            to = &(s->qos[i][c]);
+            to->depth = q->depth;
+            to->sent = q->sent;
+            to->drops = q->drops;
+            to->aqm_drops = q->aqm_drops;
+            to->ecn_marks = q->ecn_marks;
+            sr_metrics_sojourn(to, &(q->wait));
+        }
+        pthread_mutex_unlock(&(qos->ifs[i].lock));
+    }
+} /* -- sr_metrics_qos -- */
+
+void sr_metrics_snapshot(struct sr_instance* sr)
+{
+    struct sr_metrics* m = sr->metrics;
+    struct sr_metrics_snap* s;
+    struct sr_arpreq* req;
+    struct sr_if* if_walker;
+    int i;
+#ifdef SR_LATENCY
+    static struct sr_lat_hist stage[sr_lat_nstages], total[sr_lat_npaths];
+#endif
+
+    if(!m)
+    { return; }
+    s = &(m->next);
+    memset(s, 0, sizeof(*s));
+
+    sr_stats_sum(&(s->stats));
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(if_walker->index < SR_STATS_MAX_IFS)
+        {
+            strncpy(s->ifname[if_walker->index], if_walker->name,
+                    sr_IFACE_NAMELEN - 1);
+        }
+    }
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    { s->arp_entries += sr->cache.entries[i].valid ? 1 : 0; }
+    for(req = sr->cache.requests; req; req = req->next)
+    { s->arp_pending++; }
+    s->fib_routes = sr->rt_count;
+    if(sr->punt)
+    {
+        s->punting = 1;
+        memcpy(s->punts, sr->punt->punts, sizeof(s->punts));
+        memcpy(s->punt_drops, sr->punt->drops, sizeof(s->punt_drops));
+    }
+    if(sr->qos)
+    { sr_metrics_qos(s, sr->qos); }
+    if(sr->police)
+    {
+        s->policing = 1;
+        pthread_mutex_lock(&(sr->police->lock));
+        memcpy(s->police_passed, sr->police->passed, sizeof(s->police_passed));
+        memcpy(s->police_suppressed, sr->police->suppressed,
+               sizeof(s->police_suppressed));
+        memcpy(s->police_src_suppressed, sr->police->src_suppressed,
+               sizeof(s->police_src_suppressed));
+        pthread_mutex_unlock(&(sr->police->lock));
+    }
+
+#ifdef SR_LATENCY
+    sr_latency_sum(stage, total);
+    for(i = 0; i < sr_lat_nstages; i++)
+    { sr_metrics_hist(&(s->stage[i]), &stage[i]); }
+    for(i = 0; i < sr_lat_npaths; i++)
+    { sr_metrics_hist(&(s->path[i]), &total[i]); }
+#endif
+
+    pthread_mutex_lock(&(m->lock));
+    memcpy(&(m->snap), s, sizeof(*s));
+    pthread_mutex_unlock(&(m->lock));
+} /* -- sr_metrics_snapshot -- */
+
+/* -----------------------------------------------------------------------
+ * Rendering
+ * --------------------------------------------------------------------- */
+
+static void sr_metrics_head(FILE* fp, const char* name, const char* type,
+                            const char* help)
+{
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+} /* -- sr_metrics_head -- */
+
+#define SR_METRICS_IF(fp, s, name, help, field)                            \
+    do {                                                                   \
+        int i_;                                                            \
+        sr_metrics_head(fp, name, "counter", help);                        \
+        for(i_ = 0; i_ < SR_STATS_MAX_IFS; i_++)                           \
+        {                                                                  \
+            if((s)->ifname[i_][0])                                         \
+            {                                                              \
+                fprintf(fp, "%s{interface=\"%s\"} %llu\n", name,           \
+                        (s)->ifname[i_],                                   \
+                        (unsigned long long)(s)->stats.ifs[i_].field);     \
+            }                                                              \
+        }                                                                  \
+    } while(0)
+
+#ifdef SR_LATENCY
+static void sr_metrics_print_hist(FILE* fp, const char* name,
+                                  const char* label, const char* value,
+                                  const struct sr_metrics_hist* h)
+{
+    static const double bounds[] = SR_METRICS_LAT_BOUNDS;
+    int j;
+
+    for(j = 0; j < SR_METRICS_LAT_NBOUNDS; j++)
+    {
+        fprintf(fp, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label,
+                value, bounds[j], (unsigned long long)h->le[j]);
+    }
+    fprintf(fp, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label,
+            value, (unsigned long long)h->count);
+    fprintf(fp, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value, h->sum);
+    fprintf(fp, "%s_count{%s=\"%s\"} %llu\n", name, label, value,
+            (unsigned long long)h->count);
+} /* -- sr_metrics_print_hist -- */
+#endif /* SR_LATENCY */
+
+#define SR_METRICS_QOS(fp, s, name, labels, fmt, expr)                     \
+    do {                                                                   \
+        unsigned int i_, c_;                                               \
+        const struct sr_metrics_qos* q_;                                   \
+        for(i_ = 0; i_ < SR_QOS_MAX_IFS; i_++)                             \
+        {                                                                  \
+            if(!(s)->ifname[i_][0])                                        \
+            { continue; }                                                  \
+            for(c_ = 0; c_ < (s)->qos_classes; c_++)                       \
+            {                                                              \
+                q_ = &((s)->qos[i_][c_]);                                  \
+                fprintf(fp, "%s{interface=\"%s\",class=\"%s\"%s} " fmt "\n", \
+                        name, (s)->ifname[i_], (s)->qos_class[c_], labels, \
+                        expr);                                             \
+            }                                                              \
+        }                                                                  \
+    } while(0)
+
+static void sr_metrics_render_qos(FILE* fp, const struct sr_metrics_snap* s)
+{
+    static const double bounds[] = SR_METRICS_QOS_BOUNDS;
+    char le[32];
+    int j;
+
+    sr_metrics_head(fp, "sr_qos_queue_depth", "gauge",
+                    "Frames waiting in each output queue.");
+    SR_METRICS_QOS(fp, s, "sr_qos_queue_depth", "", "%u", q_->depth);
+    sr_metrics_head(fp, "sr_qos_sent_total", "counter",
+                    "Frames sent from each output queue.");
+    SR_METRICS_QOS(fp, s, "sr_qos_sent_total", "", "%llu",
+                   (unsigned long long)q_->sent);
+    sr_metrics_head(fp, "sr_qos_drops_total", "counter",
+                    "Frames dropped because the output queue was full.");
+    SR_METRICS_QOS(fp, s, "sr_qos_drops_total", "", "%llu",
+                   (unsigned long long)q_->drops);
+    sr_metrics_head(fp, "sr_qos_codel_drops_total", "counter",
+                    "Frames CoDel dropped from each output queue.");
+    SR_METRICS_QOS(fp, s, "sr_qos_codel_drops_total", "", "%llu",
+                   (unsigned long long)q_->aqm_drops);
+    sr_metrics_head(fp, "sr_qos_ecn_marks_total", "counter",
+                    "Frames CoDel marked CE rather than dropped.");
+    SR_METRICS_QOS(fp, s, "sr_qos_ecn_marks_total", "", "%llu",
+                   (unsigned long long)q_->ecn_marks);
+    sr_metrics_head(fp, "sr_qos_sojourn_seconds", "histogram",
+                    "Time frames spent in each output queue.");
+    for(j = 0; j < SR_METRICS_QOS_NBOUNDS; j++)
+    {
+        snprintf(le, sizeof(le), ",le=\"%g\"", bounds[j]);
+        SR_METRICS_QOS(fp, s, "sr_qos_sojourn_seconds_bucket", le, "%llu",
+                       (unsigned long long)q_->le[j]);
+    }
+    SR_METRICS_QOS(fp, s, "sr_qos_sojourn_seconds_bucket", ",le=\"+Inf\"",
+                   "%llu", (unsigned long long)q_->count);
+    SR_METRICS_QOS(fp, s, "sr_qos_sojourn_seconds_sum", "", "%.9f", q_->sum);
+    SR_METRICS_QOS(fp, s, "sr_qos_sojourn_seconds_count", "", "%llu",
+                   (unsigned long long)q_->count);
+} /* -- sr_metrics_render_qos -- */
+
+static void sr_metrics_render(FILE* fp, const struct sr_metrics_snap* s)
+{
+    int i;
+
+    SR_METRICS_IF(fp, s, "sr_interface_rx_packets_total",
+                  "Frames received per interface.", rx_pkts);
+    SR_METRICS_IF(fp, s, "sr_interface_rx_bytes_total",
+                  "Bytes received per interface.", rx_bytes);
+    SR_METRICS_IF(fp, s, "sr_interface_tx_packets_total",
+                  "Frames sent per interface.", tx_pkts);
+    SR_METRICS_IF(fp, s, "sr_interface_tx_bytes_total",
+                  "Bytes sent per interface.", tx_bytes);
+
+    sr_metrics_head(fp, "sr_drops_total", "counter",
+                    "Frames dropped, by reason.");
+    for(i = 0; i < sr_drop_count; i++)
+    {
+        fprintf(fp, "sr_drops_total{reason=\"%s\"} %llu\n",
+                sr_stats_drop_name(i), (unsigned long long)s->stats.drops[i]);
+    }
+
+    sr_metrics_head(fp, "sr_arp_cache_entries", "gauge",
+                    "Valid entries in the ARP cache.");
+    fprintf(fp, "sr_arp_cache_entries %u\n", s->arp_entries);
+    sr_metrics_head(fp, "sr_arp_pending_requests", "gauge",
+                    "Next hops waiting for an ARP reply.");
+    fprintf(fp, "sr_arp_pending_requests %u\n", s->arp_pending);
+    sr_metrics_head(fp, "sr_arp_cache_hits_total", "counter",
+                    "Forwarded frames whose next hop was in the ARP cache.");
+    fprintf(fp, "sr_arp_cache_hits_total %llu\n",
+            (unsigned long long)s->stats.arp_hits);
+    sr_metrics_head(fp, "sr_arp_cache_misses_total", "counter",
+                    "Forwarded frames queued for an ARP request.");
+    fprintf(fp, "sr_arp_cache_misses_total %llu\n",
+            (unsigned long long)s->stats.arp_misses);
+
+    sr_metrics_head(fp, "sr_fib_routes", "gauge",
+                    "Entries in the routing table.");
+    fprintf(fp, "sr_fib_routes %u\n", s->fib_routes);
+
+    if(s->punting)
+    {
+        sr_metrics_head(fp, "sr_punts_total", "counter",
+                        "Frames handed to the slow path, by reason.");
+        for(i = 0; i < sr_punt_count; i++)
+        {
+            fprintf(fp, "sr_punts_total{reason=\"%s\"} %llu\n",
+                    sr_punt_reason_name(i), (unsigned long long)s->punts[i]);
+        }
+        sr_metrics_head(fp, "sr_punt_drops_total", "counter",
+                        "Frames dropped because the slow path queue was full, by reason.");
+        for(i = 0; i < sr_punt_count; i++)
+        {
+            fprintf(fp, "sr_punt_drops_total{reason=\"%s\"} %llu\n",
+                    sr_punt_reason_name(i),
+                    (unsigned long long)s->punt_drops[i]);
+        }
+    }
+
+    if(s->policing)
+    {
+        sr_metrics_head(fp, "sr_police_passed_total", "counter",
+                        "ICMP messages sent and datagrams to the router let"
+                        " through by -R, by class.");
+        for(i = 0; i < sr_police_count; i++)
+        {
+            fprintf(fp, "sr_police_passed_total{class=\"%s\"} %llu\n",
+                    sr_police_class_name(i),
+                    (unsigned long long)s->police_passed[i]);
+        }
+        sr_metrics_head(fp, "sr_police_suppressed_total", "counter",
+                        "ICMP messages and datagrams to the router suppressed"
+                        " by -R, by class and by the bucket that ran out.");
+        for(i = 0; i < sr_police_count; i++)
+        {
+            fprintf(fp, "sr_police_suppressed_total{class=\"%s\",bucket=\"class\"} %llu\n",
+                    sr_police_class_name(i),
+                    (unsigned long long)s->police_suppressed[i]);
+            fprintf(fp, "sr_police_suppressed_total{class=\"%s\",bucket=\"src\"} %llu\n",
+                    sr_police_class_name(i),
+                    (unsigned long long)s->police_src_suppressed[i]);
+        }
+    }
+
+    if(s->qos_classes)
+    { sr_metrics_render_qos(fp, s); }
+
+#ifdef SR_LATENCY
+    sr_metrics_head(fp, "sr_packet_latency_seconds", "histogram",
+                    "Time in the router per sampled packet, by path.");
+    for(i = 0; i < sr_lat_npaths; i++)
+    {
+        sr_metrics_print_hist(fp, "sr_packet_latency_seconds", "path",
+                              sr_latency_path_name(i), &(s->path[i]));
+    }
+    sr_metrics_head(fp, "sr_stage_latency_seconds", "histogram",
+                    "Time per stage of sr_handlepacket for sampled packets.");
+    for(i = 0; i < sr_lat_nstages; i++)
+    {
+        sr_metrics_print_hist(fp, "sr_stage_latency_seconds", "stage",
+                              sr_latency_stage_name(i), &(s->stage[i]));
+    }
+#endif
+} /* -- sr_metrics_render -- */
+
+/* -----------------------------------------------------------------------
+ * HTTP
+ * --------------------------------------------------------------------- */
+
+static int sr_metrics_write(int fd, const char* buf, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0)
+    {
+        if((n = send(fd, buf, len, MSG_NOSIGNAL)) < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+} /* -- sr_metrics_write -- */
+
+static void sr_metrics_serve(struct sr_metrics* m, int fd)
+{
+    static struct sr_metrics_snap snap;
+    char req[SR_METRICS_REQ_MAX + 1];
+    char hdr[160];
+    char* body = 0;
+    size_t blen = 0, used = 0;
+    const char* status = "200 OK";
+    ssize_t n;
+    FILE* fp;
+
+    /* the request line and headers, we only look at the former */
+    while(used < SR_METRICS_REQ_MAX)
+    {
+        if((n = recv(fd, req + used, SR_METRICS_REQ_MAX - used, 0)) <= 0)
+        { return; }
+        used += n;
+        req[used] = 0;
+        if(strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+        { break; }
+    }
+
+    if((fp = open_memstream(&body, &blen)) == 0)
+    { return; }
+    if(strncmp(req, "GET /metrics ", 13) == 0 ||
+       strncmp(req, "GET / ", 6) == 0)
+    {
+        pthread_mutex_lock(&(m->lock));
+        memcpy(&snap, &(m->snap), sizeof(snap));
+        pthread_mutex_unlock(&(m->lock));
+        sr_metrics_render(fp, &snap);
+    }
+    else
+    {
+        status = "404 Not Found";
+        fprintf(fp, "try /metrics\n");
+    }
+    fclose(fp);
+
+    n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %lu\r\n"
+                 "Connection: close\r\n\r\n", status, (unsigned long)blen);
+    if(sr_metrics_write(fd, hdr, n) == 0)
+    { sr_metrics_write(fd, body, blen); }
+    free(body);
+} /* -- sr_metrics_serve -- */
+
+/* one scrape at a time is plenty for a scraper on the same host */
+static void* sr_metrics_thread(void* arg)
+{
+    struct sr_metrics* m = (struct sr_metrics*)arg;
+    struct timeval tv;
+    int fd;
+
+    for(;;)
+    {
+        if((fd = accept(m->fd, 0, 0)) < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            { continue; }
+            break; /* shut down by sr_metrics_close() */
+        }
+        tv.tv_sec = 2;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        sr_metrics_serve(m, fd);
+        close(fd);
+    }
+    return 0;
+} /* -- sr_metrics_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_metrics_open(..)
+ * Scope:  Global
+ *
+ * Listen on 127.0.0.1:port and start the listener thread.  Returns 0 on
+ * failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_metrics* sr_metrics_open(struct sr_instance* sr, unsigned short port)
+{
+    struct sr_metrics* m;
+    struct sockaddr_in addr;
+    int on = 1;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    m = (struct sr_metrics*)calloc(1, sizeof(struct sr_metrics));
+    assert(m);
+    pthread_mutex_init(&(m->lock), 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if((m->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+       setsockopt(m->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+       bind(m->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+       listen(m->fd, 8) < 0)
+    {
+        perror("socket(..):sr_metrics.c::sr_metrics_open");
+        if(m->fd >= 0)
+        { close(m->fd); }
+        free(m);
+        return 0;
+    }
+
+    pthread_mutex_lock(&(sr->cache.lock));
+    sr->metrics = m;
+    sr_metrics_snapshot(sr);
+    pthread_mutex_unlock(&(sr->cache.lock));
+    if(pthread_create(&(m->thread), 0, sr_metrics_thread, m) != 0)
+    {
+        perror("pthread_create(..):sr_metrics.c::sr_metrics_open");
+        pthread_mutex_lock(&(sr->cache.lock));
+        sr->metrics = 0;
+        pthread_mutex_unlock(&(sr->cache.lock));
+        close(m->fd);
+        free(m);
+        return 0;
+    }
+    return m;
+} /* -- sr_metrics_open -- */
+
+void sr_metrics_close(struct sr_metrics* m)
+{
+    if(!m)
+    { return; }
+    shutdown(m->fd, SHUT_RDWR);  /* wakes accept() */
+    pthread_join(m->thread, 0);
+    close(m->fd);
+    pthread_mutex_destroy(&(m->lock));
+    free(m);
+} /* -- sr_metrics_close -- */
@@ -0,0 +1,108 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_metrics.h
+ *
+ * Description:
+ *
+ * Prometheus metrics endpoint (sr -e port).  A thread of its own answers
+ * HTTP GET /metrics on 127.0.0.1:port in the Prometheus text format.
+ *
+ * Scrapes are rendered from a snapshot, not from the live counters: once a
+ * second the ARP cache thread, which already holds the cache lock, sums
+ * the per-thread counters of sr_stats.h (and with LATENCY=1 the latency
+ * histograms), counts the ARP cache and reads the routing table size into
+ * a new snapshot.  The listener only ever reads snapshots, so a scrape
+ * costs the packet path nothing and sees values at most a second old.
+ *
+ *   sr_interface_{rx,tx}_{packets,bytes}_total{interface}  counters
+ *   sr_drops_total{reason}                                  counter
+ *   sr_arp_cache_entries, sr_arp_pending_requests           gauges
+ *   sr_arp_cache_{hits,misses}_total                        counters
+ *   sr_fib_routes                                           gauge
+ *   sr_packet_latency_seconds{path}, sr_stage_latency_seconds{stage}
+ *                                                  histograms, LATENCY=1
+ *   sr_qos_{sent,drops,codel_drops,ecn_marks}_total{interface,class}
+ *   sr_qos_queue_depth{interface,class}, sr_qos_sojourn_seconds{..}  -Q
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_METRICS_H
+#define SR_METRICS_H
+
+#include <pthread.h>
+
+#include "sr_if.h"
+#include "sr_stats.h"
+#include "sr_latency.h"
+#include "sr_punt.h"
+#include "sr_police.h"
+#include "sr_qos.h"
+
+/* upper bounds of the latency histogram buckets, in seconds */
+#define SR_METRICS_LAT_BOUNDS \
+    { 250e-9, 500e-9, 1e-6, 2e-6, 4e-6, 8e-6, 16e-6, 32e-6, 64e-6, 128e-6, \
+      1e-3 }
+#define SR_METRICS_LAT_NBOUNDS 11
+
+struct sr_metrics_hist
+{
+    uint64_t le[SR_METRICS_LAT_NBOUNDS];   /* cumulative */
+    uint64_t count;
+    double sum;                            /* seconds */
+};
+
+/* upper bounds of the -Q sojourn time buckets, in seconds */
+#define SR_METRICS_QOS_BOUNDS \
+    { 100e-6, 500e-6, 1e-3, 5e-3, 10e-3, 50e-3, 100e-3, 500e-3 }
+#define SR_METRICS_QOS_NBOUNDS 8
+
+struct sr_metrics_qos
+{
+    unsigned int depth;
+    uint64_t sent;
+    uint64_t drops;
+    uint64_t aqm_drops;
+    uint64_t ecn_marks;
+    uint64_t le[SR_METRICS_QOS_NBOUNDS];   /* sojourn time, cumulative */
+    uint64_t count;
+    double sum;                            /* s */
+};
+
+struct sr_metrics_snap
+{
+    struct sr_stats_totals stats;
+    char ifname[SR_STATS_MAX_IFS][sr_IFACE_NAMELEN];
+    unsigned int arp_entries;
+    unsigned int arp_pending;
+    unsigned int fib_routes;
+    int punting;                     /* -S given */
+    uint64_t punts[sr_punt_count];
+    uint64_t punt_drops[sr_punt_count];
+    int policing;                    /* -R given */
+    uint64_t police_passed[sr_police_count];
+    uint64_t police_suppressed[sr_police_count];
+    uint64_t police_src_suppressed[sr_police_count];
+    unsigned int qos_classes;        /* -Q given if not 0 */
+    char qos_class[SR_QOS_MAX_CLASSES][SR_QOS_NAMELEN];
+    struct sr_metrics_qos qos[SR_QOS_MAX_IFS][SR_QOS_MAX_CLASSES];
+#ifdef SR_LATENCY
+    struct sr_metrics_hist stage[sr_lat_nstages];
+    struct sr_metrics_hist path[sr_lat_npaths];
+#endif
+};
+
+struct sr_instance;
+
+struct sr_metrics
+{
+    int fd;                          /* listening socket */
+    pthread_t thread;
+    pthread_mutex_t lock;            /* guards snap */
+    struct sr_metrics_snap snap;
+    struct sr_metrics_snap next;     /* being filled by sr_metrics_snapshot */
+};
+
+struct sr_metrics* sr_metrics_open(struct sr_instance* sr, unsigned short port);
+void sr_metrics_close(struct sr_metrics* m);
+void sr_metrics_snapshot(struct sr_instance* sr);
+
+#endif /* -- SR_METRICS_H -- */
@@ -0,0 +1,700 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_microbench.c
+ *
+ * Description:
+ *
+ * Micro-benchmarks for the router's building blocks, each timed on its own
+ * over a range of sizes:
+ *
+ *   cksum            cksum() over 'len' bytes
+ *   lpm              lpm() with 'routes' entries in the routing table
+ *   arp_lookup       sr_arpcache_lookup() hit, 'fill' valid entries
+ *   arp_lookup_miss  the same for an address not in the cache
+ *   arp_insert       sr_arpcache_insert() into a cache holding 'fill'
+ *   arp_queuereq     sr_arpcache_queuereq() onto one of 'pending' requests
+ *   get_interface    sr_get_interface() with 'ifaces' interfaces
+ *   icmp_echo        send_icmp_echo_packet() for a 'payload' byte request
+ *   icmp_error       send_icmp_error_packet() (time exceeded), 'payload'
+ *   icmp_frag_needed send_icmp_frag_needed_packet()
+ *
+ *   usage: sr_microbench [-o out.json] [-b baseline.json] [-t seconds]
+ *                        [-r runs] [benchmark ...]
+ *
+ * Each benchmark runs for about -t seconds (default 0.1) per repetition;
+ * the median and fastest of -r repetitions (default 3) are reported in
+ * nanoseconds per call.  Results are written as JSON, one result object
+ * per line so that the file is also easy to grep and diff.  With -b, the
+ * results of an earlier run are read first and each result gains
+ * baseline_ns and change_pct (negative is faster); a comparison table goes
+ * to stderr.  Naming benchmarks on the command line runs only those.
+ *
+ * "make bench" runs the whole suite into bench.json; "make bench
+ * BASELINE=old.json" compares against a saved run.
+ *
+ * Like sr_bench, this links the real router objects against a stub
+ * sr_send_packet() that only counts frames.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_utils.h"
+
+#define MB_MAX_FRAME   9018
+#define MB_NADDRS      4096      /* lookup keys cycled through, power of two */
+#define MB_QUEUE_BATCH 1024      /* queued packets between request teardowns */
+#define MB_MAX_RESULTS 128
+#define MB_MAX_RUNS    31
+
+int sr_log_level = 0;
+
+/* -----------------------------------------------------------------------
+ * Stub transport
+ * --------------------------------------------------------------------- */
+
+static unsigned long mb_tx_frames;
+
+int sr_send_packet(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   const char* iface)
+{
+    mb_tx_frames++;
+    return 0;
+}
+
+void sr_flush_packets(struct sr_instance* sr)
+{
+}
+
+/* -----------------------------------------------------------------------
+ * Setup
+ * --------------------------------------------------------------------- */
+
+static struct sr_instance mb_sr;
+static uint32_t mb_addrs[MB_NADDRS];
+static uint8_t mb_frame[MB_MAX_FRAME];
+static volatile uint32_t mb_sink;    /* keeps results from being optimized out */
+
+static uint32_t mb_rand(void)
+{
+    static uint32_t x = 2463534242u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+static void mb_mac(unsigned char* mac, int host)
+{
+    mac[0] = 0x02; mac[1] = 0x00; mac[2] = 0x5e;
+    mac[3] = 0x00; mac[4] = (host >> 8) & 0xff; mac[5] = host & 0xff;
+}
+
+/* n interfaces eth1..ethn; eth1-3 are the lab's (see ../IP_CONFIG) */
+static void mb_interfaces(int n)
+{
+    static const char* lab[] = { "192.168.2.1", "172.64.3.1", "10.0.1.1" };
+    unsigned char mac[ETHER_ADDR_LEN];
+    char name[sr_IFACE_NAMELEN];
+    struct sr_if* next;
+    int i;
+
+    while(mb_sr.if_list)
+    {
+        next = mb_sr.if_list->next;
+        free(mb_sr.if_list);
+        mb_sr.if_list = next;
+    }
+    for(i = 0; i < n; i++)
+    {
+        snprintf(name, sizeof(name), "eth%d", i + 1);
+        mb_mac(mac, i + 1);
+        sr_add_interface(&mb_sr, name);
+        sr_set_ether_addr(&mb_sr, mac);
+        sr_set_ether_ip(&mb_sr, i < 3 ? inet_addr(lab[i])
+                                      : htonl(0x0a640001 + (i << 8)));
+        sr_set_ether_mtu(&mb_sr, SR_MTU_DEFAULT);
+    }
+}
+
+static void mb_free_routes(void)
+{
+    struct sr_rt* next;
+
+    while(mb_sr.routing_table)
+    {
+        next = mb_sr.routing_table->next;
+        free(mb_sr.routing_table);
+        mb_sr.routing_table = next;
+    }
+    mb_sr.rt_count = 0;
+}
+
+/* the lab's three routes plus random /8../32 prefixes; half the lookup keys
+ * fall inside a route, the rest are random */
+static void mb_routes(unsigned long n)
+{
+    static const char* lab[][4] = {
+        { "10.0.1.0",    "10.0.1.100",  "255.255.255.0",   "eth3" },
+        { "192.168.2.2", "192.168.2.2", "255.255.255.255", "eth1" },
+        { "172.64.3.0",  "172.64.3.10", "255.255.255.0",   "eth2" },
+    };
+    static uint32_t dests[10000];
+    struct in_addr dest, gw, mask;
+    char iface[sr_IFACE_NAMELEN];
+    unsigned long i;
+    int len;
+
+    mb_free_routes();
+    for(i = 0; i < n; i++)
+    {
+        if(i < 3)
+        {
+            inet_aton(lab[i][0], &dest);
+            inet_aton(lab[i][1], &gw);
+            inet_aton(lab[i][2], &mask);
+            strcpy(iface, lab[i][3]);
+        }
+        else
+        {
+            len = 8 + mb_rand() % 25;
+            mask.s_addr = htonl(len == 32 ? 0xffffffff
+                                          : ~(0xffffffffu >> len));
+            dest.s_addr = mb_rand() & mask.s_addr;
+            gw.s_addr = inet_addr("10.0.1.100");
+            snprintf(iface, sizeof(iface), "eth%lu", 1 + i % 3);
+        }
+        dests[i % 10000] = dest.s_addr;
+        sr_add_rt_entry(&mb_sr, dest, gw, mask, iface);
+    }
+    for(i = 0; i < MB_NADDRS; i++)
+    {
+        mb_addrs[i] = (i & 1) ? mb_rand()
+                              : dests[mb_rand() % (n < 10000 ? n : 10000)] |
+                                (mb_rand() & htonl(0xff));
+    }
+}
+
+/* 'fill' valid entries for 10.1.x.y, and lookup keys cycling over them */
+static void mb_arp_fill(int fill)
+{
+    unsigned char mac[ETHER_ADDR_LEN];
+    int i;
+
+    memset(mb_sr.cache.entries, 0, sizeof(mb_sr.cache.entries));
+    for(i = 0; i < fill; i++)
+    {
+        mb_mac(mac, 0x100 + i);
+        sr_arpcache_insert(&mb_sr.cache, mac, htonl(0x0a010000 + i));
+    }
+    for(i = 0; i < MB_NADDRS; i++)
+    { mb_addrs[i] = htonl(0x0a010000 + (fill ? i % fill : 0)); }
+}
+
+/* an ICMP echo request of 'payload' bytes from the client to eth3 */
+static unsigned int mb_echo_frame(unsigned int payload)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)mb_frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*)(ip + 1);
+    unsigned int icmp_len = sizeof(sr_icmp_hdr_t) + 4 + payload;
+
+    memset(mb_frame, 0, sizeof(mb_frame));
+    mb_mac(eth->ether_dhost, 3);
+    mb_mac(eth->ether_shost, 0x200);
+    eth->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(sizeof(sr_ip_hdr_t) + icmp_len);
+    ip->ip_ttl = 64;
+    ip->ip_p = ip_protocol_icmp;
+    ip->ip_src = inet_addr("10.0.1.100");
+    ip->ip_dst = inet_addr("10.0.1.1");
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+    icmp->icmp_type = 8;
+    icmp->icmp_sum = cksum(icmp, icmp_len);
+    return sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + icmp_len;
+}
+
+/* -----------------------------------------------------------------------
+ * Benchmarks: setup(param), then run(param, iterations) returns the
+ * nanoseconds spent in the timed part
+ * --------------------------------------------------------------------- */
+
+static double mb_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void mb_setup_none(unsigned long v)
+{
+}
+
+static double mb_cksum(unsigned long len, unsigned long n)
+{
+    double t0 = mb_now();
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    { mb_sink += cksum(mb_frame + (i & 7), (int)len); }
+    return mb_now() - t0;
+}
+
+static void mb_setup_lpm(unsigned long routes)
+{
+    mb_interfaces(3);
+    mb_routes(routes);
+}
+
+static double mb_lpm(unsigned long routes, unsigned long n)
+{
+    double t0 = mb_now();
+    struct sr_rt* rt;
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    {
+        rt = lpm(&mb_sr, mb_addrs[i & (MB_NADDRS - 1)]);
+        mb_sink += (rt != 0);
+    }
+    return mb_now() - t0;
+}
+
+static void mb_setup_arp(unsigned long fill)
+{
+    mb_arp_fill((int)fill);
+}
+
+static double mb_arp_lookup(unsigned long fill, unsigned long n)
+{
+    double t0 = mb_now();
+    struct sr_arpentry* e;
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    {
+        e = sr_arpcache_lookup(&mb_sr.cache, mb_addrs[i & (MB_NADDRS - 1)]);
+        mb_sink += (e != 0);
+        free(e);
+    }
+    return mb_now() - t0;
+}
+
+static double mb_arp_lookup_miss(unsigned long fill, unsigned long n)
+{
+    double t0 = mb_now();
+    struct sr_arpentry* e;
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    {
+        e = sr_arpcache_lookup(&mb_sr.cache, htonl(0x0b000000 + (i & 0xff)));
+        mb_sink += (e != 0);
+        free(e);
+    }
+    return mb_now() - t0;
+}
+
+/* fill-1 entries stay, the last slot is inserted and freed again */
+static void mb_setup_arp_insert(unsigned long fill)
+{
+    mb_arp_fill((int)fill - 1);
+}
+
+static double mb_arp_insert(unsigned long fill, unsigned long n)
+{
+    unsigned char mac[ETHER_ADDR_LEN];
+    double t0 = mb_now();
+    unsigned long i;
+
+    mb_mac(mac, 0x300);
+    for(i = 0; i < n; i++)
+    {
+        mb_sink += (sr_arpcache_insert(&mb_sr.cache, mac,
+                                       htonl(0x0a020000 + (i & 0xff))) != 0);
+        mb_sr.cache.entries[fill - 1].valid = 0;
+    }
+    return mb_now() - t0;
+}
+
+static void mb_setup_queuereq(unsigned long pending)
+{
+    mb_interfaces(3);
+    mb_arp_fill(0);
+    mb_echo_frame(56);
+}
+
+static void mb_drop_requests(void)
+{
+    while(mb_sr.cache.requests)
+    { sr_arpreq_destroy(&mb_sr.cache, mb_sr.cache.requests); }
+}
+
+static double mb_arp_queuereq(unsigned long pending, unsigned long n)
+{
+    double t = 0, t0;
+    unsigned long i, j, m;
+
+    for(i = 0; i < n; i += m)
+    {
+        m = (n - i < MB_QUEUE_BATCH) ? n - i : MB_QUEUE_BATCH;
+        t0 = mb_now();
+        for(j = 0; j < m; j++)
+        {
+            sr_arpcache_queuereq(&mb_sr.cache, htonl(0x0a030000 + j % pending),
+                                 mb_frame, 98, "eth1");
+        }
+        t += mb_now() - t0;
+        mb_drop_requests();
+    }
+    return t;
+}
+
+static void mb_setup_interfaces(unsigned long ifaces)
+{
+    mb_interfaces((int)ifaces);
+}
+
+static double mb_get_interface(unsigned long ifaces, unsigned long n)
+{
+    char names[64][sr_IFACE_NAMELEN];
+    double t0;
+    unsigned long i;
+
+    for(i = 0; i < ifaces && i < 64; i++)
+    { snprintf(names[i], sr_IFACE_NAMELEN, "eth%lu", i + 1); }
+    t0 = mb_now();
+    for(i = 0; i < n; i++)
+    { mb_sink += (sr_get_interface(&mb_sr, names[i % ifaces]) != 0); }
+    return mb_now() - t0;
+}
+
+static void mb_setup_icmp(unsigned long payload)
+{
+    mb_interfaces(3);
+    mb_echo_frame((unsigned int)payload);
+}
+
+static double mb_icmp_echo(unsigned long payload, unsigned long n)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)mb_frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    unsigned int len = sizeof(*eth) + ntohs(ip->ip_len);
+    double t0 = mb_now();
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    {
+        send_icmp_echo_packet(&mb_sr, "eth3", len, ip->ip_dst, eth, ip,
+                              (sr_icmp_hdr_t*)(ip + 1));
+    }
+    return mb_now() - t0;
+}
+
+static double mb_icmp_error(unsigned long payload, unsigned long n)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)mb_frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    unsigned int len = sizeof(*eth) + ntohs(ip->ip_len);
+    double t0 = mb_now();
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    { send_icmp_error_packet(&mb_sr, "eth3", len, 0, eth, ip, 11, 0); }
+    return mb_now() - t0;
+}
+
+static double mb_icmp_frag_needed(unsigned long mtu, unsigned long n)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)mb_frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    double t0 = mb_now();
+    unsigned long i;
+
+    for(i = 0; i < n; i++)
+    { send_icmp_frag_needed_packet(&mb_sr, "eth3", eth, ip, mtu); }
+    return mb_now() - t0;
+}
+
+struct mb_bench
+{
+    const char* name;
+    const char* param;
+    unsigned long values[6];   /* zero terminated */
+    void (*setup)(unsigned long);
+    double (*run)(unsigned long, unsigned long);
+};
+
+static const struct mb_bench mb_benches[] = {
+    { "cksum",           "len",     { 20, 64, 576, 1500, 9000 },
+      mb_setup_none,       mb_cksum },
+    { "lpm",             "routes",  { 3, 100, 1000, 10000 },
+      mb_setup_lpm,        mb_lpm },
+    { "arp_lookup",      "fill",    { 1, 10, 50, SR_ARPCACHE_SZ },
+      mb_setup_arp,        mb_arp_lookup },
+    { "arp_lookup_miss", "fill",    { 1, 10, 50, SR_ARPCACHE_SZ },
+      mb_setup_arp,        mb_arp_lookup_miss },
+    { "arp_insert",      "fill",    { 1, 10, 50, SR_ARPCACHE_SZ },
+      mb_setup_arp_insert, mb_arp_insert },
+    { "arp_queuereq",    "pending", { 1, 10, 100 },
+      mb_setup_queuereq,   mb_arp_queuereq },
+    { "get_interface",   "ifaces",  { 3, 8, 16, 64 },
+      mb_setup_interfaces, mb_get_interface },
+    { "icmp_echo",       "payload", { 56, 512, 1472 },
+      mb_setup_icmp,       mb_icmp_echo },
+    { "icmp_error",      "payload", { 56, 512, 1472 },
+      mb_setup_icmp,       mb_icmp_error },
+    { "icmp_frag_needed", "mtu",    { 1400 },
+      mb_setup_icmp,       mb_icmp_frag_needed },
+};
+#define MB_NBENCHES (sizeof(mb_benches) / sizeof(mb_benches[0]))
+
+/* -----------------------------------------------------------------------
+ * Results
+ * --------------------------------------------------------------------- */
+
+struct mb_result
+{
+    char name[32];
+    char param[16];
+    unsigned long value;
+    unsigned long iterations;
+    double ns_per_op;          /* median of the runs */
+    double ns_min;
+    double baseline_ns;        /* 0 if not in the baseline */
+};
+
+static struct mb_result mb_results[MB_MAX_RESULTS];
+static int mb_nresults;
+static struct mb_result mb_baseline[MB_MAX_RESULTS];
+static int mb_nbaseline;
+
+static int mb_cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void mb_measure(const struct mb_bench* b, unsigned long v,
+                       double min_ns, int runs)
+{
+    struct mb_result* r = &mb_results[mb_nresults++];
+    double ns[MB_MAX_RUNS];
+    unsigned long n = 16;
+    double t;
+    int i;
+
+    b->setup(v);
+
+    /* warm up, and grow n until one run takes min_ns */
+    while((t = b->run(v, n)) < min_ns && n < (1ul << 40))
+    { n = (t < min_ns / 64) ? n * 8 : (unsigned long)(n * min_ns / t) + 1; }
+
+    for(i = 0; i < runs; i++)
+    { ns[i] = b->run(v, n) / n; }
+    qsort(ns, runs, sizeof(double), mb_cmp_double);
+
+    strncpy(r->name, b->name, sizeof(r->name) - 1);
+    strncpy(r->param, b->param, sizeof(r->param) - 1);
+    r->value = v;
+    r->iterations = n;
+    r->ns_per_op = ns[runs / 2];
+    r->ns_min = ns[0];
+    for(i = 0; i < mb_nbaseline; i++)
+    {
+        if(strcmp(mb_baseline[i].name, r->name) == 0 &&
+           mb_baseline[i].value == r->value)
+        { r->baseline_ns = mb_baseline[i].ns_per_op; }
+    }
+}
+
+/* result lines of an earlier run; anything else in the file is skipped */
+static void mb_load_baseline(const char* path)
+{
+    struct mb_result* r;
+    char line[512];
+    FILE* fp;
+
+    if((fp = fopen(path, "r")) == 0)
+    {
+        perror(path);
+        exit(1);
+    }
+    while(mb_nbaseline < MB_MAX_RESULTS && fgets(line, sizeof(line), fp))
+    {
+        r = &mb_baseline[mb_nbaseline];
+        if(sscanf(line, " {\"name\": \"%31[^\"]\", \"param\": \"%15[^\"]\", "
+                  "\"value\": %lu, \"iterations\": %lu, \"ns_per_op\": %lf",
+                  r->name, r->param, &r->value, &r->iterations,
+                  &r->ns_per_op) == 5)
+        { mb_nbaseline++; }
+    }
+    fclose(fp);
+    if(mb_nbaseline == 0)
+    {
+        fprintf(stderr, "%s: no results found\n", path);
+        exit(1);
+    }
+}
+
+static void mb_write_json(FILE* fp, double min_ns, int runs,
+                          const char* baseline)
+{
+    struct utsname u;
+    time_t now = time(0);
+    char date[32];
+    int i;
+
+    uname(&u);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(fp, "{\n  \"suite\": \"sr_microbench\",\n  \"date\": \"%s\",\n"
+            "  \"host\": \"%s %s\",\n  \"min_time_s\": %.3f,\n  \"runs\": %d,\n",
+            date, u.nodename, u.machine, min_ns / 1e9, runs);
+    if(baseline)
+    { fprintf(fp, "  \"baseline\": \"%s\",\n", baseline); }
+    fprintf(fp, "  \"results\": [\n");
+    for(i = 0; i < mb_nresults; i++)
+    {
+        struct mb_result* r = &mb_results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"param\": \"%s\", \"value\": %lu, "
+                "\"iterations\": %lu, \"ns_per_op\": %.3f, \"ns_min\": %.3f",
+                r->name, r->param, r->value, r->iterations, r->ns_per_op,
+                r->ns_min);
+        if(r->baseline_ns > 0)
+        {
+            fprintf(fp, ", \"baseline_ns\": %.3f, \"change_pct\": %.1f",
+                    r->baseline_ns,
+                    100.0 * (r->ns_per_op - r->baseline_ns) / r->baseline_ns);
+        }
+        fprintf(fp, "}%s\n", i + 1 < mb_nresults ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+static void mb_print_comparison(void)
+{
+    struct mb_result* r;
+    int i;
+
+    fprintf(stderr, "%-18s %-8s %8s %12s %12s %9s\n", "benchmark", "param",
+            "value", "baseline ns", "ns/op", "change");
+    for(i = 0; i < mb_nresults; i++)
+    {
+        r = &mb_results[i];
+        if(r->baseline_ns > 0)
+        {
+            fprintf(stderr, "%-18s %-8s %8lu %12.1f %12.1f %8.1f%%\n",
+                    r->name, r->param, r->value, r->baseline_ns, r->ns_per_op,
+                    100.0 * (r->ns_per_op - r->baseline_ns) / r->baseline_ns);
+        }
+        else
+        {
+            fprintf(stderr, "%-18s %-8s %8lu %12s %12.1f %9s\n", r->name,
+                    r->param, r->value, "-", r->ns_per_op, "new");
+        }
+    }
+}
+
+static void usage(char* argv0)
+{
+    unsigned int i;
+
+    fprintf(stderr, "usage: %s [-o out.json] [-b baseline.json] "
+            "[-t seconds] [-r runs] [benchmark ...]\nbenchmarks:", argv0);
+    for(i = 0; i < MB_NBENCHES; i++)
+    { fprintf(stderr, " %s", mb_benches[i].name); }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    const char* out = 0;
+    const char* baseline = 0;
+    double min_ns = 0.1e9;
+    int runs = 3;
+    unsigned int i, j;
+    int c, k, selected;
+    FILE* fp = stdout;
+
+    while((c = getopt(argc, argv, "ho:b:t:r:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'o': out = optarg; break;
+            case 'b': baseline = optarg; break;
+            case 't': min_ns = atof(optarg) * 1e9; break;
+            case 'r': runs = atoi(optarg); break;
+            default:  usage(argv[0]);
+        }
+    }
+    if(min_ns <= 0 || runs < 1 || runs > MB_MAX_RUNS)
+    { usage(argv[0]); }
+    for(k = optind; k < argc; k++)
+    {
+        for(i = 0; i < MB_NBENCHES; i++)
+        {
+            if(strcmp(argv[k], mb_benches[i].name) == 0)
+            { break; }
+        }
+        if(i == MB_NBENCHES)
+        { usage(argv[0]); }
+    }
+
+    /* read before writing, the baseline may be the output file */
+    if(baseline)
+    { mb_load_baseline(baseline); }
+
+    memset(&mb_sr, 0, sizeof(mb_sr));
+    mb_sr.max_msg_len = SR_MSG_LEN_DEFAULT;
+    mb_sr.max_frame_len = MB_MAX_FRAME;
+    mb_sr.if_mtu = SR_MTU_DEFAULT;
+    sr_arpcache_init(&mb_sr.cache);   /* no sweeper thread */
+    for(i = 0; i < sizeof(mb_frame); i++)
+    { mb_frame[i] = (uint8_t)mb_rand(); }
+
+    for(i = 0; i < MB_NBENCHES; i++)
+    {
+        selected = (optind == argc);
+        for(k = optind; k < argc; k++)
+        { selected |= (strcmp(argv[k], mb_benches[i].name) == 0); }
+        if(!selected)
+        { continue; }
+        for(j = 0; j < 6 && mb_benches[i].values[j]; j++)
+        {
+            mb_measure(&mb_benches[i], mb_benches[i].values[j], min_ns, runs);
+            fprintf(stderr, "%-18s %-8s %8lu %10.1f ns\n",
+                    mb_benches[i].name, mb_benches[i].param,
+                    mb_benches[i].values[j],
+                    mb_results[mb_nresults - 1].ns_per_op);
+        }
+    }
+
+    if(baseline)
+    {
+        fprintf(stderr, "\n");
+        mb_print_comparison();
+    }
+    if(out && (fp = fopen(out, "w")) == 0)
+    {
+        perror(out);
+        return 1;
+    }
+    mb_write_json(fp, min_ns, runs, baseline);
+    if(fp != stdout)
+    { fclose(fp); }
+    return 0;
+}
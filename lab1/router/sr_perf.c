@@ -0,0 +1,326 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_perf.c
+ *
+ * Description:
+ *
+ * perf_event_open(2) counter groups per thread, see sr_perf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif /* _LINUX_ */
+
+#include "sr_perf.h"
+
+unsigned int sr_perf_mask = 0;
+
+#define SR_PERF_NAME(id, name) name,
+static const char* sr_perf_region_names[] = { SR_PERF_REGIONS(SR_PERF_NAME) 0 };
+static const char* sr_perf_event_names[] = { SR_PERF_EVENTS(SR_PERF_NAME) 0 };
+#undef SR_PERF_NAME
+
+/*---------------------------------------------------------------------
+ * Method: sr_perf_set_regions(..)
+ * Scope:  Global
+ *
+ * Count the regions in the comma separated 'list' ("all" for every one).
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_perf_set_regions(const char* list)
+{
+    const char* p = list;
+    size_t n;
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(list);
+
+    sr_perf_mask = 0;
+    while(*p)
+    {
+        n = strcspn(p, ",");
+        if(n == 3 && strncmp(p, "all", 3) == 0)
+        { sr_perf_mask = (1u << sr_perf_nregions) - 1; }
+        else
+        {
+            for(i = 0; i < sr_perf_nregions; i++)
+            {
+                if(strlen(sr_perf_region_names[i]) == n &&
+                   strncmp(p, sr_perf_region_names[i], n) == 0)
+                { break; }
+            }
+            if(i == sr_perf_nregions)
+            {
+                fprintf(stderr, "Error: unknown perf region \"%.*s\" "
+                        "(packet, fib, arp or all)\n", (int)n, p);
+                sr_perf_mask = 0;
+                return -1;
+            }
+            sr_perf_mask |= 1u << i;
+        }
+        p += n;
+        if(*p == ',')
+        { p++; }
+    }
+    return 0;
+} /* -- sr_perf_set_regions -- */
+
+#ifdef _LINUX_
+
+struct sr_perf_thread
+{
+    int leader;                       /* group fd, -1 when nothing opened */
+    int nopen;
+    int slot[sr_perf_nevents];        /* position in the group read, or -1 */
+    int multiplexed;                  /* the group was not always counting */
+    uint64_t start[sr_perf_nregions][sr_perf_nevents];
+    uint64_t sum[sr_perf_nregions][sr_perf_nevents];
+    uint64_t count[sr_perf_nregions];
+    struct sr_perf_thread* next;
+};
+
+/* PERF_FORMAT_GROUP with both times */
+struct sr_perf_read
+{
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    uint64_t value[sr_perf_nevents];
+};
+
+static __thread struct sr_perf_thread* sr_perf_self = 0;
+static struct sr_perf_thread* sr_perf_threads = 0;
+static pthread_mutex_t sr_perf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sr_perf_event_attr(int event, struct perf_event_attr* attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->read_format = PERF_FORMAT_GROUP |
+                        PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+
+    switch(event)
+    {
+        case sr_pev_cycles:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case sr_pev_instructions:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case sr_pev_l1d_miss:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case sr_pev_llc_miss:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_LL |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case sr_pev_branch_miss:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+} /* -- sr_perf_event_attr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_perf_thread_open(..)
+ * Scope:  Local
+ *
+ * Open the counters for the calling thread, leaving out the events that
+ * cannot be had.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_perf_thread* sr_perf_thread_open(void)
+{
+    struct sr_perf_thread* t;
+    struct perf_event_attr attr;
+    int i, fd, err = 0;
+
+    t = (struct sr_perf_thread*)calloc(1, sizeof(struct sr_perf_thread));
+    assert(t);
+    t->leader = -1;
+    for(i = 0; i < sr_perf_nevents; i++)
+    {
+        t->slot[i] = -1;
+        sr_perf_event_attr(i, &attr);
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, t->leader, 0);
+        if(fd < 0)
+        {
+            err = errno;
+            continue;
+        }
+        if(t->leader < 0)
+        { t->leader = fd; }
+        t->slot[i] = t->nopen++;
+    }
+
+    if(t->leader < 0)
+    {
+        fprintf(stderr, "Warning: no perf counters (%s), -P has no effect\n",
+                strerror(err));
+    }
+    else if(t->nopen < sr_perf_nevents)
+    {
+        fprintf(stderr, "Warning: %d of %d perf counters unavailable\n",
+                sr_perf_nevents - t->nopen, sr_perf_nevents);
+    }
+
+    pthread_mutex_lock(&sr_perf_lock);
+    t->next = sr_perf_threads;
+    sr_perf_threads = t;
+    pthread_mutex_unlock(&sr_perf_lock);
+
+    sr_perf_self = t;
+    return t;
+} /* -- sr_perf_thread_open -- */
+
+static int sr_perf_read_group(struct sr_perf_thread* t, struct sr_perf_read* r)
+{
+    if(read(t->leader, r, sizeof(*r)) < (ssize_t)(3 * sizeof(uint64_t)))
+    { return -1; }
+    if(r->time_running < r->time_enabled)
+    { t->multiplexed = 1; }
+    return 0;
+} /* -- sr_perf_read_group -- */
+
+void sr_perf_begin(int region)
+{
+    struct sr_perf_thread* t = sr_perf_self;
+    struct sr_perf_read r;
+    int i;
+
+    if(!t)
+    { t = sr_perf_thread_open(); }
+    if(t->leader < 0 || sr_perf_read_group(t, &r) != 0)
+    { return; }
+    for(i = 0; i < sr_perf_nevents; i++)
+    {
+        if(t->slot[i] >= 0)
+        { t->start[region][i] = r.value[t->slot[i]]; }
+    }
+} /* -- sr_perf_begin -- */
+
+void sr_perf_end(int region)
+{
+    struct sr_perf_thread* t = sr_perf_self;
+    struct sr_perf_read r;
+    int i;
+
+    if(!t || t->leader < 0 || sr_perf_read_group(t, &r) != 0)
+    { return; }
+    for(i = 0; i < sr_perf_nevents; i++)
+    {
+        if(t->slot[i] >= 0)
+        { t->sum[region][i] += r.value[t->slot[i]] - t->start[region][i]; }
+    }
+    t->count[region]++;
+} /* -- sr_perf_end -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_perf_dump(..)
+ * Scope:  Global
+ *
+ * Print the average of every counter per run of each region.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_perf_dump(FILE* fp)
+{
+    uint64_t sum[sr_perf_nregions][sr_perf_nevents];
+    uint64_t count[sr_perf_nregions];
+    int have[sr_perf_nevents];
+    struct sr_perf_thread* t;
+    int i, j, multiplexed = 0;
+
+    if(!sr_perf_mask)
+    { return; }
+
+    memset(sum, 0, sizeof(sum));
+    memset(count, 0, sizeof(count));
+    memset(have, 0, sizeof(have));
+    pthread_mutex_lock(&sr_perf_lock);
+    for(t = sr_perf_threads; t; t = t->next)
+    {
+        multiplexed |= t->multiplexed;
+        for(j = 0; j < sr_perf_nevents; j++)
+        { have[j] |= (t->slot[j] >= 0); }
+        for(i = 0; i < sr_perf_nregions; i++)
+        {
+            count[i] += t->count[i];
+            for(j = 0; j < sr_perf_nevents; j++)
+            { sum[i][j] += t->sum[i][j]; }
+        }
+    }
+    pthread_mutex_unlock(&sr_perf_lock);
+
+    for(j = 0; j < sr_perf_nevents && !have[j]; j++);
+    if(j == sr_perf_nevents)
+    {
+        fprintf(fp, "perf counters: none available\n");
+        return;
+    }
+
+    fprintf(fp, "perf counters, average per run%s\n",
+            multiplexed ? " (multiplexed, counts are low)" : "");
+    fprintf(fp, "  %-8s %10s", "region", "runs");
+    for(j = 0; j < sr_perf_nevents; j++)
+    { fprintf(fp, " %12s", sr_perf_event_names[j]); }
+    fprintf(fp, " %6s\n", "ipc");
+    for(i = 0; i < sr_perf_nregions; i++)
+    {
+        if(!(sr_perf_mask & (1u << i)) || count[i] == 0)
+        { continue; }
+        fprintf(fp, "  %-8s %10llu", sr_perf_region_names[i],
+                (unsigned long long)count[i]);
+        for(j = 0; j < sr_perf_nevents; j++)
+        {
+            if(have[j])
+            { fprintf(fp, " %12.1f", (double)sum[i][j] / count[i]); }
+            else
+            { fprintf(fp, " %12s", "n/a"); }
+        }
+        if(have[sr_pev_cycles] && have[sr_pev_instructions] &&
+           sum[i][sr_pev_cycles])
+        {
+            fprintf(fp, " %6.2f", (double)sum[i][sr_pev_instructions] /
+                                  sum[i][sr_pev_cycles]);
+        }
+        fprintf(fp, "\n");
+    }
+} /* -- sr_perf_dump -- */
+
+#else /* -- not _LINUX_ -- */
+
+void sr_perf_begin(int region) { }
+void sr_perf_end(int region) { }
+
+void sr_perf_dump(FILE* fp)
+{
+    if(sr_perf_mask)
+    { fprintf(fp, "perf counters need Linux\n"); }
+}
+
+#endif /* _LINUX_ */
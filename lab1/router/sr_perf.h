@@ -0,0 +1,70 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_perf.h
+ *
+ * Description:
+ *
+ * Hardware performance counters around regions of the packet path, for
+ * sr -P.  Each region reads one perf_event_open(2) group (cycles,
+ * instructions, L1D and last level cache read misses, branch misses) on
+ * entry and exit and adds up the difference; the stats dump divides by the
+ * number of times the region ran.  Only user space is counted.
+ *
+ * Counters are per thread and opened on first use.  Events the kernel or
+ * hardware will not give (virtual machines often lack some) are left out
+ * and shown as n/a; if none can be opened the regions are not counted and
+ * the router runs as usual.  Built without PERF=1, or off Linux, the
+ * marks compile to nothing.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PERF_H
+#define SR_PERF_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_PERF_REGIONS(X) \
+    X(sr_perf_packet, "packet") \
+    X(sr_perf_fib,    "fib")    \
+    X(sr_perf_arp,    "arp")    \
+    X(sr_perf_vector, "vector")
+
+#define SR_PERF_EVENTS(X) \
+    X(sr_pev_cycles,       "cycles")      \
+    X(sr_pev_instructions, "instructions") \
+    X(sr_pev_l1d_miss,     "l1d-miss")    \
+    X(sr_pev_llc_miss,     "llc-miss")    \
+    X(sr_pev_branch_miss,  "branch-miss")
+
+#define SR_PERF_ENUM(id, name) id,
+enum sr_perf_region { SR_PERF_REGIONS(SR_PERF_ENUM) sr_perf_nregions };
+enum sr_perf_event  { SR_PERF_EVENTS(SR_PERF_ENUM) sr_perf_nevents };
+#undef SR_PERF_ENUM
+
+extern unsigned int sr_perf_mask;   /* 1 << region for the regions counted */
+
+int  sr_perf_set_regions(const char* list);
+void sr_perf_begin(int region);
+void sr_perf_end(int region);
+void sr_perf_dump(FILE* fp);
+
+#if defined(SR_PERF) && defined(_LINUX_)
+#define SR_PERF_BEGIN(r) \
+    do { if(__builtin_expect(sr_perf_mask & (1u << (r)), 0)) \
+           sr_perf_begin(r); } while(0)
+#define SR_PERF_END(r) \
+    do { if(__builtin_expect(sr_perf_mask & (1u << (r)), 0)) \
+           sr_perf_end(r); } while(0)
+#else
+#define SR_PERF_BEGIN(r) do{}while(0)
+#define SR_PERF_END(r)   do{}while(0)
+#endif /* SR_PERF */
+
+#endif /* -- SR_PERF_H -- */
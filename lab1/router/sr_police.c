@@ -0,0 +1,325 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_police.c
+ *
+ * Description:
+ *
+ * Token buckets for control-plane policing, see sr_police.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sr_police.h"
+#include "sr_router.h"
+
+#define SR_TOKEN 1000000000ULL
+
+static const char* sr_police_names[] = {
+#define SR_POLICE_NAME(id, name) name,
+    SR_POLICE_CLASSES(SR_POLICE_NAME)
+#undef SR_POLICE_NAME
+};
+
+static uint64_t sr_police_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+} /* -- sr_police_now -- */
+
+static void sr_bucket_set(struct sr_bucket* b, uint32_t rate, uint32_t burst,
+                          uint64_t now)
+{
+    b->rate = rate;
+    b->burst = burst;
+    b->tokens = (uint64_t)burst * SR_TOKEN;
+    b->last = now;
+} /* -- sr_bucket_set -- */
+
+/* refill for the time since the last call, then take a token if there is
+ * one */
+static int sr_bucket_take(struct sr_bucket* b, uint64_t now)
+{
+    uint64_t full = (uint64_t)b->burst * SR_TOKEN;
+    uint64_t elapsed;
+
+    if(b->rate == 0)
+    { return 1; }
+    if(now > b->last)
+    {
+        elapsed = now - b->last;
+        /* no need to count past a full bucket, and no overflow */
+        if(elapsed >= full / b->rate)
+        { b->tokens = full; }
+        else if((b->tokens += elapsed * b->rate) > full)
+        { b->tokens = full; }
+        b->last = now;
+    }
+    if(b->tokens < SR_TOKEN)
+    { return 0; }
+    b->tokens -= SR_TOKEN;
+    return 1;
+} /* -- sr_bucket_take -- */
+
+/* give back the token of a packet another bucket stopped */
+static void sr_bucket_refund(struct sr_bucket* b)
+{
+    uint64_t full = (uint64_t)b->burst * SR_TOKEN;
+
+    if(b->rate != 0 && (b->tokens += SR_TOKEN) > full)
+    { b->tokens = full; }
+} /* -- sr_bucket_refund -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_police_create(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_police* sr_police_create(void)
+{
+    struct sr_police* police;
+
+    if((police = (struct sr_police*)calloc(1, sizeof(struct sr_police))) == 0)
+    {
+        perror("calloc");
+        return 0;
+    }
+    pthread_mutex_init(&(police->lock), 0);
+    return police;
+} /* -- sr_police_create -- */
+
+void sr_police_destroy(struct sr_police* police)
+{
+    if(!police)
+    { return; }
+    pthread_mutex_destroy(&(police->lock));
+    free(police->slots);
+    free(police);
+} /* -- sr_police_destroy -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_police_parse(..)
+ * Scope: Global
+ *
+ * Parse one -R argument, a comma separated list of class=rate[/burst].
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_police_item(struct sr_police* police, char* item)
+{
+    char *eq, *end;
+    unsigned long rate, burst, len;
+    int cls;
+
+    if((eq = strchr(item, '=')) == 0)
+    {
+        fprintf(stderr, "Error: rate limit \"%s\" is not class=rate[/burst]\n",
+                item);
+        return -1;
+    }
+    *eq = '\0';
+
+    rate = strtoul(eq + 1, &end, 10);
+    burst = rate;
+    if(*end == '/')
+    { burst = strtoul(end + 1, &end, 10); }
+    if(*end != '\0' || rate == 0 || rate > SR_POLICE_RATE_MAX ||
+       burst == 0 || burst > SR_POLICE_RATE_MAX)
+    {
+        fprintf(stderr, "Error: rate limit for %s: \"%s\" is not a rate in"
+                " [1, %d] with an optional /burst\n", item, eq + 1,
+                SR_POLICE_RATE_MAX);
+        return -1;
+    }
+
+    if(strncmp(item, "src/", 4) == 0)
+    {
+        len = strtoul(item + 4, &end, 10);
+        if(*end != '\0' || item[4] == '\0' || len < 1 || len > 32)
+        {
+            fprintf(stderr, "Error: rate limit \"%s\": prefix length not in"
+                    " [1, 32]\n", item);
+            return -1;
+        }
+        if(!police->slots &&
+           (police->slots = (struct sr_police_slot*)calloc(SR_POLICE_SLOTS,
+                                sizeof(struct sr_police_slot))) == 0)
+        {
+            perror("calloc");
+            return -1;
+        }
+        police->src_mask = htonl(0xffffffffUL << (32 - len));
+        sr_bucket_set(&(police->src), (uint32_t)rate, (uint32_t)burst, 0);
+        memset(police->slots, 0, SR_POLICE_SLOTS * sizeof(struct sr_police_slot));
+        return 0;
+    }
+
+    for(cls = 0; cls < sr_police_count; cls++)
+    {
+        if(strcmp(item, sr_police_names[cls]) == 0)
+        {
+            sr_bucket_set(&(police->cls[cls]), (uint32_t)rate,
+                          (uint32_t)burst, sr_police_now());
+            return 0;
+        }
+    }
+    fprintf(stderr, "Error: unknown rate limit class \"%s\", expected echo,"
+            " unreach, timex, local or src/LEN\n", item);
+    return -1;
+} /* -- sr_police_item -- */
+
+int sr_police_parse(struct sr_police* police, const char* spec)
+{
+    char *copy, *item, *save = 0;
+    int rc = 0;
+
+    if((copy = strdup(spec)) == 0)
+    {
+        perror("strdup");
+        return -1;
+    }
+    for(item = strtok_r(copy, ",", &save); item && rc == 0;
+        item = strtok_r(0, ",", &save))
+    { rc = sr_police_item(police, item); }
+    free(copy);
+    return rc;
+} /* -- sr_police_parse -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_police_slot(..)
+ * Scope: Local
+ *
+ * The bucket of 'prefix': its slot in the set the prefix hashes to, else a
+ * free slot with a full bucket, else the least recently charged slot with
+ * its bucket as it is.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_police_slot* sr_police_slot(struct sr_police* police,
+                                             uint32_t prefix, uint64_t now)
+{
+    struct sr_police_slot *set, *victim;
+    uint32_t h = ntohl(prefix) * 2654435761U;
+    int i;
+
+    set = &(police->slots[(h >> (32 - SR_POLICE_SET_BITS)) * SR_POLICE_WAYS]);
+    victim = set;
+    for(i = 0; i < SR_POLICE_WAYS; i++)
+    {
+        if(set[i].used && set[i].prefix == prefix)
+        { return &(set[i]); }
+        if(victim->used && (!set[i].used || set[i].b.last < victim->b.last))
+        { victim = &(set[i]); }
+    }
+    if(!victim->used)
+    {
+        victim->used = 1;
+        sr_bucket_set(&(victim->b), police->src.rate, police->src.burst, now);
+    }
+    victim->prefix = prefix;
+    return victim;
+} /* -- sr_police_slot -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_police(..)
+ * Scope: Global
+ *
+ * Charge one packet of class 'cls' to the bucket of the source prefix
+ * 'addr' belongs to and to its class bucket.  The class is only charged
+ * if the prefix lets the packet through, and the prefix gets its token
+ * back if the class does not, so one prefix's flood does not use up the
+ * class for the others.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_police(struct sr_instance* sr, int cls, uint32_t addr)
+{
+    struct sr_police* police = sr->police;
+    struct sr_police_slot* slot = 0;
+    uint64_t now;
+    int ok = 1;
+
+    pthread_mutex_lock(&(police->lock));
+    now = sr_police_now();
+    if(police->src_mask)
+    {
+        slot = sr_police_slot(police, addr & police->src_mask, now);
+        if(!sr_bucket_take(&(slot->b), now))
+        {
+            police->src_suppressed[cls]++;
+            ok = 0;
+        }
+    }
+    if(ok && !sr_bucket_take(&(police->cls[cls]), now))
+    {
+        police->suppressed[cls]++;
+        ok = 0;
+        if(slot)
+        { sr_bucket_refund(&(slot->b)); }
+    }
+    if(ok)
+    { police->passed[cls]++; }
+    pthread_mutex_unlock(&(police->lock));
+    return ok;
+} /* -- sr_police -- */
+
+int sr_police_icmp_class(uint8_t type)
+{
+    switch(type)
+    {
+        case ECHO_REPLY_TYPE:
+            return sr_police_echo;
+        case TIME_EXCEEDED_TYPE:
+            return sr_police_timex;
+        default:
+            return sr_police_unreach;
+    }
+} /* -- sr_police_icmp_class -- */
+
+const char* sr_police_class_name(int cls)
+{
+    return (cls >= 0 && cls < sr_police_count) ? sr_police_names[cls] : "unknown";
+} /* -- sr_police_class_name -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_police_dump(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_police_dump(struct sr_police* police, FILE* fp)
+{
+    int i;
+
+    if(!police)
+    { return; }
+    pthread_mutex_lock(&(police->lock));
+    fprintf(fp, "%-12s %10s %8s %12s %12s %12s\n", "policer", "rate", "burst",
+            "passed", "suppressed", "by src");
+    for(i = 0; i < sr_police_count; i++)
+    {
+        if(police->cls[i].rate)
+        {
+            fprintf(fp, "%-12s %10u %8u", sr_police_names[i],
+                    police->cls[i].rate, police->cls[i].burst);
+        }
+        else
+        { fprintf(fp, "%-12s %10s %8s", sr_police_names[i], "-", "-"); }
+        fprintf(fp, " %12llu %12llu %12llu\n",
+                (unsigned long long)police->passed[i],
+                (unsigned long long)police->suppressed[i],
+                (unsigned long long)police->src_suppressed[i]);
+    }
+    if(police->src_mask)
+    {
+        fprintf(fp, "src/%-8d %10u %8u\n",
+                32 - __builtin_ctz(ntohl(police->src_mask)),
+                police->src.rate, police->src.burst);
+    }
+    pthread_mutex_unlock(&(police->lock));
+} /* -- sr_police_dump -- */
@@ -0,0 +1,111 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_police.h
+ *
+ * Description:
+ *
+ * Control-plane policing (-R).  Token buckets limit what the router spends
+ * on itself:
+ *
+ *   echo     echo replies sent
+ *   unreach  destination unreachable sent (net, host, port, frag needed)
+ *   timex    time exceeded sent
+ *   local    datagrams addressed to one of the router's interfaces
+ *
+ * and, with src/LEN, a bucket per source prefix of LEN bits that is charged
+ * for both: the errors and replies sent to the prefix and the datagrams
+ * it sends to the router.  Something must pass both its prefix bucket and
+ * its class bucket, and is charged to neither if it does not.
+ *
+ *   -R timex=100,unreach=100/20,src/24=10
+ *
+ * gives every class a rate in packets per second and, after the '/', a
+ * burst (default: one second's worth).  Classes not given are unlimited.
+ *
+ * A suppressed ICMP message is simply not built; the frame that caused it
+ * was already counted as dropped.  A policed datagram to the router is
+ * dropped as "policed" before it is copied to the slow path (-S).  The
+ * suppressed counts are in the dump and on the metrics endpoint.
+ *
+ * The prefix buckets are a table of SR_POLICE_WAYS-way sets.  A new prefix
+ * gets a free slot of its set with a full bucket or, when the set is full,
+ * takes over the slot charged longest ago with its bucket as it is, so a
+ * flood spread over more prefixes than a set holds shares the rate of the
+ * slots it lands in instead of getting a fresh burst per prefix.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_POLICE_H
+#define SR_POLICE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SR_POLICE_RATE_MAX  10000000     /* packets per second */
+#define SR_POLICE_SET_BITS  10
+#define SR_POLICE_WAYS      4            /* prefix buckets per set */
+#define SR_POLICE_SLOTS     (SR_POLICE_WAYS << SR_POLICE_SET_BITS)
+
+#define SR_POLICE_CLASSES(X) \
+    X(sr_police_echo,    "echo")    \
+    X(sr_police_unreach, "unreach") \
+    X(sr_police_timex,   "timex")   \
+    X(sr_police_local,   "local")
+
+#define SR_POLICE_ENUM(id, name) id,
+enum sr_police_class { SR_POLICE_CLASSES(SR_POLICE_ENUM) sr_police_count };
+#undef SR_POLICE_ENUM
+
+struct sr_instance;
+
+/* tokens are kept in billionths so a nanosecond of refill is exact */
+struct sr_bucket
+{
+    uint64_t tokens;
+    uint64_t last;                       /* ns */
+    uint32_t rate;                       /* per second, 0 for unlimited */
+    uint32_t burst;
+};
+
+struct sr_police_slot
+{
+    uint32_t prefix;
+    uint32_t used;
+    struct sr_bucket b;
+};
+
+struct sr_police
+{
+    struct sr_bucket cls[sr_police_count];
+
+    uint32_t src_mask;                   /* network order, 0 for no src/LEN */
+    struct sr_bucket src;                /* rate and burst for new slots */
+    struct sr_police_slot* slots;
+
+    /* all under lock: ICMP is sent from the packet thread, the slow path
+     * and the ARP thread */
+    pthread_mutex_t lock;
+    uint64_t passed[sr_police_count];
+    uint64_t suppressed[sr_police_count];     /* by the class bucket */
+    uint64_t src_suppressed[sr_police_count]; /* by the prefix bucket */
+};
+
+struct sr_police* sr_police_create(void);
+void sr_police_destroy(struct sr_police* police);
+/* add "class=rate[/burst],..." to the configuration, -1 on a bad spec */
+int  sr_police_parse(struct sr_police* police, const char* spec);
+
+/* 1 if a packet of 'cls' to or from 'addr' (network order) may go */
+int  sr_police(struct sr_instance* sr, int cls, uint32_t addr);
+int  sr_police_icmp_class(uint8_t type);
+const char* sr_police_class_name(int cls);
+void sr_police_dump(struct sr_police* police, FILE* fp);
+
+#endif /* -- SR_POLICE_H -- */
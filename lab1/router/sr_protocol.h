@@ -119,6 +119,11 @@ struct sr_ip_hdr
 #error "Byte ordering ot specified " 
 #endif 
     uint8_t ip_tos;			/* type of service */
+#define	IP_ECN_MASK 0x03		/* ECN field of ip_tos (RFC 3168) */
+#define	IP_ECN_NOT_ECT 0x00		/* not ECN-capable */
+#define	IP_ECN_ECT1 0x01		/* ECN-capable */
+#define	IP_ECN_ECT0 0x02
+#define	IP_ECN_CE 0x03			/* congestion experienced */
     uint16_t ip_len;			/* total length */
     uint16_t ip_id;			/* identification */
     uint16_t ip_off;			/* fragment offset field */
@@ -133,6 +138,11 @@ struct sr_ip_hdr
   } __attribute__ ((packed)) ;
 typedef struct sr_ip_hdr sr_ip_hdr_t;
 
+/* IP options (RFC 791) */
+#define	IP_OPT_EOL 0			/* end of option list */
+#define	IP_OPT_NOP 1			/* no operation */
+#define	IP_OPT_COPIED 0x80		/* copied into every fragment */
+
 /* 
  *  Ethernet packet header prototype.  Too many O/S's define this differently.
  *  Easy enough to solve that and define it here.
@@ -152,6 +162,8 @@ typedef struct sr_ethernet_hdr sr_ethernet_hdr_t;
 
 enum sr_ip_protocol {
   ip_protocol_icmp = 0x0001,
+  ip_protocol_tcp = 0x0006,
+  ip_protocol_udp = 0x0011,
 };
 
 enum sr_ethertype {
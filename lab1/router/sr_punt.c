@@ -0,0 +1,316 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_punt.c
+ *
+ * Description:
+ *
+ * Slow-path queue and thread, see sr_punt.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef _LINUX_
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif /* _LINUX_ */
+
+#include "sr_punt.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_arpcache.h"
+#include "sr_stats.h"
+
+__thread int sr_punt_slow_thread = 0;
+
+static const char* sr_punt_names[] = {
+#define SR_PUNT_NAME(id, name) name,
+    SR_PUNT_REASONS(SR_PUNT_NAME)
+#undef SR_PUNT_NAME
+};
+
+static void* sr_punt_thread(void* arg);
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_open(..)
+ * Scope: Global
+ *
+ * Create the queue, 'depth' frames of up to sr->max_frame_len bytes, and
+ * start the slow-path thread.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_punt* sr_punt_open(struct sr_instance* sr, unsigned int depth)
+{
+    struct sr_punt* punt;
+    uint32_t nslots = SR_PUNT_DEPTH_MIN;
+
+    if(depth < SR_PUNT_DEPTH_MIN || depth > SR_PUNT_DEPTH_MAX)
+    {
+        fprintf(stderr, "Error: slow path queue depth %u not in [%d, %d]\n",
+                depth, SR_PUNT_DEPTH_MIN, SR_PUNT_DEPTH_MAX);
+        return 0;
+    }
+    while(nslots < depth)
+    { nslots <<= 1; }
+
+    if((punt = (struct sr_punt*)calloc(1, sizeof(struct sr_punt))) == 0)
+    {
+        perror("calloc");
+        return 0;
+    }
+    punt->sr = sr;
+    punt->nslots = nslots;
+    /* keep every slot 8-byte aligned */
+    punt->slot_size = (sizeof(struct sr_punt_rec) + sr->max_frame_len + 7) & ~7u;
+    if((punt->slots = (uint8_t*)malloc((size_t)nslots * punt->slot_size)) == 0)
+    {
+        perror("malloc");
+        free(punt);
+        return 0;
+    }
+    pthread_mutex_init(&(punt->lock), 0);
+    pthread_cond_init(&(punt->cond), 0);
+    punt->running = 1;
+    if(pthread_create(&(punt->thread), 0, sr_punt_thread, punt) != 0)
+    {
+        perror("pthread_create(..):sr_punt.c::sr_punt_open");
+        free(punt->slots);
+        free(punt);
+        return 0;
+    }
+    return punt;
+} /* -- sr_punt_open -- */
+
+void sr_punt_close(struct sr_punt* punt)
+{
+    if(!punt)
+    { return; }
+    pthread_mutex_lock(&(punt->lock));
+    punt->running = 0;
+    pthread_cond_signal(&(punt->cond));
+    pthread_mutex_unlock(&(punt->lock));
+    pthread_join(punt->thread, 0);
+    pthread_cond_destroy(&(punt->cond));
+    pthread_mutex_destroy(&(punt->lock));
+    free(punt->slots);
+    free(punt);
+} /* -- sr_punt_close -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt(..)
+ * Scope: Global
+ *
+ * Producer side, packet thread only.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_punt(struct sr_instance* sr, int reason, uint8_t* packet,
+            unsigned int len, const char* iface, uint32_t arg,
+            const char* out_iface)
+{
+    struct sr_punt* punt = sr->punt;
+    struct sr_punt_rec* rec;
+    uint32_t head;
+
+    if(!punt || sr_punt_slow_thread)
+    { return 0; }
+
+    head = punt->head;
+    if(head - __atomic_load_n(&(punt->tail), __ATOMIC_ACQUIRE) == punt->nslots ||
+       len > punt->slot_size - sizeof(struct sr_punt_rec))
+    {
+        /* ttl_expired, no_route and frag_needed are already counted as
+         * drops by the caller; the ICMP error is what is lost */
+        punt->drops[reason]++;
+        if(reason == sr_punt_arp || reason == sr_punt_local ||
+           reason == sr_punt_arp_miss)
+        { sr_stats_drop(sr_drop_punt_full); }
+        return 1;
+    }
+
+    rec = (struct sr_punt_rec*)(punt->slots +
+            (size_t)(head & (punt->nslots - 1)) * punt->slot_size);
+    rec->reason = reason;
+    rec->len = len;
+    rec->arg = arg;
+    strncpy(rec->iface, iface, sr_IFACE_NAMELEN - 1);
+    rec->iface[sr_IFACE_NAMELEN - 1] = '\0';
+    rec->out_iface[0] = '\0';
+    if(out_iface)
+    {
+        strncpy(rec->out_iface, out_iface, sr_IFACE_NAMELEN - 1);
+        rec->out_iface[sr_IFACE_NAMELEN - 1] = '\0';
+    }
+    memcpy(rec + 1, packet, len);
+    __atomic_store_n(&(punt->head), head + 1, __ATOMIC_RELEASE);
+    punt->punts[reason]++;
+
+    /* pairs with the barrier in sr_punt_thread() before it sleeps */
+    __sync_synchronize();
+    if(punt->waiting)
+    {
+        pthread_mutex_lock(&(punt->lock));
+        pthread_cond_signal(&(punt->cond));
+        pthread_mutex_unlock(&(punt->lock));
+    }
+    return 1;
+} /* -- sr_punt -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_handle(..)
+ * Scope: Local
+ *
+ * The work the packet thread would have done inline.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_punt_handle(struct sr_instance* sr, struct sr_punt_rec* rec)
+{
+    uint8_t* packet = (uint8_t*)(rec + 1);
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)packet;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    struct sr_arpentry* entry;
+    struct sr_arpreq* req;
+    struct sr_if* out_if;
+
+    switch(rec->reason)
+    {
+        case sr_punt_arp:
+            sr_handle_arp_packet_type(sr, packet, rec->len, rec->iface);
+            break;
+        case sr_punt_local:
+            sr_ip_packet_reply(sr, packet, rec->len, rec->iface, rec->arg);
+            break;
+        case sr_punt_ttl_expired:
+            send_icmp_error_packet(sr, rec->iface, rec->len, 0, eth, ip,
+                                   TIME_EXCEEDED_TYPE, TIME_EXCEEDED_CODE);
+            break;
+        case sr_punt_no_route:
+            send_icmp_error_packet(sr, rec->iface, rec->len, 0, eth, ip,
+                                   DST_NET_UNREACHABLE_TYPE,
+                                   DST_NET_UNREACHABLE_CODE);
+            break;
+        case sr_punt_frag_needed:
+            send_icmp_frag_needed_packet(sr, rec->iface, eth, ip, rec->arg);
+            break;
+        case sr_punt_arp_miss:
+            /* the reply may have come in while the frame was queued */
+            if((out_if = sr_get_interface(sr, rec->out_iface)) == 0)
+            { break; }
+            pthread_mutex_lock(&(sr->cache.lock));
+            if((entry = sr_arpcache_lookup(&(sr->cache), rec->arg)) != 0)
+            {
+                memcpy(eth->ether_dhost, entry->mac, ETHER_ADDR_LEN);
+                memcpy(eth->ether_shost, out_if->addr, ETHER_ADDR_LEN);
+                free(entry);
+                sr_send_packet(sr, packet, rec->len, out_if->name);
+            }
+            else
+            {
+                req = sr_arpcache_queuereq(&(sr->cache), rec->arg, packet,
+                                           rec->len, out_if->name);
+                handle_arpreq(sr, req);
+            }
+            pthread_mutex_unlock(&(sr->cache.lock));
+            break;
+    }
+} /* -- sr_punt_handle -- */
+
+static void* sr_punt_thread(void* arg)
+{
+    struct sr_punt* punt = (struct sr_punt*)arg;
+    struct sr_punt_rec* rec;
+    struct timespec ts;
+    uint32_t tail;
+    int unflushed = 0;
+
+    sr_punt_slow_thread = 1;
+#ifdef _LINUX_
+    /* Linux nice values are per thread */
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), SR_PUNT_NICE);
+#endif /* _LINUX_ */
+
+    while(punt->running)
+    {
+        tail = punt->tail;
+        if(__atomic_load_n(&(punt->head), __ATOMIC_ACQUIRE) != tail)
+        {
+            rec = (struct sr_punt_rec*)(punt->slots +
+                    (size_t)(tail & (punt->nslots - 1)) * punt->slot_size);
+            sr_punt_handle(punt->sr, rec);
+            punt->handled++;
+            __atomic_store_n(&(punt->tail), tail + 1, __ATOMIC_RELEASE);
+            unflushed = 1;
+            continue;
+        }
+
+        /* with -b what was sent waits in the TX batch; send it before
+         * sleeping rather than at the next RX message or ARP sweep */
+        if(unflushed)
+        {
+            sr_flush_packets(punt->sr);
+            unflushed = 0;
+        }
+
+        /* empty: sleep until the producer sees 'waiting' and signals */
+        pthread_mutex_lock(&(punt->lock));
+        punt->waiting = 1;
+        __sync_synchronize();
+        if(punt->head == punt->tail && punt->running)
+        {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += SR_PUNT_POLL_MS * 1000000L;
+            if(ts.tv_nsec >= 1000000000L)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&(punt->cond), &(punt->lock), &ts);
+        }
+        punt->waiting = 0;
+        pthread_mutex_unlock(&(punt->lock));
+    }
+    return 0;
+} /* -- sr_punt_thread -- */
+
+const char* sr_punt_reason_name(int reason)
+{
+    return (reason >= 0 && reason < sr_punt_count) ? sr_punt_names[reason] : "unknown";
+} /* -- sr_punt_reason_name -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_punt_dump(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_punt_dump(struct sr_punt* punt, FILE* fp)
+{
+    uint64_t punts = 0, drops = 0;
+    int i;
+
+    if(!punt)
+    { return; }
+    for(i = 0; i < sr_punt_count; i++)
+    {
+        punts += punt->punts[i];
+        drops += punt->drops[i];
+    }
+    fprintf(fp, "punted %llu, handled %llu, dropped %llu (queue %u, %u queued)\n",
+            (unsigned long long)punts, (unsigned long long)punt->handled,
+            (unsigned long long)drops, punt->nslots,
+            punt->head - punt->tail);
+    for(i = 0; i < sr_punt_count; i++)
+    {
+        if(punt->punts[i] || punt->drops[i])
+        {
+            fprintf(fp, "  %-20s %llu punted %llu dropped\n", sr_punt_names[i],
+                    (unsigned long long)punt->punts[i],
+                    (unsigned long long)punt->drops[i]);
+        }
+    }
+} /* -- sr_punt_dump -- */
@@ -0,0 +1,115 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_punt.h
+ *
+ * Description:
+ *
+ * Fast/slow path split (-S depth).  The packet thread only forwards
+ * transit IPv4 whose next hop is in the ARP cache.  Everything that needs
+ * the control plane is copied onto a bounded queue and handled by a
+ * slow-path thread running at a lower priority (nice SR_PUNT_NICE):
+ *
+ *   arp          ARP requests and replies (sr_handle_arp_packet_type)
+ *   local        traffic to the router itself (sr_ip_packet_reply)
+ *   ttl_expired  ICMP time exceeded
+ *   no_route     ICMP net unreachable
+ *   frag_needed  ICMP fragmentation needed
+ *   arp_miss     next hop not resolved: queue the frame, send the request
+ *
+ * The queue is a single-producer / single-consumer ring of fixed slots
+ * of one frame each.  When it is full the frame is dropped and counted
+ * per punt reason, so an ARP storm or a traceroute sweep costs the packet
+ * thread a copy at most.  The packet thread has already counted a
+ * ttl_expired, no_route or frag_needed frame as a drop by its own reason;
+ * the others (arp, local, arp_miss) also count as drop reason
+ * punt_queue_full, so each frame is one drop.
+ *
+ * The slow-path thread does no routing table lookups; what it needs from
+ * the route (next hop, outgoing interface) travels with the frame.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PUNT_H
+#define SR_PUNT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+
+#define SR_PUNT_DEPTH_MIN 16
+#define SR_PUNT_DEPTH_MAX 65536
+#define SR_PUNT_NICE      10     /* slow-path thread priority */
+#define SR_PUNT_POLL_MS   10     /* bounds a lost wakeup */
+
+#define SR_PUNT_REASONS(X) \
+    X(sr_punt_arp,         "arp")         \
+    X(sr_punt_local,       "local")       \
+    X(sr_punt_ttl_expired, "ttl_expired") \
+    X(sr_punt_no_route,    "no_route")    \
+    X(sr_punt_frag_needed, "frag_needed") \
+    X(sr_punt_arp_miss,    "arp_miss")
+
+#define SR_PUNT_ENUM(id, name) id,
+enum sr_punt_reason { SR_PUNT_REASONS(SR_PUNT_ENUM) sr_punt_count };
+#undef SR_PUNT_ENUM
+
+struct sr_instance;
+
+/* slot header, followed by the frame */
+struct sr_punt_rec
+{
+    uint32_t reason;
+    uint32_t len;
+    uint32_t arg;                        /* local ip, mtu or next hop */
+    char iface[sr_IFACE_NAMELEN];        /* received on */
+    char out_iface[sr_IFACE_NAMELEN];    /* arp_miss: to send on */
+};
+
+/* head is only written by the packet thread, tail and waiting only by the
+ * slow-path thread */
+struct sr_punt
+{
+    struct sr_instance* sr;
+    uint8_t* slots;
+    uint32_t nslots;                     /* power of two */
+    uint32_t slot_size;
+    volatile uint32_t head;
+    uint8_t pad0[64 - sizeof(uint32_t)];
+    volatile uint32_t tail;
+    uint8_t pad1[64 - sizeof(uint32_t)];
+    volatile uint32_t waiting;
+    uint8_t pad2[64 - sizeof(uint32_t)];
+
+    uint64_t punts[sr_punt_count];       /* packet thread */
+    uint64_t drops[sr_punt_count];
+    uint64_t handled;                    /* slow-path thread */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    volatile int running;
+    pthread_t thread;
+};
+
+extern __thread int sr_punt_slow_thread;
+
+struct sr_punt* sr_punt_open(struct sr_instance* sr, unsigned int depth);
+void sr_punt_close(struct sr_punt* punt);
+
+/* Hand a frame to the slow path.  Returns 1 if it was taken (queued, or
+ * dropped because the queue is full), 0 if the caller should handle it
+ * inline: punting is off, or this is the slow-path thread itself. */
+int  sr_punt(struct sr_instance* sr, int reason, uint8_t* packet,
+             unsigned int len, const char* iface, uint32_t arg,
+             const char* out_iface);
+const char* sr_punt_reason_name(int reason);
+void sr_punt_dump(struct sr_punt* punt, FILE* fp);
+
+#endif /* -- SR_PUNT_H -- */
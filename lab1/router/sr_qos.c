@@ -0,0 +1,797 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_qos.c
+ *
+ * Description:
+ *
+ * Classification, queues, shaper and scheduler thread for -Q, see
+ * sr_qos.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sr_qos.h"
+#include "sr_codel.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_filter.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+
+#define SR_QOS_NS 1000000000ULL
+
+static const char* sr_qos_defaults[] = {
+    "control prio 0 dscp 48-63 match arp or icmp type 3 or icmp type 11",
+    "interactive prio 1 dscp 40-47",
+    "default weight 4",
+    "bulk weight 1 dscp 8-15",
+    0
+};
+
+static void* sr_qos_thread(void* arg);
+
+static uint64_t sr_qos_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * SR_QOS_NS + ts.tv_nsec;
+} /* -- sr_qos_now -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_qos_create(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_qos* sr_qos_create(void)
+{
+    struct sr_qos* qos;
+    unsigned int i;
+
+    if((qos = (struct sr_qos*)calloc(1, sizeof(struct sr_qos))) == 0)
+    {
+        perror("calloc");
+        return 0;
+    }
+    for(i = 0; i < SR_QOS_MAX_IFS; i++)
+    { pthread_mutex_init(&(qos->ifs[i].lock), 0); }
+    qos->target = (uint64_t)SR_CODEL_TARGET * 1000;
+    qos->interval = (uint64_t)SR_CODEL_INTERVAL * 1000;
+    qos->ecn = 1;
+    pthread_mutex_init(&(qos->lock), 0);
+    pthread_cond_init(&(qos->cond), 0);
+    return qos;
+} /* -- sr_qos_create -- */
+
+static int sr_qos_number(const char* spec, const char* what, const char* s,
+                         unsigned long lo, unsigned long hi,
+                         unsigned long* v)
+{
+    char* end;
+
+    if(s)
+    {
+        *v = strtoul(s, &end, 10);
+        if(*end == '\0' && end != s && *v >= lo && *v <= hi)
+        { return 0; }
+    }
+    fprintf(stderr, "Error: -Q \"%s\": %s needs a number in [%lu, %lu]\n",
+            spec, what, lo, hi);
+    return -1;
+} /* -- sr_qos_number -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_qos_parse(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_qos_parse(struct sr_qos* qos, const char* spec)
+{
+    struct sr_qos_class* c;
+    char *copy, *tok, *save = 0, *dash = 0;
+    unsigned long v, hi;
+    int i, rc = -1;
+
+    if((copy = strdup(spec)) == 0)
+    {
+        perror("strdup");
+        return -1;
+    }
+    if((tok = strtok_r(copy, " \t", &save)) == 0)
+    {
+        fprintf(stderr, "Error: empty -Q\n");
+        goto done;
+    }
+
+    if(strcmp(tok, "shape") == 0)
+    {
+        qos->shape = 1;
+        if((tok = strtok_r(0, " \t", &save)) != 0)
+        {
+            if(sr_qos_number(spec, "shape", tok, 1, 1000000, &v) != 0)
+            { goto done; }
+            qos->shape_mbit = (unsigned int)v;
+        }
+        rc = 0;
+        goto done;
+    }
+    if(strcmp(tok, "codel") == 0)
+    {
+        if(qos->aqm == SR_QOS_FIFO)
+        { qos->aqm = SR_QOS_CODEL; }
+        while((tok = strtok_r(0, " \t", &save)) != 0)
+        {
+            if(strcmp(tok, "noecn") == 0)
+            {
+                qos->ecn = 0;
+                continue;
+            }
+            if(strcmp(tok, "target") != 0 && strcmp(tok, "interval") != 0)
+            {
+                fprintf(stderr, "Error: -Q \"%s\": unknown keyword %s\n",
+                        spec, tok);
+                goto done;
+            }
+            if(sr_qos_number(spec, tok, strtok_r(0, " \t", &save),
+                             1, 10000000, &v) != 0)
+            { goto done; }
+            if(tok[0] == 't')
+            { qos->target = (uint64_t)v * 1000; }
+            else
+            { qos->interval = (uint64_t)v * 1000; }
+        }
+        rc = 0;
+        goto done;
+    }
+    if(strcmp(tok, "fq") == 0)
+    {
+        if(sr_qos_number(spec, "fq", strtok_r(0, " \t", &save),
+                         1, SR_QOS_FLOWS_MAX, &v) != 0)
+        { goto done; }
+        qos->aqm = SR_QOS_FQ_CODEL;
+        qos->flows = (unsigned int)v;
+        rc = 0;
+        goto done;
+    }
+    if(strcmp(tok, "ecn") == 0)
+    {
+        if(sr_qos_number(spec, "ecn", strtok_r(0, " \t", &save),
+                         1, SR_QOS_LIMIT_MAX, &v) != 0)
+        { goto done; }
+        qos->ecn_mark = (unsigned int)v;
+        rc = 0;
+        goto done;
+    }
+    if(strcmp(tok, "default") == 0 && save &&
+       strspn(save, " \t") == strlen(save))
+    {
+        rc = 0;
+        for(i = 0; sr_qos_defaults[i] && rc == 0; i++)
+        { rc = sr_qos_parse(qos, sr_qos_defaults[i]); }
+        goto done;
+    }
+
+    /* -- a class -- */
+    for(i = 0; i < (int)qos->nclasses; i++)
+    {
+        if(strcmp(qos->cls[i].name, tok) == 0)
+        {
+            fprintf(stderr, "Error: -Q class %s defined twice\n", tok);
+            goto done;
+        }
+    }
+    if(qos->nclasses == SR_QOS_MAX_CLASSES)
+    {
+        fprintf(stderr, "Error: -Q allows at most %d classes\n",
+                SR_QOS_MAX_CLASSES);
+        goto done;
+    }
+    if(strlen(tok) >= SR_QOS_NAMELEN)
+    {
+        fprintf(stderr, "Error: -Q class name %s too long\n", tok);
+        goto done;
+    }
+    c = &(qos->cls[qos->nclasses]);
+    memset(c, 0, sizeof(*c));
+    strcpy(c->name, tok);
+    c->prio = -1;
+    c->limit = SR_QOS_LIMIT;
+    c->dscp_lo = c->dscp_hi = -1;
+
+    while((tok = strtok_r(0, " \t", &save)) != 0)
+    {
+        if(strcmp(tok, "prio") == 0)
+        {
+            if(sr_qos_number(spec, "prio", strtok_r(0, " \t", &save),
+                             0, 255, &v) != 0)
+            { goto bad; }
+            c->prio = (int)v;
+        }
+        else if(strcmp(tok, "weight") == 0)
+        {
+            if(sr_qos_number(spec, "weight", strtok_r(0, " \t", &save),
+                             1, 1000, &v) != 0)
+            { goto bad; }
+            c->weight = (unsigned int)v;
+        }
+        else if(strcmp(tok, "limit") == 0)
+        {
+            if(sr_qos_number(spec, "limit", strtok_r(0, " \t", &save),
+                             1, SR_QOS_LIMIT_MAX, &v) != 0)
+            { goto bad; }
+            c->limit = (unsigned int)v;
+        }
+        else if(strcmp(tok, "dscp") == 0)
+        {
+            tok = strtok_r(0, " \t", &save);
+            dash = tok ? strchr(tok, '-') : 0;
+            if(dash)
+            {
+                *dash = '\0';
+                if(sr_qos_number(spec, "dscp", dash + 1, 0, 63, &hi) != 0)
+                { goto bad; }
+            }
+            if(sr_qos_number(spec, "dscp", tok, 0, 63, &v) != 0)
+            { goto bad; }
+            c->dscp_lo = (int)v;
+            c->dscp_hi = dash ? (int)hi : (int)v;
+            if(c->dscp_hi < c->dscp_lo)
+            {
+                fprintf(stderr, "Error: -Q \"%s\": empty dscp range\n", spec);
+                goto bad;
+            }
+        }
+        else if(strcmp(tok, "codel") == 0)
+        { c->aqm = SR_QOS_CODEL; }
+        else if(strcmp(tok, "fq") == 0)
+        {
+            if(sr_qos_number(spec, "fq", strtok_r(0, " \t", &save),
+                             1, SR_QOS_FLOWS_MAX, &v) != 0)
+            { goto bad; }
+            c->aqm = SR_QOS_FQ_CODEL;
+            c->flows = (unsigned int)v;
+        }
+        else if(strcmp(tok, "ecn") == 0)
+        {
+            if(sr_qos_number(spec, "ecn", strtok_r(0, " \t", &save),
+                             1, SR_QOS_LIMIT_MAX, &v) != 0)
+            { goto bad; }
+            c->ecn_mark = (unsigned int)v;
+        }
+        else if(strcmp(tok, "match") == 0)
+        {
+            /* the access list is the rest of the argument */
+            if(!save || *save == '\0' ||
+               (c->match = sr_filter_compile(save)) == 0)
+            {
+                fprintf(stderr, "Error: -Q \"%s\": bad match\n", spec);
+                goto bad;
+            }
+            break;
+        }
+        else
+        {
+            fprintf(stderr, "Error: -Q \"%s\": unknown keyword %s\n", spec, tok);
+            goto bad;
+        }
+    }
+    if((c->prio >= 0) == (c->weight > 0))
+    {
+        fprintf(stderr, "Error: -Q \"%s\": a class needs either prio or"
+                " weight\n", spec);
+        goto bad;
+    }
+    qos->nclasses++;
+    rc = 0;
+    goto done;
+
+bad:
+    sr_filter_destroy(c->match);
+    c->match = 0;
+done:
+    free(copy);
+    return rc;
+} /* -- sr_qos_parse -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_qos_start(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_qos_start(struct sr_qos* qos, struct sr_instance* sr)
+{
+    unsigned int i, j, t;
+
+    qos->sr = sr;
+    if(qos->nclasses == 0 && sr_qos_parse(qos, "default") != 0)
+    { return -1; }
+
+    /* frames nothing matches */
+    for(i = 0; i < qos->nclasses; i++)
+    {
+        if(strcmp(qos->cls[i].name, "default") == 0)
+        { break; }
+    }
+    if(i == qos->nclasses && sr_qos_parse(qos, "default weight 1") != 0)
+    { return -1; }
+    qos->dflt = i;
+
+    for(i = 0; i < qos->nclasses; i++)
+    {
+        if(qos->cls[i].aqm == SR_QOS_FIFO)
+        {
+            qos->cls[i].aqm = qos->aqm;
+            qos->cls[i].flows = qos->flows;
+        }
+        if(qos->cls[i].ecn_mark == 0)
+        { qos->cls[i].ecn_mark = qos->ecn_mark; }
+    }
+    qos->perturb = (uint32_t)(sr_qos_now() ^ ((uint64_t)getpid() << 16));
+
+    /* priority classes by prio, then the weighted ones in the order given */
+    for(i = 0; i < qos->nclasses; i++)
+    {
+        if(qos->cls[i].prio < 0)
+        {
+            qos->drr[qos->ndrr++] = i;
+            continue;
+        }
+        for(j = qos->nprio++; j > 0 &&
+            qos->cls[qos->prio[j - 1]].prio > qos->cls[i].prio; j--)
+        { qos->prio[j] = qos->prio[j - 1]; }
+        qos->prio[j] = i;
+    }
+
+    printf("QoS classes:");
+    for(t = 0; t < qos->nprio; t++)
+    {
+        printf(" %s(prio %d)", qos->cls[qos->prio[t]].name,
+               qos->cls[qos->prio[t]].prio);
+    }
+    for(t = 0; t < qos->ndrr; t++)
+    {
+        printf(" %s(weight %u)", qos->cls[qos->drr[t]].name,
+               qos->cls[qos->drr[t]].weight);
+    }
+    printf("\n");
+
+    qos->running = 1;
+    if(pthread_create(&(qos->thread), 0, sr_qos_thread, qos) != 0)
+    {
+        perror("pthread_create(..):sr_qos.c::sr_qos_start");
+        qos->running = 0;
+        return -1;
+    }
+    return 0;
+} /* -- sr_qos_start -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_qos_add_interfaces(..)
+ * Scope: Global
+ *
+ * Name the queues of every interface and set up their shapers; called
+ * once the VNS hardware info is in, which is also when the link speeds
+ * are known.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_qos_add_interfaces(struct sr_qos* qos)
+{
+    struct sr_instance* sr = qos->sr;
+    struct sr_qos_if* qif;
+    struct sr_if* if_walker;
+    unsigned int mbit, c;
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(if_walker->index >= SR_QOS_MAX_IFS)
+        {
+            fprintf(stderr, "Interface %s: not scheduled, more than %d"
+                    " interfaces\n", if_walker->name, SR_QOS_MAX_IFS);
+            continue;
+        }
+        qif = &(qos->ifs[if_walker->index]);
+        pthread_mutex_lock(&(qif->lock));
+        strncpy(qif->name, if_walker->name, sr_IFACE_NAMELEN - 1);
+        for(c = 0; c < qos->nclasses; c++)
+        {
+            if(sr_codel_init(&(qif->queue[c]), &(qos->cls[c])) != 0)
+            {
+                fprintf(stderr, "Interface %s: class %s falls back to"
+                        " codel\n", if_walker->name, qos->cls[c].name);
+            }
+        }
+        mbit = qos->shape_mbit ? qos->shape_mbit : if_walker->speed;
+        if(qos->shape && mbit == 0)
+        {
+            fprintf(stderr, "Interface %s: link speed unknown, not shaped"
+                    " (use -Q \"shape N\")\n", if_walker->name);
+        }
+        else if(qos->shape)
+        {
+            qif->rate = (uint64_t)mbit * 125000;
+            qif->burst = qif->rate / 1000;
+            if(qif->burst < 2 * (uint64_t)sr->max_frame_len)
+            { qif->burst = 2 * (uint64_t)sr->max_frame_len; }
+            qif->tokens = qif->burst * SR_QOS_NS;
+            qif->last = sr_qos_now();
+        }
+        pthread_mutex_unlock(&(qif->lock));
+    }
+} /* -- sr_qos_add_interfaces -- */
+
+void sr_qos_destroy(struct sr_qos* qos)
+{
+    unsigned int i, c;
+
+    if(!qos)
+    { return; }
+    if(qos->running)
+    {
+        pthread_mutex_lock(&(qos->lock));
+        qos->running = 0;
+        pthread_cond_signal(&(qos->cond));
+        pthread_mutex_unlock(&(qos->lock));
+        pthread_join(qos->thread, 0);
+    }
+    for(i = 0; i < SR_QOS_MAX_IFS; i++)
+    {
+        for(c = 0; c < qos->nclasses; c++)
+        { sr_codel_flush(&(qos->ifs[i].queue[c])); }
+        pthread_mutex_destroy(&(qos->ifs[i].lock));
+    }
+    for(c = 0; c < qos->nclasses; c++)
+    { sr_filter_destroy(qos->cls[c].match); }
+    pthread_cond_destroy(&(qos->cond));
+    pthread_mutex_destroy(&(qos->lock));
+    free(qos);
+} /* -- sr_qos_destroy -- */
+
+/* ---- classification, shaper, scheduler ---- */
+
+static unsigned int sr_qos_classify(struct sr_qos* qos, const uint8_t* buf,
+                                    unsigned int len)
+{
+    const struct sr_qos_class* c;
+    int dscp = -1;
+    unsigned int i;
+
+    if(len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+       ethertype((uint8_t*)buf) == ethertype_ip)
+    { dscp = ((const sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t)))->ip_tos >> 2; }
+
+    for(i = 0; i < qos->nclasses; i++)
+    {
+        c = &(qos->cls[i]);
+        if(c->dscp_lo >= 0 && dscp >= c->dscp_lo && dscp <= c->dscp_hi)
+        { return i; }
+        if(c->match && sr_filter_match(c->match, buf, len))
+        { return i; }
+    }
+    return qos->dflt;
+} /* -- sr_qos_classify -- */
+
+/* refill the shaper; 0 if 'len' bytes may go now, else ns to wait */
+static uint64_t sr_qos_tokens(struct sr_qos_if* qif, unsigned int len,
+                              uint64_t now)
+{
+    uint64_t full, elapsed, need;
+
+    if(qif->rate == 0)
+    { return 0; }
+    full = qif->burst * SR_QOS_NS;
+    if(now > qif->last)
+    {
+        elapsed = now - qif->last;
+        if(elapsed >= full / qif->rate)
+        { qif->tokens = full; }
+        else if((qif->tokens += elapsed * qif->rate) > full)
+        { qif->tokens = full; }
+        qif->last = now;
+    }
+    need = (uint64_t)len * SR_QOS_NS;
+    if(qif->tokens >= need)
+    { return 0; }
+    return (need - qif->tokens) / qif->rate + 1;
+} /* -- sr_qos_tokens -- */
+
+/* the class whose head frame goes next, -1 if none; strict priority first,
+ * then deficit round robin */
+static int sr_qos_pick(struct sr_qos* qos, struct sr_qos_if* qif)
+{
+    struct sr_qos_queue* q;
+    struct sr_qos_pkt* p;
+    unsigned int i, c;
+
+    for(i = 0; i < qos->nprio; i++)
+    {
+        if(qif->queue[qos->prio[i]].depth)
+        { return qos->prio[i]; }
+    }
+    if(qif->backlog == 0)
+    { return -1; }
+
+    /* something weighted is queued, so this ends within a few rounds */
+    for(;;)
+    {
+        c = qos->drr[qif->drr_next];
+        q = &(qif->queue[c]);
+        if((p = sr_codel_peek(q)) != 0)
+        {
+            if(!qif->drr_fresh)
+            {
+                q->deficit += qos->cls[c].weight * SR_QOS_QUANTUM;
+                qif->drr_fresh = 1;
+            }
+            if(p->len <= q->deficit)
+            { return c; }
+        }
+        else
+        { q->deficit = 0; }
+        qif->drr_next = (qif->drr_next + 1) % qos->ndrr;
+        qif->drr_fresh = 0;
+    }
+} /* -- sr_qos_pick -- */
+
+/* send what the shaper allows from one interface, with qif->lock held;
+ * returns 0 when the queues are empty, else ns until more may go */
+static uint64_t sr_qos_drain(struct sr_qos* qos, struct sr_qos_if* qif)
+{
+    struct sr_qos_queue* q;
+    struct sr_qos_pkt* p;
+    uint64_t now, wait, need;
+    unsigned int depth;
+    int c;
+
+    while((c = sr_qos_pick(qos, qif)) >= 0)
+    {
+        q = &(qif->queue[c]);
+        now = sr_qos_now();
+        if((wait = sr_qos_tokens(qif, sr_codel_peek(q)->len, now)) != 0)
+        { return wait; }
+
+        /* CoDel may drop the head and send a later frame, so the shaper
+         * and the deficit are charged what actually goes */
+        depth = q->depth;
+        p = sr_codel_dequeue(qos, q, now);
+        qif->backlog -= depth - q->depth;
+        if(!p)
+        { continue; }
+        need = (uint64_t)p->len * SR_QOS_NS;
+        if(qif->rate)
+        { qif->tokens = qif->tokens > need ? qif->tokens - need : 0; }
+        if(qos->cls[c].prio < 0)
+        { q->deficit = q->deficit > p->len ? q->deficit - p->len : 0; }
+        q->sent++;
+        sr_lat_record(&(q->wait), now - p->enqueued);
+        sr_send_packet_now(qos->sr, (uint8_t*)(p + 1), p->len, qif->name);
+        free(p);
+    }
+    return 0;
+} /* -- sr_qos_drain -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_qos_send(..)
+ * Scope: Global
+ *
+ * Queue a frame for its interface, or send it at once if nothing is
+ * queued there and the shaper allows.  Frames are sent with the
+ * interface's lock held so they leave in the order the scheduler chose.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_qos_send(struct sr_qos* qos, uint8_t* buf, unsigned int len,
+                const char* iface)
+{
+    struct sr_if* if_rec = sr_get_interface(qos->sr, iface);
+    struct sr_qos_if* qif;
+    struct sr_qos_queue* q;
+    struct sr_qos_pkt* p;
+    unsigned int c;
+    uint64_t now;
+    int ret = 0;
+
+    /* let the transmit path report what it cannot send */
+    if(!if_rec || if_rec->index >= SR_QOS_MAX_IFS ||
+       len < sizeof(sr_ethernet_hdr_t) || len > qos->sr->max_frame_len)
+    { return sr_send_packet_now(qos->sr, buf, len, iface); }
+
+    qif = &(qos->ifs[if_rec->index]);
+    c = sr_qos_classify(qos, buf, len);
+    q = &(qif->queue[c]);
+
+    pthread_mutex_lock(&(qif->lock));
+    now = sr_qos_now();
+    if(qif->backlog == 0 && sr_qos_tokens(qif, len, now) == 0)
+    {
+        if(qif->rate)
+        { qif->tokens -= (uint64_t)len * SR_QOS_NS; }
+        q->sent++;
+        sr_lat_record(&(q->wait), 0);
+        ret = sr_send_packet_now(qos->sr, buf, len, iface);
+        pthread_mutex_unlock(&(qif->lock));
+        return ret;
+    }
+
+    if(q->depth >= qos->cls[c].limit)
+    {
+        if(!q->flows)
+        {
+            q->drops++;
+            pthread_mutex_unlock(&(qif->lock));
+            sr_stats_drop(sr_drop_qos_full);
+            return 0;
+        }
+        sr_codel_overflow(q);
+        qif->backlog--;
+    }
+    if((p = (struct sr_qos_pkt*)malloc(sizeof(struct sr_qos_pkt) + len)) == 0)
+    {
+        pthread_mutex_unlock(&(qif->lock));
+        sr_stats_drop(sr_drop_tx_error);
+        return -1;
+    }
+    p->enqueued = now;
+    p->len = len;
+    memcpy(p + 1, buf, len);
+    if(qos->cls[c].ecn_mark && q->depth >= qos->cls[c].ecn_mark &&
+       len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+       ethertype((uint8_t*)(p + 1)) == ethertype_ip &&
+       ip_set_ce((sr_ip_hdr_t*)((uint8_t*)(p + 1) +
+                                sizeof(sr_ethernet_hdr_t))))
+    { q->ecn_marks++; }
+    sr_codel_enqueue(qos, q, p);
+    if(q->depth > q->max_depth)
+    { q->max_depth = q->depth; }
+    q->queued++;
+    qif->backlog++;
+    pthread_mutex_unlock(&(qif->lock));
+
+    /* pairs with the barrier in sr_qos_thread() before it sleeps */
+    __sync_synchronize();
+    if(qos->waiting)
+    {
+        pthread_mutex_lock(&(qos->lock));
+        pthread_cond_signal(&(qos->cond));
+        pthread_mutex_unlock(&(qos->lock));
+    }
+    return 0;
+} /* -- sr_qos_send -- */
+
+static void* sr_qos_thread(void* arg)
+{
+    struct sr_qos* qos = (struct sr_qos*)arg;
+    struct sr_qos_if* qif;
+    struct timespec ts;
+    uint64_t wait, next, left, backlog;
+    unsigned int i;
+    int drained;
+
+    while(qos->running)
+    {
+        next = (uint64_t)SR_QOS_POLL_MS * 1000000;
+        left = 0;
+        drained = 0;
+        for(i = 0; i < SR_QOS_MAX_IFS; i++)
+        {
+            qif = &(qos->ifs[i]);
+            if(qif->name[0] == '\0' || qif->backlog == 0)
+            { continue; }
+            pthread_mutex_lock(&(qif->lock));
+            wait = sr_qos_drain(qos, qif);
+            left += qif->backlog;
+            pthread_mutex_unlock(&(qif->lock));
+            drained = 1;
+            if(wait && wait < next)
+            { next = wait; }
+        }
+
+        /* with -b the frames drained wait in the TX batch; send them now,
+         * or the shaper's timing only shows at the next RX message */
+        if(drained)
+        { sr_flush_packets(qos->sr); }
+
+        /* sleep until more is queued or the shaper has tokens again; what
+         * is left is waiting for tokens */
+        pthread_mutex_lock(&(qos->lock));
+        qos->waiting = 1;
+        __sync_synchronize();
+        for(i = 0, backlog = 0; i < SR_QOS_MAX_IFS; i++)
+        { backlog += qos->ifs[i].backlog; }
+        if(qos->running && backlog <= left)
+        {
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += next / SR_QOS_NS;
+            ts.tv_nsec += next % SR_QOS_NS;
+            if(ts.tv_nsec >= (long)SR_QOS_NS)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= SR_QOS_NS;
+            }
+            pthread_cond_timedwait(&(qos->cond), &(qos->lock), &ts);
+        }
+        qos->waiting = 0;
+        pthread_mutex_unlock(&(qos->lock));
+    }
+    return 0;
+} /* -- sr_qos_thread -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_qos_dump(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_qos_dump(struct sr_qos* qos, FILE* fp)
+{
+    struct sr_qos_if* qif;
+    struct sr_qos_queue* q;
+    char aqm[16];
+    unsigned int i, c;
+
+    if(!qos)
+    { return; }
+    fprintf(fp, "%-8s %-12s %8s %-7s %10s %10s %8s %8s %8s %6s %6s %9s %9s %9s\n",
+            "qos", "class", "sched", "aqm", "sent", "queued", "dropped",
+            "codel", "marked", "depth", "max", "p50 us", "p99 us", "max us");
+    for(i = 0; i < SR_QOS_MAX_IFS; i++)
+    {
+        qif = &(qos->ifs[i]);
+        if(qif->name[0] == '\0')
+        { continue; }
+        pthread_mutex_lock(&(qif->lock));
+        for(c = 0; c < qos->nclasses; c++)
+        {
+            q = &(qif->queue[c]);
+            if(q->aqm == SR_QOS_FQ_CODEL)
+            { snprintf(aqm, sizeof(aqm), "fq%u", q->nflows); }
+            else
+            { strcpy(aqm, q->aqm == SR_QOS_CODEL ? "codel" : "-"); }
+            fprintf(fp, "%-8s %-12s %4s %3d %-7s %10llu %10llu %8llu %8llu %8llu"
+                    " %6u %6u %9.1f %9.1f %9.1f\n", qif->name, qos->cls[c].name,
+                    qos->cls[c].prio >= 0 ? "prio" : "wt",
+                    qos->cls[c].prio >= 0 ? qos->cls[c].prio
+                                          : (int)qos->cls[c].weight, aqm,
+                    (unsigned long long)q->sent,
+                    (unsigned long long)q->queued,
+                    (unsigned long long)q->drops,
+                    (unsigned long long)q->aqm_drops,
+                    (unsigned long long)q->ecn_marks, q->depth, q->max_depth,
+                    q->wait.count ? sr_latency_percentile(&(q->wait), 0.50) / 1e3 : 0.0,
+                    q->wait.count ? sr_latency_percentile(&(q->wait), 0.99) / 1e3 : 0.0,
+                    q->wait.max / 1e3);
+        }
+        if(qif->rate)
+        {
+            fprintf(fp, "%-8s shaped to %llu Mbit/s, burst %llu bytes\n",
+                    qif->name, (unsigned long long)(qif->rate / 125000),
+                    (unsigned long long)qif->burst);
+        }
+        pthread_mutex_unlock(&(qif->lock));
+    }
+    for(c = 0; c < qos->nclasses && qos->cls[c].aqm == SR_QOS_FIFO; c++)
+    { }
+    if(c < qos->nclasses)
+    {
+        fprintf(fp, "codel target %llu us, interval %llu us, %s\n",
+                (unsigned long long)(qos->target / 1000),
+                (unsigned long long)(qos->interval / 1000),
+                qos->ecn ? "ECN marks" : "drops only");
+    }
+    for(c = 0; c < qos->nclasses; c++)
+    {
+        if(qos->cls[c].ecn_mark)
+        {
+            fprintf(fp, "ecn %s marks CE from a depth of %u frames\n",
+                    qos->cls[c].name, qos->cls[c].ecn_mark);
+        }
+    }
+} /* -- sr_qos_dump -- */
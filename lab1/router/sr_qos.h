@@ -0,0 +1,247 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_qos.h
+ *
+ * Description:
+ *
+ * Output scheduling (-Q).  Every frame sr_send_packet() is given is put in
+ * one of up to SR_QOS_MAX_CLASSES queues of its outgoing interface, and a
+ * scheduler decides what leaves next: strict priority classes first,
+ * lowest 'prio' first, then the weighted classes by deficit round robin
+ * with a quantum of 'weight' full-size frames.
+ *
+ * Each -Q defines one class, checked in the order given; a frame goes to
+ * the first class it matches, or to the class named "default":
+ *
+ *   -Q "NAME prio N   [dscp A[-B]] [limit N] [codel|fq N] [ecn N] [match EXPR]"
+ *   -Q "NAME weight N [dscp A[-B]] [limit N] [codel|fq N] [ecn N] [match EXPR]"
+ *
+ * 'dscp' matches IPv4 by the top six bits of ip_tos; 'match' takes the
+ * rest of the argument as an access list in the -f filter language (see
+ * sr_filter.h), e.g. match "udp port 5000 or dst net 10.0.1.0/24".  A class
+ * with both matches a frame that satisfies either.  'limit' is the queue
+ * length in frames (default SR_QOS_LIMIT), beyond which frames are tail
+ * dropped as "qos_queue_full".
+ *
+ * A queue is a plain FIFO unless the class asks for queue management:
+ * 'codel' drops (or, for ECN-capable IPv4, marks CE) at the head of the
+ * queue once frames have spent more than the target in it for an
+ * interval, and 'fq N' hashes the class by addresses and ports into N
+ * flows, each with its own CoDel, served round robin one frame's worth at
+ * a time with new flows first (FQ-CoDel, RFC 8290).  A full fq class drops
+ * from the head of its longest flow rather than the new frame.
+ *
+ * 'ecn N' marks CE on every ECN-capable IPv4 frame queued behind N or more
+ * frames of its class, a step threshold on the instantaneous queue as in
+ * DCTCP.  It signals congestion well before the queue fills or CoDel's
+ * interval runs out, and leaves frames that are not ECN-capable alone.
+ *
+ *   -Q shape        shape every interface to its link speed (VNS HWSPEED)
+ *   -Q "shape N"    ... or to N Mbit/s
+ *   -Q "codel [target US] [interval US] [noecn]"
+ *                   CoDel for every class that does not choose itself,
+ *                   target and interval in microseconds (5000, 100000)
+ *   -Q "fq N"       ... or FQ-CoDel with N flows
+ *   -Q "ecn N"      ... and an ECN threshold of N frames
+ *   -Q default      the classes below, also used if only "shape", "codel"
+ *                   or "fq" is given
+ *
+ *   control      prio 0    dscp 48-63 (CS6, CS7), ARP, ICMP errors
+ *   interactive  prio 1    dscp 40-47 (CS5, EF)
+ *   default      weight 4
+ *   bulk         weight 1  dscp 8-15 (CS1)
+ *
+ * A queue only builds where frames arrive faster than they leave, so
+ * without a shaper the scheduler has little to do: a frame for an
+ * interface with nothing queued is sent at once by the thread that sent
+ * it.  With one, the interface sends at most its rate (bursts of 1 ms or
+ * two frames) and the scheduler thread drains the queues as tokens come
+ * in, so ICMP and interactive traffic no longer wait behind a bulk
+ * transfer.  Strict priority classes can starve the rest; -R keeps ICMP
+ * in check.
+ *
+ * Per class and interface the dump shows frames queued, sent and dropped,
+ * what CoDel dropped, what was marked CE, the queue depth and the time
+ * frames spent queued (their sojourn time, also a histogram on the metrics
+ * endpoint).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_QOS_H
+#define SR_QOS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+#include "sr_stats.h"
+#include "sr_latency.h"
+
+#define SR_QOS_MAX_CLASSES 8
+#define SR_QOS_MAX_IFS     SR_STATS_MAX_IFS
+#define SR_QOS_NAMELEN     16
+#define SR_QOS_LIMIT       256     /* default queue length, frames */
+#define SR_QOS_LIMIT_MAX   65536
+#define SR_QOS_QUANTUM     1514    /* bytes per unit of weight and round */
+#define SR_QOS_POLL_MS     10      /* bounds a lost wakeup */
+#define SR_QOS_FLOWS_MAX   4096
+#define SR_CODEL_TARGET    5000    /* us */
+#define SR_CODEL_INTERVAL  100000  /* us */
+
+/* queue management of a class */
+#define SR_QOS_FIFO        0
+#define SR_QOS_CODEL       1
+#define SR_QOS_FQ_CODEL    2
+
+struct sr_instance;
+struct sr_filter;
+
+struct sr_qos_class
+{
+    char name[SR_QOS_NAMELEN];
+    int prio;                      /* strict priority, -1 for weighted */
+    unsigned int weight;
+    unsigned int limit;
+    int dscp_lo;                   /* -1 for no dscp match */
+    int dscp_hi;
+    struct sr_filter* match;       /* 0 for no access list */
+    int aqm;                       /* SR_QOS_FIFO, ... */
+    unsigned int flows;            /* SR_QOS_FQ_CODEL */
+    unsigned int ecn_mark;         /* mark CE at this depth, 0 for never */
+};
+
+/* queued frame, followed by the frame itself */
+struct sr_qos_pkt
+{
+    struct sr_qos_pkt* next;
+    uint64_t enqueued;             /* ns */
+    unsigned int len;
+};
+
+/* CoDel state of one FIFO (RFC 8289) */
+struct sr_codel
+{
+    uint64_t first_above;          /* ns, 0 while below target */
+    uint64_t drop_next;            /* ns */
+    unsigned int count;            /* drops since dropping began */
+    unsigned int lastcount;
+    int dropping;
+};
+
+/* a FIFO: the whole queue of a class, or one of its flows with fq */
+struct sr_qos_flow
+{
+    struct sr_qos_pkt* head;
+    struct sr_qos_pkt* tail;
+    unsigned int depth;
+    uint64_t bytes;
+    struct sr_codel codel;
+
+    /* fq only */
+    int deficit;                   /* bytes */
+    int list;                      /* SR_QOS_FLOW_IDLE, _NEW, _OLD */
+    int next;                      /* in that list, -1 for the last */
+};
+
+#define SR_QOS_FLOW_IDLE 0
+#define SR_QOS_FLOW_NEW  1
+#define SR_QOS_FLOW_OLD  2
+
+struct sr_qos_flist
+{
+    int head;                      /* -1 for empty */
+    int tail;
+};
+
+struct sr_qos_queue
+{
+    int aqm;                       /* of the class */
+    struct sr_qos_flow fifo;       /* SR_QOS_FIFO and SR_QOS_CODEL */
+    struct sr_qos_flow* flows;     /* SR_QOS_FQ_CODEL */
+    unsigned int nflows;
+    struct sr_qos_flist new_flows;
+    struct sr_qos_flist old_flows;
+
+    unsigned int depth;            /* frames in all flows */
+    uint64_t bytes;
+    unsigned int max_depth;
+    unsigned int deficit;          /* bytes, weighted classes */
+
+    uint64_t queued;               /* frames that had to wait */
+    uint64_t sent;
+    uint64_t drops;                /* queue full */
+    uint64_t aqm_drops;            /* dropped by CoDel */
+    uint64_t ecn_marks;            /* marked CE, by CoDel or 'ecn' */
+    struct sr_lat_hist wait;       /* ns queued, 0 for sent at once */
+};
+
+/* one per interface, everything under lock */
+struct sr_qos_if
+{
+    pthread_mutex_t lock;
+    char name[sr_IFACE_NAMELEN];   /* empty if unused */
+    unsigned int backlog;          /* frames in all queues */
+    struct sr_qos_queue queue[SR_QOS_MAX_CLASSES];
+    unsigned int drr_next;         /* position in sr_qos.drr */
+    int drr_fresh;                 /* drr_next got its quantum this round */
+
+    uint64_t rate;                 /* shaper, bytes per second, 0 for none */
+    uint64_t burst;                /* bytes */
+    uint64_t tokens;               /* billionths of a byte */
+    uint64_t last;                 /* ns */
+};
+
+struct sr_qos
+{
+    struct sr_instance* sr;
+    struct sr_qos_class cls[SR_QOS_MAX_CLASSES];
+    unsigned int nclasses;
+    unsigned int dflt;             /* class of frames nothing matched */
+    unsigned int prio[SR_QOS_MAX_CLASSES];   /* priority classes in order */
+    unsigned int nprio;
+    unsigned int drr[SR_QOS_MAX_CLASSES];    /* weighted classes */
+    unsigned int ndrr;
+
+    int shape;                     /* -Q shape given */
+    unsigned int shape_mbit;       /* 0 for the link speed */
+
+    int aqm;                       /* -Q codel or fq, for classes without */
+    unsigned int flows;
+    uint64_t target;               /* CoDel, ns */
+    uint64_t interval;             /* ns */
+    int ecn;                       /* mark rather than drop where possible */
+    unsigned int ecn_mark;         /* -Q ecn, for classes without */
+    uint32_t perturb;              /* fq hash seed */
+
+    struct sr_qos_if ifs[SR_QOS_MAX_IFS];    /* by sr_if.index */
+
+    /* scheduler thread */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    volatile int waiting;
+    volatile int running;
+    pthread_t thread;
+};
+
+struct sr_qos* sr_qos_create(void);
+/* add one -Q argument to the configuration, -1 on a bad one */
+int  sr_qos_parse(struct sr_qos* qos, const char* spec);
+/* set up the classes and start the scheduler */
+int  sr_qos_start(struct sr_qos* qos, struct sr_instance* sr);
+/* queues and shapers for the interfaces from VNS hardware info */
+void sr_qos_add_interfaces(struct sr_qos* qos);
+void sr_qos_destroy(struct sr_qos* qos);
+
+/* sr_send_packet() when -Q is on */
+int  sr_qos_send(struct sr_qos* qos, uint8_t* buf, unsigned int len,
+                 const char* iface);
+void sr_qos_dump(struct sr_qos* qos, FILE* fp);
+
+#endif /* -- SR_QOS_H -- */
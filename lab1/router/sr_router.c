@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 #include "sr_if.h"
@@ -22,6 +23,15 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_trace.h"
+#include "sr_stats.h"
+#include "sr_latency.h"
+#include "sr_perf.h"
+#include "sr_sdt.h"
+#include "sr_punt.h"
+#include "sr_police.h"
+#include "sr_acl.h"
+#include "sr_flow.h"
 
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
@@ -78,7 +88,7 @@ void sr_handlepacket(struct sr_instance* sr,
   assert(packet);
   assert(interface);
 
-  printf("*** -> Received packet of length %d \n",len);
+  SR_TRACE2(sr_ev_rx, len, sr_get_interface(sr, interface)->index);
 
   /* Entry of code */
   static const unsigned int IP_PACKET_SIZE_CHECK = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t);
@@ -88,6 +98,7 @@ void sr_handlepacket(struct sr_instance* sr,
     case ethertype_arp:
       if(len < ARP_PACKET_SIZE_CHECK)
       {
+        sr_stats_drop(sr_drop_short_frame);
         return;
       }
       else
@@ -98,6 +109,7 @@ void sr_handlepacket(struct sr_instance* sr,
     case ethertype_ip:
       if(len < IP_PACKET_SIZE_CHECK)
       {
+        sr_stats_drop(sr_drop_short_frame);
         return;
       }
       else
@@ -106,6 +118,7 @@ void sr_handlepacket(struct sr_instance* sr,
       }
       break;
     default:
+      sr_stats_drop(sr_drop_ethertype);
       return; /* Neither ARP or IP Packet type */
   }
 
@@ -120,10 +133,19 @@ void sr_handle_arp_packet_type(struct sr_instance* sr,
   sr_arp_hdr_t *recv_arp_hdr = (sr_arp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
   struct sr_if *recv_if = sr_get_interface(sr, interface);
 
+  if(sr->punt && sr_punt(sr, sr_punt_arp, packet, len, interface, 0, 0))
+  {
+    return;
+  }
+  SR_LAT_STAGE(sr_lat_parse);
+  SR_LAT_PATH(sr_path_arp);
+  SR_TRACE3(sr_ev_arp_rx, ntohs(recv_arp_hdr->ar_op), recv_arp_hdr->ar_sip,
+    recv_arp_hdr->ar_tip);
   if(ntohs(recv_arp_hdr->ar_op) == arp_op_reply) /* We received an ARP Reply */
   {
     /* Cache it, go through request queue and send outstanding packet */
     struct sr_arpreq * arp_req_res = sr_arpcache_insert(&(sr->cache), recv_arp_hdr->ar_sha, recv_arp_hdr->ar_sip);
+    SR_LAT_STAGE(sr_lat_arp);
     if(arp_req_res == NULL)
     {
       return;
@@ -131,14 +153,18 @@ void sr_handle_arp_packet_type(struct sr_instance* sr,
     else
     {
       struct sr_packet *pkt = arp_req_res->packets;
+      unsigned int flushed = 0;
       while(pkt != NULL)
       {
+        flushed++;
         sr_ethernet_hdr_t *ethernetFrame = (sr_ethernet_hdr_t *)(pkt->buf);
         memcpy(ethernetFrame->ether_dhost, recv_arp_hdr->ar_sha, ETHER_ADDR_LEN);
         memcpy(ethernetFrame->ether_shost, recv_if->addr, ETHER_ADDR_LEN);
         sr_send_packet(sr, pkt->buf, pkt->len, recv_if->name);
+        SR_LAT_STAGE(sr_lat_send);
         pkt = pkt->next;
       }
+      SR_PROBE2(arp_reply, recv_arp_hdr->ar_sip, flushed);
       sr_arpreq_destroy(&(sr->cache), arp_req_res);
     } 
 
@@ -161,10 +187,12 @@ void sr_handle_arp_packet_type(struct sr_instance* sr,
     memcpy(send_arp_hdr->ar_sha, recv_if->addr, ETHER_ADDR_LEN);
     /* send arp request */
     sr_send_packet(sr, ethernet_frame, len, recv_if->name);
+    SR_LAT_STAGE(sr_lat_send);
     free(ethernet_frame);
   }
   else
   {
+    sr_stats_drop(sr_drop_arp_not_for_us);
     return;
   }
 }
@@ -187,20 +215,35 @@ void sr_handle_ip_packet_type(struct sr_instance* sr,
   if(chk_sum_1 != chk_sum_2)
   {
     ip_hdr->ip_sum = chk_sum_1;
+    sr_stats_drop(sr_drop_ip_cksum);
     return;
   }
   else
   {
     /* We can continue processing */
-    struct sr_if* curr_if = ip_packet_forwarding(sr, packet);
+    SR_LAT_STAGE(sr_lat_parse);
+    struct sr_flow_fwd fwd;
+    sr_ip_packet_decide(sr, packet, len, &fwd);
+    if(fwd.acl && fwd.acl->action == SR_ACL_DENY)
+    {
+      sr_stats_drop(sr_drop_acl);
+      return;
+    }
+    struct sr_if* curr_if = fwd.local;
     if(curr_if == NULL)
     {
       /* Not on our interface list, thus next hop */
-      sr_ip_packet_next_hop(sr, packet, len, interface);
+      sr_ip_packet_route(sr, packet, len, interface, fwd.rt);
     }
     else
     {
       /* Matches with one of our interface list */
+      SR_TRACE3(sr_ev_ip_local, ip_hdr->ip_src, ip_hdr->ip_dst, ip_hdr->ip_p);
+      if(sr->police && !sr_police(sr, sr_police_local, ip_hdr->ip_src))
+      {
+        sr_stats_drop(sr_drop_policed);
+        return;
+      }
       sr_ip_packet_reply(sr, packet, len, interface, curr_if->ip);
     }
   }
@@ -243,6 +286,37 @@ bool validate_packet(uint8_t * packet, unsigned int len, enum sr_packet_header_t
 }
 */
 
+/* The -A rule, local interface and route for a datagram: what its flow
+ * decided before if -F has it, else worked out here and given to the flow */
+void sr_ip_packet_decide(struct sr_instance* sr,
+  uint8_t * packet, unsigned int len, struct sr_flow_fwd* fwd)
+{
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  uint32_t flow = 0;
+  if(sr->flows && sr_flow_packet(sr->flows, packet, len, &flow, fwd))
+  {
+    if(fwd->acl)
+    {
+      sr_acl_hit(fwd->acl, len);
+    }
+    SR_LAT_STAGE(sr_lat_local);
+    return;
+  }
+  fwd->acl = sr->acl ? sr_acl_match(sr->acl, packet, len) : NULL;
+  fwd->local = ip_packet_forwarding(sr, packet);
+  SR_LAT_STAGE(sr_lat_local);
+  fwd->rt = NULL;
+  if(fwd->local == NULL)
+  {
+    fwd->rt = sr_ip_lookup(sr, ip_hdr->ip_dst);
+    SR_LAT_STAGE(sr_lat_lpm);
+  }
+  if(flow)
+  {
+    sr_flow_cache(sr->flows, flow, fwd);
+  }
+}
+
 /* Returns NULL if ip packet is not part of subnet */
 struct sr_if *ip_packet_forwarding(struct sr_instance* sr, uint8_t * packet)
 {
@@ -264,15 +338,39 @@ struct sr_if *ip_packet_forwarding(struct sr_instance* sr, uint8_t * packet)
   return curr_if;
 } 
 
+/* Longest prefix match, timed and traced */
+struct sr_rt *sr_ip_lookup(struct sr_instance* sr, uint32_t dst)
+{
+  SR_PERF_BEGIN(sr_perf_fib);
+  struct sr_rt *rt_entry = lpm(sr, dst);
+  SR_PERF_END(sr_perf_fib);
+  SR_PROBE2(lpm, dst, rt_entry);
+  return rt_entry;
+}
+
 void sr_ip_packet_next_hop(struct sr_instance* sr, 
   uint8_t * packet, unsigned int len, char* interface)
+{
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  struct sr_rt *rt_entry = sr_ip_lookup(sr, ip_hdr->ip_dst);
+  SR_LAT_STAGE(sr_lat_lpm);
+  sr_ip_packet_route(sr, packet, len, interface, rt_entry);
+}
+
+/* Forward along rt_entry, or answer net unreachable if there is none */
+void sr_ip_packet_route(struct sr_instance* sr, 
+  uint8_t * packet, unsigned int len, char* interface, struct sr_rt *rt_entry)
 {
   sr_ethernet_hdr_t *ethernet_hdr = (sr_ethernet_hdr_t *)(packet);
   sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
-  struct sr_rt *rt_entry = lpm(sr, ip_hdr->ip_dst);
   if(rt_entry == NULL)
   {
     /* send net unreachable type */
+    sr_stats_drop(sr_drop_no_route);
+    if(sr->punt && sr_punt(sr, sr_punt_no_route, packet, len, interface, 0, 0))
+    {
+      return;
+    }
     send_icmp_error_packet(sr, interface, len, 0, ethernet_hdr,
    ip_hdr, DST_NET_UNREACHABLE_TYPE, DST_NET_UNREACHABLE_CODE);
     return;
@@ -286,25 +384,40 @@ void sr_ip_packet_next_hop(struct sr_instance* sr,
       ip_hdr->ip_sum = 0;
       calc_sum = cksum(ip_hdr, sizeof(sr_ip_hdr_t));
       ip_hdr->ip_sum = calc_sum;
-      struct sr_if *recv_if = sr_get_interface(sr, rt_entry->interface);
-      /* frame to next hop */
-      struct sr_arpentry *arp_entry = sr_arpcache_lookup(&(sr->cache), rt_entry->gw.s_addr);
-      if(arp_entry != NULL)
+      struct sr_if *out_if = sr_get_interface(sr, rt_entry->interface);
+      unsigned int ip_len = ntohs(ip_hdr->ip_len);
+      if(ip_len > len - sizeof(sr_ethernet_hdr_t))
+      {
+        sr_stats_drop(sr_drop_ip_truncated);
+        return; /* truncated datagram */
+      }
+      if(ip_len <= out_if->mtu)
+      {
+        sr_ip_packet_output(sr, packet, len, rt_entry);
+      }
+      else if(ntohs(ip_hdr->ip_off) & IP_DF)
       {
-        memcpy(ethernet_hdr->ether_dhost, (uint8_t *)arp_entry->mac, ETHER_ADDR_LEN);
-        memcpy(ethernet_hdr->ether_shost, recv_if->addr, ETHER_ADDR_LEN);
-        free(arp_entry);
-        sr_send_packet(sr, packet, len, rt_entry->interface);
+        /* too big for the outgoing link and we may not fragment it */
+        sr_stats_drop(sr_drop_frag_needed);
+        if(sr->punt && sr_punt(sr, sr_punt_frag_needed, packet, len, interface, out_if->mtu, 0))
+        {
+          return;
+        }
+        send_icmp_frag_needed_packet(sr, interface, ethernet_hdr, ip_hdr, out_if->mtu);
       }
       else
       {
-        struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), rt_entry->gw.s_addr, packet, len, rt_entry->interface);
-        handle_arpreq(sr, req);
+        sr_ip_packet_fragment(sr, packet, len, rt_entry, out_if->mtu);
       }
     }
     else
     {
       /* Time exceeded error code */
+      sr_stats_drop(sr_drop_ttl_expired);
+      if(sr->punt && sr_punt(sr, sr_punt_ttl_expired, packet, len, interface, 0, 0))
+      {
+        return;
+      }
       send_icmp_error_packet(sr, interface, len, 0, ethernet_hdr,
         ip_hdr, TIME_EXCEEDED_TYPE, TIME_EXCEEDED_CODE);
       return;
@@ -312,6 +425,138 @@ void sr_ip_packet_next_hop(struct sr_instance* sr,
   }
 }
 
+/* Frame an IP datagram for the next hop of rt_entry and send it, or queue it
+ * until the next hop's ARP entry is resolved */
+void sr_ip_packet_output(struct sr_instance* sr,
+  uint8_t * packet, unsigned int len, struct sr_rt *rt_entry)
+{
+  sr_ethernet_hdr_t *ethernet_hdr = (sr_ethernet_hdr_t *)(packet);
+  struct sr_if *out_if = sr_get_interface(sr, rt_entry->interface);
+  SR_TRACE4(sr_ev_ip_forward,
+    ((sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t)))->ip_dst,
+    rt_entry->gw.s_addr, out_if->index, len);
+  /* frame to next hop */
+  SR_PERF_BEGIN(sr_perf_arp);
+  struct sr_arpentry *arp_entry = sr_arpcache_lookup(&(sr->cache), rt_entry->gw.s_addr);
+  SR_PERF_END(sr_perf_arp);
+  SR_LAT_STAGE(sr_lat_arp);
+  SR_LAT_PATH(sr_path_forward);
+  sr_stats_arp(arp_entry != NULL);
+  if(arp_entry != NULL)
+  {
+    memcpy(ethernet_hdr->ether_dhost, (uint8_t *)arp_entry->mac, ETHER_ADDR_LEN);
+    memcpy(ethernet_hdr->ether_shost, out_if->addr, ETHER_ADDR_LEN);
+    free(arp_entry);
+    sr_send_packet(sr, packet, len, rt_entry->interface);
+    SR_LAT_STAGE(sr_lat_send);
+  }
+  else
+  {
+    SR_PROBE1(arp_miss, rt_entry->gw.s_addr);
+    /* the slow path looks the next hop up again before queueing */
+    if(sr->punt && sr_punt(sr, sr_punt_arp_miss, packet, len,
+      out_if->name, rt_entry->gw.s_addr, rt_entry->interface))
+    {
+      SR_LAT_STAGE(sr_lat_send);
+      return;
+    }
+    struct sr_arpreq *req = sr_arpcache_queuereq(&(sr->cache), rt_entry->gw.s_addr, packet, len, rt_entry->interface);
+    SR_PROBE2(arp_queue, rt_entry->gw.s_addr, len);
+    handle_arpreq(sr, req);
+    SR_LAT_STAGE(sr_lat_send);
+  }
+}
+
+/* Build the IP header of the fragments after the first in to: the fixed
+ * header and those options with the copied flag set (RFC 791 3.1), padded
+ * to a 4-byte boundary.  A malformed option ends the list.  Returns the
+ * header length. */
+static unsigned int sr_ip_copied_options(const uint8_t *hdr,
+  unsigned int hdr_len, uint8_t *to)
+{
+  unsigned int i = sizeof(sr_ip_hdr_t), n = sizeof(sr_ip_hdr_t);
+  memcpy(to, hdr, sizeof(sr_ip_hdr_t));
+  while(i < hdr_len && hdr[i] != IP_OPT_EOL)
+  {
+    if(hdr[i] == IP_OPT_NOP)
+    {
+      i++;
+      continue;
+    }
+    if(i + 1 >= hdr_len || hdr[i + 1] < 2 || i + hdr[i + 1] > hdr_len)
+    {
+      break;
+    }
+    if(hdr[i] & IP_OPT_COPIED)
+    {
+      memcpy(to + n, hdr + i, hdr[i + 1]);
+      n += hdr[i + 1];
+    }
+    i += hdr[i + 1];
+  }
+  while(n % 4)
+  {
+    to[n++] = IP_OPT_EOL;
+  }
+  ((sr_ip_hdr_t *)to)->ip_hl = n / 4;
+  return n;
+}
+
+/* Split an IP datagram into fragments of at most mtu bytes (RFC 791) and send
+ * each to the next hop.  The first fragment keeps all the options, the
+ * others only those to be copied. */
+void sr_ip_packet_fragment(struct sr_instance* sr,
+  uint8_t * packet, unsigned int len, struct sr_rt *rt_entry, uint32_t mtu)
+{
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  unsigned int hdr_len = ip_hdr->ip_hl * 4;
+  unsigned int ip_len = ntohs(ip_hdr->ip_len);
+  uint16_t ip_off = ntohs(ip_hdr->ip_off);
+  unsigned int payload_len, frag_hdr_len, rest_hdr_len, chunk, offset, frag_payload;
+  uint8_t rest_hdr[60];
+
+  if(hdr_len < sizeof(sr_ip_hdr_t) || hdr_len >= ip_len)
+  {
+    sr_stats_drop(sr_drop_ip_truncated);
+    return;
+  }
+  if(mtu < hdr_len + 8)
+  {
+    /* not even 8 bytes of payload fit */
+    sr_stats_drop(sr_drop_frag_needed);
+    return;
+  }
+  SR_TRACE3(sr_ev_ip_frag, ip_hdr->ip_dst, ip_len, mtu);
+  payload_len = ip_len - hdr_len;
+  rest_hdr_len = sr_ip_copied_options((uint8_t *)ip_hdr, hdr_len, rest_hdr);
+
+  uint8_t *frag = (uint8_t *)malloc(sizeof(sr_ethernet_hdr_t) + mtu);
+  sr_ip_hdr_t *frag_ip_hdr = (sr_ip_hdr_t *)(frag + sizeof(sr_ethernet_hdr_t));
+  memcpy(frag, packet, sizeof(sr_ethernet_hdr_t) + hdr_len);
+  frag_hdr_len = hdr_len;
+  for(offset = 0; offset < payload_len; offset += frag_payload)
+  {
+    if(offset > 0)
+    {
+      memcpy(frag_ip_hdr, rest_hdr, rest_hdr_len);
+      frag_hdr_len = rest_hdr_len;
+    }
+    /* fragment offsets count 8-byte units */
+    chunk = ((mtu - frag_hdr_len) / 8) * 8;
+    frag_payload = (payload_len - offset < chunk) ? payload_len - offset : chunk;
+    memcpy(frag + sizeof(sr_ethernet_hdr_t) + frag_hdr_len,
+      packet + sizeof(sr_ethernet_hdr_t) + hdr_len + offset, frag_payload);
+    frag_ip_hdr->ip_len = htons(frag_hdr_len + frag_payload);
+    /* the last piece keeps MF if the datagram was itself a fragment */
+    frag_ip_hdr->ip_off = htons(((ip_off & IP_OFFMASK) + offset / 8) |
+      ((offset + frag_payload < payload_len) ? IP_MF : (ip_off & IP_MF)));
+    frag_ip_hdr->ip_sum = 0;
+    frag_ip_hdr->ip_sum = cksum(frag_ip_hdr, frag_hdr_len);
+    sr_ip_packet_output(sr, frag, sizeof(sr_ethernet_hdr_t) + frag_hdr_len + frag_payload, rt_entry);
+  }
+  free(frag);
+}
+
 void sr_ip_packet_reply(struct sr_instance* sr, 
   uint8_t * packet, unsigned int len, char* interface,
   uint32_t dest_if_ip)
@@ -320,10 +565,16 @@ void sr_ip_packet_reply(struct sr_instance* sr,
   sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
   sr_icmp_hdr_t *icmp_hdr = (sr_icmp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
 
+  if(sr->punt && sr_punt(sr, sr_punt_local, packet, len, interface, dest_if_ip, 0))
+  {
+    return;
+  }
+  SR_LAT_PATH(sr_path_local_icmp);
   if(ip_protocol((uint8_t *)ip_hdr) == ip_protocol_icmp)
   {
     if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t))
     {
+      sr_stats_drop(sr_drop_ip_truncated);
       return;
     }
     else
@@ -341,6 +592,7 @@ void sr_ip_packet_reply(struct sr_instance* sr,
       if(chk_sum_1 != chk_sum_2)
       {
         icmp_hdr->icmp_sum = chk_sum_1;
+        sr_stats_drop(sr_drop_icmp_cksum);
         return;
       }
       else
@@ -384,6 +636,10 @@ void send_icmp_echo_packet(struct sr_instance* sr, char* interface,
   unsigned int len, uint32_t dest_if_ip, sr_ethernet_hdr_t *recv_ethernet_hdr, 
   sr_ip_hdr_t *recv_ip_hdr, sr_icmp_hdr_t *recv_icmp_hdr)
 {
+  if(sr->police && !sr_police(sr, sr_police_echo, recv_ip_hdr->ip_src))
+  {
+    return;
+  }
   /* Function Variables */
   static const unsigned int total_header_size = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_hdr_t);
   uint8_t *icmp_echo_packet = (uint8_t *)malloc(len);
@@ -410,7 +666,11 @@ void send_icmp_echo_packet(struct sr_instance* sr, char* interface,
   memset(send_icmp_hdr, 0, sizeof(sr_icmp_hdr_t));
   send_icmp_hdr->icmp_sum = cksum(send_icmp_hdr, icmp_packet_size);
   /* Send the packet */
+  SR_LAT_STAGE(sr_lat_icmp);
+  SR_TRACE3(sr_ev_icmp_tx, 0, 0, send_ip_hdr->ip_dst);
+  SR_PROBE3(icmp_send, 0, 0, send_ip_hdr->ip_dst);
   sr_send_packet(sr, icmp_echo_packet, len, interface);
+  SR_LAT_STAGE(sr_lat_send);
   free(icmp_echo_packet);
 }
 
@@ -418,6 +678,11 @@ void send_icmp_error_packet(struct sr_instance* sr, char * interface,
   unsigned int len, uint32_t dest_if_ip, sr_ethernet_hdr_t *recv_ethernet_hdr,
    sr_ip_hdr_t *recv_ip_hdr, uint8_t error_type, uint8_t error_code)
 {
+  if(sr->police &&
+    !sr_police(sr, sr_police_icmp_class(error_type), recv_ip_hdr->ip_src))
+  {
+    return;
+  }
   /* Function Variables */
   uint8_t *icmp_echo_packet = (uint8_t *)calloc(1, len);
   sr_ethernet_hdr_t *send_ethernet_hdr = (sr_ethernet_hdr_t *)(icmp_echo_packet);
@@ -445,6 +710,53 @@ void send_icmp_error_packet(struct sr_instance* sr, char * interface,
   send_icmp_hdr->icmp_sum = 0;
   send_icmp_hdr->icmp_sum = cksum(send_icmp_hdr, sizeof(sr_icmp_hdr_t));
   /* Send the packet */
+  SR_LAT_STAGE(sr_lat_icmp);
+  SR_TRACE3(sr_ev_icmp_tx, error_type, error_code, send_ip_hdr->ip_dst);
+  SR_PROBE3(icmp_send, error_type, error_code, send_ip_hdr->ip_dst);
   sr_send_packet(sr, icmp_echo_packet, len, interface);
+  SR_LAT_STAGE(sr_lat_send);
   free(icmp_echo_packet);
-}
\ No newline at end of file
+}
+
+void send_icmp_frag_needed_packet(struct sr_instance* sr, char * interface,
+  sr_ethernet_hdr_t *recv_ethernet_hdr, sr_ip_hdr_t *recv_ip_hdr, uint32_t mtu)
+{
+  if(sr->police && !sr_police(sr, sr_police_unreach, recv_ip_hdr->ip_src))
+  {
+    return;
+  }
+  /* Function Variables */
+  static const unsigned int len = sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t);
+  uint8_t *icmp_packet = (uint8_t *)calloc(1, len);
+  sr_ethernet_hdr_t *send_ethernet_hdr = (sr_ethernet_hdr_t *)(icmp_packet);
+  sr_ip_hdr_t *send_ip_hdr = (sr_ip_hdr_t *)(icmp_packet + sizeof(sr_ethernet_hdr_t));
+  sr_icmp_t3_hdr_t *send_icmp_hdr = (sr_icmp_t3_hdr_t *)(icmp_packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+  struct sr_if *send_if = sr_get_interface(sr, interface);
+  /* Fill out Ethernet Header */
+  memcpy(send_ethernet_hdr->ether_dhost, recv_ethernet_hdr->ether_shost, ETHER_ADDR_LEN);
+  memcpy(send_ethernet_hdr->ether_shost, (uint8_t *)send_if->addr, ETHER_ADDR_LEN);
+  send_ethernet_hdr->ether_type = htons(ethertype_ip);
+  /* Fill out IP Header */
+  send_ip_hdr->ip_v = 4;
+  send_ip_hdr->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+  send_ip_hdr->ip_len = htons(len - sizeof(sr_ethernet_hdr_t));
+  send_ip_hdr->ip_off = htons(IP_DF);
+  send_ip_hdr->ip_ttl = INIT_TTL;
+  send_ip_hdr->ip_p = ip_protocol_icmp;
+  send_ip_hdr->ip_src = send_if->ip;
+  send_ip_hdr->ip_dst = recv_ip_hdr->ip_src;
+  send_ip_hdr->ip_sum = cksum(send_ip_hdr, sizeof(sr_ip_hdr_t));
+  /* Fill out ICMP Header, quoting the IP header and 8 bytes of payload */
+  send_icmp_hdr->icmp_type = FRAG_NEEDED_TYPE;
+  send_icmp_hdr->icmp_code = FRAG_NEEDED_CODE;
+  send_icmp_hdr->next_mtu = htons(mtu);
+  memcpy(send_icmp_hdr->data, recv_ip_hdr, ICMP_DATA_SIZE);
+  send_icmp_hdr->icmp_sum = cksum(send_icmp_hdr, sizeof(sr_icmp_t3_hdr_t));
+  /* Send the packet */
+  SR_LAT_STAGE(sr_lat_icmp);
+  SR_TRACE3(sr_ev_icmp_tx, FRAG_NEEDED_TYPE, FRAG_NEEDED_CODE, send_ip_hdr->ip_dst);
+  SR_PROBE3(icmp_send, FRAG_NEEDED_TYPE, FRAG_NEEDED_CODE, send_ip_hdr->ip_dst);
+  sr_send_packet(sr, icmp_packet, len, interface);
+  SR_LAT_STAGE(sr_lat_send);
+  free(icmp_packet);
+}
@@ -16,20 +16,36 @@
 
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_shm.h"
+#include "sr_bufpool.h"
+#include "sr_logger.h"
+#include "sr_filter.h"
+
+/* Debug output is on while sr_log_level > 0 (srctl log level <n>) */
+extern int sr_log_level;
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
-#define Debug(x, args...) printf(x, ## args)
+#define Debug(x, args...) do { if(sr_log_level > 0) printf(x, ## args); } while (0)
 #define DebugMAC(x) \
-  do { int ivyl; for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
-  (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } while (0)
+  do { int ivyl; if(sr_log_level > 0) { for(ivyl=0; ivyl<5; ivyl++) printf("%02x:", \
+  (unsigned char)(x[ivyl])); printf("%02x",(unsigned char)(x[5])); } } while (0)
 #else
 #define Debug(x, args...) do{}while(0)
 #define DebugMAC(x) do{}while(0)
 #endif
 
 #define INIT_TTL 255
-#define PACKET_DUMP_SIZE 1024
+
+/* VNS message size.  The default is the historic limit; -M raises it so
+ * jumbo frames fit in a single VNSPACKET. */
+#define SR_MSG_LEN_DEFAULT 10000
+#define SR_MSG_LEN_MIN     2048
+#define SR_MSG_LEN_MAX     65536
+
+/* interface MTU unless VNSHWINFO or -j says otherwise */
+#define SR_MTU_DEFAULT 1500
+#define SR_MTU_MIN     68
 
 /* ICMP ECHO REPLY */
 #define ECHO_REPLY_TYPE 0
@@ -46,6 +62,10 @@
 #define PORT_UNREACHABLE_TYPE 3
 #define PORT_UNREACHABLE_CODE 3
 
+/* ICMP FRAGMENTATION NEEDED AND DF SET */
+#define FRAG_NEEDED_TYPE 3
+#define FRAG_NEEDED_CODE 4
+
 /* ICMP TIME EXCEEDED */
 #define TIME_EXCEEDED_TYPE 11
 #define TIME_EXCEEDED_CODE 0
@@ -58,6 +78,50 @@ enum sr_packet_header_type {
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_ctl;
+struct sr_metrics;
+struct sr_vec;
+struct sr_punt;
+struct sr_police;
+struct sr_qos;
+struct sr_acl;
+struct sr_flow_table;
+struct sr_flow_fwd;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vns_batch
+ *
+ * Frames waiting to go out in one VNSPACKET_BATCH message, see
+ * sr_flush_packets().
+ *
+ * -------------------------------------------------------------------------- */
+
+#define SR_BATCH_MAX_FRAMES 64
+
+struct sr_vns_batch
+{
+    uint8_t* buf;
+    unsigned int size;  /* capacity of buf, sr_instance.max_msg_len */
+    unsigned int len;
+    unsigned int count;
+    pthread_mutex_t lock;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_vns_stats
+ *
+ * Frame and message counts for the VNS transport, printed at exit.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_vns_stats
+{
+    unsigned long rx_frames;
+    unsigned long rx_msgs;
+    unsigned long tx_frames;
+    unsigned long tx_msgs;
+    struct timeval start;
+};
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -76,9 +140,29 @@ struct sr_instance
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
     struct sr_rt* routing_table; /* routing table */
+    unsigned int rt_count;       /* entries in routing_table */
     struct sr_arpcache cache;   /* ARP cache */
     pthread_attr_t attr;
-    FILE* logfile;
+    struct sr_logger* logger; /* -l packet capture */
+    struct sr_filter* logfilter; /* -f, frames not matching are not logged */
+    char shm_path[SR_SHM_PATHLEN]; /* shared memory segment to offer, if any */
+    struct sr_shm* shm;            /* shared memory transport */
+    int batching;                  /* send frames as VNSPACKET_BATCH */
+    struct sr_vns_batch txbatch;
+    struct sr_vns_stats vns_stats;
+    unsigned int max_msg_len;      /* largest VNS message accepted or sent */
+    unsigned int max_frame_len;    /* largest ethernet frame that fits in one */
+    unsigned int snaplen;          /* bytes of each frame written to the log */
+    uint32_t if_mtu;               /* MTU for interfaces VNSHWINFO leaves unset */
+    struct sr_bufpool msgpool;     /* max_msg_len buffers for VNS messages */
+    struct sr_ctl* ctl;            /* -c management socket, if any */
+    struct sr_metrics* metrics;    /* -e metrics listener, if any */
+    struct sr_vec* vec;            /* -V vector processing, 0 for scalar */
+    struct sr_punt* punt;          /* -S slow path queue, 0 to handle inline */
+    struct sr_police* police;      /* -R rate limits, 0 for none */
+    struct sr_qos* qos;            /* -Q output scheduler, 0 for none */
+    struct sr_acl* acl;            /* -A access list, 0 for none */
+    struct sr_flow_table* flows;   /* -F flow table, 0 for none */
 };
 
 /* -- sr_main.c -- */
@@ -86,8 +170,12 @@ int sr_verify_routing_table(struct sr_instance* sr);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_now(struct sr_instance* , uint8_t* , unsigned int , const char*);
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+int sr_set_max_msg_len(struct sr_instance* , unsigned int );
+void sr_flush_packets(struct sr_instance* );
+void sr_vns_print_stats(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
@@ -97,19 +185,26 @@ void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
 void sr_add_interface(struct sr_instance* , const char* );
 void sr_set_ether_ip(struct sr_instance* , uint32_t );
 void sr_set_ether_addr(struct sr_instance* , const unsigned char* );
+void sr_set_ether_mtu(struct sr_instance* , uint32_t );
 void sr_print_if_list(struct sr_instance* );
 
 /* -- ip forwarding & ARP -- */
 void sr_handle_arp_packet_type(struct sr_instance* , uint8_t * , unsigned int , char*);
 void sr_handle_ip_packet_type(struct sr_instance* , uint8_t * , unsigned int , char*);
 void sr_ip_packet_reply(struct sr_instance* , uint8_t * , unsigned int , char*, uint32_t);
+void sr_ip_packet_decide(struct sr_instance* , uint8_t * , unsigned int , struct sr_flow_fwd*);
 void sr_ip_packet_next_hop(struct sr_instance* , uint8_t * , unsigned int , char*);
+void sr_ip_packet_route(struct sr_instance* , uint8_t * , unsigned int , char*, struct sr_rt *);
+void sr_ip_packet_output(struct sr_instance* , uint8_t * , unsigned int , struct sr_rt *);
+void sr_ip_packet_fragment(struct sr_instance* , uint8_t * , unsigned int , struct sr_rt *, uint32_t);
 
 /* -- utility helper functions -- */
 bool validate_packet(uint8_t * , unsigned int , enum sr_packet_header_type);
 struct sr_if *ip_packet_forwarding(struct sr_instance* , uint8_t *); 
 struct sr_rt *lpm(struct sr_instance* , uint32_t);
+struct sr_rt *sr_ip_lookup(struct sr_instance* , uint32_t);
 void send_icmp_echo_packet(struct sr_instance* , char* , unsigned int , uint32_t, sr_ethernet_hdr_t *, sr_ip_hdr_t *, sr_icmp_hdr_t *);
 void send_icmp_error_packet(struct sr_instance* , char *, unsigned int, uint32_t, sr_ethernet_hdr_t *, sr_ip_hdr_t *, uint8_t, uint8_t);
+void send_icmp_frag_needed_packet(struct sr_instance* , char *, sr_ethernet_hdr_t *, sr_ip_hdr_t *, uint32_t);
 
 #endif /* SR_ROUTER_H */
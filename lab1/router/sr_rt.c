@@ -21,6 +21,7 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_flow.h"
 
 /*---------------------------------------------------------------------
  * Method:
@@ -35,6 +36,8 @@ void sr_destory_rt(struct sr_instance* sr){
         sr->routing_table = next;
     }
     sr->routing_table = 0;
+    sr->rt_count = 0;
+    sr_flow_invalidate(sr->flows);
 }
 
 
@@ -120,6 +123,8 @@ struct in_addr gw, struct in_addr mask,char* if_name)
         sr->routing_table->gw   = gw;
         sr->routing_table->mask = mask;
         strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+        sr->rt_count = 1;
+        sr_flow_invalidate(sr->flows);
 
         return;
     }
@@ -139,9 +144,44 @@ struct in_addr gw, struct in_addr mask,char* if_name)
     rt_walker->gw   = gw;
     rt_walker->mask = mask;
     strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+    sr->rt_count++;
+    sr_flow_invalidate(sr->flows);
 
 } /* -- sr_add_entry -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_del_rt_entry(..)
+ *
+ * Remove the first entry for dest/mask.  Returns 0 if one was removed,
+ * -1 if there was none.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_del_rt_entry(struct sr_instance* sr, struct in_addr dest,
+struct in_addr mask)
+{
+    struct sr_rt** link = 0;
+    struct sr_rt* rt_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(link = &(sr->routing_table); *link; link = &((*link)->next))
+    {
+        rt_walker = *link;
+        if(rt_walker->dest.s_addr == dest.s_addr &&
+           rt_walker->mask.s_addr == mask.s_addr)
+        {
+            *link = rt_walker->next;
+            free(rt_walker);
+            sr->rt_count--;
+            sr_flow_invalidate(sr->flows);
+            return 0;
+        }
+    }
+    return -1;
+} /* -- sr_del_rt_entry -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
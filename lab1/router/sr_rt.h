@@ -40,6 +40,7 @@ void sr_destory_rt(struct sr_instance*);
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, char*);
+int sr_del_rt_entry(struct sr_instance*, struct in_addr, struct in_addr);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
@@ -0,0 +1,46 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_sdt.h
+ *
+ * Description:
+ *
+ * USDT (static tracepoint) probes for the router, provider "sr".  With
+ * <sys/sdt.h> (systemtap-sdt-dev) each probe is a single nop plus an ELF
+ * note that bpftrace and perf find in the binary, so they can be attached
+ * to a running sr without rebuilding.  Without that header, or built with
+ * USDT=0, the probes compile to nothing.  Example scripts are in probes/.
+ *
+ *   handlepacket_entry(packet, len, interface)
+ *   handlepacket_return(len)
+ *   lpm(dst, rt_entry)             rt_entry 0 when there is no route
+ *   arp_miss(ip)                   next hop not in the ARP cache
+ *   arp_queue(ip, len)             frame of len bytes waits for ip
+ *   arp_request(ip, times_sent)
+ *   arp_reply(ip, packets)         reply flushed 'packets' queued frames
+ *   icmp_send(type, code, dst)
+ *   drop(reason)                   enum sr_drop_reason, see sr_stats.h
+ *
+ * Addresses are in network byte order as in the headers.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SDT_H
+#define SR_SDT_H
+
+#if defined(SR_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SR_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef SR_HAVE_SDT
+#define SR_PROBE1(name, a)       DTRACE_PROBE1(sr, name, a)
+#define SR_PROBE2(name, a, b)    DTRACE_PROBE2(sr, name, a, b)
+#define SR_PROBE3(name, a, b, c) DTRACE_PROBE3(sr, name, a, b, c)
+#else
+#define SR_PROBE1(name, a)       do{}while(0)
+#define SR_PROBE2(name, a, b)    do{}while(0)
+#define SR_PROBE3(name, a, b, c) do{}while(0)
+#endif /* SR_HAVE_SDT */
+
+#endif /* -- SR_SDT_H -- */
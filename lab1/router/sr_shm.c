@@ -0,0 +1,297 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.c
+ *
+ * Description:
+ *
+ * Shared-memory SPSC rings between the VNS server and sr.  See sr_shm.h for
+ * the segment layout and the doorbell protocol.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "sr_shm.h"
+
+#define SR_SHM_RING_CTL_SIZE (sizeof(struct sr_shm_ring))
+
+static void sr_shm_bell_name(char* out, const char* path, int ring)
+{
+    snprintf(out, SR_SHM_PATHLEN + 4, "%s.%s", path,
+             ring == SR_SHM_RX ? "rx" : "tx");
+}
+
+static void sr_shm_ring_bell(struct sr_shm* shm, int ring)
+{
+    char c = 0;
+
+    /* pairs with the fence in the consumer's arm: publish head before
+     * looking at waiting */
+    __sync_synchronize();
+    if(shm->ring[ring]->waiting)
+    {
+        shm->ring[ring]->waiting = 0;
+        if(write(shm->bell[ring], &c, 1) < 0 && errno != EAGAIN)
+        { perror("write(..):sr_shm.c::sr_shm_ring_bell"); }
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_create(..)
+ * Scope:  Global
+ *
+ * Create the segment and its doorbells.  Returns 0 on failure; the router
+ * then simply stays on the TCP transport.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_shm* sr_shm_create(const char* path, uint32_t nslots,
+                             uint32_t slot_size)
+{
+    struct sr_shm* shm;
+    struct sr_shm_hdr* hdr;
+    char bell[SR_SHM_PATHLEN + 4];
+    size_t ring_bytes;
+    int fd, i;
+
+    /* -- REQUIRES -- */
+    assert(path);
+
+    if(strlen(path) >= SR_SHM_PATHLEN || (nslots & (nslots - 1)) != 0 ||
+       slot_size <= sizeof(struct sr_shm_slot))
+    {
+        fprintf(stderr, "sr_shm_create: bad geometry for %s\n", path);
+        return 0;
+    }
+
+    shm = (struct sr_shm*)calloc(1, sizeof(struct sr_shm));
+    assert(shm);
+    strncpy(shm->path, path, SR_SHM_PATHLEN);
+    shm->nslots = nslots;
+    shm->slot_size = slot_size;
+    shm->bell[0] = shm->bell[1] = -1;
+    pthread_mutex_init(&(shm->tx_lock), 0);
+
+    ring_bytes = SR_SHM_RING_CTL_SIZE + (size_t)nslots * slot_size;
+    shm->size = sizeof(struct sr_shm_hdr) + 2 * ring_bytes;
+
+    if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+    {
+        perror("open(..):sr_shm.c::sr_shm_create");
+        free(shm);
+        return 0;
+    }
+    if(ftruncate(fd, shm->size) != 0)
+    {
+        perror("ftruncate(..):sr_shm.c::sr_shm_create");
+        close(fd);
+        unlink(path);
+        free(shm);
+        return 0;
+    }
+    shm->base = mmap(0, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm->base == MAP_FAILED)
+    {
+        perror("mmap(..):sr_shm.c::sr_shm_create");
+        unlink(path);
+        free(shm);
+        return 0;
+    }
+
+    hdr = (struct sr_shm_hdr*)shm->base;
+    hdr->version = SR_SHM_VERSION;
+    hdr->nslots = nslots;
+    hdr->slot_size = slot_size;
+    for(i = 0; i < 2; i++)
+    {
+        hdr->ring_off[i] = sizeof(struct sr_shm_hdr) + i * ring_bytes;
+        shm->ring[i] = (struct sr_shm_ring*)(shm->base + hdr->ring_off[i]);
+        shm->slots[i] = shm->base + hdr->ring_off[i] + SR_SHM_RING_CTL_SIZE;
+
+        sr_shm_bell_name(bell, path, i);
+        unlink(bell);
+        /* O_RDWR keeps the FIFO open without waiting for a peer (Linux) */
+        if(mkfifo(bell, 0600) != 0 ||
+           (shm->bell[i] = open(bell, O_RDWR | O_NONBLOCK)) < 0)
+        {
+            perror("mkfifo(..):sr_shm.c::sr_shm_create");
+            sr_shm_destroy(shm);
+            return 0;
+        }
+    }
+    /* magic last, so a server that maps early never sees a half header */
+    __sync_synchronize();
+    hdr->magic = SR_SHM_MAGIC;
+
+    return shm;
+} /* -- sr_shm_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_destroy(..)
+ * Scope:  Global
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_shm_destroy(struct sr_shm* shm)
+{
+    char bell[SR_SHM_PATHLEN + 4];
+    int i;
+
+    if(!shm)
+    { return; }
+
+    for(i = 0; i < 2; i++)
+    {
+        if(shm->bell[i] >= 0)
+        { close(shm->bell[i]); }
+        sr_shm_bell_name(bell, shm->path, i);
+        unlink(bell);
+    }
+    if(shm->base && shm->base != MAP_FAILED)
+    { munmap(shm->base, shm->size); }
+    unlink(shm->path);
+    pthread_mutex_destroy(&(shm->tx_lock));
+    free(shm);
+} /* -- sr_shm_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_send(..)
+ * Scope:  Global
+ *
+ * Copy a frame into the next free TX slot and publish it.  Callers on
+ * different threads are serialized by tx_lock; the ring itself only ever
+ * sees one producer.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_shm_send(struct sr_shm* shm, const uint8_t* buf, unsigned int len,
+                const char* iface)
+{
+    struct sr_shm_ring* ring = shm->ring[SR_SHM_TX];
+    struct sr_shm_slot* slot;
+    uint32_t head;
+
+    if(len > shm->slot_size - sizeof(struct sr_shm_slot))
+    { return -1; }
+
+    pthread_mutex_lock(&(shm->tx_lock));
+
+    head = ring->head;
+    if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= shm->nslots)
+    {
+        pthread_mutex_unlock(&(shm->tx_lock));
+        return -1; /* full */
+    }
+
+    slot = (struct sr_shm_slot*)(shm->slots[SR_SHM_TX] +
+            (size_t)(head & (shm->nslots - 1)) * shm->slot_size);
+    slot->len = len;
+    strncpy(slot->iface, iface, sizeof(slot->iface));
+    memcpy(((uint8_t*)slot) + sizeof(struct sr_shm_slot), buf, len);
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    sr_shm_ring_bell(shm, SR_SHM_TX);
+
+    pthread_mutex_unlock(&(shm->tx_lock));
+    return 0;
+} /* -- sr_shm_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_rx_peek(..)
+ * Scope:  Global
+ *
+ * Lend the oldest RX frame in place.  Returns 1 if a frame is available,
+ * 0 if the ring is empty.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_shm_rx_peek(struct sr_shm* shm, uint8_t** buf, unsigned int* len,
+                   char** iface)
+{
+    return sr_shm_rx_peek_at(shm, 0, buf, len, iface);
+} /* -- sr_shm_rx_peek -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_rx_peek_at(..)
+ * Scope:  Global
+ *
+ * Lend the i-th oldest RX frame in place; the frames before it stay lent
+ * too until they are released.  Returns 0 if fewer than i + 1 frames are
+ * waiting.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_shm_rx_peek_at(struct sr_shm* shm, uint32_t i, uint8_t** buf,
+                      unsigned int* len, char** iface)
+{
+    struct sr_shm_ring* ring = shm->ring[SR_SHM_RX];
+    struct sr_shm_slot* slot;
+    uint32_t tail = ring->tail + i;
+
+    if(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail <= i)
+    { return 0; }
+
+    slot = (struct sr_shm_slot*)(shm->slots[SR_SHM_RX] +
+            (size_t)(tail & (shm->nslots - 1)) * shm->slot_size);
+
+    /* never trust the peer with our bounds */
+    if(slot->len > shm->slot_size - sizeof(struct sr_shm_slot))
+    { slot->len = 0; }
+    slot->iface[sizeof(slot->iface) - 1] = '\0';
+
+    *buf = ((uint8_t*)slot) + sizeof(struct sr_shm_slot);
+    *len = slot->len;
+    *iface = slot->iface;
+    return 1;
+} /* -- sr_shm_rx_peek_at -- */
+
+void sr_shm_rx_release(struct sr_shm* shm)
+{
+    sr_shm_rx_release_n(shm, 1);
+} /* -- sr_shm_rx_release -- */
+
+void sr_shm_rx_release_n(struct sr_shm* shm, uint32_t n)
+{
+    struct sr_shm_ring* ring = shm->ring[SR_SHM_RX];
+
+    __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+} /* -- sr_shm_rx_release_n -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_rx_arm(..)
+ * Scope:  Global
+ *
+ * Set the waiting flag before blocking on the RX doorbell, then re-check
+ * the ring so a frame published in between is not missed.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_shm_rx_arm(struct sr_shm* shm)
+{
+    struct sr_shm_ring* ring = shm->ring[SR_SHM_RX];
+
+    ring->waiting = 1;
+    __sync_synchronize();
+    if(ring->head != ring->tail)
+    {
+        ring->waiting = 0;
+        return 1;
+    }
+    return 0;
+} /* -- sr_shm_rx_arm -- */
+
+void sr_shm_rx_clear_bell(struct sr_shm* shm)
+{
+    char junk[64];
+
+    while(read(shm->bell[SR_SHM_RX], junk, sizeof(junk)) > 0);
+} /* -- sr_shm_rx_clear_bell -- */
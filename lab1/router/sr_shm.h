@@ -0,0 +1,119 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.h
+ *
+ * Description:
+ *
+ * Optional shared-memory transport between the VNS server (POX srhandler)
+ * and sr.  A single segment under /dev/shm holds two single-producer /
+ * single-consumer rings of fixed-size slots:
+ *
+ *   ring 0 (SR_SHM_RX)  server -> router
+ *   ring 1 (SR_SHM_TX)  router -> server
+ *
+ * The segment is created by the router and offered to the server with a
+ * VNS_SHM_OPEN message after the VNS open handshake.  Until the server
+ * answers with a positive VNS_SHM_STATUS, frames keep flowing over the TCP
+ * socket.  Control messages (HWINFO, CLOSE, ...) always use TCP.
+ *
+ * Layout (host byte order, both ends live on the same machine):
+ *
+ *   0                        struct sr_shm_hdr    (64 bytes)
+ *   ring_off[i]              struct sr_shm_ring   (3 cache lines)
+ *   ring_off[i] + 192        nslots * slot_size bytes of slots
+ *
+ * Each slot starts with a struct sr_shm_slot followed by the frame.
+ *
+ * A consumer that is about to sleep sets ring->waiting and blocks on the
+ * ring's doorbell, a FIFO named <path>.rx (ring 0) or <path>.tx (ring 1).
+ * The producer writes one byte to the FIFO when it sees waiting set.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SHM_H
+#define SR_SHM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include <pthread.h>
+
+#define SR_SHM_MAGIC      0x53525348 /* "SRSH" */
+#define SR_SHM_VERSION    1
+#define SR_SHM_PATHLEN    108
+#define SR_SHM_NSLOTS     1024       /* must be a power of two */
+#define SR_SHM_SLOT_SIZE  2048
+#define SR_SHM_CACHELINE  64
+#define SR_SHM_POLL_MS    10         /* bounds a lost doorbell wakeup */
+
+#define SR_SHM_RX 0
+#define SR_SHM_TX 1
+
+struct sr_shm_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t slot_size;
+    uint32_t ring_off[2];
+    uint8_t  pad[SR_SHM_CACHELINE - 6*sizeof(uint32_t)];
+} __attribute__ ((packed)) ;
+
+/* head is only written by the producer and tail only by the consumer.
+ * The consumer sets waiting before it sleeps on the doorbell; the
+ * producer clears it when it rings.  Each lives on its own cache line. */
+struct sr_shm_ring
+{
+    volatile uint32_t head;
+    uint8_t  pad0[SR_SHM_CACHELINE - sizeof(uint32_t)];
+    volatile uint32_t tail;
+    uint8_t  pad1[SR_SHM_CACHELINE - sizeof(uint32_t)];
+    volatile uint32_t waiting;
+    uint8_t  pad2[SR_SHM_CACHELINE - sizeof(uint32_t)];
+} __attribute__ ((packed)) ;
+
+struct sr_shm_slot
+{
+    uint32_t len;        /* length of the ethernet frame */
+    uint32_t pad;
+    char     iface[16];  /* same width as c_packet_header.mInterfaceName */
+} __attribute__ ((packed)) ;
+
+struct sr_shm
+{
+    char     path[SR_SHM_PATHLEN];
+    uint8_t* base;
+    size_t   size;
+    uint32_t nslots;
+    uint32_t slot_size;
+    struct sr_shm_ring* ring[2];
+    uint8_t* slots[2];
+    int      bell[2];        /* doorbell FIFOs, opened O_RDWR|O_NONBLOCK */
+    int      active;         /* server accepted the segment */
+    pthread_mutex_t tx_lock; /* sr_send_packet runs on several threads */
+};
+
+struct sr_shm* sr_shm_create(const char* path, uint32_t nslots,
+                             uint32_t slot_size);
+void sr_shm_destroy(struct sr_shm* shm);
+
+/* producer side of SR_SHM_TX; returns 0 on success, -1 if full/too large */
+int  sr_shm_send(struct sr_shm* shm, const uint8_t* buf, unsigned int len,
+                 const char* iface);
+
+/* consumer side of SR_SHM_RX; the frame is lent until sr_shm_rx_release() */
+int  sr_shm_rx_peek(struct sr_shm* shm, uint8_t** buf, unsigned int* len,
+                    char** iface);
+void sr_shm_rx_release(struct sr_shm* shm);
+/* the same for the i-th unreleased frame, and releasing n at once, for
+ * holding several frames in place (-V) */
+int  sr_shm_rx_peek_at(struct sr_shm* shm, uint32_t i, uint8_t** buf,
+                       unsigned int* len, char** iface);
+void sr_shm_rx_release_n(struct sr_shm* shm, uint32_t n);
+
+/* announce that the consumer is about to sleep on bell[SR_SHM_RX].
+ * Returns nonzero if frames arrived in the meantime (do not sleep). */
+int  sr_shm_rx_arm(struct sr_shm* shm);
+void sr_shm_rx_clear_bell(struct sr_shm* shm);
+
+#endif /* -- SR_SHM_H -- */
@@ -0,0 +1,178 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.c
+ *
+ * Description:
+ *
+ * Per-thread counter blocks and their dump, see sr_stats.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_stats.h"
+#include "sr_latency.h"
+#include "sr_perf.h"
+#include "sr_punt.h"
+#include "sr_police.h"
+#include "sr_flow.h"
+
+__thread struct sr_stats_block* sr_stats_self = 0;
+volatile int sr_stats_dump_pending = 0;
+
+static struct sr_stats_block* sr_stats_blocks = 0;
+static pthread_mutex_t sr_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define SR_DROP_NAME(id, name) name,
+static const char* sr_drop_names[] = { SR_DROP_REASONS(SR_DROP_NAME) 0 };
+#undef SR_DROP_NAME
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_thread_block(..)
+ * Scope:  Global
+ *
+ * Slow path of sr_stats_block(): give the calling thread its counters.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_stats_block* sr_stats_thread_block(void)
+{
+    struct sr_stats_block* b = 0;
+
+    if(posix_memalign((void**)&b, 64, sizeof(struct sr_stats_block)) != 0)
+    { b = 0; }
+    assert(b);
+    memset(b, 0, sizeof(struct sr_stats_block));
+
+    pthread_mutex_lock(&sr_stats_lock);
+    b->next = sr_stats_blocks;
+    sr_stats_blocks = b;
+    pthread_mutex_unlock(&sr_stats_lock);
+
+    sr_stats_self = b;
+    return b;
+} /* -- sr_stats_thread_block -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_sum(..)
+ * Scope:  Global
+ *
+ * Add up the counters of all threads into 't'.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_stats_sum(struct sr_stats_totals* t)
+{
+    const volatile struct sr_stats_block* b;
+    int i;
+
+    memset(t, 0, sizeof(*t));
+
+    pthread_mutex_lock(&sr_stats_lock);
+    for(b = sr_stats_blocks; b; b = b->next)
+    {
+        for(i = 0; i < SR_STATS_MAX_IFS; i++)
+        {
+            t->ifs[i].rx_pkts  += b->ifs[i].rx_pkts;
+            t->ifs[i].rx_bytes += b->ifs[i].rx_bytes;
+            t->ifs[i].tx_pkts  += b->ifs[i].tx_pkts;
+            t->ifs[i].tx_bytes += b->ifs[i].tx_bytes;
+        }
+        for(i = 0; i < sr_drop_count; i++)
+        { t->drops[i] += b->drops[i]; }
+        t->arp_hits   += b->arp_hits;
+        t->arp_misses += b->arp_misses;
+    }
+    pthread_mutex_unlock(&sr_stats_lock);
+} /* -- sr_stats_sum -- */
+
+const char* sr_stats_drop_name(int reason)
+{
+    return (reason >= 0 && reason < sr_drop_count) ?
+           sr_drop_names[reason] : "unknown";
+} /* -- sr_stats_drop_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_dump(..)
+ * Scope:  Global
+ *
+ * Print per-interface traffic, the drop counters and, when built with
+ * LATENCY=1, the latency percentiles; with PERF=1 and -P the hardware
+ * counters too.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_stats_dump(struct sr_instance* sr, FILE* fp)
+{
+    struct sr_stats_totals t;
+    struct sr_if* if_walker;
+    uint64_t dropped = 0;
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(fp);
+
+    sr_stats_sum(&t);
+
+    fprintf(fp, "%-12s %12s %14s %12s %14s\n",
+            "interface", "rx pkts", "rx bytes", "tx pkts", "tx bytes");
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(if_walker->index >= SR_STATS_MAX_IFS)
+        { continue; }
+        i = if_walker->index;
+        fprintf(fp, "%-12s %12llu %14llu %12llu %14llu\n", if_walker->name,
+                (unsigned long long)t.ifs[i].rx_pkts,
+                (unsigned long long)t.ifs[i].rx_bytes,
+                (unsigned long long)t.ifs[i].tx_pkts,
+                (unsigned long long)t.ifs[i].tx_bytes);
+    }
+
+    for(i = 0; i < sr_drop_count; i++)
+    { dropped += t.drops[i]; }
+    fprintf(fp, "arp cache hits %llu misses %llu\n",
+            (unsigned long long)t.arp_hits, (unsigned long long)t.arp_misses);
+    fprintf(fp, "dropped %llu\n", (unsigned long long)dropped);
+    for(i = 0; i < sr_drop_count; i++)
+    {
+        if(t.drops[i])
+        {
+            fprintf(fp, "  %-20s %llu\n", sr_drop_names[i],
+                    (unsigned long long)t.drops[i]);
+        }
+    }
+    sr_punt_dump(sr->punt, fp);
+    sr_police_dump(sr->police, fp);
+    sr_flow_dump(sr->flows, fp);
+#ifdef SR_LATENCY
+    sr_latency_dump(fp);
+#endif
+#ifdef SR_PERF
+    sr_perf_dump(fp);
+#endif
+    fflush(fp);
+} /* -- sr_stats_dump -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_stats_poll(..)
+ * Scope:  Global
+ *
+ * Dump the counters if SIGUSR1 asked for it.  Called once a second from
+ * the ARP cache thread, as the signal handler itself cannot print.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_stats_poll(struct sr_instance* sr)
+{
+    if(sr_stats_dump_pending)
+    {
+        sr_stats_dump_pending = 0;
+        sr_stats_dump(sr, stdout);
+    }
+} /* -- sr_stats_poll -- */
@@ -0,0 +1,143 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.h
+ *
+ * Description:
+ *
+ * Packet and drop counters.  Every thread that counts gets its own
+ * cache-line aligned block and is the only writer of it, so counting is a
+ * plain increment with no atomics and no sharing.  Readers add up the
+ * blocks of all threads when asked (SIGUSR1, and at exit); a sum taken
+ * while packets are flowing is not a consistent snapshot across counters,
+ * but each counter is exact.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_STATS_H
+#define SR_STATS_H
+
+#include <stdio.h>
+
+#include "sr_sdt.h"
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_STATS_MAX_IFS 32   /* interfaces by sr_if.index */
+
+/* ----------------------------------------------------------------------------
+ * Why a frame was dropped, with the name the dump shows.  New reasons go
+ * at the end: probes/drops.bt knows them by number.
+ * -------------------------------------------------------------------------- */
+
+#define SR_DROP_REASONS(X) \
+    X(sr_drop_short_frame,    "short_frame")       \
+    X(sr_drop_unknown_if,     "unknown_interface") \
+    X(sr_drop_ethertype,      "unknown_ethertype") \
+    X(sr_drop_arp_not_for_us, "arp_not_for_us")    \
+    X(sr_drop_ip_cksum,       "bad_ip_checksum")   \
+    X(sr_drop_ip_truncated,   "ip_truncated")      \
+    X(sr_drop_icmp_cksum,     "bad_icmp_checksum") \
+    X(sr_drop_no_route,       "no_route")          \
+    X(sr_drop_ttl_expired,    "ttl_expired")       \
+    X(sr_drop_frag_needed,    "df_too_big")        \
+    X(sr_drop_arp_giveup,     "arp_unresolved")    \
+    X(sr_drop_tx_error,       "tx_error")          \
+    X(sr_drop_punt_full,      "punt_queue_full")   \
+    X(sr_drop_policed,        "policed")           \
+    X(sr_drop_qos_full,       "qos_queue_full")    \
+    X(sr_drop_arp_queue_full, "arp_queue_full")    \
+    X(sr_drop_codel,          "codel")             \
+    X(sr_drop_acl,            "acl_deny")
+
+#define SR_DROP_ENUM(id, name) id,
+enum sr_drop_reason {
+    SR_DROP_REASONS(SR_DROP_ENUM)
+    sr_drop_count
+};
+#undef SR_DROP_ENUM
+
+struct sr_stats_if
+{
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    uint64_t tx_pkts;
+    uint64_t tx_bytes;
+};
+
+/* one per counting thread, never freed so counts outlive their thread */
+struct sr_stats_block
+{
+    struct sr_stats_if ifs[SR_STATS_MAX_IFS];
+    uint64_t drops[sr_drop_count];
+    uint64_t arp_hits;      /* next hop found in the ARP cache */
+    uint64_t arp_misses;    /* frame queued for an ARP request */
+    struct sr_stats_block* next;
+} __attribute__ ((aligned (64)));
+
+/* sums over all threads */
+struct sr_stats_totals
+{
+    struct sr_stats_if ifs[SR_STATS_MAX_IFS];
+    uint64_t drops[sr_drop_count];
+    uint64_t arp_hits;
+    uint64_t arp_misses;
+};
+
+struct sr_instance;
+
+extern __thread struct sr_stats_block* sr_stats_self;
+extern volatile int sr_stats_dump_pending;
+
+struct sr_stats_block* sr_stats_thread_block(void);
+void sr_stats_sum(struct sr_stats_totals* t);
+const char* sr_stats_drop_name(int reason);
+void sr_stats_dump(struct sr_instance* sr, FILE* fp);
+void sr_stats_poll(struct sr_instance* sr);
+
+static __inline__ struct sr_stats_block* sr_stats_block(void)
+{
+    struct sr_stats_block* b = sr_stats_self;
+    return b ? b : sr_stats_thread_block();
+}
+
+static __inline__ void sr_stats_rx(uint32_t ifindex, unsigned int len)
+{
+    struct sr_stats_block* b = sr_stats_block();
+    if(ifindex < SR_STATS_MAX_IFS)
+    {
+        b->ifs[ifindex].rx_pkts++;
+        b->ifs[ifindex].rx_bytes += len;
+    }
+}
+
+static __inline__ void sr_stats_tx(uint32_t ifindex, unsigned int len)
+{
+    struct sr_stats_block* b = sr_stats_block();
+    if(ifindex < SR_STATS_MAX_IFS)
+    {
+        b->ifs[ifindex].tx_pkts++;
+        b->ifs[ifindex].tx_bytes += len;
+    }
+}
+
+static __inline__ void sr_stats_arp(int hit)
+{
+    struct sr_stats_block* b = sr_stats_block();
+    if(hit)
+    { b->arp_hits++; }
+    else
+    { b->arp_misses++; }
+}
+
+static __inline__ void sr_stats_drop(enum sr_drop_reason reason)
+{
+    SR_PROBE1(drop, (int)reason);
+    sr_stats_block()->drops[reason]++;
+}
+
+#endif /* -- SR_STATS_H -- */
@@ -0,0 +1,262 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trace.c
+ *
+ * Description:
+ *
+ * Per-thread event rings and the thread that drains them, see sr_trace.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_trace.h"
+
+#define SR_TRACE_FILE_BUF (1 << 20)
+
+volatile int sr_trace_on = 0;
+__thread struct sr_trace_ring* sr_trace_ring_self = 0;
+
+/* threads that could not get a ring stop asking */
+static __thread int sr_trace_no_ring = 0;
+
+static struct
+{
+    pthread_mutex_t lock;         /* protects rings/nrings */
+    struct sr_trace_ring* rings[SR_TRACE_MAX_THREADS];
+    int nrings;
+    FILE* fp;
+    char* fbuf;
+    pthread_t thread;
+    volatile int running;
+    struct sr_trace_file_hdr hdr;
+    uint64_t start_mono;          /* monotonic ns at hdr.start_ticks */
+} sr_tracer = { PTHREAD_MUTEX_INITIALIZER };
+
+static void* sr_trace_thread(void* arg);
+
+static uint64_t sr_trace_now_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+} /* -- sr_trace_now_ns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_calibrate(..)
+ * Scope:  Local
+ *
+ * Rate of sr_trace_ticks() measured against the monotonic clock since
+ * (t0, n0).
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_trace_calibrate(uint64_t t0, uint64_t n0)
+{
+    uint64_t t1 = sr_trace_ticks();
+    uint64_t n1 = sr_trace_now_ns(CLOCK_MONOTONIC);
+
+    if(n1 <= n0)
+    { return 1000000000ull; }
+    return (uint64_t)((double)(t1 - t0) * 1e9 / (double)(n1 - n0));
+} /* -- sr_trace_calibrate -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_start(..)
+ * Scope:  Global
+ *
+ * Open 'fname' and switch tracing on.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_trace_start(const char* fname)
+{
+    struct sr_trace_file_hdr* hdr = &(sr_tracer.hdr);
+    uint64_t n0;
+
+    /* -- REQUIRES -- */
+    assert(fname);
+    assert(!sr_tracer.fp);
+
+    if((sr_tracer.fp = fopen(fname, "wb")) == 0)
+    {
+        perror("fopen(..):sr_trace.c::sr_trace_start");
+        return -1;
+    }
+    sr_tracer.fbuf = (char*)malloc(SR_TRACE_FILE_BUF);
+    if(sr_tracer.fbuf)
+    { setvbuf(sr_tracer.fp, sr_tracer.fbuf, _IOFBF, SR_TRACE_FILE_BUF); }
+
+    /* a first estimate of the tick rate, refined in sr_trace_stop() */
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = SR_TRACE_MAGIC;
+    hdr->version = SR_TRACE_VERSION;
+    hdr->rec_size = sizeof(struct sr_trace_rec);
+    n0 = sr_trace_now_ns(CLOCK_MONOTONIC);
+    hdr->start_ticks = sr_trace_ticks();
+    hdr->start_ns = sr_trace_now_ns(CLOCK_REALTIME);
+    usleep(10000);
+    hdr->ticks_per_sec = sr_trace_calibrate(hdr->start_ticks, n0);
+    sr_tracer.start_mono = n0;
+    fwrite(hdr, sizeof(*hdr), 1, sr_tracer.fp);
+
+    sr_tracer.running = 1;
+    if(pthread_create(&(sr_tracer.thread), 0, sr_trace_thread, 0) != 0)
+    {
+        perror("pthread_create(..):sr_trace.c::sr_trace_start");
+        fclose(sr_tracer.fp);
+        sr_tracer.fp = 0;
+        return -1;
+    }
+    sr_trace_on = 1;
+    return 0;
+} /* -- sr_trace_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_thread_ring(..)
+ * Scope:  Global
+ *
+ * Slow path of sr_trace_emit(): give the calling thread its ring.
+ * Rings live until the process exits since a thread may still hold one
+ * after sr_trace_stop().
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_trace_ring* sr_trace_thread_ring(void)
+{
+    struct sr_trace_ring* ring = 0;
+
+    if(sr_trace_no_ring)
+    { return 0; }
+
+    pthread_mutex_lock(&(sr_tracer.lock));
+    if(sr_tracer.nrings < SR_TRACE_MAX_THREADS &&
+       posix_memalign((void**)&ring, 64, sizeof(struct sr_trace_ring)) == 0)
+    {
+        memset(ring, 0, sizeof(struct sr_trace_ring));
+        ring->id = sr_tracer.nrings;
+        sr_tracer.rings[sr_tracer.nrings++] = ring;
+    }
+    pthread_mutex_unlock(&(sr_tracer.lock));
+
+    if(!ring)
+    {
+        fprintf(stderr, "Warning: no trace ring left, thread not traced\n");
+        sr_trace_no_ring = 1;
+    }
+    sr_trace_ring_self = ring;
+    return ring;
+} /* -- sr_trace_thread_ring -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_set_interface(..)
+ * Scope:  Global
+ *
+ * Record the name of interface 'index' for the decoder, which shows the
+ * first 11 characters.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trace_set_interface(uint32_t index, const char* name)
+{
+    uint32_t packed[3];
+
+    if(!sr_trace_on)
+    { return; }
+    memset(packed, 0, sizeof(packed));
+    strncpy((char*)packed, name, sizeof(packed) - 1);
+    sr_trace_emit(sr_ev_ifname, index, packed[0], packed[1], packed[2]);
+} /* -- sr_trace_set_interface -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_drain(..)
+ * Scope:  Local
+ *
+ * Write out whatever the rings hold.  Returns the number of records.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_trace_drain(void)
+{
+    struct sr_trace_ring* ring;
+    uint32_t head, tail, idx, n;
+    unsigned int total = 0;
+    int i, nrings;
+
+    pthread_mutex_lock(&(sr_tracer.lock));
+    nrings = sr_tracer.nrings;
+    pthread_mutex_unlock(&(sr_tracer.lock));
+
+    for(i = 0; i < nrings; i++)
+    {
+        ring = sr_tracer.rings[i];
+        head = __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE);
+        tail = ring->tail;
+        while(tail != head)
+        {
+            /* up to the end of the ring, then wrap */
+            idx = tail & (SR_TRACE_RING_RECS - 1);
+            n = head - tail;
+            if(n > SR_TRACE_RING_RECS - idx)
+            { n = SR_TRACE_RING_RECS - idx; }
+            fwrite(&(ring->recs[idx]), sizeof(struct sr_trace_rec), n,
+                   sr_tracer.fp);
+            tail += n;
+            total += n;
+        }
+        __atomic_store_n(&(ring->tail), tail, __ATOMIC_RELEASE);
+    }
+    return total;
+} /* -- sr_trace_drain -- */
+
+static void* sr_trace_thread(void* arg)
+{
+    while(sr_tracer.running)
+    {
+        if(sr_trace_drain() == 0)
+        { usleep(SR_TRACE_DRAIN_US); }
+    }
+    return 0;
+} /* -- sr_trace_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_stop(..)
+ * Scope:  Global
+ *
+ * Switch tracing off, write out the rings and close the file.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trace_stop(void)
+{
+    struct sr_trace_file_hdr* hdr = &(sr_tracer.hdr);
+    int i;
+
+    if(!sr_tracer.fp)
+    { return; }
+
+    sr_trace_on = 0;
+    sr_tracer.running = 0;
+    pthread_join(sr_tracer.thread, 0);
+    sr_trace_drain();
+
+    hdr->ticks_per_sec = sr_trace_calibrate(hdr->start_ticks,
+                                            sr_tracer.start_mono);
+    hdr->lost = 0;
+    for(i = 0; i < sr_tracer.nrings; i++)
+    { hdr->lost += sr_tracer.rings[i]->lost; }
+    if(hdr->lost)
+    { fprintf(stderr, "trace: %lu events lost\n", (unsigned long)hdr->lost); }
+
+    rewind(sr_tracer.fp);
+    fwrite(hdr, sizeof(*hdr), 1, sr_tracer.fp);
+    fclose(sr_tracer.fp);
+    sr_tracer.fp = 0;
+    free(sr_tracer.fbuf);
+    sr_tracer.fbuf = 0;
+} /* -- sr_trace_stop -- */
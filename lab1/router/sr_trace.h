@@ -0,0 +1,163 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trace.h
+ *
+ * Description:
+ *
+ * Binary event trace for the packet path.  Each thread that emits an
+ * event gets its own single-producer ring of fixed-size records, so
+ * emitting is a timestamp, a few stores and no lock.  A background thread
+ * drains the rings into the file given with -x; sr_trace_decode turns that
+ * file back into text.  When a ring is full the event is counted as lost.
+ *
+ * Trace points cost nothing when the router is built with TRACE=0 (no
+ * SR_TRACE define) and a single predictable branch when tracing is
+ * compiled in but not switched on.
+ *
+ * File layout (host byte order):
+ *
+ *   struct sr_trace_file_hdr
+ *   struct sr_trace_rec ...    in time order per thread, not across threads
+ *
+ * Interface names travel as sr_ev_ifname records so the decoder can show
+ * them in place of the interface index.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TRACE_H
+#define SR_TRACE_H
+
+#include <time.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TRACE_MAGIC      0x31435254535253ull /* "SRSTRC1" */
+#define SR_TRACE_VERSION    1
+#define SR_TRACE_RING_RECS  8192   /* per thread, power of two */
+#define SR_TRACE_MAX_THREADS 16
+#define SR_TRACE_DRAIN_US   1000
+
+/* ----------------------------------------------------------------------------
+ * Events.  Argument formats are used by sr_trace_decode: %u decimal, %x hex,
+ * %I an IPv4 address in network byte order, %s an interface index, %n
+ * the rest of the arguments as a string.
+ * -------------------------------------------------------------------------- */
+
+#define SR_TRACE_EVENTS(X) \
+  X(sr_ev_ifname,     "ifname",      "if=%u name=%n") \
+  X(sr_ev_rx,         "rx",          "len=%u if=%s") \
+  X(sr_ev_tx,         "tx",          "len=%u if=%s") \
+  X(sr_ev_arp_rx,     "arp_rx",      "op=%u sip=%I tip=%I") \
+  X(sr_ev_arp_req,    "arp_request", "ip=%I tries=%u") \
+  X(sr_ev_ip_local,   "ip_local",    "src=%I dst=%I proto=%u") \
+  X(sr_ev_ip_forward, "ip_forward",  "dst=%I gw=%I if=%s len=%u") \
+  X(sr_ev_ip_frag,    "ip_fragment", "dst=%I len=%u mtu=%u") \
+  X(sr_ev_icmp_tx,    "icmp_tx",     "type=%u code=%u dst=%I")
+
+#define SR_TRACE_ENUM(id, name, fmt) id,
+enum sr_trace_event {
+  SR_TRACE_EVENTS(SR_TRACE_ENUM)
+  sr_ev_count
+};
+#undef SR_TRACE_ENUM
+
+/* one event, 32 bytes */
+struct sr_trace_rec
+{
+  uint64_t ts;         /* ticks, see sr_trace_file_hdr */
+  uint16_t event;      /* enum sr_trace_event */
+  uint16_t thread;     /* ring number */
+  uint32_t arg[5];
+};
+
+struct sr_trace_file_hdr
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t rec_size;
+  uint64_t ticks_per_sec; /* rate of sr_trace_rec.ts */
+  uint64_t start_ticks;   /* ts value at start_ns */
+  uint64_t start_ns;      /* wall clock, ns since the epoch */
+  uint64_t lost;          /* events dropped on full rings */
+};
+
+struct sr_trace_ring
+{
+  struct sr_trace_rec recs[SR_TRACE_RING_RECS];
+  volatile uint32_t head;   /* written by the owning thread */
+  uint8_t pad0[60];
+  volatile uint32_t tail;   /* written by the drain thread */
+  uint8_t pad1[60];
+  unsigned long lost;
+  uint16_t id;
+};
+
+extern volatile int sr_trace_on;
+
+int  sr_trace_start(const char* fname);
+void sr_trace_set_interface(uint32_t index, const char* name);
+void sr_trace_stop(void);
+struct sr_trace_ring* sr_trace_thread_ring(void);
+
+/* read the clock sr_trace_rec.ts counts in */
+static __inline__ uint64_t sr_trace_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t)hi << 32) | lo;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+extern __thread struct sr_trace_ring* sr_trace_ring_self;
+
+static __inline__ void sr_trace_emit(uint16_t event, uint32_t a0, uint32_t a1,
+                                     uint32_t a2, uint32_t a3)
+{
+  struct sr_trace_ring* ring = sr_trace_ring_self;
+  struct sr_trace_rec* rec;
+  uint32_t head;
+
+  if(!ring && (ring = sr_trace_thread_ring()) == 0)
+  { return; }
+
+  head = ring->head;
+  if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= SR_TRACE_RING_RECS)
+  {
+    ring->lost++;
+    return;
+  }
+  rec = &(ring->recs[head & (SR_TRACE_RING_RECS - 1)]);
+  rec->ts = sr_trace_ticks();
+  rec->event = event;
+  rec->thread = ring->id;
+  rec->arg[0] = a0;
+  rec->arg[1] = a1;
+  rec->arg[2] = a2;
+  rec->arg[3] = a3;
+  rec->arg[4] = 0;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#ifdef SR_TRACE
+#define SR_TRACE4(ev, a0, a1, a2, a3) \
+  do { if(__builtin_expect(sr_trace_on, 0)) \
+         sr_trace_emit((ev), (a0), (a1), (a2), (a3)); } while(0)
+#else
+#define SR_TRACE4(ev, a0, a1, a2, a3) do{}while(0)
+#endif /* SR_TRACE */
+
+#define SR_TRACE1(ev, a0)         SR_TRACE4(ev, a0, 0, 0, 0)
+#define SR_TRACE2(ev, a0, a1)     SR_TRACE4(ev, a0, a1, 0, 0)
+#define SR_TRACE3(ev, a0, a1, a2) SR_TRACE4(ev, a0, a1, a2, 0)
+
+#endif /* -- SR_TRACE_H -- */
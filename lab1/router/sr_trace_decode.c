@@ -0,0 +1,187 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trace_decode.c
+ *
+ * Description:
+ *
+ * Print a trace written by sr -x as text, one event per line in time order
+ * across all threads.  With -c only the number of events of each kind.
+ *
+ *   usage: sr_trace_decode [-c] tracefile
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_trace.h"
+
+#define DECODE_MAX_IFS 64
+#define DECODE_NAMELEN 12
+
+#define SR_TRACE_NAME(id, name, fmt) name,
+static const char* ev_names[] = { SR_TRACE_EVENTS(SR_TRACE_NAME) 0 };
+#undef SR_TRACE_NAME
+#define SR_TRACE_FMT(id, name, fmt) fmt,
+static const char* ev_fmts[] = { SR_TRACE_EVENTS(SR_TRACE_FMT) 0 };
+#undef SR_TRACE_FMT
+
+static char ifnames[DECODE_MAX_IFS][DECODE_NAMELEN];
+
+static int rec_cmp(const void* a, const void* b)
+{
+    const struct sr_trace_rec* x = (const struct sr_trace_rec*)a;
+    const struct sr_trace_rec* y = (const struct sr_trace_rec*)b;
+
+    if(x->ts != y->ts)
+    { return x->ts < y->ts ? -1 : 1; }
+    return (int)x->thread - (int)y->thread;
+}
+
+static void print_args(const struct sr_trace_rec* rec)
+{
+    const char* f = ev_fmts[rec->event];
+    struct in_addr in;
+    int a = 0;
+
+    for(; *f; f++)
+    {
+        if(*f != '%' || f[1] == 0 || a >= 5)
+        {
+            putchar(*f);
+            continue;
+        }
+        switch(*++f)
+        {
+            case 'u':
+                printf("%u", rec->arg[a++]);
+                break;
+            case 'x':
+                printf("0x%x", rec->arg[a++]);
+                break;
+            case 'I':
+                in.s_addr = rec->arg[a++];
+                printf("%s", inet_ntoa(in));
+                break;
+            case 's':
+                if(rec->arg[a] < DECODE_MAX_IFS && ifnames[rec->arg[a]][0])
+                { printf("%s", ifnames[rec->arg[a]]); }
+                else
+                { printf("#%u", rec->arg[a]); }
+                a++;
+                break;
+            case 'n':
+                printf("%.*s", (int)(sizeof(rec->arg) - a * 4),
+                       (const char*)&(rec->arg[a]));
+                a = 5;
+                break;
+            default:
+                putchar(*f);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    struct sr_trace_file_hdr hdr;
+    struct sr_trace_rec* recs = 0;
+    unsigned long counts[sr_ev_count];
+    size_t n = 0, cap = 0, i;
+    int c, count_only = 0;
+    double t;
+    FILE* fp;
+
+    while((c = getopt(argc, argv, "c")) != EOF)
+    {
+        if(c == 'c')
+        { count_only = 1; }
+        else
+        {
+            fprintf(stderr, "usage: %s [-c] tracefile\n", argv[0]);
+            return 1;
+        }
+    }
+    if(optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-c] tracefile\n", argv[0]);
+        return 1;
+    }
+    if((fp = fopen(argv[optind], "rb")) == 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    if(fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != SR_TRACE_MAGIC ||
+       hdr.version != SR_TRACE_VERSION ||
+       hdr.rec_size != sizeof(struct sr_trace_rec))
+    {
+        fprintf(stderr, "%s: not a version %d sr trace\n", argv[optind],
+                SR_TRACE_VERSION);
+        return 1;
+    }
+
+    for(;;)
+    {
+        if(n == cap)
+        {
+            cap = cap ? cap * 2 : 65536;
+            recs = (struct sr_trace_rec*)realloc(recs, cap * sizeof(*recs));
+            if(!recs)
+            {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+        }
+        if(fread(&recs[n], sizeof(*recs), 1, fp) != 1)
+        { break; }
+        if(recs[n].event < sr_ev_count)
+        { n++; }
+    }
+    fclose(fp);
+    qsort(recs, n, sizeof(*recs), rec_cmp);
+
+    /* names first, so events before the interfaces were known decode too */
+    for(i = 0; i < n; i++)
+    {
+        if(recs[i].event == sr_ev_ifname && recs[i].arg[0] < DECODE_MAX_IFS)
+        {
+            memcpy(ifnames[recs[i].arg[0]], &(recs[i].arg[1]),
+                   DECODE_NAMELEN - 1);
+        }
+    }
+
+    memset(counts, 0, sizeof(counts));
+    for(i = 0; i < n; i++)
+    {
+        counts[recs[i].event]++;
+        if(count_only)
+        { continue; }
+        t = (double)(int64_t)(recs[i].ts - hdr.start_ticks) /
+            (double)hdr.ticks_per_sec;
+        printf("%14.9f t%-2u %-12s ", t, recs[i].thread,
+               ev_names[recs[i].event]);
+        print_args(&recs[i]);
+        putchar('\n');
+    }
+
+    if(count_only)
+    {
+        for(c = 0; c < sr_ev_count; c++)
+        {
+            if(counts[c])
+            { printf("%-12s %lu\n", ev_names[c], counts[c]); }
+        }
+    }
+    if(hdr.lost)
+    {
+        fprintf(stderr, "%lu events lost while tracing\n",
+                (unsigned long)hdr.lost);
+    }
+    free(recs);
+    return 0;
+}
@@ -30,6 +30,27 @@ uint8_t ip_protocol(uint8_t *buf) {
   return iphdr->ip_p;
 }
 
+/* Mark an ECN-capable datagram Congestion Experienced, updating the
+   checksum for the one word that changed (RFC 1624).  Returns 0 if the
+   datagram is not ECN-capable. */
+int ip_set_ce(sr_ip_hdr_t *iphdr) {
+  uint16_t old, new;
+  uint32_t sum;
+
+  if ((iphdr->ip_tos & IP_ECN_MASK) == IP_ECN_NOT_ECT)
+    return 0;
+  if ((iphdr->ip_tos & IP_ECN_MASK) == IP_ECN_CE)
+    return 1;
+  memcpy(&old, iphdr, sizeof(old));
+  iphdr->ip_tos |= IP_ECN_CE;
+  memcpy(&new, iphdr, sizeof(new));
+  sum = (uint16_t)~iphdr->ip_sum + (uint16_t)~old + new;
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  iphdr->ip_sum = (uint16_t)~sum;
+  return 1;
+}
+
 
 /* Prints out formatted Ethernet address, e.g. 00:11:22:33:44:55 */
 void print_addr_eth(uint8_t *addr) {
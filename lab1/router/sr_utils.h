@@ -32,6 +32,7 @@ uint16_t cksum(const void *_data, int len);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
+int ip_set_ce(sr_ip_hdr_t *iphdr);
 
 void print_addr_eth(uint8_t *addr);
 void print_addr_ip(struct in_addr address);
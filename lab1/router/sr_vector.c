@@ -0,0 +1,462 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vector.c
+ *
+ * Description:
+ *
+ * Vector packet processing, see sr_vector.h.  Every node takes the
+ * packet indices queued for it and moves each to the queue of the node it
+ * needs next.  ARP input runs before the IPv4 nodes, so a reply in the
+ * vector resolves the next hop for the packets behind it; the other nodes
+ * that hand packets to the scalar code in sr_router.c run last, after the
+ * fast path has sent its frames.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sr_vector.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+#include "sr_trace.h"
+#include "sr_perf.h"
+#include "sr_sdt.h"
+#include "sr_police.h"
+#include "sr_acl.h"
+#include "sr_flow.h"
+
+#define SR_VEC_NEXTHOPS 8      /* next hops arp-resolve remembers per run */
+
+static const char* sr_vec_node_names[] = {
+#define SR_VEC_NAME(id, name) name,
+    SR_VEC_NODES(SR_VEC_NAME)
+#undef SR_VEC_NAME
+};
+
+/* remembered ARP cache lookups, freed at the end of the run */
+struct sr_vec_nexthop
+{
+    uint32_t ip;
+    struct sr_arpentry* entry;   /* 0 if unresolved */
+};
+
+static __inline__ void sr_vec_next(struct sr_vec* vec, int node, uint16_t i)
+{
+    vec->queue[node][vec->queued[node]++] = i;
+}
+
+static __inline__ void sr_vec_prefetch(struct sr_vec* vec, uint16_t* q,
+                                       unsigned int i, unsigned int n)
+{
+    if(i + SR_VEC_PREFETCH < n)
+    { __builtin_prefetch(vec->pkt[q[i + SR_VEC_PREFETCH]].buf, 1); }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vec_create(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_vec* sr_vec_create(unsigned int size)
+{
+    struct sr_vec* vec;
+
+    if(size < SR_VEC_MIN || size > SR_VEC_MAX)
+    {
+        fprintf(stderr, "Error: vector size %u not in [%d, %d]\n",
+                size, SR_VEC_MIN, SR_VEC_MAX);
+        return 0;
+    }
+    if((vec = (struct sr_vec*)calloc(1, sizeof(struct sr_vec))) == 0)
+    {
+        perror("calloc");
+        return 0;
+    }
+    vec->size = size;
+    return vec;
+} /* -- sr_vec_create -- */
+
+void sr_vec_destroy(struct sr_vec* vec)
+{
+    free(vec);
+} /* -- sr_vec_destroy -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vec_add(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_vec_add(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                struct sr_if* iface)
+{
+    struct sr_vec* vec = sr->vec;
+    struct sr_vec_pkt* p;
+
+    if(vec->n == vec->size)
+    { sr_vec_run(sr); }
+    p = &(vec->pkt[vec->n]);
+    p->buf = packet;
+    p->len = len;
+    p->rx_if = iface;
+    sr_vec_next(vec, sr_node_classify, (uint16_t)vec->n);
+    vec->n++;
+} /* -- sr_vec_add -- */
+
+/* ----------------------------------------------------------------------------
+ * Fast path nodes
+ * -------------------------------------------------------------------------- */
+
+static void sr_vec_classify(struct sr_instance* sr, struct sr_vec* vec,
+                            uint16_t* q, unsigned int n)
+{
+    struct sr_vec_pkt* p;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        sr_vec_prefetch(vec, q, i, n);
+        p = &(vec->pkt[q[i]]);
+        SR_TRACE2(sr_ev_rx, p->len, p->rx_if->index);
+        switch(ethertype(p->buf))
+        {
+            case ethertype_arp:
+                if(p->len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+                { sr_stats_drop(sr_drop_short_frame); }
+                else
+                { sr_vec_next(vec, sr_node_arp_input, q[i]); }
+                break;
+            case ethertype_ip:
+                if(p->len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+                { sr_stats_drop(sr_drop_short_frame); }
+                else
+                { sr_vec_next(vec, sr_node_ip4_input, q[i]); }
+                break;
+            default:
+                sr_stats_drop(sr_drop_ethertype);
+                break;
+        }
+    }
+}
+
+/* header checksum, -A and -F, checked the way sr_handle_ip_packet_type()
+ * does; ip4-local and ip4-lookup take what this decided */
+static void sr_vec_ip4_input(struct sr_instance* sr, struct sr_vec* vec,
+                             uint16_t* q, unsigned int n)
+{
+    struct sr_flow_fwd fwd;
+    struct sr_vec_pkt* p;
+    sr_ip_hdr_t* ip;
+    uint16_t sum;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        sr_vec_prefetch(vec, q, i, n);
+        ip = (sr_ip_hdr_t*)(vec->pkt[q[i]].buf + sizeof(sr_ethernet_hdr_t));
+        sum = ip->ip_sum;
+        ip->ip_sum = 0;
+        if(cksum(ip, sizeof(sr_ip_hdr_t)) != sum)
+        {
+            ip->ip_sum = sum;
+            sr_stats_drop(sr_drop_ip_cksum);
+            continue;
+        }
+        ip->ip_sum = sum;
+        p = &(vec->pkt[q[i]]);
+        p->decided = sr->acl || sr->flows;
+        if(p->decided)
+        {
+            sr_ip_packet_decide(sr, p->buf, p->len, &fwd);
+            if(fwd.acl && fwd.acl->action == SR_ACL_DENY)
+            {
+                sr_stats_drop(sr_drop_acl);
+                continue;
+            }
+            p->tx_if = fwd.local;
+            p->rt = fwd.rt;
+        }
+        sr_vec_next(vec, sr_node_ip4_local, q[i]);
+    }
+}
+
+static void sr_vec_ip4_local(struct sr_instance* sr, struct sr_vec* vec,
+                             uint16_t* q, unsigned int n)
+{
+    struct sr_vec_pkt* p;
+    sr_ip_hdr_t* ip;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        p = &(vec->pkt[q[i]]);
+        ip = (sr_ip_hdr_t*)(p->buf + sizeof(sr_ethernet_hdr_t));
+        if(!p->decided)
+        { p->tx_if = ip_packet_forwarding(sr, p->buf); }
+        if(p->tx_if != 0)
+        {
+            SR_TRACE3(sr_ev_ip_local, ip->ip_src, ip->ip_dst, ip->ip_p);
+            if(sr->police && !sr_police(sr, sr_police_local, ip->ip_src))
+            { sr_stats_drop(sr_drop_policed); }
+            else
+            { sr_vec_next(vec, sr_node_local, q[i]); }
+        }
+        else
+        { sr_vec_next(vec, sr_node_ip4_lookup, q[i]); }
+    }
+}
+
+/* longest prefix match, once per run of packets to the same destination;
+ * whatever needs more than a TTL decrement goes to the scalar path.  The
+ * TTL is decremented here rather than in rewrite so that a packet leaving
+ * for arp-miss is queued with it done, as sr_ip_packet_route() does */
+static void sr_vec_ip4_lookup(struct sr_instance* sr, struct sr_vec* vec,
+                              uint16_t* q, unsigned int n)
+{
+    struct sr_rt* rt = 0;
+    struct sr_if* out_if = 0;
+    uint32_t last_dst = 0;
+    int have_last = 0;
+    struct sr_vec_pkt* p;
+    sr_ip_hdr_t* ip;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        sr_vec_prefetch(vec, q, i, n);
+        p = &(vec->pkt[q[i]]);
+        ip = (sr_ip_hdr_t*)(p->buf + sizeof(sr_ethernet_hdr_t));
+        if(p->decided)
+        {
+            rt = p->rt;
+            out_if = rt ? sr_get_interface(sr, rt->interface) : 0;
+            have_last = 0;
+        }
+        else if(!have_last || ip->ip_dst != last_dst)
+        {
+            rt = lpm(sr, ip->ip_dst);
+            SR_PROBE2(lpm, ip->ip_dst, rt);
+            out_if = rt ? sr_get_interface(sr, rt->interface) : 0;
+            last_dst = ip->ip_dst;
+            have_last = 1;
+        }
+        if(!rt || !out_if || ip->ip_ttl <= 1 ||
+           ntohs(ip->ip_len) > p->len - sizeof(sr_ethernet_hdr_t) ||
+           ntohs(ip->ip_len) > out_if->mtu)
+        {
+            sr_vec_next(vec, sr_node_exception, q[i]);
+            continue;
+        }
+        ip->ip_ttl--;
+        ip->ip_sum = 0;
+        ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+        p->rt = rt;
+        p->tx_if = out_if;
+        sr_vec_next(vec, sr_node_arp_resolve, q[i]);
+    }
+}
+
+static void sr_vec_arp_resolve(struct sr_instance* sr, struct sr_vec* vec,
+                               uint16_t* q, unsigned int n,
+                               struct sr_vec_nexthop* hops,
+                               unsigned int* nhops)
+{
+    struct sr_vec_nexthop* hop;
+    struct sr_vec_pkt* p;
+    unsigned int i, h;
+
+    for(i = 0; i < n; i++)
+    {
+        p = &(vec->pkt[q[i]]);
+        hop = 0;
+        for(h = 0; h < *nhops; h++)
+        {
+            if(hops[h].ip == p->rt->gw.s_addr)
+            {
+                hop = &hops[h];
+                break;
+            }
+        }
+        if(!hop)
+        {
+            /* forget the oldest when full */
+            if(*nhops == SR_VEC_NEXTHOPS)
+            {
+                free(hops[0].entry);
+                memmove(hops, hops + 1, (SR_VEC_NEXTHOPS - 1) * sizeof(*hops));
+                (*nhops)--;
+            }
+            hop = &hops[(*nhops)++];
+            hop->ip = p->rt->gw.s_addr;
+            hop->entry = sr_arpcache_lookup(&(sr->cache), hop->ip);
+        }
+        if(hop->entry)
+        {
+            sr_stats_arp(1);
+            memcpy(p->mac, hop->entry->mac, ETHER_ADDR_LEN);
+            sr_vec_next(vec, sr_node_rewrite, q[i]);
+        }
+        else
+        { sr_vec_next(vec, sr_node_arp_miss, q[i]); }
+    }
+}
+
+static void sr_vec_rewrite(struct sr_instance* sr, struct sr_vec* vec,
+                           uint16_t* q, unsigned int n)
+{
+    sr_ethernet_hdr_t* eth;
+    struct sr_vec_pkt* p;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        p = &(vec->pkt[q[i]]);
+        eth = (sr_ethernet_hdr_t*)p->buf;
+        memcpy(eth->ether_dhost, p->mac, ETHER_ADDR_LEN);
+        memcpy(eth->ether_shost, p->tx_if->addr, ETHER_ADDR_LEN);
+        sr_vec_next(vec, sr_node_tx, q[i]);
+    }
+}
+
+static void sr_vec_tx(struct sr_instance* sr, struct sr_vec* vec,
+                      uint16_t* q, unsigned int n)
+{
+    struct sr_vec_pkt* p;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        p = &(vec->pkt[q[i]]);
+        SR_TRACE4(sr_ev_ip_forward,
+            ((sr_ip_hdr_t*)(p->buf + sizeof(sr_ethernet_hdr_t)))->ip_dst,
+            p->rt->gw.s_addr, p->tx_if->index, p->len);
+        sr_send_packet(sr, p->buf, p->len, p->tx_if->name);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Nodes leaving the graph for sr_router.c
+ * -------------------------------------------------------------------------- */
+
+static void sr_vec_scalar(struct sr_instance* sr, struct sr_vec* vec,
+                          int node, uint16_t* q, unsigned int n)
+{
+    struct sr_vec_pkt* p;
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        p = &(vec->pkt[q[i]]);
+        switch(node)
+        {
+            case sr_node_arp_input:
+                sr_handle_arp_packet_type(sr, p->buf, p->len, p->rx_if->name);
+                break;
+            case sr_node_local:
+                sr_ip_packet_reply(sr, p->buf, p->len, p->rx_if->name,
+                                   p->tx_if->ip);
+                break;
+            case sr_node_exception:
+                sr_ip_packet_next_hop(sr, p->buf, p->len, p->rx_if->name);
+                break;
+            case sr_node_arp_miss:
+                sr_ip_packet_output(sr, p->buf, p->len, p->rt);
+                break;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vec_run(..)
+ * Scope: Global
+ *
+ * Run every node in order over the packets queued for it.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_vec_run(struct sr_instance* sr)
+{
+    struct sr_vec* vec = sr->vec;
+    struct sr_vec_nexthop hops[SR_VEC_NEXTHOPS];
+    unsigned int nhops = 0, n, h;
+    uint16_t* q;
+    int node;
+
+    if(!vec || vec->n == 0)
+    { return; }
+
+    SR_PERF_BEGIN(sr_perf_vector);
+    vec->vectors++;
+    vec->packets += vec->n;
+    for(node = 0; node < sr_vec_nnodes; node++)
+    {
+        if((n = vec->queued[node]) == 0)
+        { continue; }
+        q = vec->queue[node];
+        vec->node_calls[node]++;
+        vec->node_pkts[node] += n;
+        switch(node)
+        {
+            case sr_node_classify:
+                sr_vec_classify(sr, vec, q, n);
+                break;
+            case sr_node_ip4_input:
+                sr_vec_ip4_input(sr, vec, q, n);
+                break;
+            case sr_node_ip4_local:
+                sr_vec_ip4_local(sr, vec, q, n);
+                break;
+            case sr_node_ip4_lookup:
+                sr_vec_ip4_lookup(sr, vec, q, n);
+                break;
+            case sr_node_arp_resolve:
+                sr_vec_arp_resolve(sr, vec, q, n, hops, &nhops);
+                break;
+            case sr_node_rewrite:
+                sr_vec_rewrite(sr, vec, q, n);
+                break;
+            case sr_node_tx:
+                sr_vec_tx(sr, vec, q, n);
+                break;
+            default:
+                sr_vec_scalar(sr, vec, node, q, n);
+                break;
+        }
+        vec->queued[node] = 0;
+    }
+    for(h = 0; h < nhops; h++)
+    { free(hops[h].entry); }
+    vec->n = 0;
+    SR_PERF_END(sr_perf_vector);
+} /* -- sr_vec_run -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vec_dump(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_vec_dump(struct sr_vec* vec, FILE* fp)
+{
+    int node;
+
+    if(!vec || vec->vectors == 0)
+    { return; }
+    fprintf(fp, "Vectors: %llu, %llu packets, %.1f per vector (max %u)\n",
+            (unsigned long long)vec->vectors,
+            (unsigned long long)vec->packets,
+            (double)vec->packets / vec->vectors, vec->size);
+    for(node = 0; node < sr_vec_nnodes; node++)
+    {
+        if(vec->node_calls[node] == 0)
+        { continue; }
+        fprintf(fp, "  %-14s %12llu packets %8.1f per call\n",
+                sr_vec_node_names[node],
+                (unsigned long long)vec->node_pkts[node],
+                (double)vec->node_pkts[node] / vec->node_calls[node]);
+    }
+} /* -- sr_vec_dump -- */
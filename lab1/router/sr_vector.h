@@ -0,0 +1,115 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vector.h
+ *
+ * Description:
+ *
+ * Vector packet processing (-V size).  Instead of taking each frame from
+ * dispatch to send on its own, the receive path collects the frames that
+ * arrive together (one VNSPACKET_BATCH message, one pass over the shared
+ * memory ring) into a vector of up to 'size' packets, and sr_vec_run()
+ * pushes the whole vector through a graph of nodes:
+ *
+ *   classify -> ip4-input -> ip4-local -> ip4-lookup -> arp-resolve
+ *            -> rewrite -> tx
+ *
+ * Each node handles every packet waiting for it before the next node runs,
+ * so a node's code and the tables it reads (interface list, routing table,
+ * ARP cache) stay in cache across the vector.  The lookup and resolve nodes
+ * also remember their last results, so packets for the same destination
+ * or next hop within a vector cost one routing table walk and one ARP cache
+ * lookup between them.
+ *
+ * Only the common case is vectorized.  ARP, traffic to the router itself
+ * and every exception (no route, TTL expiring, a datagram too large for
+ * the outgoing MTU, an unresolved next hop) leave the graph for the
+ * scalar functions in sr_router.c, so behaviour is the same in both modes.
+ * The -L latency samples cover the scalar path only.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_VECTOR_H
+#define SR_VECTOR_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_protocol.h"
+
+#define SR_VEC_MIN      2
+#define SR_VEC_MAX      256
+#define SR_VEC_PREFETCH 4      /* packets ahead whose headers are prefetched */
+
+/* ----------------------------------------------------------------------------
+ * The nodes, in the order they run.  The graph has no loops, so one pass
+ * in this order moves every packet as far as it can go.
+ * -------------------------------------------------------------------------- */
+
+#define SR_VEC_NODES(X) \
+    X(sr_node_classify,    "classify")    \
+    X(sr_node_arp_input,   "arp-input")   \
+    X(sr_node_ip4_input,   "ip4-input")   \
+    X(sr_node_ip4_local,   "ip4-local")   \
+    X(sr_node_ip4_lookup,  "ip4-lookup")  \
+    X(sr_node_arp_resolve, "arp-resolve") \
+    X(sr_node_rewrite,     "rewrite")     \
+    X(sr_node_tx,          "tx")          \
+    X(sr_node_local,       "ip4-receive") \
+    X(sr_node_exception,   "ip4-exception") \
+    X(sr_node_arp_miss,    "arp-miss")
+
+#define SR_VEC_ENUM(id, name) id,
+enum sr_vec_node { SR_VEC_NODES(SR_VEC_ENUM) sr_vec_nnodes };
+#undef SR_VEC_ENUM
+
+struct sr_instance;
+struct sr_if;
+struct sr_rt;
+
+/* per packet state carried between nodes */
+struct sr_vec_pkt
+{
+    uint8_t* buf;              /* lent by the receive path */
+    unsigned int len;
+    struct sr_if* rx_if;
+    struct sr_if* tx_if;       /* set by ip4-local or ip4-lookup */
+    struct sr_rt* rt;
+    int decided;               /* tx_if and rt already set by ip4-input */
+    unsigned char mac[ETHER_ADDR_LEN];   /* next hop, set by arp-resolve */
+};
+
+struct sr_vec
+{
+    unsigned int size;
+    unsigned int n;
+    struct sr_vec_pkt pkt[SR_VEC_MAX];
+
+    /* packet indices waiting at each node */
+    uint16_t queue[sr_vec_nnodes][SR_VEC_MAX];
+    unsigned int queued[sr_vec_nnodes];
+
+    /* counters, main thread only */
+    uint64_t vectors;
+    uint64_t packets;
+    uint64_t node_calls[sr_vec_nnodes];
+    uint64_t node_pkts[sr_vec_nnodes];
+};
+
+struct sr_vec* sr_vec_create(unsigned int size);
+void sr_vec_destroy(struct sr_vec* vec);
+
+/* queue a received frame, running the vector first if it is full; the
+ * frame must stay valid until the next sr_vec_run() */
+void sr_vec_add(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                struct sr_if* iface);
+/* process everything queued */
+void sr_vec_run(struct sr_instance* sr);
+void sr_vec_dump(struct sr_vec* vec, FILE* fp);
+
+#endif /* -- SR_VECTOR_H -- */
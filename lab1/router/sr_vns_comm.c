@@ -35,6 +35,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <poll.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
@@ -43,13 +44,39 @@
 
 #include "sha1.h"
 #include "vnscommand.h"
-
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+#include "sr_shm.h"
+#include "sr_trace.h"
+#include "sr_stats.h"
+#include "sr_latency.h"
+#include "sr_perf.h"
+#include "sr_sdt.h"
+#include "sr_ctl.h"
+#include "sr_vector.h"
+#include "sr_qos.h"
+
+/* frames taken off the shared-memory ring before the socket is checked */
+#define SR_SHM_BUDGET 64
+
+static void sr_log_packet(struct sr_instance* , uint8_t* , int ,
+                          const char* , uint32_t );
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
                                   char* interface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
+static void sr_dispatch_packet(struct sr_instance* sr,
+                               uint8_t* packet /* lent */,
+                               unsigned int len,
+                               char* interface /* lent */);
+static void sr_offer_shm(struct sr_instance* sr);
+static int  sr_handle_packet_batch(struct sr_instance* sr,
+                                   uint8_t* buf /* borrowed */,
+                                   int len);
+static int  sr_batch_packet(struct sr_instance* sr,
+                            uint8_t* buf /* borrowed */,
+                            unsigned int len,
+                            const char* iface /* borrowed */);
+static int  sr_flush_packets_locked(struct sr_instance* sr);
 
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
@@ -159,9 +186,141 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         if(sr_read_from_server_expect(sr, VNS_RTABLE) != 1)
             return -1; /* needed to get the rtable */
 
+    /* frames stay on TCP until the server acks with VNS_SHM_STATUS */
+    if(sr->shm_path[0] != '\0')
+        sr_offer_shm(sr);
+
+    /* an empty batch tells the server we speak VNSPACKET_BATCH */
+    if(sr->batching)
+    {
+        sr->txbatch.size = sr->max_msg_len;
+        sr->txbatch.buf = (uint8_t*)malloc(sr->txbatch.size);
+        assert(sr->txbatch.buf);
+        sr->txbatch.len = sizeof(c_packet_batch);
+        sr->txbatch.count = 0;
+        pthread_mutex_lock(&(sr->txbatch.lock));
+        sr_flush_packets_locked(sr);
+        pthread_mutex_unlock(&(sr->txbatch.lock));
+    }
+
     return 0;
 } /* -- sr_connect_to_server -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_set_max_msg_len(..)
+ * Scope: Global
+ *
+ * Set the largest VNS message the router accepts and sends, and size the
+ * message buffer pool to match.  Must be called once before connecting.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  -1 if len is out of range or the pool cannot be set up
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_set_max_msg_len(struct sr_instance* sr, unsigned int len)
+{
+    /* REQUIRES */
+    assert(sr);
+
+    if(len < SR_MSG_LEN_MIN || len > SR_MSG_LEN_MAX)
+    {
+        fprintf(stderr, "Error: message size %u not in [%d, %d]\n",
+                len, SR_MSG_LEN_MIN, SR_MSG_LEN_MAX);
+        return -1;
+    }
+
+    sr->max_msg_len = len;
+    sr->max_frame_len = len - sizeof(c_packet_header);
+    sr->snaplen = sr->max_frame_len;
+
+    if(sr_bufpool_init(&(sr->msgpool), len, 16) != 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_set_max_msg_len)\n");
+        return -1;
+    }
+    return 0;
+} /* -- sr_set_max_msg_len -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_offer_shm(..)
+ * Scope: Local
+ *
+ * Create the shared-memory segment and offer it to the server.  Any failure
+ * here just leaves the router on the TCP transport.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_offer_shm(struct sr_instance* sr)
+{
+    c_shm_open so;
+    uint32_t slot_size = SR_SHM_SLOT_SIZE;
+    uint32_t nslots = SR_SHM_NSLOTS;
+
+    /* every slot must hold the largest frame; keep the segment about the
+     * same size by trading slots for slot size */
+    while(slot_size < sizeof(struct sr_shm_slot) + sr->max_frame_len)
+    {
+        slot_size *= 2;
+        if(nslots > 64)
+        { nslots /= 2; }
+    }
+
+    sr->shm = sr_shm_create(sr->shm_path, nslots, slot_size);
+    if(!sr->shm)
+    {
+        fprintf(stderr, "Shared memory transport unavailable, using TCP\n");
+        return;
+    }
+
+    memset(&so, 0, sizeof(so));
+    so.mLen      = htonl(sizeof(c_shm_open));
+    so.mType     = htonl(VNS_SHM_OPEN);
+    so.nslots    = htonl(sr->shm->nslots);
+    so.slot_size = htonl(sr->shm->slot_size);
+    strncpy(so.mPath, sr->shm_path, SHM_PATHSIZE - 1);
+
+    if(send(sr->sockfd, &so, sizeof(so), 0) != sizeof(so))
+    {
+        perror("send(..):sr_client.c::sr_offer_shm()");
+        sr_shm_destroy(sr->shm);
+        sr->shm = 0;
+    }
+} /* -- sr_offer_shm -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_shm_status(..)
+ * scope: global
+ *
+ * Switch VNSPACKET traffic to the rings, or drop the segment if the server
+ * could not map it.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_handle_shm_status(struct sr_instance* sr, c_shm_status* status, int len)
+{
+    int msg_len = len - sizeof(c_shm_status);
+
+    if(!sr->shm)
+    { return 1; } /* nothing offered, nothing to switch */
+
+    if(status->shm_ok)
+    {
+        sr->shm->active = 1;
+        printf("shared memory transport active at %s\n", sr->shm->path);
+    }
+    else
+    {
+        fprintf(stderr, "Server declined shared memory: %.*s\n",
+                msg_len, status->msg);
+        sr_shm_destroy(sr->shm);
+        sr->shm = 0;
+    }
+    return 1;
+} /* -- sr_handle_shm_status -- */
+
 
 
 /*-----------------------------------------------------------------------------
@@ -175,6 +334,7 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
 
 int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 {
+    struct sr_if* if_walker = 0;
     int num_entries;
     int i = 0;
 
@@ -201,6 +361,7 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
             case HWSPEED:
                 /* Debug("Speed: %d\n",
                         ntohl(*((unsigned int*)hwinfo->mHWInfo[i].value))); */
+                sr_set_ether_speed(sr,ntohl(*((uint32_t*)hwinfo->mHWInfo[i].value)));
                 break;
             case HWSUBNET:
                 /* Debug("Subnet: %s\n",inet_ntoa(
@@ -221,11 +382,40 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
                 Debug("\n"); */
                 sr_set_ether_addr(sr,(unsigned char*)hwinfo->mHWInfo[i].value);
                 break;
+            case HWMTU:
+                sr_set_ether_mtu(sr,ntohl(*((uint32_t*)hwinfo->mHWInfo[i].value)));
+                break;
             default:
                 printf (" %d \n",ntohl(hwinfo->mHWInfo[i].mKey));
         } /* -- switch -- */
     } /* -- for -- */
 
+    /* -- interfaces without HWMTU get the -j value, and no interface may
+     *    need a frame larger than a VNS message can carry -- */
+    for ( if_walker = sr->if_list; if_walker; if_walker = if_walker->next )
+    {
+        if ( if_walker->mtu == 0 )
+        { if_walker->mtu = sr->if_mtu; }
+        if ( if_walker->mtu > sr->max_frame_len - sizeof(struct sr_ethernet_hdr) )
+        {
+            fprintf(stderr, "Interface %s: mtu %u too large, using %u (see -M)\n",
+                    if_walker->name, if_walker->mtu,
+                    (unsigned int)(sr->max_frame_len - sizeof(struct sr_ethernet_hdr)));
+            if_walker->mtu = sr->max_frame_len - sizeof(struct sr_ethernet_hdr);
+        }
+    }
+
+    /* -- pcapng describes every interface before the first packet -- */
+    if ( sr->logger )
+    {
+        for ( if_walker = sr->if_list; if_walker; if_walker = if_walker->next )
+        { sr_logger_add_interface(sr->logger, if_walker->index, if_walker->name); }
+    }
+    for ( if_walker = sr->if_list; if_walker; if_walker = if_walker->next )
+    { sr_trace_set_interface(if_walker->index, if_walker->name); }
+    if ( sr->qos )
+    { sr_qos_add_interfaces(sr->qos); }
+
     printf("Router interfaces:\n");
     sr_print_if_list(sr);
 
@@ -326,9 +516,124 @@ int sr_handle_auth_status(struct sr_instance* sr, c_auth_status* status) {
  *
  *---------------------------------------------------------------------------*/
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_drain(..)
+ * Scope: Local
+ *
+ * Hand up to 'budget' frames from the shared-memory RX ring to the router.
+ * Frames are processed in place in their slot.  In vector mode the slots
+ * of a whole vector are held until it has run.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_shm_drain(struct sr_instance* sr, int budget)
+{
+    uint8_t* packet;
+    unsigned int len;
+    char* iface;
+    int n = 0, held;
+
+    while(sr->vec && n < budget)
+    {
+        held = 0;
+        while(held < (int)sr->vec->size && n + held < budget &&
+              sr_shm_rx_peek_at(sr->shm, held, &packet, &len, &iface))
+        {
+            if(len >= sizeof(struct sr_ethernet_hdr) &&
+               sr_get_interface(sr, iface))
+            { sr_dispatch_packet(sr, packet, len, iface); }
+            held++;
+        }
+        if(held == 0)
+        { return n; }
+        sr_vec_run(sr);
+        sr_shm_rx_release_n(sr->shm, held);
+        sr->vns_stats.rx_frames += held;
+        n += held;
+    }
+
+    while(n < budget && sr_shm_rx_peek(sr->shm, &packet, &len, &iface))
+    {
+        if(len >= sizeof(struct sr_ethernet_hdr) && sr_get_interface(sr, iface))
+        { sr_dispatch_packet(sr, packet, len, iface); }
+        sr_shm_rx_release(sr->shm);
+        sr->vns_stats.rx_frames++;
+        n++;
+    }
+    return n;
+} /* -- sr_shm_drain -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_wait_for_server(..)
+ * Scope: Local
+ *
+ * Returns 1 once the VNS socket has something to read.  While the
+ * shared-memory transport is active, frames on the RX ring are serviced in
+ * the meantime, as are requests on the -c management socket.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_wait_for_server(struct sr_instance* sr)
+{
+    struct pollfd fds[2 + SR_CTL_MAX_FDS];
+    int shm = (sr->shm && sr->shm->active);
+    int timeout, n;
+
+    if(!shm && !sr->ctl)
+    { return 1; } /* plain blocking recv() */
+
+    for(;;)
+    {
+        timeout = -1;
+        n = 1;
+        fds[0].fd = sr->sockfd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        if(shm)
+        {
+            timeout = SR_SHM_POLL_MS;
+            if(sr_shm_drain(sr, SR_SHM_BUDGET) == SR_SHM_BUDGET ||
+               sr_shm_rx_arm(sr->shm))
+            { timeout = 0; }
+
+            fds[1].fd = sr->shm->bell[SR_SHM_RX];
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            n = 2;
+        }
+        if(sr->ctl)
+        { n += sr_ctl_pollfds(sr->ctl, fds + n); }
+
+        if(poll(fds, n, timeout) < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            perror("poll(..):sr_client.c::sr_wait_for_server");
+            return -1;
+        }
+        if(shm && (fds[1].revents & POLLIN))
+        { sr_shm_rx_clear_bell(sr->shm); }
+        if(sr->ctl)
+        { sr_ctl_service(sr->ctl, fds + (shm ? 2 : 1)); }
+        if(fds[0].revents)
+        { return 1; }
+    }
+} /* -- sr_wait_for_server -- */
+
 int sr_read_from_server(struct sr_instance* sr /* borrowed */)
 {
-    return sr_read_from_server_expect(sr, 0);
+    int ret;
+
+    if((ret = sr_wait_for_server(sr)) != 1)
+    { return ret; }
+
+    ret = sr_read_from_server_expect(sr, 0);
+
+    /* whatever the last message made us send goes out now */
+    sr_flush_packets(sr);
+
+    return ret;
 }
 
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
@@ -369,14 +674,15 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     len = ntohl(len);
 
-    if ( len > 10000 || len < 0 )
+    if ( len > (int)sr->max_msg_len || len < (int)sizeof(c_base) )
     {
-        fprintf(stderr,"Error: command length to large %d\n",len);
+        fprintf(stderr,"Error: command length to large %d (max %u, see -M)\n",
+                len, sr->max_msg_len);
         close(sr->sockfd);
         return -1;
     }
 
-    if((buf = malloc(len)) == 0)
+    if((buf = sr_bufpool_get(&(sr->msgpool))) == 0)
     {
         fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
         return -1;
@@ -400,6 +706,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 { continue; }
                 fprintf(stderr,"Error: failed reading command body %d\n",ret);
                 close(sr->sockfd);
+                sr_bufpool_put(&(sr->msgpool), buf);
                 return -1;
             }
             bytes_read += ret;
@@ -414,6 +721,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     if(expected_cmd && command!=expected_cmd) {
         if(command != VNSCLOSE) { /* VNSCLOSE is always ok */
             fprintf(stderr, "Error: expected command %d but got %d\n", expected_cmd, command);
+            sr_bufpool_put(&(sr->msgpool), buf);
             return -1;
         }
     }
@@ -425,26 +733,25 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
         case VNSPACKET:
             sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
+            sr->vns_stats.rx_msgs++;
+            sr->vns_stats.rx_frames++;
+            if ( len < (int)(sizeof(c_packet_header) +
+                             sizeof(struct sr_ethernet_hdr)) )
             { break; }
 
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
+            sr_dispatch_packet(sr,
                     (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
+                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header),
                     (char*)(buf + sizeof(c_base)));
+            sr_vec_run(sr);
+
+            break;
+
+            /* -------------     VNSPACKET_BATCH   ------------------ */
 
+        case VNSPACKET_BATCH:
+            sr->vns_stats.rx_msgs++;
+            sr_handle_packet_batch(sr, buf, len);
             break;
 
             /* -------------        VNSCLOSE      -------------------- */
@@ -454,8 +761,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
 
-            if(buf)
-            { free(buf); }
+            sr_bufpool_put(&(sr->msgpool), buf);
             return 0;
             break;
 
@@ -472,8 +778,10 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             if(sr_verify_routing_table(sr) != 0)
             {
                 fprintf(stderr,"Routing table not consistent with hardware\n");
+                sr_bufpool_put(&(sr->msgpool), buf);
                 return -1;
             }
+            gettimeofday(&(sr->vns_stats.start), 0);
             printf(" <-- Ready to process packets --> \n");
             break;
 
@@ -495,17 +803,117 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
                 ret = -1;
             break;
 
+            /* -------------- VNS_SHM_STATUS -------------- */
+        case VNS_SHM_STATUS:
+            sr_handle_shm_status(sr, (c_shm_status*)buf, len);
+            break;
+
         default:
             Debug("unknown command: %d\n", command);
             break;
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
+    sr_bufpool_put(&(sr->msgpool), buf);
     return ret;
 }/* -- sr_read_from_server -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_packet_batch(..)
+ * Scope: Local
+ *
+ * Walk the frames of a VNSPACKET_BATCH message.  An empty batch is only an
+ * announcement and needs no action.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_handle_packet_batch(struct sr_instance* sr,
+                                  uint8_t* buf /* borrowed */,
+                                  int len)
+{
+    c_packet_batch* batch = (c_packet_batch*)buf;
+    c_batch_frame* frame = 0;
+    struct sr_if* iface = 0;
+    unsigned int count = ntohs(batch->count);
+    unsigned int frame_len;
+    int off = sizeof(c_packet_batch);
+
+    while(count-- > 0)
+    {
+        if(off + (int)sizeof(c_batch_frame) > len)
+        { break; }
+        frame = (c_batch_frame*)(buf + off);
+        frame_len = ntohs(frame->len);
+        off += sizeof(c_batch_frame);
+        if(off + (int)frame_len > len)
+        {
+            fprintf(stderr, "Error: truncated frame in packet batch\n");
+            sr_vec_run(sr);
+            return -1;
+        }
+
+        iface = sr_get_interface_by_index(sr, frame->ifindex);
+        if(iface && frame_len >= sizeof(struct sr_ethernet_hdr))
+        { sr_dispatch_packet(sr, buf + off, frame_len, iface->name); }
+        sr->vns_stats.rx_frames++;
+        off += frame_len;
+    }
+
+    /* the frames live in buf, which goes back to the pool after this */
+    sr_vec_run(sr);
+    return 1;
+} /* -- sr_handle_packet_batch -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_dispatch_packet(..)
+ * Scope: Local
+ *
+ * Common receive path for a single ethernet frame, whichever transport it
+ * arrived on.  In vector mode the frame is only queued; the caller runs
+ * the vector while the frame is still valid.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_dispatch_packet(struct sr_instance* sr,
+                               uint8_t* packet /* lent */,
+                               unsigned int len,
+                               char* interface /* lent */)
+{
+    struct sr_if* if_rec = sr_get_interface(sr, interface);
+
+    if ( ! if_rec )
+    {
+        sr_stats_drop(sr_drop_unknown_if);
+        return;
+    }
+    sr_stats_rx(if_rec->index, len);
+
+    /* -- check if it is an ARP to another router if so drop   -- */
+    if ( sr_arp_req_not_for_us(sr, packet, len, interface) )
+    {
+        sr_stats_drop(sr_drop_arp_not_for_us);
+        return;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr, packet, len, interface, SR_DUMP_DIR_IN);
+
+    if(sr->vec)
+    {
+        sr_vec_add(sr, packet, len, if_rec);
+        return;
+    }
+
+    /* -- pass to router, student's code should take over here -- */
+    SR_PROBE3(handlepacket_entry, packet, len, interface);
+    SR_PERF_BEGIN(sr_perf_packet);
+    SR_LAT_BEGIN();
+    sr_handlepacket(sr, packet, len, interface);
+    SR_LAT_END();
+    SR_PERF_END(sr_perf_packet);
+    SR_PROBE1(handlepacket_return, len);
+} /* -- sr_dispatch_packet -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_ether_addrs_match_interface(..)
  * Scope: Local
@@ -555,7 +963,8 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
  * Scope: Global
  *
  * Send a packet (ethernet header included!) of length 'len' to the server
- * to be injected onto the wire.
+ * to be injected onto the wire.  With -Q it goes through the output
+ * scheduler, which calls sr_send_packet_now() when its turn comes.
  *
  *---------------------------------------------------------------------------*/
 
@@ -563,9 +972,21 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
                          const char* iface /* borrowed */)
+{
+    if ( sr->qos )
+    { return sr_qos_send(sr->qos, buf, len, iface); }
+    return sr_send_packet_now(sr, buf, len, iface);
+} /* -- sr_send_packet -- */
+
+int sr_send_packet_now(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const char* iface /* borrowed */)
 {
     c_packet_header *sr_pkt;
+    struct sr_if* if_rec = 0;
     unsigned int total_len =  len + (sizeof(c_packet_header));
+    int ret;
 
     /* REQUIRES */
     assert(sr);
@@ -575,12 +996,46 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) ){
         fprintf(stderr , "** Error: packet is wayy to short \n");
+        sr_stats_drop(sr_drop_tx_error);
+        return -1;
+    }
+    if ( len > sr->max_frame_len ){
+        fprintf(stderr , "** Error: %u byte packet does not fit a VNS message\n",
+                len);
+        sr_stats_drop(sr_drop_tx_error);
+        return -1;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr,buf,len,iface,SR_DUMP_DIR_OUT);
+
+    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
+        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
+        sr_stats_drop(sr_drop_tx_error);
         return -1;
     }
+    if_rec = sr_get_interface(sr, iface);
+    SR_TRACE2(sr_ev_tx, len, if_rec->index);
+    sr_stats_tx(if_rec->index, len);
+
+    /* -- shared memory ring; when it is full fall back to the socket -- */
+    if ( sr->shm && sr->shm->active &&
+         sr_shm_send(sr->shm, buf, len, iface) == 0 )
+    {
+        __sync_fetch_and_add(&(sr->vns_stats.tx_frames), 1);
+        return 0;
+    }
+
+    /* -- batched, goes out with the next sr_flush_packets() -- */
+    if ( sr->batching )
+    {
+        if ( (ret = sr_batch_packet(sr, buf, len, iface)) != 0 )
+        { sr_stats_drop(sr_drop_tx_error); }
+        return ret;
+    }
 
     /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
+    sr_pkt = (c_packet_header *)sr_bufpool_get(&(sr->msgpool));
     assert(sr_pkt);
     sr_pkt->mLen  = htonl(total_len);
     sr_pkt->mType = htonl(VNSPACKET);
@@ -588,25 +1043,146 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
-    /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
-
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
+    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
+        fprintf(stderr, "Error writing packet\n");
+        sr_stats_drop(sr_drop_tx_error);
+        sr_bufpool_put(&(sr->msgpool), sr_pkt);
         return -1;
     }
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
+    sr_bufpool_put(&(sr->msgpool), sr_pkt);
+    __sync_fetch_and_add(&(sr->vns_stats.tx_frames), 1);
+    __sync_fetch_and_add(&(sr->vns_stats.tx_msgs), 1);
+
+    return 0;
+} /* -- sr_send_packet_now -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_batch_packet(..)
+ * Scope: Local
+ *
+ * Append a frame to the pending VNSPACKET_BATCH, flushing first if it
+ * would not fit.  Returns -1 only if the frame was not queued; the
+ * frames a failed flush loses are counted by sr_flush_packets_locked().
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_batch_packet(struct sr_instance* sr,
+                           uint8_t* buf /* borrowed */,
+                           unsigned int len,
+                           const char* iface /* borrowed */)
+{
+    struct sr_vns_batch* batch = &(sr->txbatch);
+    struct sr_if* if_rec = sr_get_interface(sr, iface);
+    c_batch_frame* frame = 0;
+
+    if(!if_rec || sizeof(c_packet_batch) + sizeof(c_batch_frame) + len >
+       batch->size)
+    {
+        fprintf(stderr, "** Error: cannot batch %u byte frame on %s\n",
+                len, iface);
         return -1;
     }
 
-    free(sr_pkt);
+    pthread_mutex_lock(&(batch->lock));
+
+    if(batch->count == SR_BATCH_MAX_FRAMES ||
+       batch->len + sizeof(c_batch_frame) + len > batch->size)
+    { sr_flush_packets_locked(sr); }
+
+    frame = (c_batch_frame*)(batch->buf + batch->len);
+    frame->len = htons(len);
+    frame->ifindex = if_rec->index;
+    frame->pad = 0;
+    memcpy(batch->buf + batch->len + sizeof(c_batch_frame), buf, len);
+    batch->len += sizeof(c_batch_frame) + len;
+    batch->count++;
+
+    pthread_mutex_unlock(&(batch->lock));
 
     return 0;
-} /* -- sr_send_packet -- */
+} /* -- sr_batch_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flush_packets(..)
+ * Scope: Global
+ *
+ * Write out the pending batch, if any.  Called after every message read
+ * from the server and after each ARP sweep.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_flush_packets(struct sr_instance* sr)
+{
+    if(!sr->batching || !sr->txbatch.buf)
+    { return; }
+
+    pthread_mutex_lock(&(sr->txbatch.lock));
+    if(sr->txbatch.count > 0)
+    { sr_flush_packets_locked(sr); }
+    pthread_mutex_unlock(&(sr->txbatch.lock));
+} /* -- sr_flush_packets -- */
+
+static int sr_flush_packets_locked(struct sr_instance* sr)
+{
+    struct sr_vns_batch* batch = &(sr->txbatch);
+    c_packet_batch* hdr = (c_packet_batch*)batch->buf;
+    unsigned int i;
+    int ret = 0;
+
+    hdr->mLen  = htonl(batch->len);
+    hdr->mType = htonl(VNSPACKET_BATCH);
+    hdr->count = htons(batch->count);
+    hdr->pad   = 0;
+
+    if( write(sr->sockfd, batch->buf, batch->len) < (int)batch->len ){
+        fprintf(stderr, "Error writing packet batch\n");
+        for(i = 0; i < batch->count; i++)
+        { sr_stats_drop(sr_drop_tx_error); }
+        ret = -1;
+    }
+    else {
+        __sync_fetch_and_add(&(sr->vns_stats.tx_frames), batch->count);
+        __sync_fetch_and_add(&(sr->vns_stats.tx_msgs), 1);
+    }
+
+    batch->len = sizeof(c_packet_batch);
+    batch->count = 0;
+    return ret;
+} /* -- sr_flush_packets_locked -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_print_stats(..)
+ * Scope: Global
+ *
+ * Frames, messages and packets per second over the session, for comparing
+ * single-frame and batched transports.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_vns_print_stats(struct sr_instance* sr)
+{
+    struct sr_vns_stats* st = &(sr->vns_stats);
+    struct timeval now;
+    double secs;
+
+    if(st->start.tv_sec == 0)
+    { return; } /* never got going */
+
+    gettimeofday(&now, 0);
+    secs = (now.tv_sec - st->start.tv_sec) +
+           (now.tv_usec - st->start.tv_usec) / 1e6;
+    if(secs <= 0)
+    { secs = 1e-6; }
+
+    printf("VNS transport (%s):\n",
+           (sr->shm && sr->shm->active) ? "shared memory" :
+           sr->batching ? "batched" : "single frame");
+    printf("  rx %lu frames in %lu messages, %.0f pps\n",
+           st->rx_frames, st->rx_msgs, st->rx_frames / secs);
+    printf("  tx %lu frames in %lu messages, %.0f pps\n",
+           st->tx_frames, st->tx_msgs, st->tx_frames / secs);
+} /* -- sr_vns_print_stats -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
@@ -614,25 +1190,24 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
  *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   const char* iface, uint32_t dir)
 {
-    struct pcap_pkthdr h;
-    int size;
+    struct sr_if* if_rec = 0;
 
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
+    if(!sr->logger)
     {return; }
 
-    size = min(PACKET_DUMP_SIZE, len);
-
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
+    /* -- decided before any timestamp or copy -- */
+    if(sr->logfilter && !sr_filter_match(sr->logfilter, buf, len))
+    {return; }
 
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
+    /* -- copied into the capture ring, written out by the logger thread -- */
+    if_rec = sr_get_interface(sr, iface);
+    sr_logger_log(sr->logger, buf, len, if_rec ? if_rec->index : 0, dir);
 } /* -- sr_log_packet -- */
 
 /*-----------------------------------------------------------------------------
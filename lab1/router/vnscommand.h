@@ -121,6 +121,7 @@ typedef struct
 #define HWETHER       32
 #define HWETHIP       64
 #define HWMASK       128
+#define HWMTU        256  /* uint32, network byte order */
 
 typedef struct
 {
@@ -196,5 +197,57 @@ typedef struct
 
 }__attribute__ ((__packed__)) c_auth_status;
 
+/* ******* Shared-memory transport (see sr_shm.h) ******** */
+#define VNS_SHM_OPEN    1024
+#define VNS_SHM_STATUS  2048
+
+#define SHM_PATHSIZE 108
+
+/* router -> server: offer a segment for VNSPACKET traffic */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint32_t nslots;       /* slots per ring, power of two */
+    uint32_t slot_size;    /* bytes per slot, including slot header */
+    char     mPath[SHM_PATHSIZE];
+
+}__attribute__ ((__packed__)) c_shm_open;
+
+/* server -> router: whether the segment was mapped; frames switch to the
+ * rings only after a positive status */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint8_t  shm_ok;
+    char     msg[0];
+
+}__attribute__ ((__packed__)) c_shm_status;
+
+/* ******* Batched frames ******** */
+#define VNSPACKET_BATCH 4096
+
+/* A VNSPACKET_BATCH message is a c_packet_batch followed by 'count'
+ * entries, each a c_batch_frame immediately followed by its frame (no
+ * padding).  An empty batch announces that the sender accepts batches;
+ * single-frame VNSPACKET messages remain valid in both directions. */
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;
+    uint16_t count;        /* number of frames in this message */
+    uint16_t pad;
+
+}__attribute__ ((__packed__)) c_packet_batch;
+
+typedef struct
+{
+    uint16_t len;          /* length of the ethernet frame that follows */
+    uint8_t  ifindex;      /* position of the interface in VNSHWINFO */
+    uint8_t  pad;
+
+}__attribute__ ((__packed__)) c_batch_frame;
+
 
 #endif  /* __VNSCOMMAND_H */
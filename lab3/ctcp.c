@@ -16,6 +16,8 @@
 #include "ctcp_sys.h"
 #include "ctcp_utils.h"
 #include "ctcp_bbr.h"
+#include "ctcp_sdt.h"
+#include "ctcp_metrics.h"
 
 /* MACROS & constants */
 
@@ -84,7 +86,17 @@ struct ctcp_state {
   FILE *bdp_output_file; /* BDP measurement file */
   long prev_packet_sent_time; /* Time stamp of when the previous packet was sent */
   long timer_time_stamp; /* Tracks whenever ctcp_timer goes off */
-  
+
+  /* Metrics (ctcp_metrics.h) */
+  uint32_t metrics_id; /* conn label, in order of ctcp_init() */
+  long last_rtt; /* Most recent round-trip time sample */
+  uint32_t num_retransmits; /* Segments retransmitted so far */
+
+  /* ECN (RFC 3168), when connect_config->ecn */
+  bool ece_pending; /* Got CE: set ECE on ACKs until the sender sets CWR */
+  bool cwr_pending; /* Reacted to ECE: set CWR on the next new segment */
+  uint32_t sent_seqno; /* End of the data sent so far */
+  uint32_t ecn_recover; /* No new reaction to ECE until this is acked */
 };
 
 /**
@@ -93,6 +105,9 @@ struct ctcp_state {
  */
 static ctcp_state_t *state_list;
 
+/* Next metrics_id to hand out */
+static uint32_t next_metrics_id = 1;
+
 /* FIXME: Feel free to add as many helper functions as needed. Don't repeat
           code! Helper functions make the code clearer and cleaner. */
 
@@ -112,6 +127,11 @@ void ctcp_send_non_data_segment(ctcp_state_t *state, int flags);
 
 void print_bdp_results(ctcp_state_t *state, long round_trip_time);
 
+/**
+ * Publishes a snapshot of all connections to the metrics listener.
+ */
+void ctcp_metrics_publish();
+
 ctcp_state_t *ctcp_init(conn_t *conn, ctcp_config_t *cfg) {
   /* Connection could not be established. */
   if (conn == NULL) {
@@ -150,6 +170,9 @@ ctcp_state_t *ctcp_init(conn_t *conn, ctcp_config_t *cfg) {
   }
   state->bbr->curr_cwnd = cfg->send_window;
   state->bdp_output_file = fopen("bdp.txt", "w");
+  state->metrics_id = next_metrics_id++;
+  state->ece_pending = state->cwr_pending = false;
+  state->sent_seqno = state->ecn_recover = INIT_SEQ_NUM;
   
   return state;
 }
@@ -234,6 +257,8 @@ void ctcp_receive(ctcp_state_t *state, ctcp_segment_t *segment, size_t len) {
   /* Check for segment being truncated, we ignore it & wait for retransmit */
   uint16_t segment_len = ntohs(segment->len);
   //uint16_t len_of_data = segment_len - ctcp_hdr_size;
+  CTCP_PROBE5(receive, state, ntohl(segment->seqno), ntohl(segment->ackno),
+              segment_len, segment->flags);
   if(len < segment_len)
   {
     free(segment);
@@ -254,6 +279,16 @@ void ctcp_receive(ctcp_state_t *state, ctcp_segment_t *segment, size_t len) {
 
   /* Reject any segments that are not within window boundries */
 
+  /* Remember a CE mark until the sender says it has slowed down */
+  if (segment->flags & TH_CWR)
+  {
+    state->ece_pending = false;
+  }
+  if ((segment->flags & CTCP_ECN_MASK) == CTCP_CE)
+  {
+    state->ece_pending = true;
+  }
+
   /* Handle FIN type of segment */
   if ((segment->flags & TH_FIN) && (state->FIN_FLAG == false))
   {
@@ -273,6 +308,16 @@ void ctcp_receive(ctcp_state_t *state, ctcp_segment_t *segment, size_t len) {
       ctcp_destroy(state);
     }
     
+    /* Congestion marked on the way: slow down, once per window of data */
+    if(state->connect_config->ecn && (segment->flags & TH_ECE) &&
+       ntohl(segment->ackno) > state->ecn_recover)
+    {
+      bbr_ecn(state->bbr);
+      state->connect_config->send_window = state->bbr->curr_cwnd;
+      state->ecn_recover = state->sent_seqno;
+      state->cwr_pending = true;
+    }
+
     //Inspect segments & retransmit ones that have not been acknowledged. (Only rt_timeout milliseconds after last sent)
     ll_node_t *curr_unacked_seg_node = ll_front(state->unacked_segs_with_info);
     ctcp_segment_with_info_t *unacked_seg_with_info;
@@ -285,6 +330,8 @@ void ctcp_receive(ctcp_state_t *state, ctcp_segment_t *segment, size_t len) {
       {
 
         long round_trip_time = current_time() - (long)unacked_seg_with_info->prev_sent_time;
+        state->last_rtt = round_trip_time;
+        ctcp_metrics_rtt(round_trip_time);
         if(state->bbr->min_rtt == -1)
         {
           state->bbr->min_rtt = state->bbr->rtt_prop = round_trip_time;
@@ -407,6 +454,11 @@ void ctcp_timer() {
   }
 
   ctcp_state_t *curr_state = state_list;
+
+  if(ctcp_metrics_on)
+  {
+    ctcp_metrics_publish();
+  }
   
   /* Loop through all the connection states */
   for( ; curr_state != NULL; curr_state = curr_state->next)
@@ -448,6 +500,11 @@ void ctcp_timer() {
         curr_unacked_segment->prev_sent_time = current_time();
         curr_state->curr_window_size -= segment_len;
         curr_unacked_segment->curr_num_retransmit++;
+        curr_state->num_retransmits++;
+        ctcp_metrics_retransmit();
+        CTCP_PROBE4(retransmit, curr_state,
+                    ntohl(curr_unacked_segment->curr_ctcp_segment->seqno),
+                    segment_len, curr_unacked_segment->curr_num_retransmit);
         conn_send(curr_state->conn, curr_unacked_segment->curr_ctcp_segment, segment_len);
       }
 
@@ -475,6 +532,31 @@ void ctcp_timer() {
   }
 }
 
+/*
+* Publishes a snapshot of every connection for the metrics listener.
+*/
+void ctcp_metrics_publish()
+{
+  ctcp_state_t *curr_state;
+  ctcp_metrics_conn_t conn;
+
+  ctcp_metrics_begin();
+  for(curr_state = state_list; curr_state != NULL; curr_state = curr_state->next)
+  {
+    conn.id = curr_state->metrics_id;
+    conn.cwnd = curr_state->bbr->curr_cwnd;
+    conn.pacing_rate = curr_state->bbr->curr_pacing_gain * curr_state->bbr->btlbw * 1000.0; /* btlbw is in bytes/ms */
+    conn.rtt = curr_state->last_rtt;
+    conn.min_rtt = curr_state->bbr->min_rtt;
+    conn.inflight = curr_state->bbr->inflight_data;
+    conn.retransmits = curr_state->num_retransmits;
+    conn.ecn_cuts = curr_state->bbr->ecn_cuts;
+    conn.bbr_mode = curr_state->bbr->curr_bbr_mode;
+    ctcp_metrics_add(&conn);
+  }
+  ctcp_metrics_commit();
+}
+
 /*
 * Needs to slide window, in-order, make sure that window size is not overwhelmed.
 * After buffering up the window, we send it.
@@ -528,9 +610,19 @@ void ctcp_send_sliding_window(ctcp_state_t *state)
       do{
         if(current_time() >= state->bbr->next_packet_send_time)
         {
+          if(state->cwr_pending)
+          {
+            seg->flags |= TH_CWR;
+            seg->cksum = 0;
+            seg->cksum = cksum(seg, ntohs(seg->len));
+            state->cwr_pending = false;
+          }
+          state->sent_seqno = ntohl(seg->seqno) + ntohs(seg->len) - ctcp_hdr_size;
           state->bbr->probe_bw_data += ntohs(seg->len);
           curr_unack_segment->is_in_flight = true;
           state->bbr->inflight_data += ntohs(seg->len);  
+          CTCP_PROBE4(send, state, ntohl(seg->seqno), ntohs(seg->len),
+                      state->bbr->inflight_data);
           conn_send(state->conn, seg, ntohs(seg->len));
           break;
         }
@@ -565,6 +657,10 @@ void ctcp_prep_data_segment(ctcp_state_t *state, uint8_t* sending_data, uint16_t
   send_segment->len = htons(send_segment_size);
   send_segment->window= htons(state->connect_config->recv_window); //TODO: this probably should be current window size
   send_segment->flags |= TH_ACK;
+  if(state->connect_config->ecn)
+  {
+    send_segment->flags |= CTCP_ECT;
+  }
   send_segment->cksum = 0;
   send_segment->cksum = cksum(send_segment,send_segment_size);
 
@@ -594,8 +690,12 @@ void ctcp_send_non_data_segment(ctcp_state_t *state, int flags)
   send_segment.seqno = htonl(state->curr_seqno); 
   send_segment.ackno = htonl(state->curr_ackno);
   send_segment.len = htons(ctcp_hdr_size);
-  send_segment.flags |= flags;
+  send_segment.flags = flags;
   //send_segment.flags |= TH_ACK;
+  if((flags & TH_ACK) && state->ece_pending)
+  {
+    send_segment.flags |= TH_ECE;
+  }
   send_segment.window = htons(state->connect_config->recv_window); //TODO: this probably should be current window size
   send_segment.cksum = 0;
   send_segment.cksum = cksum(&send_segment, ctcp_hdr_size);
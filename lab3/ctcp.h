@@ -53,6 +53,9 @@ typedef struct {
                               will be 1 * MAX_SEG_DATA_SIZE */
   int timer;               /* How often ctcp_timer() is called, in ms */
   int rt_timeout;          /* Retransmission timeout, in ms */
+  bool ecn;                /* Both hosts agreed on ECN in the handshake
+                              (--ecn): send data CTCP_ECT, echo CE marks with
+                              TH_ECE and slow down on TH_ECE */
 } ctcp_config_t;
 
 /**
@@ -1,4 +1,5 @@
 #include "ctcp_bbr.h"
+#include "ctcp_sdt.h"
 
 #define MIN(a,b) ((a)<(b)?(a):(b))
 #define MAX(a,b) ((a)>(b)?(a):(b))
@@ -26,6 +27,7 @@ ctcp_bbr_t * bbr_init()
     bbr->rtt_prop = 200;
     bbr->inflight_data = 0; 
     bbr->app_limited_until = 0; 
+    bbr->ecn_cuts = 0;
 
     
     return bbr;
@@ -34,8 +36,14 @@ ctcp_bbr_t * bbr_init()
 /* Based on the following bbr mode, call the specific mode handler */
 void bbr_update_model(ctcp_bbr_t *bbr)
 {
+    bbr_mode old_mode = bbr->curr_bbr_mode;
+
     /* Forwards bbr input to correct function handler */
     (*ModeHandlerArr[bbr->curr_bbr_mode])(bbr);
+    if(bbr->curr_bbr_mode != old_mode)
+    {
+        CTCP_PROBE4(bbr_mode, bbr, old_mode, bbr->curr_bbr_mode, bbr->rtt_cnt);
+    }
 }
 
 void bbr_startup_state(ctcp_bbr_t *bbr)
@@ -149,4 +157,27 @@ void bbr_update_rtt(ctcp_bbr_t *bbr, long round_trip_time)
                 break;
         }
     }
-}
\ No newline at end of file
+}
+
+/* The receiver echoed a CE mark: a queue is building on the path. cwnd and
+   pacing both follow btlbw, so scale the bandwidth estimate down and stop
+   whatever was pushing for more (startup, or a probe_bw gain above 1). */
+void bbr_ecn(ctcp_bbr_t *bbr)
+{
+    bbr->btlbw = MAX(bbr->btlbw * BBR_ECN_BETA, 1);
+    bbr->max_bw = MIN(bbr->max_bw, bbr->btlbw);
+    bbr->ecn_cuts++;
+
+    if(bbr->curr_bbr_mode == BBR_STARTUP)
+    {
+        bbr->curr_bbr_mode = BBR_DRAIN;
+        bbr->drain_round = bbr->rtt_cnt;
+    }
+    else if(bbr->curr_bbr_mode == BBR_PROBE_BW && bbr->curr_pacing_gain > 1.0)
+    {
+        bbr->probe_bw_data = 0;
+        bbr->probe_bw_pacing_idx = 3;
+    }
+    bbr_update_model(bbr);
+    CTCP_PROBE4(ecn, bbr, bbr->btlbw, bbr->curr_bbr_mode, bbr->ecn_cuts);
+}
@@ -8,6 +8,7 @@
 /* BBR constants */
 #define BBR_MIN_RTT_THRESHOLD 10000 /* Time in seconds when MIN_RTT not touched */
 #define BBR_FULL_BW_COUNT 3 /* N rounds without bw growth -> pipe full */
+#define BBR_ECN_BETA 0.7 /* Bandwidth estimate kept on a congestion mark */
 
 typedef enum {
     BBR_STARTUP = 0, /* ramp up sending rate rapidly to fill pipe */
@@ -41,6 +42,7 @@ typedef struct {
 
     uint32_t inflight_data; /* Total amount data (in bytes) in flight */
     uint32_t app_limited_until; /* If application is rate limited */
+    uint32_t ecn_cuts; /* Times bbr_ecn() slowed down */
     bbr_mode curr_bbr_mode;
 } ctcp_bbr_t;
 
@@ -67,4 +69,6 @@ void bbr_probe_rtt_state(ctcp_bbr_t *bbr);
 
 float bbr_update_bw(ctcp_bbr_t *bbr, long round_trip_time, uint32_t seg_len);
 
-void bbr_update_rtt(ctcp_bbr_t *bbr, long round_trip_time);
\ No newline at end of file
+void bbr_update_rtt(ctcp_bbr_t *bbr, long round_trip_time);
+
+void bbr_ecn(ctcp_bbr_t *bbr);
\ No newline at end of file
@@ -0,0 +1,262 @@
+/******************************************************************************
+ * ctcp_metrics.c
+ * --------------
+ * Snapshots and the HTTP listener for the metrics endpoint. See
+ * ctcp_metrics.h.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "ctcp_bbr.h"
+#include "ctcp_metrics.h"
+
+#define CTCP_METRICS_REQ_MAX 2048
+
+typedef struct {
+  uint64_t retransmits;
+  uint64_t rtt_le[CTCP_METRICS_RTT_NBOUNDS]; /* not cumulative */
+  uint64_t rtt_count;
+  uint64_t rtt_sum;                          /* ms */
+  int nconns;
+  ctcp_metrics_conn_t conns[CTCP_METRICS_MAX_CONNS];
+} ctcp_metrics_snap_t;
+
+bool ctcp_metrics_on = false;
+
+static const long rtt_bounds[] = CTCP_METRICS_RTT_BOUNDS;
+static const char *bbr_mode_names[TOTAL_NUM_BBR_MODES] = {
+  "startup", "drain", "probe_bw", "probe_rtt"
+};
+
+static int listen_fd = -1;
+static pthread_t metrics_thread;
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+static ctcp_metrics_snap_t live;     /* written by the main loop only */
+static ctcp_metrics_snap_t snap;     /* published copy, under snap_lock */
+
+void ctcp_metrics_rtt(long rtt_ms) {
+  int i;
+
+  if (!ctcp_metrics_on)
+    return;
+  for (i = 0; i < CTCP_METRICS_RTT_NBOUNDS; i++) {
+    if (rtt_ms <= rtt_bounds[i]) {
+      live.rtt_le[i]++;
+      break;
+    }
+  }
+  live.rtt_count++;
+  live.rtt_sum += rtt_ms;
+}
+
+void ctcp_metrics_retransmit() {
+  if (ctcp_metrics_on)
+    live.retransmits++;
+}
+
+void ctcp_metrics_begin() {
+  live.nconns = 0;
+}
+
+void ctcp_metrics_add(const ctcp_metrics_conn_t *conn) {
+  if (live.nconns < CTCP_METRICS_MAX_CONNS)
+    live.conns[live.nconns++] = *conn;
+}
+
+void ctcp_metrics_commit() {
+  pthread_mutex_lock(&snap_lock);
+  memcpy(&snap, &live, sizeof(snap));
+  pthread_mutex_unlock(&snap_lock);
+}
+
+static void print_head(FILE *fp, const char *name, const char *type,
+                       const char *help) {
+  fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * Renders snapshot s in the Prometheus text format.
+ */
+static void render(FILE *fp, const ctcp_metrics_snap_t *s) {
+  uint64_t seen = 0;
+  int i, m;
+
+  print_head(fp, "ctcp_cwnd_bytes", "gauge", "Congestion window.");
+  for (i = 0; i < s->nconns; i++)
+    fprintf(fp, "ctcp_cwnd_bytes{conn=\"%u\"} %u\n", s->conns[i].id,
+            s->conns[i].cwnd);
+
+  print_head(fp, "ctcp_pacing_rate_bytes_per_second", "gauge",
+             "BBR pacing rate, pacing gain times bottleneck bandwidth.");
+  for (i = 0; i < s->nconns; i++)
+    fprintf(fp, "ctcp_pacing_rate_bytes_per_second{conn=\"%u\"} %.0f\n",
+            s->conns[i].id, s->conns[i].pacing_rate);
+
+  print_head(fp, "ctcp_rtt_seconds", "gauge", "Last RTT sample.");
+  for (i = 0; i < s->nconns; i++)
+    fprintf(fp, "ctcp_rtt_seconds{conn=\"%u\"} %.3f\n", s->conns[i].id,
+            s->conns[i].rtt / 1000.0);
+
+  print_head(fp, "ctcp_min_rtt_seconds", "gauge", "Smallest RTT sample.");
+  for (i = 0; i < s->nconns; i++)
+    if (s->conns[i].min_rtt >= 0)
+      fprintf(fp, "ctcp_min_rtt_seconds{conn=\"%u\"} %.3f\n", s->conns[i].id,
+              s->conns[i].min_rtt / 1000.0);
+
+  print_head(fp, "ctcp_inflight_bytes", "gauge", "Bytes sent and not acked.");
+  for (i = 0; i < s->nconns; i++)
+    fprintf(fp, "ctcp_inflight_bytes{conn=\"%u\"} %u\n", s->conns[i].id,
+            s->conns[i].inflight);
+
+  print_head(fp, "ctcp_retransmits", "gauge",
+             "Segments retransmitted on this connection.");
+  for (i = 0; i < s->nconns; i++)
+    fprintf(fp, "ctcp_retransmits{conn=\"%u\"} %u\n", s->conns[i].id,
+            s->conns[i].retransmits);
+
+  print_head(fp, "ctcp_ecn_cuts", "gauge",
+             "Times this connection slowed down for an ECN echo.");
+  for (i = 0; i < s->nconns; i++)
+    fprintf(fp, "ctcp_ecn_cuts{conn=\"%u\"} %u\n", s->conns[i].id,
+            s->conns[i].ecn_cuts);
+
+  print_head(fp, "ctcp_bbr_mode", "gauge", "Current BBR mode.");
+  for (i = 0; i < s->nconns; i++)
+    for (m = 0; m < TOTAL_NUM_BBR_MODES; m++)
+      fprintf(fp, "ctcp_bbr_mode{conn=\"%u\",mode=\"%s\"} %d\n",
+              s->conns[i].id, bbr_mode_names[m], s->conns[i].bbr_mode == m);
+
+  print_head(fp, "ctcp_retransmits_total", "counter",
+             "Segments retransmitted on all connections.");
+  fprintf(fp, "ctcp_retransmits_total %llu\n",
+          (unsigned long long) s->retransmits);
+
+  print_head(fp, "ctcp_rtt_sample_seconds", "histogram",
+             "RTT samples on all connections.");
+  for (i = 0; i < CTCP_METRICS_RTT_NBOUNDS; i++) {
+    seen += s->rtt_le[i];
+    fprintf(fp, "ctcp_rtt_sample_seconds_bucket{le=\"%g\"} %llu\n",
+            rtt_bounds[i] / 1000.0, (unsigned long long) seen);
+  }
+  fprintf(fp, "ctcp_rtt_sample_seconds_bucket{le=\"+Inf\"} %llu\n",
+          (unsigned long long) s->rtt_count);
+  fprintf(fp, "ctcp_rtt_sample_seconds_sum %.3f\n", s->rtt_sum / 1000.0);
+  fprintf(fp, "ctcp_rtt_sample_seconds_count %llu\n",
+          (unsigned long long) s->rtt_count);
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/**
+ * Answers one HTTP request on fd.
+ */
+static void serve(int fd) {
+  static ctcp_metrics_snap_t copy;
+  char req[CTCP_METRICS_REQ_MAX + 1];
+  char hdr[160];
+  char *body = NULL;
+  size_t blen = 0, used = 0;
+  const char *status = "200 OK";
+  ssize_t n;
+  FILE *fp;
+
+  /* Request line and headers, only the former matters */
+  while (used < CTCP_METRICS_REQ_MAX) {
+    if ((n = recv(fd, req + used, CTCP_METRICS_REQ_MAX - used, 0)) <= 0)
+      return;
+    used += n;
+    req[used] = 0;
+    if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+      break;
+  }
+
+  if ((fp = open_memstream(&body, &blen)) == NULL)
+    return;
+  if (strncmp(req, "GET /metrics ", 13) == 0 ||
+      strncmp(req, "GET / ", 6) == 0) {
+    pthread_mutex_lock(&snap_lock);
+    memcpy(&copy, &snap, sizeof(copy));
+    pthread_mutex_unlock(&snap_lock);
+    render(fp, &copy);
+  }
+  else {
+    status = "404 Not Found";
+    fprintf(fp, "try /metrics\n");
+  }
+  fclose(fp);
+
+  n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\n"
+               "Content-Type: text/plain; version=0.0.4\r\n"
+               "Content-Length: %lu\r\n"
+               "Connection: close\r\n\r\n", status, (unsigned long) blen);
+  if (write_all(fd, hdr, n) == 0)
+    write_all(fd, body, blen);
+  free(body);
+}
+
+static void *metrics_loop(void *arg) {
+  struct timeval tv = { 2, 0 };
+  int fd;
+
+  while (true) {
+    if ((fd = accept(listen_fd, NULL, NULL)) < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    serve(fd);
+    close(fd);
+  }
+  return NULL;
+}
+
+int ctcp_metrics_start(int port) {
+  struct sockaddr_in addr;
+  int on = 1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+      bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, 8) < 0 ||
+      pthread_create(&metrics_thread, NULL, metrics_loop, NULL) != 0) {
+    fprintf(stderr, "[ERROR] Could not start metrics listener on port %d: %s\n",
+            port, strerror(errno));
+    if (listen_fd >= 0)
+      close(listen_fd);
+    listen_fd = -1;
+    return -1;
+  }
+  pthread_detach(metrics_thread);
+  ctcp_metrics_on = true;
+  fprintf(stderr, "[INFO] Metrics on http://127.0.0.1:%d/metrics\n", port);
+  return 0;
+}
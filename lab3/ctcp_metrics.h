@@ -0,0 +1,71 @@
+/******************************************************************************
+ * ctcp_metrics.h
+ * --------------
+ * Prometheus metrics endpoint for cTCP (--metrics port). A listener thread
+ * answers HTTP GET /metrics on 127.0.0.1:port in the Prometheus text format.
+ *
+ * The listener never looks at connection state. ctcp_timer() publishes a
+ * snapshot of every connection each tick, and scrapes render the latest
+ * snapshot, so a scrape costs the main loop nothing beyond that copy.
+ *
+ *   ctcp_cwnd_bytes{conn}                  gauge
+ *   ctcp_pacing_rate_bytes_per_second{conn} gauge, pacing gain * btlbw
+ *   ctcp_rtt_seconds{conn}                 gauge, last sample
+ *   ctcp_min_rtt_seconds{conn}             gauge
+ *   ctcp_inflight_bytes{conn}              gauge
+ *   ctcp_retransmits{conn}                 gauge, this connection so far
+ *   ctcp_ecn_cuts{conn}                    gauge, slowdowns for ECN echoes
+ *   ctcp_bbr_mode{conn,mode}               1 for the current mode, else 0
+ *   ctcp_retransmits_total                 counter, all connections
+ *   ctcp_rtt_sample_seconds                histogram, all connections
+ *
+ *****************************************************************************/
+
+#ifndef CTCP_METRICS_H
+#define CTCP_METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CTCP_METRICS_MAX_CONNS 64
+
+/* RTT histogram bucket bounds, in ms */
+#define CTCP_METRICS_RTT_BOUNDS { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000 }
+#define CTCP_METRICS_RTT_NBOUNDS 11
+
+/** One connection as of the last ctcp_timer() tick. */
+typedef struct {
+  uint32_t id;             /* order of ctcp_init(), the conn label */
+  uint32_t cwnd;           /* bytes */
+  double pacing_rate;      /* bytes per second */
+  long rtt;                /* ms */
+  long min_rtt;            /* ms, -1 before the first sample */
+  uint32_t inflight;       /* bytes */
+  uint32_t retransmits;
+  uint32_t ecn_cuts;
+  int bbr_mode;
+} ctcp_metrics_conn_t;
+
+/** Set by ctcp_metrics_start(), nothing is recorded while false. */
+extern bool ctcp_metrics_on;
+
+/**
+ * Starts the listener on 127.0.0.1:port. Returns 0 on success, -1 on error.
+ */
+int ctcp_metrics_start(int port);
+
+/**
+ * Counts one RTT sample and one retransmission. Main loop only.
+ */
+void ctcp_metrics_rtt(long rtt_ms);
+void ctcp_metrics_retransmit();
+
+/**
+ * Publishes a snapshot: ctcp_metrics_begin(), ctcp_metrics_add() for each
+ * connection, then ctcp_metrics_commit(). Main loop only.
+ */
+void ctcp_metrics_begin();
+void ctcp_metrics_add(const ctcp_metrics_conn_t *conn);
+void ctcp_metrics_commit();
+
+#endif /* CTCP_METRICS_H */
@@ -0,0 +1,37 @@
+/******************************************************************************
+ * ctcp_sdt.h
+ * ----------
+ * USDT (static tracepoint) probes for cTCP, provider "ctcp". With
+ * <sys/sdt.h> (systemtap-sdt-dev) each probe is a single nop plus an ELF note
+ * that bpftrace and perf can attach to in a running ctcp; without it, or with
+ * USDT=0, the probes compile to nothing. Example scripts are in probes/.
+ *
+ *   receive(state, seqno, ackno, len, flags)
+ *   send(state, seqno, len, inflight)          first transmission
+ *   retransmit(state, seqno, len, attempt)     from ctcp_timer()
+ *   bbr_mode(bbr, old_mode, new_mode, rtt_cnt)
+ *   ecn(bbr, btlbw, mode, cuts)                after bbr_ecn()
+ *
+ * seqno/ackno are in host byte order, modes are bbr_mode values.
+ *
+ *****************************************************************************/
+
+#ifndef CTCP_SDT_H
+#define CTCP_SDT_H
+
+#if defined(CTCP_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CTCP_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef CTCP_HAVE_SDT
+#define CTCP_PROBE4(name, a, b, c, d)    DTRACE_PROBE4(ctcp, name, a, b, c, d)
+#define CTCP_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(ctcp, name, a, b, c, d, e)
+#else
+#define CTCP_PROBE4(name, a, b, c, d)    do {} while (0)
+#define CTCP_PROBE5(name, a, b, c, d, e) do {} while (0)
+#endif /* CTCP_HAVE_SDT */
+
+#endif /* CTCP_SDT_H */
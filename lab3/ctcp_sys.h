@@ -46,7 +46,7 @@ typedef struct ctcp_segment {
   uint32_t seqno;        /* Sequence number (in bytes) */
   uint32_t ackno;        /* Acknowledgment number (in bytes) */
   uint16_t len;          /* Total segment length in bytes (including headers) */
-  uint32_t flags;        /* TCP flags */
+  uint32_t flags;        /* TCP flags, and the ECN field (CTCP_ECN_MASK) */
   uint16_t window;       /* Window size, in bytes */
   uint16_t cksum;        /* Checksum */
   char data[];           /* Pointer to start of data. Takes up no space in the
@@ -54,6 +54,24 @@ typedef struct ctcp_segment {
                             does not include this field */
 } ctcp_segment_t;
 
+/* ECN-Echo and Congestion Window Reduced TCP flags (RFC 3168) */
+#ifndef TH_ECE
+#define TH_ECE 0x40
+#endif
+#ifndef TH_CWR
+#define TH_CWR 0x80
+#endif
+
+/**
+ * ECN field of the IP header the segment travels in, kept in flags above the
+ * TCP flags. Set CTCP_ECT on a segment to send it ECN-capable; a segment a
+ * router marked on the way arrives with CTCP_CE.
+ */
+#define CTCP_ECN_SHIFT 8
+#define CTCP_ECN_MASK  (IPTOS_ECN_MASK << CTCP_ECN_SHIFT)
+#define CTCP_ECT       (IPTOS_ECN_ECT0 << CTCP_ECN_SHIFT)
+#define CTCP_CE        (IPTOS_ECN_CE << CTCP_ECN_SHIFT)
+
 
 /**
  * Call on this to read input locally to be put into segments that will be sent
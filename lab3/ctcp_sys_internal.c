@@ -19,6 +19,7 @@
 
 #include "ctcp_sys_internal.h"
 #include "ctcp_sys.h"
+#include "ctcp_metrics.h"
 
 #define ASSERT_CLIENT_ONLY (assert(!SERVER))
 #define ASSERT_SERVER_ONLY (assert(SERVER))
@@ -346,7 +347,8 @@ ctcp_segment_t *convert_to_ctcp(conn_t *src, char *datagram, int actual_len) {
   segment->seqno = htonl(ntohl(tcp_hdr->th_seq) - src->their_init_seqno);
   segment->ackno = htonl(ntohl(tcp_hdr->th_ack) - src->init_seqno);
   segment->len = htons(len);
-  segment->flags = tcp_hdr->th_flags;
+  segment->flags = tcp_hdr->th_flags |
+                   (ip_hdr->tos & IPTOS_ECN_MASK) << CTCP_ECN_SHIFT;
   segment->window = tcp_hdr->th_win;
   segment->cksum = 0;
   if (data_len > 0)
@@ -380,6 +382,13 @@ char *convert_to_datagram(conn_t *dst, ctcp_segment_t *segment, int len) {
   iphdr_t *ip_hdr = (iphdr_t *) datagram;
   tcphdr_t *tcp_hdr = (tcphdr_t *) (datagram + IP_HDR_SIZE);
 
+  /* ECN field from the segment. */
+  if (segment->flags & CTCP_ECN_MASK) {
+    ip_hdr->tos = (segment->flags & CTCP_ECN_MASK) >> CTCP_ECN_SHIFT;
+    ip_hdr->check = 0;
+    ip_hdr->check = cksum(datagram, IP_HDR_SIZE);
+  }
+
   /* Copy data over, if there is any. */
   uint16_t data_len = len - sizeof(ctcp_segment_t);
   if (data_len > 0 && segment->data != NULL) {
@@ -997,8 +1006,10 @@ int conn_output(conn_t *conn, const char *buf, size_t len) { ASSERT_CONN;
 conn_t *tcp_handshake(void) { ASSERT_CLIENT_ONLY;
   char buf[MAX_PACKET_SIZE];
 
-  /* Send a SYN segment to the server. */
-  if (send_syn(config->sconn))
+  /* Send a SYN segment to the server, ECN-setup if asked for (RFC 3168). */
+  if (ctcp_cfg->ecn ? send_tcp_conn_seg(config->sconn,
+                                        TH_SYN | TH_ECE | TH_CWR)
+                    : send_syn(config->sconn))
     exit(EXIT_FAILURE);
 
   /* Wait to receive SYN-ACK. */
@@ -1025,8 +1036,11 @@ conn_t *tcp_handshake(void) { ASSERT_CLIENT_ONLY;
     config->sconn->ackno = ntohl(synack->th_seq);
   }
 
-  /* Otherwise, set new acknowledgement number and send ACK response */
+  /* Otherwise, set new acknowledgement number and send ACK response. The
+     server agreed to ECN if its SYN-ACK has ECE but not CWR. */
   else {
+    ctcp_cfg->ecn = ctcp_cfg->ecn &&
+      (synack->th_flags & (TH_ECE | TH_CWR)) == TH_ECE;
     config->sconn->next_seqno++;
     config->sconn->their_init_seqno = ntohl(synack->th_seq);
     config->sconn->ackno = ntohl(synack->th_seq) + 1;
@@ -1066,13 +1080,19 @@ conn_t *tcp_new_connection(char *pkt) {
   conn->ackno = conn->their_init_seqno + 1;
   conn_add(conn);
 
-  /* Send a SYN-ACK to the client. */
-  send_synack(conn);
+  /* Send a SYN-ACK to the client, agreeing to ECN if both want it. */
+  bool ecn = ctcp_cfg->ecn &&
+    (syn->th_flags & (TH_ECE | TH_CWR)) == (TH_ECE | TH_CWR);
+  if (ecn)
+    send_tcp_conn_seg(conn, TH_SYN | TH_ACK | TH_ECE);
+  else
+    send_synack(conn);
 
   /* Get window size of the client. */
   ctcp_cfg->send_window = ntohs(syn->window);
   ctcp_config_t *config_copy = calloc(sizeof(ctcp_config_t), 1);
   memcpy(config_copy, ctcp_cfg, sizeof(ctcp_config_t));
+  config_copy->ecn = ecn;
 
   /* Student code. */
   ctcp_state_t *state = ctcp_init(conn, config_copy);
@@ -1359,6 +1379,8 @@ static void usage(char *progname) {
     "   [--corrupt corrupt_percent]\n"
     "   [--delay delay_percent]\n"
     "   [--duplicate duplicate_percent]\n"
+    "   [--metrics port]\n"
+    "   [--ecn]\n"
     "   [-- program arg1 arg2 ...]\n\n",
     progname
   );
@@ -1380,6 +1402,8 @@ int main(int argc , char *argv[]) {
   char *port_str = NULL;
   int port = -1;
   int window = 1;
+  int metrics_port = 0;
+  bool ecn = false;
   seed = time(NULL);
   test_debug_on = false;
   lab5_mode = false;
@@ -1399,12 +1423,14 @@ int main(int argc , char *argv[]) {
     { "duplicate", required_argument, NULL, 'q' },
     { "logging", no_argument, NULL, 'l' },
     { "lab5", no_argument, NULL, 'f' },
+    { "metrics", required_argument, NULL, 'M' },
+    { "ecn", no_argument, NULL, 'E' },
     { NULL, 0, NULL, 0 }
   };
 
   /* Parse command-line arguments. */
   int opt;
-  while ((opt = getopt_long(argc, argv, "dsmc:p:w:r:t:y:q:lzf", o, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "dsmc:p:w:r:t:y:q:lzfM:E", o, NULL)) != -1) {
     switch (opt) {
     /* Debug statements on. */
     case 'd':
@@ -1464,6 +1490,14 @@ int main(int argc , char *argv[]) {
     case 'f':
       lab5_mode = true;
       break;
+    /* Prometheus metrics listener. */
+    case 'M':
+      metrics_port = atoi(optarg);
+      break;
+    /* Explicit Congestion Notification. */
+    case 'E':
+      ecn = true;
+      break;
     default:
       usage(progname);
       break;
@@ -1502,12 +1536,17 @@ int main(int argc , char *argv[]) {
   cfg.send_window = window * MAX_SEG_DATA_SIZE;
   cfg.timer = TIMER_INTERVAL;
   cfg.rt_timeout = RT_INTERVAL;
+  cfg.ecn = ecn;
 
   /* Used for polling later. */
   struct pollfd _events[NUM_POLL + MAX_NUM_CLIENTS];
   memset(_events, 0, sizeof(struct pollfd) * (NUM_POLL + MAX_NUM_CLIENTS));
   events = _events;
 
+  /* Metrics listener, rendered from snapshots taken in ctcp_timer(). */
+  if (metrics_port > 0 && ctcp_metrics_start(metrics_port) < 0)
+    return 1;
+
   /* Start client/server. */
   if (is_client) {
     if (start_client(server, port_str) < 0) {
@@ -0,0 +1,97 @@
+#!/bin/bash
+
+########################################################
+# Name: ecn_mininet.sh
+# Function:
+#   Sends a file over cTCP through the lab 1 router, with ECN agreed in the
+#   handshake and the router marking CE once 20 frames queue up for server1
+#   behind a 10 Mbit/s shaper:
+#
+#     client 10.0.1.100 -- eth3 [sr] eth1 (10 Mbit/s) -- server1 192.168.2.2
+#
+#   Then shows what the router marked and how often the client slowed down
+#   for an echoed mark. With "noecn" the same transfer runs without ECN, so
+#   the queue overflows instead and segments are retransmitted.
+# How to use:
+#   1. Make sure you have tmux and POX (lab1/run_pox.sh), and have built
+#      lab1/router/sr and lab3/ctcp
+#   2. In terminal, go to lab3 folder and copy "file.txt" here
+#   3. In the same folder, run the script with
+#      "sudo ./ecn_mininet.sh [551_HOME_PATH] [noecn]",
+#      [551_HOME_PATH] is your 551 repo folder's path.
+########################################################
+
+
+HOME_FOLDER=${1%/}
+echo "551 home folder: $HOME_FOLDER"
+
+ECN="--ecn"
+if [ "$2" == "noecn" ]
+then
+    ECN=""
+fi
+
+LAB1="$HOME_FOLDER/lab1"
+LAB3="$HOME_FOLDER/lab3"
+
+SERVER_IP="192.168.2.2"
+SERVER_PORT=9096
+CLIENT_PORT=9098
+METRICS_PORT=9100
+
+SRC_FILE="$LAB3/file.txt"
+RAND_SUFFIX=$RANDOM
+DST_FILE="$LAB3/ecn_dst_$RAND_SUFFIX.txt"
+SR_OUT="$LAB3/ecn_sr_$RAND_SUFFIX.txt"
+METRICS_OUT="$LAB3/ecn_metrics_$RAND_SUFFIX.txt"
+
+echo "Starting mininet and POX"
+tmux new -s mnet -d
+tmux send -t mnet "cd $LAB1 && sudo python lab1.py" ENTER
+tmux new -s pox -d
+tmux send -t pox "cd $LAB1 && ./run_pox.sh" ENTER
+sleep 20
+
+echo "Starting the router"
+tmux new -s sr -d
+tmux send -t sr "cd $LAB1 && ./router/sr -Q 'shape 10' -Q 'ecn 20' > $SR_OUT" ENTER
+sleep 5
+
+echo "Starting server1 and client ${ECN:-without ECN}"
+tmux send -t mnet "server1 $LAB3/ctcp -m -s -p $SERVER_PORT $ECN > $DST_FILE &" ENTER
+sleep 2
+tmux send -t mnet "client $LAB3/ctcp -m -c $SERVER_IP:$SERVER_PORT -p $CLIENT_PORT $ECN --metrics $METRICS_PORT < $SRC_FILE &" ENTER
+
+START_TIME=$(($(date +%s)))
+sleep 10
+tmux send -t mnet "client curl -s http://127.0.0.1:$METRICS_PORT/metrics > $METRICS_OUT" ENTER
+sleep 20
+
+echo "Ending all nodes"
+tmux send -t sr C-c
+sleep 3
+tmux kill-session -t sr
+tmux send -t mnet "exit" ENTER
+sleep 2
+tmux kill-session -t mnet
+tmux kill-session -t pox
+
+# Verify the file made it
+if ! cmp -s $SRC_FILE $DST_FILE
+then
+    echo "FAILED: Files are different!"
+    exit 1;
+fi
+
+SEND_TIME=$(($(stat -c %Y $DST_FILE)-START_TIME))
+FILE_SIZE=$(($(stat --printf="%s" $SRC_FILE)))
+echo "Throughput: $(($FILE_SIZE * 8 / ($SEND_TIME > 0 ? $SEND_TIME : 1))) bps"
+
+echo
+echo "Router queues (marked = CE marks, dropped = queue full):"
+sed -n '/^qos /,$p' $SR_OUT | grep -E "^qos |^eth1 "
+grep "^ecn" $SR_OUT
+
+echo
+echo "Client, 10 s into the transfer:"
+grep -E "^ctcp_(ecn_cuts|retransmits|cwnd_bytes)\{" $METRICS_OUT